@@ -0,0 +1,570 @@
+#include "ArrowStreamWriter.h"
+#include <boost/variant/static_visitor.hpp>
+#include <macgyver/Exception.h>
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <functional>
+
+namespace bw = SmartMet::Plugin::WFS;
+namespace ts = SmartMet::Spine::TimeSeries;
+
+namespace
+{
+/*
+ *  Minimal flatbuffer encoder for Arrow IPC metadata. Unlike the reference
+ *  implementation the buffer is built from front to back: child objects are
+ *  always written after the object referring to them so that all unsigned
+ *  offsets point forward as the format requires. Little endian host assumed.
+ */
+class FlatBuffer
+{
+ public:
+  typedef std::function<std::size_t(FlatBuffer&)> Writer;
+
+  struct Field
+  {
+    std::uint16_t slot;
+    std::size_t size;  // 0 for offset to a child object
+    std::uint64_t scalar;
+    Writer child;
+  };
+
+  template <typename T>
+  static Field scalar(std::uint16_t slot, T value)
+  {
+    std::uint64_t tmp = 0;
+    std::memcpy(&tmp, &value, sizeof(T));
+    return Field{slot, sizeof(T), tmp, Writer()};
+  }
+
+  static Field offset(std::uint16_t slot, Writer child) { return Field{slot, 0, 0, child}; }
+
+  static Writer table(std::vector<Field> fields)
+  {
+    return [fields](FlatBuffer& fb) { return fb.write_table(fields); };
+  }
+
+  static Writer string(const std::string& value)
+  {
+    return [value](FlatBuffer& fb) { return fb.write_string(value); };
+  }
+
+  static Writer table_vector(std::vector<Writer> items)
+  {
+    return [items](FlatBuffer& fb) { return fb.write_table_vector(items); };
+  }
+
+  static Writer struct_vector(const std::string& data, std::size_t count)
+  {
+    return [data, count](FlatBuffer& fb) { return fb.write_struct_vector(data, count); };
+  }
+
+  static std::string finish(Writer root)
+  {
+    FlatBuffer fb;
+    fb.put<std::uint32_t>(0);
+    fb.patch_offset(0, root(fb));
+    return fb.buf;
+  }
+
+ private:
+  template <typename T>
+  void put(T value)
+  {
+    buf.append(reinterpret_cast<const char*>(&value), sizeof(T));
+  }
+
+  void pad(std::size_t alignment, std::size_t extra = 0)
+  {
+    while ((buf.size() + extra) % alignment != 0)
+      buf.push_back(0);
+  }
+
+  void patch_offset(std::size_t pos, std::size_t target)
+  {
+    const std::uint32_t value = target - pos;
+    std::memcpy(&buf[pos], &value, sizeof(value));
+  }
+
+  std::size_t write_table(const std::vector<Field>& fields)
+  {
+    std::size_t num_slots = 0;
+    std::size_t max_align = 4;
+    std::vector<std::size_t> order(fields.size());
+    for (std::size_t i = 0; i < fields.size(); i++)
+    {
+      order[i] = i;
+      num_slots = std::max<std::size_t>(num_slots, fields[i].slot + 1);
+      max_align = std::max(max_align, fields[i].size);
+    }
+
+    // Place larger fields first to minimize padding
+    const auto field_size = [&fields](std::size_t i) {
+      return fields[i].size ? fields[i].size : sizeof(std::uint32_t);
+    };
+    std::stable_sort(order.begin(), order.end(), [&field_size](std::size_t a, std::size_t b) {
+      return field_size(a) > field_size(b);
+    });
+
+    std::vector<std::size_t> field_pos(fields.size());
+    std::size_t table_size = sizeof(std::int32_t);
+    for (std::size_t i : order)
+    {
+      const std::size_t size = field_size(i);
+      table_size = (table_size + size - 1) / size * size;
+      field_pos[i] = table_size;
+      table_size += size;
+    }
+
+    pad(2);
+    const std::size_t vtable = buf.size();
+    put<std::uint16_t>(4 + 2 * num_slots);
+    put<std::uint16_t>(table_size);
+    std::vector<std::uint16_t> slots(num_slots, 0);
+    for (std::size_t i = 0; i < fields.size(); i++)
+      slots[fields[i].slot] = field_pos[i];
+    for (auto item : slots)
+      put<std::uint16_t>(item);
+
+    pad(max_align);
+    const std::size_t table = buf.size();
+    buf.append(table_size, '\0');
+    const std::int32_t soffset = table - vtable;
+    std::memcpy(&buf[table], &soffset, sizeof(soffset));
+    for (std::size_t i = 0; i < fields.size(); i++)
+      if (fields[i].size)
+        std::memcpy(&buf[table + field_pos[i]], &fields[i].scalar, fields[i].size);
+
+    for (std::size_t i = 0; i < fields.size(); i++)
+      if (not fields[i].size)
+        patch_offset(table + field_pos[i], fields[i].child(*this));
+
+    return table;
+  }
+
+  std::size_t write_string(const std::string& value)
+  {
+    pad(4);
+    const std::size_t pos = buf.size();
+    put<std::uint32_t>(value.size());
+    buf.append(value);
+    buf.push_back(0);
+    return pos;
+  }
+
+  std::size_t write_table_vector(const std::vector<Writer>& items)
+  {
+    pad(4);
+    const std::size_t pos = buf.size();
+    put<std::uint32_t>(items.size());
+    buf.append(4 * items.size(), '\0');
+    for (std::size_t i = 0; i < items.size(); i++)
+    {
+      const std::size_t item_pos = pos + 4 * (i + 1);
+      patch_offset(item_pos, items[i](*this));
+    }
+    return pos;
+  }
+
+  std::size_t write_struct_vector(const std::string& data, std::size_t count)
+  {
+    // Structs used here consist of 64 bit integers: elements must be 8 byte aligned
+    pad(8, 4);
+    const std::size_t pos = buf.size();
+    put<std::uint32_t>(count);
+    buf.append(data);
+    return pos;
+  }
+
+  std::string buf;
+};
+
+// Values from Arrow format specification (Schema.fbs and Message.fbs)
+const std::int16_t METADATA_VERSION_V5 = 4;
+const std::uint8_t HEADER_SCHEMA = 1;
+const std::uint8_t HEADER_RECORD_BATCH = 3;
+const std::uint8_t TYPE_INT = 2;
+const std::uint8_t TYPE_FLOATING_POINT = 3;
+const std::uint8_t TYPE_UTF8 = 5;
+const std::uint8_t TYPE_TIMESTAMP = 10;
+const std::int16_t PRECISION_DOUBLE = 2;
+const std::int16_t TIME_UNIT_SECOND = 0;
+
+const std::size_t ALIGNMENT = 8;
+
+std::size_t padded_size(std::size_t size)
+{
+  return (size + ALIGNMENT - 1) / ALIGNMENT * ALIGNMENT;
+}
+
+template <typename T>
+void append_raw(std::string& dest, T value)
+{
+  dest.append(reinterpret_cast<const char*>(&value), sizeof(T));
+}
+
+FlatBuffer::Writer create_message(std::uint8_t header_type,
+                                  FlatBuffer::Writer header,
+                                  std::int64_t body_length)
+{
+  return FlatBuffer::table({FlatBuffer::scalar<std::int16_t>(0, METADATA_VERSION_V5),
+                            FlatBuffer::scalar<std::uint8_t>(1, header_type),
+                            FlatBuffer::offset(2, header),
+                            FlatBuffer::scalar<std::int64_t>(3, body_length)});
+}
+
+void write_message(std::ostream& output, const std::string& metadata, const std::string& body)
+{
+  // Encapsulated message: continuation marker, metadata size (including padding),
+  // flatbuffer metadata, padding to 8 bytes and finally the message body
+  const std::string padding(padded_size(metadata.size() + 8) - metadata.size() - 8, '\0');
+  const std::uint32_t continuation = 0xFFFFFFFF;
+  const std::int32_t size = metadata.size() + padding.size();
+  output.write(reinterpret_cast<const char*>(&continuation), sizeof(continuation));
+  output.write(reinterpret_cast<const char*>(&size), sizeof(size));
+  output << metadata << padding << body;
+}
+
+struct ValueVisitor : public boost::static_visitor<>
+{
+  ValueVisitor(bw::ArrowStreamWriter& writer, std::size_t column, bw::ArrowStreamWriter::ColumnType type)
+      : writer(writer), column(column), type(type)
+  {
+  }
+
+  void operator()(const ts::None&) const { writer.append_null(column); }
+
+  void operator()(const std::string& value) const
+  {
+    if (type == bw::ArrowStreamWriter::STRING)
+      writer.append(column, value);
+    else
+      writer.append_null(column);
+  }
+
+  void operator()(double value) const
+  {
+    if (type == bw::ArrowStreamWriter::DOUBLE)
+      writer.append(column, value);
+    else if (type == bw::ArrowStreamWriter::INT64 and std::isfinite(value))
+      writer.append(column, static_cast<std::int64_t>(value));
+    else
+      writer.append_null(column);
+  }
+
+  void operator()(int value) const
+  {
+    if (type == bw::ArrowStreamWriter::DOUBLE)
+      writer.append(column, static_cast<double>(value));
+    else if (type == bw::ArrowStreamWriter::INT64)
+      writer.append(column, static_cast<std::int64_t>(value));
+    else
+      writer.append_null(column);
+  }
+
+  void operator()(const ts::LonLat&) const { writer.append_null(column); }
+
+  void operator()(const boost::local_time::local_date_time& value) const
+  {
+    if (type == bw::ArrowStreamWriter::TIMESTAMP)
+      writer.append(column, value.utc_time());
+    else
+      writer.append_null(column);
+  }
+
+  bw::ArrowStreamWriter& writer;
+  std::size_t column;
+  bw::ArrowStreamWriter::ColumnType type;
+};
+
+}  // anonymous namespace
+
+const char* bw::ArrowStreamWriter::CONTENT_TYPE = "application/vnd.apache.arrow.stream";
+
+bw::ArrowStreamWriter::ArrowStreamWriter() {}
+
+bw::ArrowStreamWriter::~ArrowStreamWriter() {}
+
+std::size_t bw::ArrowStreamWriter::add_column(const std::string& name, ColumnType type)
+{
+  try
+  {
+    if (num_rows() > 0)
+      throw Fmi::Exception(BCP, "Cannot add column '" + name + "' after appending values");
+
+    Column column;
+    column.name = name;
+    column.type = type;
+    column.length = 0;
+    column.null_count = 0;
+    if (type == STRING)
+      column.offsets.push_back(0);
+    columns.push_back(column);
+    return columns.size() - 1;
+  }
+  catch (...)
+  {
+    throw Fmi::Exception::Trace(BCP, "Operation failed!");
+  }
+}
+
+bw::ArrowStreamWriter::Column& bw::ArrowStreamWriter::get_column(std::size_t column,
+                                                                 ColumnType type)
+{
+  Column& result = columns.at(column);
+  if (result.type != type)
+    throw Fmi::Exception(BCP, "Value type does not match Arrow column '" + result.name + "' type");
+  return result;
+}
+
+void bw::ArrowStreamWriter::append_valid(Column& column, bool valid)
+{
+  if (column.length % 8 == 0)
+    column.validity.push_back(0);
+  if (valid)
+    column.validity.back() |= static_cast<std::uint8_t>(1U << (column.length % 8));
+  else
+    column.null_count++;
+  column.length++;
+}
+
+void bw::ArrowStreamWriter::append_null(std::size_t column)
+{
+  try
+  {
+    Column& dest = columns.at(column);
+    append_valid(dest, false);
+    switch (dest.type)
+    {
+      case STRING:
+        dest.offsets.push_back(dest.data.size());
+        break;
+      case DOUBLE:
+        append_raw<double>(dest.data, 0.0);
+        break;
+      case INT64:
+      case TIMESTAMP:
+        append_raw<std::int64_t>(dest.data, 0);
+        break;
+    }
+  }
+  catch (...)
+  {
+    throw Fmi::Exception::Trace(BCP, "Operation failed!");
+  }
+}
+
+void bw::ArrowStreamWriter::append(std::size_t column, double value)
+{
+  try
+  {
+    if (std::isnan(value))
+    {
+      append_null(column);
+      return;
+    }
+
+    Column& dest = get_column(column, DOUBLE);
+    append_valid(dest, true);
+    append_raw<double>(dest.data, value);
+  }
+  catch (...)
+  {
+    throw Fmi::Exception::Trace(BCP, "Operation failed!");
+  }
+}
+
+void bw::ArrowStreamWriter::append(std::size_t column, std::int64_t value)
+{
+  try
+  {
+    Column& dest = get_column(column, INT64);
+    append_valid(dest, true);
+    append_raw<std::int64_t>(dest.data, value);
+  }
+  catch (...)
+  {
+    throw Fmi::Exception::Trace(BCP, "Operation failed!");
+  }
+}
+
+void bw::ArrowStreamWriter::append(std::size_t column, const std::string& value)
+{
+  try
+  {
+    Column& dest = get_column(column, STRING);
+    append_valid(dest, true);
+    dest.data.append(value);
+    dest.offsets.push_back(dest.data.size());
+  }
+  catch (...)
+  {
+    throw Fmi::Exception::Trace(BCP, "Operation failed!");
+  }
+}
+
+void bw::ArrowStreamWriter::append(std::size_t column, const boost::posix_time::ptime& value)
+{
+  try
+  {
+    if (value.is_special())
+    {
+      append_null(column);
+      return;
+    }
+
+    static const boost::posix_time::ptime epoch(boost::gregorian::date(1970, 1, 1));
+    Column& dest = get_column(column, TIMESTAMP);
+    append_valid(dest, true);
+    // Avoid total_seconds() as it returns long
+    const std::int64_t days = value.date().julian_day() - epoch.date().julian_day();
+    append_raw<std::int64_t>(dest.data, 86400LL * days + value.time_of_day().total_seconds());
+  }
+  catch (...)
+  {
+    throw Fmi::Exception::Trace(BCP, "Operation failed!");
+  }
+}
+
+void bw::ArrowStreamWriter::append(std::size_t column, const ts::Value& value)
+{
+  try
+  {
+    ValueVisitor visitor(*this, column, columns.at(column).type);
+    boost::apply_visitor(visitor, value);
+  }
+  catch (...)
+  {
+    throw Fmi::Exception::Trace(BCP, "Operation failed!");
+  }
+}
+
+std::size_t bw::ArrowStreamWriter::num_rows() const
+{
+  try
+  {
+    if (columns.empty())
+      return 0;
+
+    const std::size_t result = columns.front().length;
+    for (const auto& column : columns)
+    {
+      if (column.length != result)
+        throw Fmi::Exception(BCP, "Arrow column lengths differ")
+            .addParameter("Column", column.name)
+            .addParameter("Length", std::to_string(column.length))
+            .addParameter("Expected", std::to_string(result));
+    }
+    return result;
+  }
+  catch (...)
+  {
+    throw Fmi::Exception::Trace(BCP, "Operation failed!");
+  }
+}
+
+std::string bw::ArrowStreamWriter::create_schema_message() const
+{
+  std::vector<FlatBuffer::Writer> fields;
+  for (const auto& column : columns)
+  {
+    std::uint8_t type_type = 0;
+    FlatBuffer::Writer type;
+    switch (column.type)
+    {
+      case STRING:
+        type_type = TYPE_UTF8;
+        type = FlatBuffer::table({});
+        break;
+      case DOUBLE:
+        type_type = TYPE_FLOATING_POINT;
+        type = FlatBuffer::table({FlatBuffer::scalar<std::int16_t>(0, PRECISION_DOUBLE)});
+        break;
+      case INT64:
+        type_type = TYPE_INT;
+        type = FlatBuffer::table(
+            {FlatBuffer::scalar<std::int32_t>(0, 64), FlatBuffer::scalar<std::uint8_t>(1, 1)});
+        break;
+      case TIMESTAMP:
+        type_type = TYPE_TIMESTAMP;
+        type = FlatBuffer::table({FlatBuffer::scalar<std::int16_t>(0, TIME_UNIT_SECOND),
+                                  FlatBuffer::offset(1, FlatBuffer::string("UTC"))});
+        break;
+    }
+
+    fields.push_back(FlatBuffer::table({FlatBuffer::offset(0, FlatBuffer::string(column.name)),
+                                        FlatBuffer::scalar<std::uint8_t>(1, 1),
+                                        FlatBuffer::scalar<std::uint8_t>(2, type_type),
+                                        FlatBuffer::offset(3, type),
+                                        FlatBuffer::offset(5, FlatBuffer::table_vector({}))}));
+  }
+
+  auto schema = FlatBuffer::table({FlatBuffer::scalar<std::int16_t>(0, 0),
+                                   FlatBuffer::offset(1, FlatBuffer::table_vector(fields))});
+  return FlatBuffer::finish(create_message(HEADER_SCHEMA, schema, 0));
+}
+
+std::string bw::ArrowStreamWriter::create_record_batch_message(std::string& body) const
+{
+  std::string nodes;
+  std::string buffers;
+
+  const auto add_buffer = [&body, &buffers](const char* data, std::size_t size) {
+    append_raw<std::int64_t>(buffers, body.size());
+    append_raw<std::int64_t>(buffers, size);
+    body.append(data, size);
+    body.append(padded_size(size) - size, '\0');
+  };
+
+  for (const auto& column : columns)
+  {
+    append_raw<std::int64_t>(nodes, column.length);
+    append_raw<std::int64_t>(nodes, column.null_count);
+
+    // Validity bitmap may be omitted when there are no nulls
+    if (column.null_count > 0)
+      add_buffer(reinterpret_cast<const char*>(column.validity.data()), column.validity.size());
+    else
+      add_buffer(nullptr, 0);
+
+    if (column.type == STRING)
+      add_buffer(reinterpret_cast<const char*>(column.offsets.data()),
+                 column.offsets.size() * sizeof(std::int32_t));
+
+    add_buffer(column.data.data(), column.data.size());
+  }
+
+  const std::size_t num_buffers = buffers.size() / 16;
+  auto batch = FlatBuffer::table(
+      {FlatBuffer::scalar<std::int64_t>(0, num_rows()),
+       FlatBuffer::offset(1, FlatBuffer::struct_vector(nodes, columns.size())),
+       FlatBuffer::offset(2, FlatBuffer::struct_vector(buffers, num_buffers))});
+  return FlatBuffer::finish(create_message(HEADER_RECORD_BATCH, batch, body.size()));
+}
+
+void bw::ArrowStreamWriter::write(std::ostream& output) const
+{
+  try
+  {
+    for (const auto& column : columns)
+    {
+      if (column.type == STRING and column.data.size() > 0x7FFFFFFFU)
+        throw Fmi::Exception(BCP, "Too much string data in Arrow column '" + column.name + "'");
+    }
+
+    write_message(output, create_schema_message(), "");
+
+    std::string body;
+    const std::string metadata = create_record_batch_message(body);
+    write_message(output, metadata, body);
+
+    // End-of-stream marker
+    const std::uint32_t eos[2] = {0xFFFFFFFF, 0};
+    output.write(reinterpret_cast<const char*>(eos), sizeof(eos));
+  }
+  catch (...)
+  {
+    throw Fmi::Exception::Trace(BCP, "Operation failed!");
+  }
+}
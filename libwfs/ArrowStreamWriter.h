@@ -0,0 +1,106 @@
+#pragma once
+
+#include <boost/date_time/posix_time/ptime.hpp>
+#include <spine/TimeSeries.h>
+#include <cstdint>
+#include <ostream>
+#include <string>
+#include <vector>
+
+namespace SmartMet
+{
+namespace Plugin
+{
+namespace WFS
+{
+/**
+ *   @brief Writes a table in Apache Arrow IPC streaming format
+ *
+ *   Only the small subset of the format needed for WFS responses is supported:
+ *   UTF-8 string, 64 bit float, 64 bit integer and timestamp (seconds, UTC) columns,
+ *   all of them nullable. The whole table is written as a single record batch
+ *   preceded by the schema message and followed by the end-of-stream marker.
+ *
+ *   The Arrow flatbuffer metadata is encoded directly so that no dependency on
+ *   the Arrow C++ library is needed.
+ */
+class ArrowStreamWriter
+{
+ public:
+  enum ColumnType
+  {
+    STRING,
+    DOUBLE,
+    INT64,
+    TIMESTAMP
+  };
+
+  static const char* CONTENT_TYPE;
+
+  ArrowStreamWriter();
+
+  virtual ~ArrowStreamWriter();
+
+  /**
+   *   @brief Add a column to the table and return its index
+   *
+   *   Columns must be added before any values are appended.
+   */
+  std::size_t add_column(const std::string& name, ColumnType type);
+
+  void append_null(std::size_t column);
+
+  /**
+   *   @brief Append a floating point value (NaN is stored as null)
+   */
+  void append(std::size_t column, double value);
+
+  void append(std::size_t column, std::int64_t value);
+
+  void append(std::size_t column, const std::string& value);
+
+  void append(std::size_t column, const boost::posix_time::ptime& value);
+
+  /**
+   *   @brief Append a time series value
+   *
+   *   Numeric values are accepted by numeric columns, other values only by string
+   *   columns. None and values of unsuitable type are stored as nulls.
+   */
+  void append(std::size_t column, const SmartMet::Spine::TimeSeries::Value& value);
+
+  inline std::size_t num_columns() const { return columns.size(); }
+
+  /**
+   *   @brief Get the number of rows (all columns must have the same length)
+   */
+  std::size_t num_rows() const;
+
+  void write(std::ostream& output) const;
+
+ private:
+  struct Column
+  {
+    std::string name;
+    ColumnType type;
+    std::size_t length;
+    std::size_t null_count;
+    std::vector<std::uint8_t> validity;
+    std::string data;
+    std::vector<std::int32_t> offsets;
+  };
+
+  Column& get_column(std::size_t column, ColumnType type);
+
+  void append_valid(Column& column, bool valid);
+
+  std::string create_schema_message() const;
+
+  std::string create_record_batch_message(std::string& body) const;
+
+  std::vector<Column> columns;
+};
+
+}  // namespace WFS
+}  // namespace Plugin
+}  // namespace SmartMet
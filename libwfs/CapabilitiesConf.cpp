@@ -104,6 +104,9 @@ CapabilitiesConf::CapabilitiesConf()
   supportedFormats.insert("text/xml; version=3.2");
   supportedFormats.insert("application/gml+xml; subtype=gml/3.2");
   supportedFormats.insert("application/gml+xml; version=3.2");
+  supportedFormats.insert("application/geo+json");
+  supportedFormats.insert("application/vnd.apache.arrow.stream");
+  supportedFormats.insert("text/csv");
 }
 
 CapabilitiesConf::~CapabilitiesConf()
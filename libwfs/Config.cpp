@@ -50,9 +50,13 @@ Config::Config(const string& configfile)
     const std::string sq_template_dir = get_mandatory_path("storedQueryTemplateDir");
     getFeatureById = get_optional_config_param<std::string>("getFeatureById", c_get_feature_by_id);
     geoserver_conn_str = get_optional_config_param<std::string>("geoserverConnStr", "");
+    geoserver_mirror_hours = get_optional_config_param<int>("geoserverMirrorHours", 48);
+    geoserver_mirror_update_interval =
+        get_optional_config_param<int>("geoserverMirrorUpdateInterval", 60);
     default_locale = get_optional_config_param<std::string>("locale", guess_default_locale());
     cache_size = get_optional_config_param<int>("cacheSize", 100);
     cache_time_constant = get_optional_config_param<int>("cacheTimeConstant", 60);
+    contour_cache_size = get_optional_config_param<int>("contourCacheSize", 100);
     default_expires_seconds = get_optional_config_param<int>("defaultExpiresSeconds", 60);
     validate_output = get_optional_config_param<bool>("validateXmlOutput", false);
     fail_on_validate_errors = get_optional_config_param<bool>("failOnValidateErrors", false);
@@ -392,6 +396,23 @@ accepted.
     One must of course substitute actual parameter values in this string
 </tr>
 
+<tr>
+<td>geoserverMirrorHours</td>
+<td>integer</td>
+<td>optional (default 48)</td>
+<td>Specifies the period (in hours before the current time) of GeoServer mosaic index
+    tables kept in memory. Requests starting within this period are answered without
+    querying the database. Value 0 disables the mirror.</td>
+</tr>
+
+<tr>
+<td>geoserverMirrorUpdateInterval</td>
+<td>integer</td>
+<td>optional (default 60)</td>
+<td>Specifies how often (in seconds) new rows of the mirrored GeoServer mosaic index
+    tables are checked for</td>
+</tr>
+
 <tr>
 <td>cacheSize</td>
 <td>integer</td>
@@ -406,6 +427,14 @@ accepted.
 <td>Specifies stored queries response cache time constant</td>
 </tr>
 
+<tr>
+<td>contourCacheSize</td>
+<td>integer</td>
+<td>optional (default 100)</td>
+<td>Specifies the memory limit (in megabytes) of the contour geometry cache shared by contour,
+    isoline and coverage stored queries. Value 0 disables the cache.</td>
+</tr>
+
 <tr>
 <td>defaultExpiresSeconds</td>
 <td>integer</td>
@@ -59,9 +59,12 @@ class Config : private boost::noncopyable, public SmartMet::Spine::ConfigBase
   int getDefaultExpiresSeconds() const { return default_expires_seconds; }
   const boost::filesystem::path& get_template_directory() const { return template_directory; }
   const std::string& get_geoserver_conn_string() const { return geoserver_conn_str; }
+  inline int getGeoserverMirrorHours() const { return geoserver_mirror_hours; }
+  inline int getGeoserverMirrorUpdateInterval() const { return geoserver_mirror_update_interval; }
   const std::vector<std::string>& get_languages() const { return languages; }
   inline int getCacheSize() const { return cache_size; }
   inline int getCacheTimeConstant() const { return cache_time_constant; }
+  inline int getContourCacheSize() const { return contour_cache_size; }
   inline const std::string& get_default_locale() const { return default_locale; }
   std::vector<boost::shared_ptr<WfsFeatureDef> > read_features_config(
       SmartMet::Spine::CRSRegistry& theCRSRegistry);
@@ -86,11 +89,14 @@ class Config : private boost::noncopyable, public SmartMet::Spine::ConfigBase
   std::string getFeatureById;
   std::vector<std::string> sq_config_dirs;
   std::string geoserver_conn_str;
+  int geoserver_mirror_hours;
+  int geoserver_mirror_update_interval;
   std::string default_locale;
   std::string httpProxy;
   std::string noProxy;
   int cache_size;
   int cache_time_constant;
+  int contour_cache_size;
   int default_expires_seconds;
   std::vector<std::string> languages;
   boost::filesystem::path template_directory;
@@ -0,0 +1,97 @@
+#include "ContourCache.h"
+#include <macgyver/Exception.h>
+#include <iterator>
+
+namespace bw = SmartMet::Plugin::WFS;
+
+bw::ContourCache::ContourCache(std::size_t max_size) : max_size(max_size), total_size(0) {}
+
+bw::ContourCache::~ContourCache() {}
+
+bw::ContourCache::GeometriesPtr bw::ContourCache::find(const std::string& key)
+{
+  try
+  {
+    std::unique_lock<std::mutex> lock(mutex);
+    auto pos = index.find(key);
+    if (pos == index.end())
+      return GeometriesPtr();
+
+    // Move the entry to the front as the most recently used one
+    entries.splice(entries.begin(), entries, pos->second.first);
+    return pos->second.first->second;
+  }
+  catch (...)
+  {
+    throw Fmi::Exception::Trace(BCP, "Operation failed!");
+  }
+}
+
+void bw::ContourCache::insert(const std::string& key, GeometriesPtr geometries)
+{
+  try
+  {
+    if (not geometries)
+      return;
+
+    // The key is stored both in the list and in the index
+    const std::size_t size = estimate_size(*geometries) + 2 * key.size();
+    if (size > max_size)
+      return;
+
+    std::unique_lock<std::mutex> lock(mutex);
+
+    auto pos = index.find(key);
+    if (pos != index.end())
+    {
+      total_size -= pos->second.second;
+      entries.erase(pos->second.first);
+      index.erase(pos);
+    }
+
+    while (not entries.empty() and total_size + size > max_size)
+    {
+      auto last = std::prev(entries.end());
+      auto last_pos = index.find(last->first);
+      total_size -= last_pos->second.second;
+      index.erase(last_pos);
+      entries.erase(last);
+    }
+
+    entries.emplace_front(key, geometries);
+    index[key] = std::make_pair(entries.begin(), size);
+    total_size += size;
+  }
+  catch (...)
+  {
+    throw Fmi::Exception::Trace(BCP, "Operation failed!");
+  }
+}
+
+std::size_t bw::ContourCache::size() const
+{
+  std::unique_lock<std::mutex> lock(mutex);
+  return total_size;
+}
+
+std::size_t bw::ContourCache::num_entries() const
+{
+  std::unique_lock<std::mutex> lock(mutex);
+  return entries.size();
+}
+
+std::size_t bw::ContourCache::estimate_size(const Geometries& geometries)
+{
+  try
+  {
+    std::size_t result = sizeof(Geometries) + geometries.size() * sizeof(GeometryPtr);
+    for (const auto& geom : geometries)
+      if (geom)
+        result += geom->estimate_size();
+    return result;
+  }
+  catch (...)
+  {
+    throw Fmi::Exception::Trace(BCP, "Operation failed!");
+  }
+}
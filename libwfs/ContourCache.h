@@ -0,0 +1,77 @@
+#pragma once
+
+#include "ContourGeometryIndex.h"
+#include <cstddef>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+namespace SmartMet
+{
+namespace Plugin
+{
+namespace WFS
+{
+/**
+ *   @brief Cache of unclipped contour geometries shared by all contour handlers
+ *
+ *   Geometries are stored together with their spatial index (ContourGeometryIndex)
+ *   so that the index is built only once.
+ *
+ *   The key is a description of everything the contouring depends on (querydata,
+ *   parameter, level, time, limits or isovalues, smoothing and output CRS), but not the
+ *   bounding box. Requests differing only in the bounding box therefore only need to
+ *   clip the cached geometries. Full keys are stored and compared, so that different
+ *   requests can never share an entry because of a hash collision.
+ *
+ *   Least recently used entries are dropped when the total estimated size of the cached
+ *   geometries exceeds the given limit. Cached geometries must not be modified.
+ *
+ *   Thread safe.
+ */
+class ContourCache
+{
+ public:
+  typedef std::shared_ptr<const ContourGeometryIndex> GeometryPtr;
+  typedef std::vector<GeometryPtr> Geometries;
+  typedef std::shared_ptr<const Geometries> GeometriesPtr;
+
+  /**
+   *   @param max_size Maximal total size of cached geometries in bytes (0 disables the cache)
+   */
+  explicit ContourCache(std::size_t max_size);
+
+  virtual ~ContourCache();
+
+  /**
+   *   @brief Get cached geometries (empty pointer if not found)
+   */
+  GeometriesPtr find(const std::string& key);
+
+  void insert(const std::string& key, GeometriesPtr geometries);
+
+  inline std::size_t get_max_size() const { return max_size; }
+
+  std::size_t size() const;
+
+  std::size_t num_entries() const;
+
+  static std::size_t estimate_size(const Geometries& geometries);
+
+ private:
+  typedef std::pair<std::string, GeometriesPtr> Entry;
+
+  const std::size_t max_size;
+  mutable std::mutex mutex;
+  std::list<Entry> entries;
+  std::unordered_map<std::string, std::pair<std::list<Entry>::iterator, std::size_t> > index;
+  std::size_t total_size;
+};
+
+}  // namespace WFS
+}  // namespace Plugin
+}  // namespace SmartMet
@@ -0,0 +1,155 @@
+#include "ContourGeometryIndex.h"
+#include <macgyver/Exception.h>
+#include <ogr_geometry.h>
+#include <algorithm>
+#include <cmath>
+
+namespace bw = SmartMet::Plugin::WFS;
+
+namespace
+{
+const std::size_t MAX_TILES_PER_SIDE = 32;
+
+std::size_t tile_index(double value, double min_value, double tile_size, std::size_t num_tiles)
+{
+  if (tile_size <= 0.0)
+    return 0;
+  const double ind = std::floor((value - min_value) / tile_size);
+  if (ind < 0.0)
+    return 0;
+  return std::min(static_cast<std::size_t>(ind), num_tiles - 1);
+}
+}  // namespace
+
+bw::ContourGeometryIndex::ContourGeometryIndex(GeometryPtr geometry)
+    : geometry(geometry), is_collection(false), nx(1), ny(1), tile_width(0.0), tile_height(0.0)
+{
+  try
+  {
+    if (not geometry or geometry->IsEmpty())
+      return;
+
+    const auto type = wkbFlatten(geometry->getGeometryType());
+    is_collection = (type == wkbMultiPolygon or type == wkbMultiLineString or
+                     type == wkbMultiPoint or type == wkbGeometryCollection);
+
+    if (is_collection)
+    {
+      const auto* collection = static_cast<const OGRGeometryCollection*>(geometry.get());
+      for (int i = 0; i < collection->getNumGeometries(); i++)
+        parts.push_back(collection->getGeometryRef(i));
+    }
+    else
+    {
+      parts.push_back(geometry.get());
+    }
+
+    envelopes.resize(parts.size());
+    for (std::size_t i = 0; i < parts.size(); i++)
+      parts[i]->getEnvelope(&envelopes[i]);
+    geometry->getEnvelope(&extent);
+
+    // Roughly one part per tile, but no more than MAX_TILES_PER_SIDE^2 tiles
+    const std::size_t n = std::max<std::size_t>(
+        1, std::min(MAX_TILES_PER_SIDE, static_cast<std::size_t>(std::sqrt(parts.size()))));
+    nx = n;
+    ny = n;
+    tile_width = (extent.MaxX - extent.MinX) / nx;
+    tile_height = (extent.MaxY - extent.MinY) / ny;
+
+    tiles.resize(nx * ny);
+    for (std::size_t i = 0; i < parts.size(); i++)
+    {
+      const auto& env = envelopes[i];
+      const std::size_t i1 = tile_index(env.MinX, extent.MinX, tile_width, nx);
+      const std::size_t i2 = tile_index(env.MaxX, extent.MinX, tile_width, nx);
+      const std::size_t j1 = tile_index(env.MinY, extent.MinY, tile_height, ny);
+      const std::size_t j2 = tile_index(env.MaxY, extent.MinY, tile_height, ny);
+      for (std::size_t j = j1; j <= j2; j++)
+        for (std::size_t k = i1; k <= i2; k++)
+          tiles[j * nx + k].push_back(i);
+    }
+  }
+  catch (...)
+  {
+    throw Fmi::Exception::Trace(BCP, "Operation failed!");
+  }
+}
+
+bw::ContourGeometryIndex::~ContourGeometryIndex() {}
+
+bw::ContourGeometryIndex::GeometryPtr bw::ContourGeometryIndex::select(const OGREnvelope& bbox,
+                                                                       bool& within) const
+{
+  try
+  {
+    within = true;
+
+    if (parts.empty() or bbox.Contains(extent))
+      return geometry;
+
+    const auto type = wkbFlatten(geometry->getGeometryType());
+
+    std::vector<std::size_t> selected;
+    if (bbox.Intersects(extent))
+    {
+      const std::size_t i1 = tile_index(bbox.MinX, extent.MinX, tile_width, nx);
+      const std::size_t i2 = tile_index(bbox.MaxX, extent.MinX, tile_width, nx);
+      const std::size_t j1 = tile_index(bbox.MinY, extent.MinY, tile_height, ny);
+      const std::size_t j2 = tile_index(bbox.MaxY, extent.MinY, tile_height, ny);
+
+      std::vector<bool> visited(parts.size(), false);
+      for (std::size_t j = j1; j <= j2; j++)
+        for (std::size_t k = i1; k <= i2; k++)
+          for (std::size_t i : tiles[j * nx + k])
+          {
+            if (visited[i])
+              continue;
+            visited[i] = true;
+            if (not bbox.Intersects(envelopes[i]))
+              continue;
+            if (not bbox.Contains(envelopes[i]))
+              within = false;
+            selected.push_back(i);
+          }
+    }
+
+    if (not is_collection)
+    {
+      if (selected.empty())
+        return GeometryPtr(OGRGeometryFactory::createGeometry(type));
+      return geometry;
+    }
+
+    // Keep the original order of the parts
+    std::sort(selected.begin(), selected.end());
+
+    GeometryPtr result(OGRGeometryFactory::createGeometry(type));
+    auto* collection = static_cast<OGRGeometryCollection*>(result.get());
+    for (std::size_t i : selected)
+      collection->addGeometry(parts[i]);
+    return result;
+  }
+  catch (...)
+  {
+    throw Fmi::Exception::Trace(BCP, "Operation failed!");
+  }
+}
+
+std::size_t bw::ContourGeometryIndex::estimate_size() const
+{
+  try
+  {
+    // WKB size is close to the memory used by the coordinates which dominate the size
+    std::size_t result = sizeof(*this) + parts.size() * (sizeof(OGRGeometry*) + sizeof(OGREnvelope));
+    for (const auto& tile : tiles)
+      result += sizeof(tile) + tile.size() * sizeof(std::size_t);
+    if (geometry)
+      result += sizeof(OGRGeometry) + geometry->WkbSize();
+    return result;
+  }
+  catch (...)
+  {
+    throw Fmi::Exception::Trace(BCP, "Operation failed!");
+  }
+}
@@ -0,0 +1,74 @@
+#pragma once
+
+#include <ogr_core.h>
+#include <ogr_geometry.h>
+#include <cstddef>
+#include <memory>
+#include <vector>
+
+namespace SmartMet
+{
+namespace Plugin
+{
+namespace WFS
+{
+/**
+ *   @brief Spatial index of the parts of a contour geometry
+ *
+ *   Contours cover the whole model area, but a request usually needs only a small part
+ *   of them. The polygons or lines of a multi geometry are assigned to the tiles of
+ *   a regular grid covering the geometry extent, so that the parts near the requested
+ *   bounding box can be found without looking at the other parts at all. Only the
+ *   selected parts need to be clipped.
+ *
+ *   The indexed geometry is not modified. Immutable after construction and therefore
+ *   safe to use from several threads.
+ */
+class ContourGeometryIndex
+{
+ public:
+  typedef std::shared_ptr<OGRGeometry> GeometryPtr;
+
+  explicit ContourGeometryIndex(GeometryPtr geometry);
+
+  virtual ~ContourGeometryIndex();
+
+  inline GeometryPtr get_geometry() const { return geometry; }
+
+  /**
+   *   @brief Select the parts of the geometry which intersect the bounding box
+   *
+   *   Returns the indexed geometry itself if its extent is within the bounding box,
+   *   otherwise a new geometry of the same type containing copies of the selected
+   *   parts (an empty geometry if no part intersects the bounding box). The indexed
+   *   geometry is shared by all users of the index and must not be modified.
+   *
+   *   @param within Set to true if all the returned parts are within the bounding
+   *          box and therefore do not need to be clipped
+   */
+  GeometryPtr select(const OGREnvelope& bbox, bool& within) const;
+
+  inline std::size_t num_parts() const { return parts.size(); }
+
+  /**
+   *   @brief Estimate the memory used by the geometry and the index in bytes
+   */
+  std::size_t estimate_size() const;
+
+ private:
+  GeometryPtr geometry;
+  bool is_collection;
+  std::vector<const OGRGeometry*> parts;
+  std::vector<OGREnvelope> envelopes;
+  OGREnvelope extent;
+
+  std::size_t nx;
+  std::size_t ny;
+  double tile_width;
+  double tile_height;
+  std::vector<std::vector<std::size_t> > tiles;
+};
+
+}  // namespace WFS
+}  // namespace Plugin
+}  // namespace SmartMet
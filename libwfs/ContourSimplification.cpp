@@ -0,0 +1,173 @@
+#include "ContourSimplification.h"
+#include <macgyver/Exception.h>
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <vector>
+
+namespace bw = SmartMet::Plugin::WFS;
+
+namespace
+{
+// Snapping has no visible effect when there are more grid steps than this across
+// the coordinate range, and the integer arithmetic below would overflow
+const double MAX_GRID_STEPS = 1.0e9;
+
+struct GridPoint
+{
+  std::int64_t x;
+  std::int64_t y;
+
+  bool operator==(const GridPoint& other) const { return x == other.x and y == other.y; }
+};
+
+// Exact for grid coordinates limited by MAX_GRID_STEPS
+bool collinear(const GridPoint& a, const GridPoint& b, const GridPoint& c)
+{
+  return (b.x - a.x) * (c.y - b.y) == (b.y - a.y) * (c.x - b.x);
+}
+
+std::vector<GridPoint> snap(const OGRSimpleCurve& curve, double tolerance, bool closed)
+{
+  // The closing point of a ring is handled as the wrap around of the points
+  int n = curve.getNumPoints();
+  if (closed and n > 1 and curve.getX(0) == curve.getX(n - 1) and
+      curve.getY(0) == curve.getY(n - 1))
+    n--;
+
+  std::vector<GridPoint> points;
+  points.reserve(n);
+  for (int i = 0; i < n; i++)
+  {
+    const GridPoint point{std::llround(curve.getX(i) / tolerance),
+                          std::llround(curve.getY(i) / tolerance)};
+    while (points.size() >= 2 and collinear(points[points.size() - 2], points.back(), point))
+      points.pop_back();
+    if (not points.empty() and points.back() == point)
+      continue;
+    points.push_back(point);
+  }
+
+  if (closed)
+  {
+    for (bool changed = true; changed;)
+    {
+      changed = false;
+      if (points.size() > 1 and points.back() == points.front())
+      {
+        points.pop_back();
+        changed = true;
+      }
+      if (points.size() >= 3 and
+          collinear(points[points.size() - 2], points.back(), points.front()))
+      {
+        points.pop_back();
+        changed = true;
+      }
+      if (points.size() >= 3 and collinear(points.back(), points[0], points[1]))
+      {
+        points.erase(points.begin());
+        changed = true;
+      }
+    }
+    if (points.size() < 3)
+      points.clear();
+  }
+  else if (points.size() < 2)
+  {
+    points.clear();
+  }
+
+  return points;
+}
+
+template <typename Curve>
+Curve* create_curve(const std::vector<GridPoint>& points, double tolerance, bool closed)
+{
+  auto* curve = new Curve;
+  curve->setNumPoints(static_cast<int>(points.size() + (closed ? 1 : 0)), FALSE);
+  for (std::size_t i = 0; i < points.size(); i++)
+    curve->setPoint(static_cast<int>(i), points[i].x * tolerance, points[i].y * tolerance);
+  if (closed)
+    curve->setPoint(static_cast<int>(points.size()),
+                    points[0].x * tolerance,
+                    points[0].y * tolerance);
+  return curve;
+}
+
+// Returns nullptr if the geometry collapses
+OGRGeometry* simplify(const OGRGeometry& geometry, double tolerance)
+{
+  const auto type = wkbFlatten(geometry.getGeometryType());
+  switch (type)
+  {
+    case wkbLineString:
+    {
+      const auto points = snap(static_cast<const OGRLineString&>(geometry), tolerance, false);
+      if (points.empty())
+        return nullptr;
+      return create_curve<OGRLineString>(points, tolerance, false);
+    }
+    case wkbPolygon:
+    {
+      const auto& polygon = static_cast<const OGRPolygon&>(geometry);
+      if (polygon.IsEmpty())
+        return nullptr;
+      const auto exterior = snap(*polygon.getExteriorRing(), tolerance, true);
+      if (exterior.empty())
+        return nullptr;
+
+      auto* result = new OGRPolygon;
+      result->addRingDirectly(create_curve<OGRLinearRing>(exterior, tolerance, true));
+      for (int i = 0; i < polygon.getNumInteriorRings(); i++)
+      {
+        const auto hole = snap(*polygon.getInteriorRing(i), tolerance, true);
+        if (not hole.empty())
+          result->addRingDirectly(create_curve<OGRLinearRing>(hole, tolerance, true));
+      }
+      return result;
+    }
+    case wkbMultiLineString:
+    case wkbMultiPolygon:
+    case wkbGeometryCollection:
+    {
+      const auto& collection = static_cast<const OGRGeometryCollection&>(geometry);
+      auto* result = static_cast<OGRGeometryCollection*>(OGRGeometryFactory::createGeometry(type));
+      for (int i = 0; i < collection.getNumGeometries(); i++)
+      {
+        OGRGeometry* part = simplify(*collection.getGeometryRef(i), tolerance);
+        if (part)
+          result->addGeometryDirectly(part);
+      }
+      return result;
+    }
+    default:
+      return geometry.clone();
+  }
+}
+}  // namespace
+
+std::shared_ptr<OGRGeometry> bw::simplify_contour(const OGRGeometry& geometry, double tolerance)
+{
+  try
+  {
+    if (tolerance <= 0.0 or geometry.IsEmpty())
+      return std::shared_ptr<OGRGeometry>(geometry.clone());
+
+    OGREnvelope envelope;
+    geometry.getEnvelope(&envelope);
+    const double extent = std::max(std::max(std::fabs(envelope.MinX), std::fabs(envelope.MaxX)),
+                                   std::max(std::fabs(envelope.MinY), std::fabs(envelope.MaxY)));
+    if (extent / tolerance > MAX_GRID_STEPS)
+      return std::shared_ptr<OGRGeometry>(geometry.clone());
+
+    OGRGeometry* result = simplify(geometry, tolerance);
+    if (not result)
+      result = OGRGeometryFactory::createGeometry(wkbFlatten(geometry.getGeometryType()));
+    return std::shared_ptr<OGRGeometry>(result);
+  }
+  catch (...)
+  {
+    throw Fmi::Exception::Trace(BCP, "Operation failed!");
+  }
+}
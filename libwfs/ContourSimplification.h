@@ -0,0 +1,31 @@
+#pragma once
+
+#include <ogr_geometry.h>
+#include <memory>
+
+namespace SmartMet
+{
+namespace Plugin
+{
+namespace WFS
+{
+/**
+ *   @brief Simplify a contour geometry by snapping its vertices to a grid
+ *
+ *   Vertices are rounded to the nearest multiple of the tolerance, after which repeated
+ *   vertices and vertices on a straight line between their neighbours are removed.
+ *   Each vertex is moved independently of the rest of the geometry, so a boundary shared
+ *   by adjacent isobands is simplified the same way in both of them and no gaps or
+ *   overlaps appear between the bands (which is not the case when the bands are
+ *   simplified separately with OGRGeometry::SimplifyPreserveTopology). Rings and lines
+ *   which collapse are removed, and a polygon is removed if its exterior ring collapses.
+ *
+ *   @return A new geometry of the same type (empty if everything collapsed). A copy of
+ *           the geometry is returned if the tolerance is not positive or too small
+ *           compared to the coordinates to have any effect.
+ */
+std::shared_ptr<OGRGeometry> simplify_contour(const OGRGeometry& geometry, double tolerance);
+
+}  // namespace WFS
+}  // namespace Plugin
+}  // namespace SmartMet
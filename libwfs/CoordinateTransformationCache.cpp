@@ -0,0 +1,135 @@
+#include "CoordinateTransformationCache.h"
+#include <fmt/format.h>
+#include <macgyver/Exception.h>
+#include <ogr_geometry.h>
+#include <algorithm>
+#include <cmath>
+
+namespace bw = SmartMet::Plugin::WFS;
+
+bw::CoordinateTransformationCache::CoordinateTransformationCache(TransformationPtr transformation)
+    : transformation(transformation)
+{
+}
+
+bw::CoordinateTransformationCache::~CoordinateTransformationCache() {}
+
+NFmiPoint bw::CoordinateTransformationCache::transform(double x, double y)
+{
+  try
+  {
+    const Key key(x, y);
+    auto pos = point_cache.find(key);
+    if (pos == point_cache.end())
+    {
+      NFmiPoint p1(x, y);
+      pos = point_cache.insert(std::make_pair(key, transformation->transform(p1))).first;
+    }
+    return pos->second;
+  }
+  catch (...)
+  {
+    throw Fmi::Exception::Trace(BCP, "Operation failed!");
+  }
+}
+
+std::vector<NFmiPoint> bw::CoordinateTransformationCache::transform(
+    const std::vector<NFmiPoint>& src)
+{
+  try
+  {
+    // Collect distinct points which are not yet in the cache
+    std::vector<Key> missing;
+    for (const auto& p : src)
+    {
+      const Key key(p.X(), p.Y());
+      if (point_cache.count(key) == 0)
+        missing.push_back(key);
+    }
+
+    std::sort(missing.begin(), missing.end());
+    missing.erase(std::unique(missing.begin(), missing.end()), missing.end());
+
+    if (missing.size() == 1)
+    {
+      transform(missing[0].first, missing[0].second);
+    }
+    else if (not missing.empty())
+    {
+      OGRLineString line;
+      line.setNumPoints(missing.size(), FALSE);
+      for (std::size_t i = 0; i < missing.size(); i++)
+        line.setPoint(i, missing[i].first, missing[i].second);
+
+      transformation->transform(line);
+
+      for (std::size_t i = 0; i < missing.size(); i++)
+        point_cache.insert(std::make_pair(missing[i], NFmiPoint(line.getX(i), line.getY(i))));
+    }
+
+    std::vector<NFmiPoint> result;
+    result.reserve(src.size());
+    for (const auto& p : src)
+      result.push_back(point_cache.at(Key(p.X(), p.Y())));
+    return result;
+  }
+  catch (...)
+  {
+    throw Fmi::Exception::Trace(BCP, "Operation failed!");
+  }
+}
+
+const bw::CoordinateTransformationCache::Coord2D& bw::CoordinateTransformationCache::get_2D_coord(
+    double x, double y)
+{
+  try
+  {
+    const Key key(x, y);
+    auto pos = coord_cache.find(key);
+    if (pos == coord_cache.end())
+      pos = coord_cache.insert(std::make_pair(key, format_2D_coord(transform(x, y)))).first;
+    return pos->second;
+  }
+  catch (...)
+  {
+    throw Fmi::Exception::Trace(BCP, "Operation failed!");
+  }
+}
+
+std::vector<bw::CoordinateTransformationCache::Coord2D>
+bw::CoordinateTransformationCache::get_2D_coords(const std::vector<NFmiPoint>& src)
+{
+  try
+  {
+    // Transform all points at first at once. Formatting is done afterwards
+    // and is also cached
+    transform(src);
+
+    std::vector<Coord2D> result;
+    result.reserve(src.size());
+    for (const auto& p : src)
+      result.push_back(get_2D_coord(p.X(), p.Y()));
+    return result;
+  }
+  catch (...)
+  {
+    throw Fmi::Exception::Trace(BCP, "Operation failed!");
+  }
+}
+
+bw::CoordinateTransformationCache::Coord2D bw::CoordinateTransformationCache::format_2D_coord(
+    const NFmiPoint& p)
+{
+  try
+  {
+    double w1 = std::max(std::fabs(p.X()), std::fabs(p.Y()));
+    int prec = w1 < 1000 ? 5 : std::max(0, 7 - static_cast<int>(std::floor(log10(w1))));
+    auto str_x = fmt::format("{:.{}f}", p.X(), prec);
+    auto str_y = fmt::format("{:.{}f}", p.Y(), prec);
+    return {str_x, str_y};
+  }
+  catch (...)
+  {
+    throw Fmi::Exception::Trace(BCP, "Operation failed!");
+  }
+}
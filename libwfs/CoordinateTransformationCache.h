@@ -0,0 +1,74 @@
+#pragma once
+
+#include <boost/shared_ptr.hpp>
+#include <newbase/NFmiPoint.h>
+#include <spine/CRSRegistry.h>
+#include <map>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace SmartMet
+{
+namespace Plugin
+{
+namespace WFS
+{
+/**
+ *   @brief Memoizing wrapper around SmartMet::Spine::CRSRegistry::Transformation
+ *
+ *   Intended to be used for a single request. Observation and forecast results
+ *   repeat the same station coordinates on every row, so both the transformed
+ *   points and the formatted coordinate strings are cached by source point.
+ *   The CRS pair is fixed by the wrapped transformation object.
+ *
+ *   Not thread safe.
+ */
+class CoordinateTransformationCache
+{
+ public:
+  typedef boost::shared_ptr<SmartMet::Spine::CRSRegistry::Transformation> TransformationPtr;
+  typedef std::pair<std::string, std::string> Coord2D;
+
+  CoordinateTransformationCache(TransformationPtr transformation);
+
+  virtual ~CoordinateTransformationCache();
+
+  NFmiPoint transform(double x, double y);
+
+  /**
+   *   @brief Transform a set of points
+   *
+   *   Points not found in the cache are transformed using a single call of
+   *   the underlying OGR coordinate transformation.
+   */
+  std::vector<NFmiPoint> transform(const std::vector<NFmiPoint>& src);
+
+  /**
+   *   @brief Get transformed and formatted coordinates of the point
+   */
+  const Coord2D& get_2D_coord(double x, double y);
+
+  std::vector<Coord2D> get_2D_coords(const std::vector<NFmiPoint>& src);
+
+  inline TransformationPtr get_transformation() const { return transformation; }
+
+  /**
+   *   @brief Format already transformed point
+   *
+   *   The precision depends on magnitude of the coordinates: 5 decimals for geographic
+   *   coordinates and less for projected ones.
+   */
+  static Coord2D format_2D_coord(const NFmiPoint& p);
+
+ private:
+  typedef std::pair<double, double> Key;
+
+  TransformationPtr transformation;
+  std::map<Key, NFmiPoint> point_cache;
+  std::map<Key, Coord2D> coord_cache;
+};
+
+}  // namespace WFS
+}  // namespace Plugin
+}  // namespace SmartMet
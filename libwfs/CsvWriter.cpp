@@ -0,0 +1,119 @@
+#include "CsvWriter.h"
+#include "FormattedValueColumn.h"
+#include <macgyver/Exception.h>
+#include <macgyver/StringConversion.h>
+
+namespace bw = SmartMet::Plugin::WFS;
+
+bw::CsvWriter::CsvWriter(std::ostream& output)
+    : output(output), num_columns(0), num_fields(0), row_count(0)
+{
+}
+
+bw::CsvWriter::~CsvWriter() {}
+
+void bw::CsvWriter::write_header(const std::vector<std::string>& names)
+{
+  try
+  {
+    if (num_columns > 0 or row_count > 0 or num_fields > 0)
+      throw Fmi::Exception(BCP, "CSV header must be written before any data rows");
+
+    for (const auto& name : names)
+      add_field(name);
+    num_columns = names.size();
+    output << row << "\r\n";
+    row.clear();
+    num_fields = 0;
+  }
+  catch (...)
+  {
+    throw Fmi::Exception::Trace(BCP, "Operation failed!");
+  }
+}
+
+void bw::CsvWriter::add_field(const std::string& value)
+{
+  begin_field();
+  if (value.find_first_of(",\"\r\n") == std::string::npos)
+  {
+    row += value;
+  }
+  else
+  {
+    row += '"';
+    for (char c : value)
+    {
+      if (c == '"')
+        row += '"';
+      row += c;
+    }
+    row += '"';
+  }
+}
+
+void bw::CsvWriter::add_field(const boost::posix_time::ptime& value)
+{
+  begin_field();
+  if (not value.is_special())
+  {
+    row += Fmi::to_iso_extended_string(value);
+    row += 'Z';
+  }
+}
+
+void bw::CsvWriter::add_field(const FormattedValueColumn& column, std::size_t ind)
+{
+  try
+  {
+    if (column.is_missing(ind))
+    {
+      add_empty_field();
+    }
+    else
+    {
+      tmp.clear();
+      column.append_to(tmp, ind);
+      add_field(tmp);
+    }
+  }
+  catch (...)
+  {
+    throw Fmi::Exception::Trace(BCP, "Operation failed!");
+  }
+}
+
+void bw::CsvWriter::add_empty_field()
+{
+  begin_field();
+}
+
+void bw::CsvWriter::end_row()
+{
+  try
+  {
+    if (num_columns > 0 and num_fields != num_columns)
+    {
+      Fmi::Exception exception(BCP, "Wrong number of fields in CSV row");
+      exception.addParameter("Expected", std::to_string(num_columns));
+      exception.addParameter("Actual", std::to_string(num_fields));
+      throw exception;
+    }
+
+    row += "\r\n";
+    output << row;
+    row.clear();
+    num_fields = 0;
+    row_count++;
+  }
+  catch (...)
+  {
+    throw Fmi::Exception::Trace(BCP, "Operation failed!");
+  }
+}
+
+void bw::CsvWriter::begin_field()
+{
+  if (num_fields++ > 0)
+    row += ',';
+}
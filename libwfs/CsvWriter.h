@@ -0,0 +1,73 @@
+#pragma once
+
+#include <boost/date_time/posix_time/ptime.hpp>
+#include <cstddef>
+#include <ostream>
+#include <string>
+#include <vector>
+
+namespace SmartMet
+{
+namespace Plugin
+{
+namespace WFS
+{
+class FormattedValueColumn;
+
+/**
+ *   @brief Writes a table in CSV format (RFC 4180)
+ *
+ *   Rows are written to the output stream as soon as they are completed so that
+ *   the whole table is never kept in memory. Fields are quoted only when needed.
+ *   Missing values are written as empty fields.
+ */
+class CsvWriter
+{
+ public:
+  explicit CsvWriter(std::ostream& output);
+
+  virtual ~CsvWriter();
+
+  /**
+   *   @brief Write the header row
+   *
+   *   Every row written after the header must have the same number of fields.
+   */
+  void write_header(const std::vector<std::string>& names);
+
+  void add_field(const std::string& value);
+
+  /**
+   *   @brief Add UTC time in ISO 8601 format
+   */
+  void add_field(const boost::posix_time::ptime& value);
+
+  /**
+   *   @brief Add value of formatted column (empty field for missing value)
+   */
+  void add_field(const FormattedValueColumn& column, std::size_t ind);
+
+  void add_empty_field();
+
+  void end_row();
+
+  /**
+   *   @brief Get the number of data rows written (header is not included)
+   */
+  inline std::size_t num_rows() const { return row_count; }
+
+ private:
+  void begin_field();
+
+ private:
+  std::ostream& output;
+  std::string row;
+  std::string tmp;
+  std::size_t num_columns;
+  std::size_t num_fields;
+  std::size_t row_count;
+};
+
+}  // namespace WFS
+}  // namespace Plugin
+}  // namespace SmartMet
@@ -1,11 +1,14 @@
 #include "DataSetIndex.h"
 #include <boost/algorithm/string.hpp>
+#include <boost/bind.hpp>
 #include <boost/foreach.hpp>
 #include <boost/regex.hpp>
 #include <macgyver/TimeParser.h>
 #include <macgyver/TypeName.h>
 #include <spine/Convenience.h>
 #include <macgyver/Exception.h>
+#include <algorithm>
+#include <chrono>
 #include <stdexcept>
 #include <vector>
 
@@ -126,6 +129,7 @@ bw::DataSetDefinition::DataSetDefinition(SmartMet::Spine::ConfigBase& config,
       file_regex.assign(config.get_mandatory_config_param<std::string>(setting, "file_regex"));
       origin_time_extract.assign(
           config.get_mandatory_config_param<std::string>(setting, "origin_time_extract"));
+      update_interval = config.get_optional_config_param<int>(setting, "updateInterval", 10);
 
       if ((server_dir != "") and (*server_dir.rbegin() != '/'))
         server_dir += "/";
@@ -188,7 +192,9 @@ boost::shared_ptr<bw::DataSetDefinition> bw::DataSetDefinition::create(
 {
   try
   {
-    return boost::shared_ptr<bw::DataSetDefinition>(new bw::DataSetDefinition(config, setting));
+    boost::shared_ptr<bw::DataSetDefinition> result(new bw::DataSetDefinition(config, setting));
+    result->start_monitor();
+    return result;
   }
   catch (...)
   {
@@ -196,51 +202,171 @@ boost::shared_ptr<bw::DataSetDefinition> bw::DataSetDefinition::create(
   }
 }
 
-bw::DataSetDefinition::~DataSetDefinition() {}
+bw::DataSetDefinition::~DataSetDefinition()
+{
+  if (directory_monitor_thread.joinable())
+  {
+    directory_monitor.stop();
+    directory_monitor_thread.join();
+  }
+}
 
-bool bw::DataSetDefinition::intersects(const bw::DataSetDefinition::box_t& bbox) const
+void bw::DataSetDefinition::start_monitor()
 {
   try
   {
-    return boost::geometry::intersects(bbox, this->bbox);
+    directory_monitor.watch(
+        dir,
+        boost::bind(&bw::DataSetDefinition::on_dir_change, this, ::_1, ::_2, ::_3, ::_4),
+        boost::bind(&bw::DataSetDefinition::on_dir_error, this, ::_1, ::_2, ::_3, ::_4),
+        update_interval,
+        Fmi::DirectoryMonitor::CREATE | Fmi::DirectoryMonitor::DELETE);
+
+    std::thread tmp([this]() { directory_monitor.run(); });
+    directory_monitor_thread.swap(tmp);
+
+    // Wait for the initial scan so that the first requests see all files
+    std::unique_lock<std::mutex> lock(index_mutex);
+    while (not file_index and not directory_monitor.ready())
+      index_cond.wait_for(lock, std::chrono::milliseconds(100));
   }
   catch (...)
   {
-    throw Fmi::Exception::Trace(BCP, "Operation failed!");
+    Fmi::Exception exception(BCP, "Operation failed!");
+    exception.addParameter("Data set", name);
+    throw exception;
   }
 }
 
-std::vector<boost::filesystem::path> bw::DataSetDefinition::query_files(
-    const boost::posix_time::ptime& begin, const boost::posix_time::ptime& end) const
+void bw::DataSetDefinition::on_dir_change(Fmi::DirectoryMonitor::Watcher watcher,
+                                          const boost::filesystem::path& path,
+                                          const boost::regex& pattern,
+                                          const Fmi::DirectoryMonitor::Status& status)
 {
   try
   {
-    std::vector<boost::filesystem::path> result;
-    for (auto it = fs::directory_iterator(dir); it != fs::directory_iterator(); ++it)
+    (void)watcher;
+    (void)path;
+    (void)pattern;
+
+    bool changed = false;
+    for (const auto& item : *status)
     {
-      fs::path entry = *it;
-      const std::string fn = entry.filename().string();
-      boost::match_results<std::string::const_iterator> what;
-      if (boost::regex_match(fn, what, file_regex))
+      const fs::path& entry = item.first;
+      if (item.second == Fmi::DirectoryMonitor::DELETE)
+      {
+        changed |= (files.erase(entry) > 0);
+      }
+      else if (item.second == Fmi::DirectoryMonitor::CREATE)
       {
-        try
+        const std::string fn = entry.filename().string();
+        if (boost::regex_match(fn, file_regex))
         {
-          pt::ptime origintime = extract_origintime(fn);
-          if (begin <= origintime and origintime <= end)
+          try
           {
-            result.push_back(entry);
+            files[entry] = extract_origintime(fn);
+            changed = true;
+          }
+          catch (...)
+          {
+            Fmi::Exception exception(
+                BCP, "Failed to extract origin time from the file name!", nullptr);
+            exception.addDetail("File ignored.");
+            exception.addParameter("File name", entry.string());
+            std::cout << exception.getStackTrace();
           }
-        }
-        catch (...)
-        {
-          Fmi::Exception exception(
-              BCP, "Failed to extract origin time from the file name!", nullptr);
-          exception.addDetail("File ignored.");
-          exception.addParameter("File name", entry.string());
-          std::cout << exception.getStackTrace();
         }
       }
     }
+
+    if (changed or not get_file_index())
+    {
+      auto index = std::make_shared<FileIndex>();
+      index->reserve(files.size());
+      for (const auto& item : files)
+        index->emplace_back(item.second, item.first);
+      std::stable_sort(index->begin(),
+                       index->end(),
+                       [](const FileIndex::value_type& a, const FileIndex::value_type& b)
+                       { return a.first < b.first; });
+
+      std::lock_guard<std::mutex> lock(index_mutex);
+      file_index = index;
+      index_cond.notify_all();
+    }
+  }
+  catch (...)
+  {
+    Fmi::Exception exception(BCP, "Operation failed!");
+    exception.addParameter("Data set", name);
+    throw exception;
+  }
+}
+
+void bw::DataSetDefinition::on_dir_error(Fmi::DirectoryMonitor::Watcher watcher,
+                                         const boost::filesystem::path& path,
+                                         const boost::regex& pattern,
+                                         const std::string& message)
+{
+  (void)watcher;
+  (void)pattern;
+
+  Fmi::Exception exception(BCP, "Failed to scan data set directory!", nullptr);
+  exception.addParameter("Data set", name);
+  exception.addParameter("Directory", path.string());
+  exception.addParameter("Message", message);
+  std::cout << exception.getStackTrace();
+
+  // Do not keep the initialization waiting if the initial scan failed
+  std::lock_guard<std::mutex> lock(index_mutex);
+  if (not file_index)
+  {
+    file_index = std::make_shared<FileIndex>();
+    index_cond.notify_all();
+  }
+}
+
+std::shared_ptr<const bw::DataSetDefinition::FileIndex> bw::DataSetDefinition::get_file_index()
+    const
+{
+  std::lock_guard<std::mutex> lock(index_mutex);
+  return file_index;
+}
+
+bool bw::DataSetDefinition::intersects(const bw::DataSetDefinition::box_t& bbox) const
+{
+  try
+  {
+    return boost::geometry::intersects(bbox, this->bbox);
+  }
+  catch (...)
+  {
+    throw Fmi::Exception::Trace(BCP, "Operation failed!");
+  }
+}
+
+std::vector<boost::filesystem::path> bw::DataSetDefinition::query_files(
+    const boost::posix_time::ptime& begin, const boost::posix_time::ptime& end) const
+{
+  try
+  {
+    std::vector<boost::filesystem::path> result;
+    auto index = get_file_index();
+    if (not index)
+      return result;
+
+    auto first = std::lower_bound(index->begin(),
+                                  index->end(),
+                                  begin,
+                                  [](const FileIndex::value_type& item, const pt::ptime& t)
+                                  { return item.first < t; });
+    auto last = std::upper_bound(first,
+                                 index->end(),
+                                 end,
+                                 [](const pt::ptime& t, const FileIndex::value_type& item)
+                                 { return t < item.first; });
+    for (auto it = first; it != last; ++it)
+      result.push_back(it->second);
     return result;
   }
   catch (...)
@@ -339,6 +465,13 @@ This configuration data type describes file set available for download
       </td>
 </tr>
 
+<tr>
+  <td>updateInterval</td>
+  <td>integer</td>
+  <td>optional (default 10)</td>
+  <td>Interval in seconds for checking the directory for new and removed files</td>
+</tr>
+
 <tr>
   <td>params</td>
   <td>array of strig</td>
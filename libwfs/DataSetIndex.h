@@ -8,9 +8,17 @@
 #include <boost/geometry/geometries/point_xy.hpp>
 #include <boost/optional.hpp>
 #include <boost/regex.hpp>
+#include <macgyver/DirectoryMonitor.h>
 #include <spine/ConfigBase.h>
+#include <condition_variable>
+#include <map>
+#include <memory>
+#include <mutex>
 #include <set>
 #include <string>
+#include <thread>
+#include <utility>
+#include <vector>
 
 namespace SmartMet
 {
@@ -45,6 +53,13 @@ class DataSetQuery
   std::set<int> levels;
 };
 
+/**
+ *   @brief Definition of a file set available for download
+ *
+ *   The files of the data set directory are kept in an index sorted by origin time.
+ *   The index is maintained by Fmi::DirectoryMonitor in a separate thread, so
+ *   query_files() does not need to access the file system.
+ */
 class DataSetDefinition : public boost::enable_shared_from_this<DataSetDefinition>
 {
  public:
@@ -74,6 +89,23 @@ class DataSetDefinition : public boost::enable_shared_from_this<DataSetDefinitio
 
   boost::posix_time::ptime extract_origintime(const boost::filesystem::path& p) const;
 
+ private:
+  typedef std::vector<std::pair<boost::posix_time::ptime, boost::filesystem::path> > FileIndex;
+
+  void start_monitor();
+
+  void on_dir_change(Fmi::DirectoryMonitor::Watcher watcher,
+                     const boost::filesystem::path& path,
+                     const boost::regex& pattern,
+                     const Fmi::DirectoryMonitor::Status& status);
+
+  void on_dir_error(Fmi::DirectoryMonitor::Watcher watcher,
+                    const boost::filesystem::path& path,
+                    const boost::regex& pattern,
+                    const std::string& message);
+
+  std::shared_ptr<const FileIndex> get_file_index() const;
+
  private:
   std::string name;
   boost::filesystem::path dir;
@@ -85,6 +117,19 @@ class DataSetDefinition : public boost::enable_shared_from_this<DataSetDefinitio
   boost::basic_regex<char> origin_time_extract;
   boost::basic_regex<char> origin_time_match;
   std::string origin_time_replace;
+  int update_interval;
+
+  /**
+   *   @brief Origin times of the matching files (updated only by the monitor thread)
+   */
+  std::map<boost::filesystem::path, boost::posix_time::ptime> files;
+
+  mutable std::mutex index_mutex;
+  std::condition_variable index_cond;
+  std::shared_ptr<const FileIndex> file_index;
+
+  Fmi::DirectoryMonitor directory_monitor;
+  std::thread directory_monitor_thread;
 };
 
 }  // namespace WFS
@@ -0,0 +1,122 @@
+#include "FormattedValueColumn.h"
+#include <macgyver/Exception.h>
+#include <cmath>
+
+namespace bw = SmartMet::Plugin::WFS;
+namespace ts = SmartMet::Spine::TimeSeries;
+
+bw::FormattedValueColumn::FormattedValueColumn(const SmartMet::Spine::ValueFormatter& formatter,
+                                               int precision)
+    : formatter(formatter), precision(precision), missing_text(formatter.missing())
+{
+  offsets.push_back(0);
+}
+
+bw::FormattedValueColumn::~FormattedValueColumn() {}
+
+void bw::FormattedValueColumn::append(const ts::TimeSeries& src)
+{
+  try
+  {
+    reserve(size() + src.size());
+    for (const auto& item : src)
+      append(item.value);
+  }
+  catch (...)
+  {
+    throw Fmi::Exception::Trace(BCP, "Operation failed!");
+  }
+}
+
+void bw::FormattedValueColumn::append(const ts::TimeSeries& src,
+                                      const std::vector<std::size_t>& rows)
+{
+  try
+  {
+    reserve(size() + rows.size());
+    for (std::size_t row : rows)
+      append(src.at(row).value);
+  }
+  catch (...)
+  {
+    throw Fmi::Exception::Trace(BCP, "Operation failed!");
+  }
+}
+
+void bw::FormattedValueColumn::append(const ts::Value& value)
+{
+  try
+  {
+    if (const double* d = boost::get<double>(&value))
+    {
+      append_double(*d);
+    }
+    else if (boost::get<ts::None>(&value))
+    {
+      missing.push_back(true);
+      offsets.push_back(buffer.size());
+    }
+    else
+    {
+      // Rare non-numeric values: use the generic visitor
+      ts::StringVisitor sv(formatter, precision);
+      buffer += boost::apply_visitor(sv, value);
+      missing.push_back(false);
+      offsets.push_back(buffer.size());
+    }
+  }
+  catch (...)
+  {
+    throw Fmi::Exception::Trace(BCP, "Operation failed!");
+  }
+}
+
+void bw::FormattedValueColumn::append_double(double value)
+{
+  if (std::isnan(value))
+  {
+    missing.push_back(true);
+  }
+  else
+  {
+    buffer += formatter.format(value, precision);
+    missing.push_back(false);
+  }
+  offsets.push_back(buffer.size());
+}
+
+void bw::FormattedValueColumn::reserve(std::size_t num_values, std::size_t avg_value_length)
+{
+  buffer.reserve(num_values * avg_value_length);
+  offsets.reserve(num_values + 1);
+  missing.reserve(num_values);
+}
+
+std::string bw::FormattedValueColumn::get(std::size_t ind) const
+{
+  try
+  {
+    if (missing.at(ind))
+      return missing_text;
+    return buffer.substr(offsets[ind], offsets[ind + 1] - offsets[ind]);
+  }
+  catch (...)
+  {
+    throw Fmi::Exception::Trace(BCP, "Operation failed!");
+  }
+}
+
+void bw::FormattedValueColumn::append_to(std::string& dest, std::size_t ind) const
+{
+  try
+  {
+    if (missing.at(ind))
+      dest += missing_text;
+    else
+      dest.append(buffer, offsets[ind], offsets[ind + 1] - offsets[ind]);
+  }
+  catch (...)
+  {
+    throw Fmi::Exception::Trace(BCP, "Operation failed!");
+  }
+}
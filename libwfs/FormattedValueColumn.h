@@ -0,0 +1,75 @@
+#pragma once
+
+#include <spine/TimeSeries.h>
+#include <spine/ValueFormatter.h>
+#include <cstddef>
+#include <string>
+#include <vector>
+
+namespace SmartMet
+{
+namespace Plugin
+{
+namespace WFS
+{
+/**
+ *   @brief Formatted string representation of one time series column
+ *
+ *   Values are formatted in a single pass using the same precision for the
+ *   entire column. Formatted values are stored into one contiguous buffer
+ *   (with an offset table) instead of separate std::string objects. Missing
+ *   values are only marked in a bitmap and are not stored into the buffer.
+ */
+class FormattedValueColumn
+{
+ public:
+  FormattedValueColumn(const SmartMet::Spine::ValueFormatter& formatter, int precision);
+
+  virtual ~FormattedValueColumn();
+
+  /**
+   *   @brief Format all values of provided time series
+   */
+  void append(const SmartMet::Spine::TimeSeries::TimeSeries& ts);
+
+  /**
+   *   @brief Format values of provided time series rows in the specified order
+   */
+  void append(const SmartMet::Spine::TimeSeries::TimeSeries& ts,
+              const std::vector<std::size_t>& rows);
+
+  void append(const SmartMet::Spine::TimeSeries::Value& value);
+
+  void reserve(std::size_t num_values, std::size_t avg_value_length = 8);
+
+  inline std::size_t size() const { return missing.size(); }
+  inline bool empty() const { return missing.empty(); }
+  inline bool is_missing(std::size_t ind) const { return missing.at(ind); }
+
+  /**
+   *   @brief Get formatted value (missing text for missing values)
+   */
+  std::string get(std::size_t ind) const;
+
+  /**
+   *   @brief Append formatted value to provided string without creating temporary strings
+   */
+  void append_to(std::string& dest, std::size_t ind) const;
+
+  inline const std::string& get_missing_text() const { return missing_text; }
+
+ private:
+  void append_double(double value);
+
+ private:
+  const SmartMet::Spine::ValueFormatter& formatter;
+  const int precision;
+  const std::string missing_text;
+  std::string buffer;
+  std::vector<std::size_t> offsets;
+  std::vector<bool> missing;
+};
+
+}  // namespace WFS
+}  // namespace Plugin
+}  // namespace SmartMet
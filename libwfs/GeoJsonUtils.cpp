@@ -0,0 +1,206 @@
+#include "GeoJsonUtils.h"
+#include "WfsConst.h"
+#include <boost/variant/static_visitor.hpp>
+#include <cpl_conv.h>
+#include <macgyver/Exception.h>
+#include <macgyver/StringConversion.h>
+#include <ogr_geometry.h>
+#include <cmath>
+#include <cstdlib>
+
+namespace bw = SmartMet::Plugin::WFS;
+namespace ts = SmartMet::Spine::TimeSeries;
+
+namespace
+{
+struct JsonVisitor : public boost::static_visitor<Json::Value>
+{
+  Json::Value operator()(const ts::None&) const { return Json::Value(Json::nullValue); }
+
+  Json::Value operator()(const std::string& value) const { return Json::Value(value); }
+
+  Json::Value operator()(double value) const
+  {
+    return std::isnan(value) ? Json::Value(Json::nullValue) : Json::Value(value);
+  }
+
+  Json::Value operator()(int value) const { return Json::Value(value); }
+
+  Json::Value operator()(const ts::LonLat& value) const
+  {
+    Json::Value result(Json::arrayValue);
+    result.append(value.lon);
+    result.append(value.lat);
+    return result;
+  }
+
+  Json::Value operator()(const boost::local_time::local_date_time& value) const
+  {
+    return Json::Value(Fmi::to_iso_extended_string(value.utc_time()) + "Z");
+  }
+};
+
+Json::Value& add_feature_impl(Json::Value& collection, const std::string& id)
+{
+  Json::Value& features = collection["features"];
+  Json::Value& feature = features[features.size()];
+  feature["type"] = "Feature";
+  feature["id"] = id;
+  feature["properties"] = Json::Value(Json::objectValue);
+  return feature;
+}
+}  // anonymous namespace
+
+Json::Value bw::GeoJson::create_feature_collection(const boost::posix_time::ptime& time_stamp)
+{
+  try
+  {
+    Json::Value result(Json::objectValue);
+    result["type"] = "FeatureCollection";
+    result["timeStamp"] = Fmi::to_iso_extended_string(time_stamp) + "Z";
+    result["numberMatched"] = 0;
+    result["numberReturned"] = 0;
+    result["features"] = Json::Value(Json::arrayValue);
+    return result;
+  }
+  catch (...)
+  {
+    throw Fmi::Exception::Trace(BCP, "Operation failed!");
+  }
+}
+
+Json::Value& bw::GeoJson::add_point_feature(Json::Value& collection,
+                                            const std::string& id,
+                                            double lon,
+                                            double lat)
+{
+  try
+  {
+    Json::Value& feature = add_feature_impl(collection, id);
+    Json::Value& geometry = feature["geometry"];
+    geometry["type"] = "Point";
+    geometry["coordinates"].append(lon);
+    geometry["coordinates"].append(lat);
+    return feature["properties"];
+  }
+  catch (...)
+  {
+    throw Fmi::Exception::Trace(BCP, "Operation failed!");
+  }
+}
+
+Json::Value& bw::GeoJson::add_feature(Json::Value& collection,
+                                      const std::string& id,
+                                      const OGRGeometry& geometry)
+{
+  try
+  {
+    Json::Value& feature = add_feature_impl(collection, id);
+    char* json = geometry.exportToJson();
+    if (json == nullptr)
+      throw Fmi::Exception(BCP, "Failed to export geometry to GeoJSON");
+    std::string tmp(json);
+    CPLFree(json);
+    feature["geometry"] = parse(tmp);
+    return feature["properties"];
+  }
+  catch (...)
+  {
+    throw Fmi::Exception::Trace(BCP, "Operation failed!");
+  }
+}
+
+Json::Value bw::GeoJson::to_json(const ts::Value& value)
+{
+  return boost::apply_visitor(JsonVisitor(), value);
+}
+
+Json::Value bw::GeoJson::to_json(const std::string& value, const std::string& missing_text)
+{
+  if (value.empty() or value == missing_text)
+    return Json::Value(Json::nullValue);
+
+  char* end = nullptr;
+  const double tmp = std::strtod(value.c_str(), &end);
+  if (end and *end == 0 and not std::isnan(tmp))
+    return Json::Value(tmp);
+  else
+    return Json::Value(value);
+}
+
+void bw::GeoJson::update_counts(Json::Value& collection)
+{
+  const Json::ArrayIndex num_features = collection["features"].size();
+  collection["numberMatched"] = num_features;
+  collection["numberReturned"] = num_features;
+}
+
+void bw::GeoJson::select_members(Json::Value& collection,
+                                 std::size_t start_index,
+                                 std::size_t count)
+{
+  try
+  {
+    const Json::Value& src = collection["features"];
+    Json::Value selected(Json::arrayValue);
+    const std::size_t end_index = start_index + count;
+    for (std::size_t i = start_index; i < end_index and i < src.size(); i++)
+      selected.append(src[Json::ArrayIndex(i)]);
+    collection["numberReturned"] = selected.size();
+    collection["features"].swap(selected);
+  }
+  catch (...)
+  {
+    throw Fmi::Exception::Trace(BCP, "Operation failed!");
+  }
+}
+
+void bw::GeoJson::merge(Json::Value& dest, const Json::Value& src)
+{
+  try
+  {
+    Json::Value& features = dest["features"];
+    for (const auto& item : src["features"])
+      features.append(item);
+    dest["numberMatched"] = dest["numberMatched"].asUInt() + src["numberMatched"].asUInt();
+    dest["numberReturned"] = features.size();
+  }
+  catch (...)
+  {
+    throw Fmi::Exception::Trace(BCP, "Operation failed!");
+  }
+}
+
+Json::Value bw::GeoJson::parse(const std::string& src)
+{
+  try
+  {
+    Json::Value result;
+    Json::Reader reader;
+    if (not reader.parse(src, result))
+    {
+      Fmi::Exception exception(BCP, "Failed to parse GeoJSON document");
+      exception.addDetail(reader.getFormattedErrorMessages());
+      exception.addParameter(WFS_EXCEPTION_CODE, WFS_OPERATION_PROCESSING_FAILED);
+      throw exception;
+    }
+    return result;
+  }
+  catch (...)
+  {
+    throw Fmi::Exception::Trace(BCP, "Operation failed!");
+  }
+}
+
+void bw::GeoJson::write(const Json::Value& collection, std::ostream& output)
+{
+  try
+  {
+    Json::FastWriter writer;
+    output << writer.write(collection);
+  }
+  catch (...)
+  {
+    throw Fmi::Exception::Trace(BCP, "Operation failed!");
+  }
+}
@@ -0,0 +1,82 @@
+#pragma once
+
+#include <boost/date_time/posix_time/ptime.hpp>
+#include <json/json.h>
+#include <spine/TimeSeries.h>
+#include <cstddef>
+#include <ostream>
+#include <string>
+
+class OGRGeometry;
+
+namespace SmartMet
+{
+namespace Plugin
+{
+namespace WFS
+{
+/**
+ *   @brief Helpers for generating GeoJSON (RFC 7946) responses
+ *
+ *   Coordinates are always written as WGS84 longitude and latitude as required
+ *   by RFC 7946. The requested CRS is therefore ignored for this output format.
+ */
+namespace GeoJson
+{
+/**
+ *   @brief Create an empty FeatureCollection object
+ */
+Json::Value create_feature_collection(const boost::posix_time::ptime& time_stamp);
+
+/**
+ *   @brief Append a Point feature and return a reference to its properties
+ */
+Json::Value& add_point_feature(Json::Value& collection,
+                               const std::string& id,
+                               double lon,
+                               double lat);
+
+/**
+ *   @brief Append a feature with provided OGR geometry and return a reference to its properties
+ */
+Json::Value& add_feature(Json::Value& collection,
+                         const std::string& id,
+                         const OGRGeometry& geometry);
+
+/**
+ *   @brief Convert time series value to JSON (missing values are mapped to null)
+ */
+Json::Value to_json(const SmartMet::Spine::TimeSeries::Value& value);
+
+/**
+ *   @brief Convert already formatted value to JSON
+ *
+ *   Numeric strings are converted to numbers and the missing text to null.
+ */
+Json::Value to_json(const std::string& value, const std::string& missing_text);
+
+/**
+ *   @brief Update numberMatched and numberReturned of the collection
+ */
+void update_counts(Json::Value& collection);
+
+/**
+ *   @brief Select the members specified by WFS startIndex and count parameters
+ *
+ *   numberMatched is preserved and numberReturned is updated.
+ */
+void select_members(Json::Value& collection, std::size_t start_index, std::size_t count);
+
+/**
+ *   @brief Append the features of the second collection to the first one
+ */
+void merge(Json::Value& dest, const Json::Value& src);
+
+Json::Value parse(const std::string& src);
+
+void write(const Json::Value& collection, std::ostream& output);
+
+}  // namespace GeoJson
+}  // namespace WFS
+}  // namespace Plugin
+}  // namespace SmartMet
@@ -1,10 +1,20 @@
 #include "GeoServerDB.h"
+#include "GeoServerMosaicIndex.h"
 #include <macgyver/Exception.h>
 
 namespace bw = SmartMet::Plugin::WFS;
 
-bw::GeoServerDB::GeoServerDB(const std::string& conn_str, std::size_t keep_conn)
-    : conn_str(conn_str), conn_pool(boost::bind(&bw::GeoServerDB::create_new_conn, this), keep_conn)
+const std::chrono::seconds bw::GeoServerDB::column_names_max_age(300);
+
+bw::GeoServerDB::GeoServerDB(const std::string& conn_str,
+                             std::size_t keep_conn,
+                             int mirror_hours,
+                             int mirror_update_interval)
+    : conn_str(conn_str),
+      keep_conn(keep_conn),
+      conn_pool(boost::bind(&bw::GeoServerDB::create_new_conn, this), keep_conn),
+      mirror_hours(mirror_hours),
+      mirror_update_interval(mirror_update_interval)
 {
   try
   {
@@ -36,6 +46,110 @@ void bw::GeoServerDB::update()
   try
   {
     conn_pool.update();
+
+    {
+      std::lock_guard<std::mutex> lock(column_names_mutex);
+      column_names.clear();
+    }
+
+    std::lock_guard<std::mutex> lock(mosaic_index_mutex);
+    mosaic_index_map.clear();
+  }
+  catch (...)
+  {
+    throw Fmi::Exception::Trace(BCP, "Operation failed!");
+  }
+}
+
+std::vector<std::string> bw::GeoServerDB::get_column_names(const std::string& table_name)
+{
+  try
+  {
+    const auto now = std::chrono::steady_clock::now();
+    {
+      std::lock_guard<std::mutex> lock(column_names_mutex);
+      auto pos = column_names.find(table_name);
+      if (pos != column_names.end() and now < pos->second.updated + column_names_max_age)
+        return pos->second.names;
+    }
+
+    boost::shared_ptr<pqxx::connection> conn = get_conn();
+    pqxx::work work(*conn);
+    pqxx::result result = work.exec("SELECT * FROM " + table_name + " LIMIT 0");
+    work.commit();
+
+    std::vector<std::string> names;
+    for (unsigned i = 0; i < result.columns(); i++)
+      names.push_back(result.column_name(i));
+
+    std::lock_guard<std::mutex> lock(column_names_mutex);
+    column_names[table_name] = ColumnNames{names, now};
+    return names;
+  }
+  catch (...)
+  {
+    Fmi::Exception exception(BCP, "Operation failed!");
+    exception.addParameter("Table", table_name);
+    throw exception;
+  }
+}
+
+void bw::GeoServerDB::invalidate_column_names(const std::string& table_name)
+{
+  try
+  {
+    std::lock_guard<std::mutex> lock(column_names_mutex);
+    column_names.erase(table_name);
+  }
+  catch (...)
+  {
+    throw Fmi::Exception::Trace(BCP, "Operation failed!");
+  }
+}
+
+std::string bw::GeoServerDB::prepare(pqxx::connection& conn, const std::string& sql)
+{
+  try
+  {
+    std::string name;
+    {
+      std::lock_guard<std::mutex> lock(statements_mutex);
+      auto& item = statement_names[sql];
+      if (item.empty())
+        item = "wfs_gs_stmt_" + std::to_string(statement_names.size());
+      name = item;
+      if (prepared_statements[&conn].count(name) > 0)
+        return name;
+    }
+
+    // The connection is used only by the calling thread, so it is not prepared
+    // concurrently by another thread while the lock is not held
+    conn.prepare(name, sql);
+
+    std::lock_guard<std::mutex> lock(statements_mutex);
+    prepared_statements[&conn].insert(name);
+    return name;
+  }
+  catch (...)
+  {
+    throw Fmi::Exception::Trace(BCP, "Operation failed!");
+  }
+}
+
+std::shared_ptr<bw::GeoServerMosaicIndex> bw::GeoServerDB::get_mosaic_index(
+    const std::string& table_name)
+{
+  try
+  {
+    if (mirror_hours <= 0)
+      return nullptr;
+
+    std::lock_guard<std::mutex> lock(mosaic_index_mutex);
+    auto& index = mosaic_index_map[table_name];
+    if (not index)
+      index = std::make_shared<GeoServerMosaicIndex>(
+          *this, table_name, mirror_hours, mirror_update_interval);
+    return index;
   }
   catch (...)
   {
@@ -47,7 +161,12 @@ boost::shared_ptr<pqxx::connection> bw::GeoServerDB::create_new_conn()
 {
   try
   {
-    return boost::shared_ptr<pqxx::connection>(new pqxx::connection(conn_str));
+    boost::shared_ptr<pqxx::connection> conn(new pqxx::connection(conn_str));
+
+    // A new connection may have the address of an earlier closed one
+    std::lock_guard<std::mutex> lock(statements_mutex);
+    prepared_statements.erase(conn.get());
+    return conn;
   }
   catch (...)
   {
@@ -3,6 +3,13 @@
 #include <boost/noncopyable.hpp>
 #include <macgyver/ObjectPool.h>
 #include <pqxx/pqxx>
+#include <chrono>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <set>
+#include <string>
+#include <vector>
 
 namespace SmartMet
 {
@@ -10,23 +17,92 @@ namespace Plugin
 {
 namespace WFS
 {
+class GeoServerMosaicIndex;
+
 class GeoServerDB : virtual protected boost::noncopyable
 {
  public:
-  GeoServerDB(const std::string& conn_str, std::size_t keep_conn = 5);
+  /**
+   *   @param mirror_hours Length of the period of mosaic index tables mirrored in memory
+   *          (0 disables mirroring)
+   *   @param mirror_update_interval Minimum interval (seconds) of checking new rows
+   *          in the mirrored tables
+   */
+  GeoServerDB(const std::string& conn_str,
+              std::size_t keep_conn = 5,
+              int mirror_hours = 0,
+              int mirror_update_interval = 60);
 
   virtual ~GeoServerDB();
 
   boost::shared_ptr<pqxx::connection> get_conn();
 
+  /**
+   *   @brief Get the maximal number of connections kept open
+   *
+   *   Concurrent queries should not use more connections than this.
+   */
+  std::size_t get_max_conn() const { return keep_conn; }
+
   void update();
 
+  /**
+   *   @brief Get the column names of a database table
+   *
+   *   The names are remembered for column_names_max_age and queried again after
+   *   that or after invalidate_column_names() has been called for the table.
+   */
+  std::vector<std::string> get_column_names(const std::string& table_name);
+
+  /**
+   *   @brief Forget the remembered column names of a table (for example after a failed query)
+   */
+  void invalidate_column_names(const std::string& table_name);
+
+  /**
+   *   @brief Prepare a statement on the connection unless it is already prepared there
+   *
+   *   Statement names are assigned by the SQL text, so different statements never
+   *   share a name and each statement is prepared only once per connection.
+   *
+   *   @return The name of the prepared statement
+   */
+  std::string prepare(pqxx::connection& conn, const std::string& sql);
+
+  /**
+   *   @brief Get the in-memory mirror of a mosaic index table (nullptr if disabled)
+   *
+   *   The mirror is created on first request and is not yet loaded then.
+   */
+  std::shared_ptr<GeoServerMosaicIndex> get_mosaic_index(const std::string& table_name);
+
  private:
   boost::shared_ptr<pqxx::connection> create_new_conn();
 
  private:
+  struct ColumnNames
+  {
+    std::vector<std::string> names;
+    std::chrono::steady_clock::time_point updated;
+  };
+
+  static const std::chrono::seconds column_names_max_age;
+
   const std::string conn_str;
+  const std::size_t keep_conn;
   Fmi::ObjectPool<pqxx::connection> conn_pool;
+
+  std::mutex column_names_mutex;
+  std::map<std::string, ColumnNames> column_names;
+
+  std::mutex statements_mutex;
+  std::map<std::string, std::string> statement_names;
+  std::map<const pqxx::connection*, std::set<std::string> > prepared_statements;
+
+  const int mirror_hours;
+  const int mirror_update_interval;
+  std::mutex mosaic_index_mutex;
+  std::map<std::string, std::shared_ptr<GeoServerMosaicIndex> > mosaic_index_map;
 };
 
 }  // namespace WFS
@@ -1,13 +1,14 @@
 #include "GeoServerDataIndex.h"
+#include "ParallelFor.h"
 #include <boost/date_time/posix_time/posix_time.hpp>
 #include <boost/foreach.hpp>
-#include <boost/regex.hpp>
-#include <gis/OGR.h>
+#include <ogr_spatialref.h>
 #include <macgyver/StringConversion.h>
 #include <macgyver/TypeName.h>
 #include <spine/Convenience.h>
 #include <macgyver/Exception.h>
 #include <iostream>
+#include <memory>
 #include <sstream>
 
 namespace bw = SmartMet::Plugin::WFS;
@@ -15,26 +16,46 @@ namespace pt = boost::posix_time;
 
 namespace
 {
-std::vector<double> get_coords(const OGRLineString* geom)
+/**
+ *  @brief Decode a boundary line string from WKB into interleaved coordinates
+ */
+void decode_boundary(const pqxx::field& field, std::vector<double>& coords, int& dim)
 {
   try
   {
-    const int num_points = geom->getNumPoints();
-    const int point_dim = geom->getCoordinateDimension();
-    std::vector<double> result;
+    const pqxx::binarystring wkb(field);
+    OGRGeometry* geom = nullptr;
+    if (OGRGeometryFactory::createFromWkb(wkb.data(), nullptr, &geom, wkb.size()) !=
+            OGRERR_NONE or
+        geom == nullptr)
+    {
+      throw Fmi::Exception(BCP, "Failed to parse WKB geometry");
+    }
+
+    std::unique_ptr<OGRGeometry, void (*)(OGRGeometry*)> holder(
+        geom, &OGRGeometryFactory::destroyGeometry);
+    const auto* line = dynamic_cast<const OGRLineString*>(geom);
+    if (line == nullptr)
+    {
+      Fmi::Exception exception(BCP, "Unexpected boundary geometry type");
+      exception.addParameter("Type", geom->getGeometryName());
+      throw exception;
+    }
+
+    const int num_points = line->getNumPoints();
+    dim = line->getCoordinateDimension();
+    coords.clear();
+    coords.reserve(num_points * dim);
     for (int i = 0; i < num_points; i++)
     {
-      result.push_back(geom->getX(i));
-      if (point_dim > 1)
+      coords.push_back(line->getX(i));
+      if (dim > 1)
       {
-        result.push_back(geom->getY(i));
-        if (point_dim > 2)
-        {
-          result.push_back(geom->getZ(i));
-        }
+        coords.push_back(line->getY(i));
+        if (dim > 2)
+          coords.push_back(line->getZ(i));
       }
     }
-    return result;
   }
   catch (...)
   {
@@ -42,16 +63,53 @@ std::vector<double> get_coords(const OGRLineString* geom)
   }
 }
 
-static void check_geometry(OGRGeometry* geom, const std::string& location, const std::string& gml)
+/**
+ *  @brief Check whether the axis order of the SRS is lat,lon (or northing,easting)
+ *
+ *  The axis order in the data returned from PostGIS is always lon,lat (or
+ *  easting,northing). Results are remembered in the provided map.
+ */
+bool swap_needed(int srs, std::map<int, bool>& cache)
+{
+  auto pos = cache.find(srs);
+  if (pos == cache.end())
+  {
+    OGRSpatialReference ogr_sr;
+    ogr_sr.SetAxisMappingStrategy(OAMS_TRADITIONAL_GIS_ORDER);
+    ogr_sr.importFromEPSGA(srs);
+    const bool swap = ogr_sr.EPSGTreatsAsLatLong() or ogr_sr.EPSGTreatsAsNorthingEasting();
+    pos = cache.emplace(srs, swap).first;
+  }
+  return pos->second;
+}
+
+typedef std::unique_ptr<OGRCoordinateTransformation, void (*)(OGRCoordinateTransformation*)>
+    TransformationPtr;
+
+/**
+ *  @brief Create coordinate transformation using the same (lon,lat) axis order as PostGIS
+ */
+TransformationPtr create_transformation(int from_srs, int to_srs)
 {
   try
   {
-    if (geom == nullptr)
+    OGRSpatialReference from;
+    OGRSpatialReference to;
+    from.SetAxisMappingStrategy(OAMS_TRADITIONAL_GIS_ORDER);
+    to.SetAxisMappingStrategy(OAMS_TRADITIONAL_GIS_ORDER);
+    if (from.importFromEPSG(from_srs) != OGRERR_NONE or to.importFromEPSG(to_srs) != OGRERR_NONE)
     {
-      std::ostringstream msg;
-      msg << location << ": failed to parse GML format geometry '" << gml << "'";
-      throw Fmi::Exception(BCP, msg.str());
+      Fmi::Exception exception(BCP, "Unknown EPSG code");
+      exception.addParameter("From", std::to_string(from_srs));
+      exception.addParameter("To", std::to_string(to_srs));
+      throw exception;
     }
+
+    TransformationPtr transformation(OGRCreateCoordinateTransformation(&from, &to),
+                                     &OGRCoordinateTransformation::DestroyCT);
+    if (not transformation)
+      throw Fmi::Exception(BCP, "Failed to create coordinate transformation");
+    return transformation;
   }
   catch (...)
   {
@@ -59,23 +117,40 @@ static void check_geometry(OGRGeometry* geom, const std::string& location, const
   }
 }
 
-bool find_srs(const std::string& gml, int& srs)
+/**
+ *  @brief Transform interleaved coordinates in place
+ */
+void transform_coords(OGRCoordinateTransformation& transformation,
+                      std::vector<double>& coords,
+                      int dim)
 {
   try
   {
-    boost::regex r_srs("srsName=[\"]EPSG:([0-9]+)[\"]", boost::regex::perl | boost::regex::icase);
-    boost::smatch match_results;
-    boost::regex_search(gml, match_results, r_srs);
-    if (match_results.size() >= 1)
+    if (dim < 2 or coords.empty())
+      return;
+
+    const std::size_t num_points = coords.size() / dim;
+    std::vector<double> x(num_points);
+    std::vector<double> y(num_points);
+    std::vector<double> z(dim > 2 ? num_points : 0);
+    for (std::size_t i = 0; i < num_points; i++)
     {
-      std::string match = match_results[1];
-      srs = std::stoi(match);
-      return true;
+      x[i] = coords[i * dim];
+      y[i] = coords[i * dim + 1];
+      if (dim > 2)
+        z[i] = coords[i * dim + 2];
     }
-    else
+
+    if (not transformation.Transform(
+            num_points, x.data(), y.data(), dim > 2 ? z.data() : nullptr))
+      throw Fmi::Exception(BCP, "Coordinate transformation failed");
+
+    for (std::size_t i = 0; i < num_points; i++)
     {
-      srs = -1;
-      return false;
+      coords[i * dim] = x[i];
+      coords[i * dim + 1] = y[i];
+      if (dim > 2)
+        coords[i * dim + 2] = z[i];
     }
   }
   catch (...)
@@ -83,13 +158,24 @@ bool find_srs(const std::string& gml, int& srs)
     throw Fmi::Exception::Trace(BCP, "Operation failed!");
   }
 }
+
+/**
+ *  @brief Swap the first two coordinates of each point
+ */
+void swap_xy(std::vector<double>& coords, int dim)
+{
+  if (dim < 2)
+    return;
+  for (std::size_t i = 0; i + 1 < coords.size(); i += dim)
+    std::swap(coords[i], coords[i + 1]);
+}
 }  // namespace
 
 bw::GeoServerDataIndex::LayerRec::LayerRec()
     : name(""),
       layer(""),
-      orig_geom(nullptr),
-      dest_geom(nullptr),
+      orig_dim(2),
+      dest_dim(2),
       orig_srs(-1),
       dest_srs(-1),
       orig_srs_swapped(false),
@@ -97,89 +183,14 @@ bw::GeoServerDataIndex::LayerRec::LayerRec()
 {
 }
 
-bw::GeoServerDataIndex::LayerRec::LayerRec(
-    const SmartMet::Plugin::WFS::GeoServerDataIndex::LayerRec& rec)
-    : name(rec.name),
-      layer(rec.layer),
-      orig_geom(rec.orig_geom ? &dynamic_cast<OGRLineString&>(*(rec.orig_geom->clone())) : nullptr),
-      dest_geom(rec.dest_geom ? &dynamic_cast<OGRLineString&>(*(rec.dest_geom->clone())) : nullptr),
-      orig_srs(rec.orig_srs),
-      dest_srs(rec.dest_srs),
-      orig_srs_swapped(rec.orig_srs_swapped),
-      dest_srs_swapped(rec.dest_srs_swapped),
-      data_map(rec.data_map)
-{
-}
-
-bw::GeoServerDataIndex::LayerRec::~LayerRec()
-{
-  clear();
-}
-
-bw::GeoServerDataIndex::LayerRec& bw::GeoServerDataIndex::LayerRec::operator=(
-    const SmartMet::Plugin::WFS::GeoServerDataIndex::LayerRec& rec)
-{
-  try
-  {
-    name = rec.name;
-    layer = rec.layer;
-    orig_geom = rec.orig_geom ? &dynamic_cast<OGRLineString&>(*(rec.orig_geom->clone())) : nullptr;
-    dest_geom = rec.dest_geom ? &dynamic_cast<OGRLineString&>(*(rec.dest_geom->clone())) : nullptr;
-    orig_srs = rec.orig_srs;
-    dest_srs = rec.dest_srs;
-    orig_srs_swapped = rec.orig_srs_swapped;
-    dest_srs_swapped = rec.dest_srs_swapped;
-
-    return *this;
-  }
-  catch (...)
-  {
-    throw Fmi::Exception::Trace(BCP, "Operation failed!");
-  }
-}
-
-void bw::GeoServerDataIndex::LayerRec::clear()
-{
-  try
-  {
-    if (orig_geom)
-    {
-      OGRGeometryFactory::destroyGeometry(orig_geom);
-      orig_geom = nullptr;
-    }
-    if (dest_geom)
-    {
-      OGRGeometryFactory::destroyGeometry(dest_geom);
-      dest_geom = nullptr;
-    }
-    orig_srs = -1;
-    dest_srs = -1;
-    orig_srs_swapped = false;
-    dest_srs_swapped = false;
-  }
-  catch (...)
-  {
-    throw Fmi::Exception::Trace(BCP, "Operation failed!");
-  }
-}
-
-std::vector<double> bw::GeoServerDataIndex::LayerRec::get_orig_coords() const
-{
-  try
-  {
-    return get_coords(orig_geom);
-  }
-  catch (...)
-  {
-    throw Fmi::Exception::Trace(BCP, "Operation failed!");
-  }
-}
-
-std::vector<double> bw::GeoServerDataIndex::LayerRec::get_dest_coords() const
+OGREnvelope bw::GeoServerDataIndex::LayerRec::get_orig_envelope() const
 {
   try
   {
-    return get_coords(dest_geom);
+    OGREnvelope envelope;
+    for (std::size_t i = 0; orig_dim > 1 and i + 1 < orig_coords.size(); i += orig_dim)
+      envelope.Merge(orig_coords[i], orig_coords[i + 1]);
+    return envelope;
   }
   catch (...)
   {
@@ -188,13 +199,13 @@ std::vector<double> bw::GeoServerDataIndex::LayerRec::get_dest_coords() const
 }
 
 bw::GeoServerDataIndex::GeoServerDataIndex(GeoServerDB& db, const std::string& db_table_name_format)
-    : db(db), db_table_name_def(db_table_name_format)
+    : db(db), db_table_name_def(db_table_name_format), data(), debug_level(0)
 {
 }
 
 bw::GeoServerDataIndex::GeoServerDataIndex(
     GeoServerDB& db, const std::map<std::string, std::string>& db_table_name_map)
-    : db(db), db_table_name_def(db_table_name_map)
+    : db(db), db_table_name_def(db_table_name_map), data(), debug_level(0)
 {
 }
 
@@ -226,16 +237,29 @@ void bw::GeoServerDataIndex::query(const boost::posix_time::ptime& begin,
 {
   try
   {
-    std::for_each(layers.begin(),
-                  layers.end(),
-                  boost::bind(&bw::GeoServerDataIndex::query_single_layer,
-                              this,
-                              begin,
-                              end,
-                              ::_1,
-                              boundingBox,
-                              boundingBoxCRS,
-                              destCRS));
+    // Layers are queried concurrently: from the in-memory mirror of the table when it
+    // covers the requested period and otherwise from the database using separate
+    // connections. At most as many layers as there are pooled connections are
+    // queried at the same time. The results are processed afterwards in the order of the layers
+    // so that the content of the index does not depend on which query completes first.
+    std::vector<std::vector<GeoServerMosaicIndex::GranulePtr> > granules(layers.size());
+    std::vector<pqxx::result> results(layers.size());
+    std::vector<char> mirrored(layers.size(), 0);
+    parallel_for(layers.size(), db.get_max_conn(), [&](std::size_t i) {
+      mirrored[i] =
+          select_from_mirror(begin, end, layers[i], boundingBox, boundingBoxCRS, granules[i]);
+      if (not mirrored[i])
+        results[i] =
+            execute_sql_request(begin, end, layers[i], boundingBox, boundingBoxCRS, destCRS);
+    });
+
+    for (std::size_t i = 0; i < layers.size(); i++)
+    {
+      if (mirrored[i])
+        process_granules(granules[i], layers[i], destCRS);
+      else
+        process_sql_result(results[i], layers[i], destCRS);
+    }
   }
   catch (...)
   {
@@ -252,19 +276,116 @@ void bw::GeoServerDataIndex::query_single_layer(const boost::posix_time::ptime&
 {
   try
   {
-    const std::string sql =
-        create_sql_request(begin, end, layer, boundingBox, boundingBoxCRS, destCRS);
-    if (debug_level > 2)
+    query(begin, end, std::vector<std::string>{layer}, boundingBox, boundingBoxCRS, destCRS);
+  }
+  catch (...)
+  {
+    throw Fmi::Exception::Trace(BCP, "Operation failed!");
+  }
+}
+
+bool bw::GeoServerDataIndex::select_from_mirror(
+    const boost::posix_time::ptime& begin,
+    const boost::posix_time::ptime& end,
+    const std::string& layer,
+    const double* boundingBox,
+    int boundingBoxCRS,
+    std::vector<GeoServerMosaicIndex::GranulePtr>& granules) const
+{
+  try
+  {
+    auto mirror = db.get_mosaic_index(get_db_table_name(layer));
+    if (not mirror)
+      return false;
+
+    mirror->update();
+    if (not mirror->covers(begin))
+      return false;
+
+    // No rows in the mirrored period
+    const int srid = mirror->get_srid();
+    if (srid <= 0)
+      return true;
+
+    // The same area as ST_MakeEnvelope(...) transformed to the SRID of the table
+    OGRLinearRing ring;
+    ring.addPoint(boundingBox[0], boundingBox[1]);
+    ring.addPoint(boundingBox[2], boundingBox[1]);
+    ring.addPoint(boundingBox[2], boundingBox[3]);
+    ring.addPoint(boundingBox[0], boundingBox[3]);
+    ring.addPoint(boundingBox[0], boundingBox[1]);
+    OGRPolygon area;
+    area.addRing(&ring);
+    if (srid != boundingBoxCRS)
+    {
+      auto transformation = create_transformation(boundingBoxCRS, srid);
+      if (area.transform(transformation.get()) != OGRERR_NONE)
+        throw Fmi::Exception(BCP, "Failed to transform the bounding box");
+    }
+
+    granules = mirror->select(begin, end, area);
+    return true;
+  }
+  catch (...)
+  {
+    Fmi::Exception exception(BCP, "Operation failed!");
+    exception.addParameter("Layer", layer);
+    throw exception;
+  }
+}
+
+pqxx::result bw::GeoServerDataIndex::execute_sql_request(const boost::posix_time::ptime& begin,
+                                                         const boost::posix_time::ptime& end,
+                                                         const std::string& layer,
+                                                         const double* boundingBox,
+                                                         int boundingBoxCRS,
+                                                         int destCRS) const
+{
+  try
+  {
+    const std::string table_name = get_db_table_name(layer);
+
+    // The statement contains the column names of the table. If the query fails, the
+    // table may have been changed, so the column names are queried again and the
+    // query is retried once.
+    for (int attempt = 0;; attempt++)
     {
-      std::ostringstream msg;
-      msg << METHOD_NAME << "GeoServer SQL request for layer '" << layer << "':\n" << sql << "\n";
-      std::cout << msg.str() << std::flush;
+      const std::string sql = create_sql_request(table_name);
+      if (debug_level > 2)
+      {
+        std::ostringstream msg;
+        msg << METHOD_NAME << "GeoServer SQL request for layer '" << layer << "':\n"
+            << sql << "\n"
+            << "Parameters: " << begin << ", " << end << ", " << boundingBox[0] << ", "
+            << boundingBox[1] << ", " << boundingBox[2] << ", " << boundingBox[3] << ", "
+            << boundingBoxCRS << ", " << destCRS << "\n";
+        std::cout << msg.str() << std::flush;
+      }
+
+      try
+      {
+        boost::shared_ptr<pqxx::connection> conn = db.get_conn();
+        const std::string statement_name = db.prepare(*conn, sql);
+        pqxx::work work(*conn);
+        pqxx::result result = work.exec_prepared(statement_name,
+                                                 Fmi::to_iso_extended_string(begin) + "Z",
+                                                 Fmi::to_iso_extended_string(end) + "Z",
+                                                 boundingBox[0],
+                                                 boundingBox[1],
+                                                 boundingBox[2],
+                                                 boundingBox[3],
+                                                 boundingBoxCRS,
+                                                 destCRS);
+        work.commit();
+        return result;
+      }
+      catch (...)
+      {
+        if (attempt > 0)
+          throw;
+        db.invalidate_column_names(table_name);
+      }
     }
-    boost::shared_ptr<pqxx::connection> conn = db.get_conn();
-    pqxx::work work(*conn);
-    pqxx::result result = work.exec(sql);
-    process_sql_result(result, layer);
-    work.commit();
   }
   catch (...)
   {
@@ -317,42 +438,39 @@ std::string bw::GeoServerDataIndex::get_db_table_name(const std::string& layer_n
   }
 }
 
-std::string bw::GeoServerDataIndex::create_sql_request(const boost::posix_time::ptime& begin,
-                                                       const boost::posix_time::ptime& end,
-                                                       const std::string& layer,
-                                                       const double* boundingBox,
-                                                       int boundingBoxCRS,
-                                                       int destCRS)
+std::string bw::GeoServerDataIndex::create_sql_request(const std::string& table_name) const
 {
   try
   {
-    const std::string geometry_str = create_geometry_str(boundingBox, boundingBoxCRS);
-    const std::string s_begin = Fmi::to_iso_extended_string(begin) + "Z";
-    const std::string s_end = Fmi::to_iso_extended_string(end) + "Z";
-
-    std::ostringstream q_fields;
-    std::ostringstream q_tables;
-    std::ostringstream q_where;
-
-    std::ostringstream q_geom_check;
-
-    q_geom_check << "ST_Intersects(St_Transform(the_geom, " << boundingBoxCRS << "),"
-                 << geometry_str << ")";
-
+    // The geometry itself is not needed as such: only its boundary is returned
+    std::ostringstream q_columns;
+    for (const auto& name : db.get_column_names(table_name))
+      if (name != "the_geom")
+        q_columns << "    ,t.\"" << name << "\"\n";
+
+    // The bounding box is transformed to the SRID of the table (instead of
+    // transforming the geometry of each row) so that the spatial index can be used.
+    // Parameters: $1, $2 = time range, $3 ... $6 = bounding box, $7 = its CRS and
+    // $8 = CRS of the returned boundaries.
     std::ostringstream query_str;
-    query_str << "SELECT\n"
-              << "    time\n"
-              << "    ,location\n"
-              << "    ,ST_AsGml(ST_Boundary(the_geom))\n"
-              << "    ,ST_AsGml(ST_Boundary(ST_Transform(the_geom, " << destCRS << ")))\n"
-              << "    ,*\n"
-              << "FROM\n"
-              << "    " << get_db_table_name(layer) << "\n"
+    query_str << "WITH bbox AS (\n"
+              << "    SELECT ST_Transform(ST_MakeEnvelope($3, $4, $5, $6, $7),\n"
+              << "        (SELECT ST_SRID(the_geom) FROM " << table_name << " LIMIT 1)) AS geom\n"
+              << ")\n"
+              << "SELECT\n"
+              << "    t.time\n"
+              << "    ,t.location\n"
+              << "    ,ST_AsBinary(ST_Boundary(t.the_geom))\n"
+              << "    ,ST_SRID(t.the_geom)\n"
+              << "    ,ST_AsBinary(ST_Boundary(ST_Transform(t.the_geom, $8::integer)))\n"
+              << q_columns.str() << "FROM\n"
+              << "    " << table_name << " AS t, bbox\n"
               << "WHERE\n"
-              << "    " << q_geom_check.str() << "\n"
-              << "    AND time >= '" << s_begin << "'\n"
-              << "    AND time <= '" << s_end << "'\n\n"
-              << "ORDER BY time DESC\n";
+              << "    t.the_geom && bbox.geom\n"
+              << "    AND ST_Intersects(t.the_geom, bbox.geom)\n"
+              << "    AND t.time >= $1\n"
+              << "    AND t.time <= $2\n\n"
+              << "ORDER BY t.time DESC\n";
 
     return query_str.str();
   }
@@ -362,29 +480,13 @@ std::string bw::GeoServerDataIndex::create_sql_request(const boost::posix_time::
   }
 }
 
-std::string bw::GeoServerDataIndex::create_geometry_str(const double* boundingBox,
-                                                        int boundingBoxCRS)
-{
-  try
-  {
-    std::ostringstream result;
-    result << "ST_GeomFromText('POLYGON((" << boundingBox[0] << " " << boundingBox[1] << ","
-           << boundingBox[2] << " " << boundingBox[1] << "," << boundingBox[2] << " "
-           << boundingBox[3] << "," << boundingBox[0] << " " << boundingBox[3] << ","
-           << boundingBox[0] << " " << boundingBox[1] << "))', " << boundingBoxCRS << ")";
-    return result.str();
-  }
-  catch (...)
-  {
-    throw Fmi::Exception::Trace(BCP, "Operation failed!");
-  }
-}
-
-void bw::GeoServerDataIndex::process_sql_result(pqxx::result& result, const std::string& layer)
+void bw::GeoServerDataIndex::process_sql_result(pqxx::result& result,
+                                                const std::string& layer,
+                                                int destCRS)
 {
   try
   {
-    const unsigned col_begin = 4;
+    const unsigned col_begin = 5;
     const unsigned num_columns = result.columns();
     std::map<unsigned, std::string> col_names;
     for (unsigned i = col_begin; i < num_columns; i++)
@@ -392,6 +494,8 @@ void bw::GeoServerDataIndex::process_sql_result(pqxx::result& result, const std:
       col_names[i] = result.column_name(i);
     }
 
+    std::map<int, bool> swap_cache;
+
     for (auto row = result.begin(); row != result.end(); ++row)
     {
       const std::string s_epoch = row[0].as<std::string>();
@@ -400,77 +504,106 @@ void bw::GeoServerDataIndex::process_sql_result(pqxx::result& result, const std:
       Item& item = data[epoch];
       item.epoch = epoch;
 
-      OGRGeometry* geom = nullptr;
-      try
+      LayerRec rec;
+      rec.name = row[1].as<std::string>();
+      rec.layer = layer;
+
+      decode_boundary(row[2], rec.orig_coords, rec.orig_dim);
+      rec.orig_srs = row[3].is_null() ? -1 : row[3].as<int>();
+      if (rec.orig_srs > 0 and swap_needed(rec.orig_srs, swap_cache))
       {
-        LayerRec rec;
-        rec.name = row[1].as<std::string>();
-        rec.layer = layer;
-
-        const std::string s_orig_geom = row[2].as<std::string>();
-        const std::string s_dest_geom = row[3].as<std::string>();
-
-        geom = OGRGeometryFactory::createFromGML(s_orig_geom.c_str());
-        check_geometry(geom, __PRETTY_FUNCTION__, s_orig_geom);
-        find_srs(s_orig_geom, rec.orig_srs);
-        // Change EPSG axis order if needed.
-        // Axis order in the data returned from PostGis is always Long,Lat or Easting,Northing.
-        OGRSpatialReference orig_ogr_sr;
-	orig_ogr_sr.SetAxisMappingStrategy(OAMS_TRADITIONAL_GIS_ORDER);
-        orig_ogr_sr.importFromEPSGA(rec.orig_srs);
-        if (orig_ogr_sr.EPSGTreatsAsLatLong() or orig_ogr_sr.EPSGTreatsAsNorthingEasting())
-        {
-          geom->swapXY();
-          rec.orig_srs_swapped = true;
-        }
+        swap_xy(rec.orig_coords, rec.orig_dim);
+        rec.orig_srs_swapped = true;
+      }
+
+      decode_boundary(row[4], rec.dest_coords, rec.dest_dim);
+      rec.dest_srs = destCRS;
+      if (swap_needed(rec.dest_srs, swap_cache))
+      {
+        swap_xy(rec.dest_coords, rec.dest_dim);
+        rec.dest_srs_swapped = true;
+      }
 
-        rec.orig_geom = &dynamic_cast<OGRLineString&>(*geom);
-
-        geom = OGRGeometryFactory::createFromGML(s_dest_geom.c_str());
-        check_geometry(geom, __PRETTY_FUNCTION__, s_dest_geom);
-        find_srs(s_dest_geom, rec.dest_srs);
-        // Change EPSG axis order if needed.
-        // Axis order in the data returned from PostGis is always Long,Lat or Easting,Northing.
-        OGRSpatialReference dest_ogr_sr;
-	dest_ogr_sr.SetAxisMappingStrategy(OAMS_TRADITIONAL_GIS_ORDER);
-        dest_ogr_sr.importFromEPSGA(rec.dest_srs);
-        if (dest_ogr_sr.EPSGTreatsAsLatLong() or dest_ogr_sr.EPSGTreatsAsNorthingEasting())
+      for (unsigned i = col_begin; i < num_columns; i++)
+      {
+        const auto& value = row[i];
+        if (not value.is_null())
         {
-          geom->swapXY();
-          rec.dest_srs_swapped = true;
+          SmartMet::Spine::Value tmp(value.as<std::string>());
+          rec.data_map[col_names[i]] = tmp;
         }
+      }
 
-        rec.dest_geom = &dynamic_cast<OGRLineString&>(*geom);
+      if (debug_level > 2)
+      {
+        std::ostringstream msg;
+        msg << SmartMet::Spine::log_time_str() << ": [WFS] [DEBUG] [" << METHOD_NAME << "]:"
+            << " name='" << rec.name << "'"
+            << " layer='" << rec.layer << "'"
+            << " epoch='" << epoch << "'"
+            << " orig_coords=" << rec.orig_coords.size() << "x" << rec.orig_dim
+            << " dest_coords=" << rec.dest_coords.size() << "x" << rec.dest_dim << '\n';
+        std::cout << msg.str() << std::flush;
+      }
 
-        for (unsigned i = col_begin; i < num_columns; i++)
-        {
-          const auto& value = row[i];
-          if (not value.is_null())
-          {
-            SmartMet::Spine::Value tmp(value.as<std::string>());
-            rec.data_map[col_names[i]] = tmp;
-          }
-        }
+      item.layers.push_back(std::move(rec));
+    }
+  }
+  catch (...)
+  {
+    throw Fmi::Exception::Trace(BCP, "Operation failed!");
+  }
+}
 
-        if (debug_level > 2)
-        {
-          std::ostringstream msg;
-          msg << SmartMet::Spine::log_time_str() << ": [WFS] [DEBUG] [" << METHOD_NAME << "]:"
-              << " name='" << rec.name << "'"
-              << " layer='" << rec.layer << "'"
-              << " epoch='" << epoch << "'"
-              << " orig_geom='" << Fmi::OGR::exportToWkt(*rec.orig_geom) << "'"
-              << " dest_geom='" << Fmi::OGR::exportToWkt(*rec.dest_geom) << "'" << '\n';
-          std::cout << msg.str() << std::flush;
-        }
+void bw::GeoServerDataIndex::process_granules(
+    const std::vector<GeoServerMosaicIndex::GranulePtr>& granules,
+    const std::string& layer,
+    int destCRS)
+{
+  try
+  {
+    std::map<int, bool> swap_cache;
+    std::map<int, TransformationPtr> transformations;
 
-        item.layers.push_back(rec);
+    for (const auto& granule : granules)
+    {
+      Item& item = data[granule->time];
+      item.epoch = granule->time;
+
+      LayerRec rec;
+      rec.name = granule->location;
+      rec.layer = layer;
+
+      rec.orig_coords = granule->boundary;
+      rec.orig_dim = granule->dim;
+      rec.orig_srs = granule->srid;
+      if (rec.orig_srs > 0 and swap_needed(rec.orig_srs, swap_cache))
+      {
+        swap_xy(rec.orig_coords, rec.orig_dim);
+        rec.orig_srs_swapped = true;
       }
-      catch (...)
+
+      rec.dest_coords = granule->boundary;
+      rec.dest_dim = granule->dim;
+      rec.dest_srs = destCRS;
+      if (granule->srid != destCRS)
       {
-        OGRGeometryFactory::destroyGeometry(geom);
-        throw Fmi::Exception::Trace(BCP, "Operation failed!");
+        auto pos = transformations.find(granule->srid);
+        if (pos == transformations.end())
+          pos = transformations
+                    .emplace(granule->srid, create_transformation(granule->srid, destCRS))
+                    .first;
+        transform_coords(*pos->second, rec.dest_coords, rec.dest_dim);
       }
+      if (swap_needed(rec.dest_srs, swap_cache))
+      {
+        swap_xy(rec.dest_coords, rec.dest_dim);
+        rec.dest_srs_swapped = true;
+      }
+
+      rec.data_map = granule->attributes;
+
+      item.layers.push_back(std::move(rec));
     }
   }
   catch (...)
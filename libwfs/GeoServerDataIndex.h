@@ -1,6 +1,7 @@
 #pragma once
 
 #include "GeoServerDB.h"
+#include "GeoServerMosaicIndex.h"
 
 #include <engines/gis/GdalUtils.h>
 #include <spine/Value.h>
@@ -12,6 +13,7 @@
 #include <boost/function.hpp>
 #include <boost/variant.hpp>
 
+#include <map>
 #include <string>
 #include <vector>
 
@@ -24,12 +26,20 @@ namespace WFS
 class GeoServerDataIndex
 {
  public:
+  /**
+   *   @brief Data of one mosaic granule
+   *
+   *   Boundaries are stored as interleaved coordinates (dimension given by
+   *   orig_dim and dest_dim). Records are move-only to avoid copying them.
+   */
   struct LayerRec
   {
     std::string name;
     std::string layer;
-    OGRLineString* orig_geom;
-    OGRLineString* dest_geom;
+    std::vector<double> orig_coords;
+    std::vector<double> dest_coords;
+    int orig_dim;
+    int dest_dim;
     int orig_srs;
     int dest_srs;
     bool orig_srs_swapped;
@@ -38,12 +48,13 @@ class GeoServerDataIndex
 
    public:
     LayerRec();
-    LayerRec(const LayerRec& rec);
-    virtual ~LayerRec();
-    LayerRec& operator=(const LayerRec& rec);
-    void clear();
-    std::vector<double> get_orig_coords() const;
-    std::vector<double> get_dest_coords() const;
+    LayerRec(const LayerRec& rec) = delete;
+    LayerRec(LayerRec&& rec) = default;
+    LayerRec& operator=(const LayerRec& rec) = delete;
+    LayerRec& operator=(LayerRec&& rec) = default;
+    inline const std::vector<double>& get_orig_coords() const { return orig_coords; }
+    inline const std::vector<double>& get_dest_coords() const { return dest_coords; }
+    OGREnvelope get_orig_envelope() const;
   };
 
   struct Item
@@ -88,16 +99,44 @@ class GeoServerDataIndex
   inline void set_debug_level(int debug_level) { this->debug_level = debug_level; }
 
  private:
-  std::string create_sql_request(const boost::posix_time::ptime& begin,
-                                 const boost::posix_time::ptime& end,
-                                 const std::string& layer,
-                                 const double* boundingBox,
-                                 int boundingBoxCRS,
-                                 int destCRS = 4326);
+  /**
+   *   @brief Create the parametrized SQL statement for querying a table
+   *
+   *   The same statement text is used for all requests of the table, so it can
+   *   be prepared once per connection.
+   */
+  std::string create_sql_request(const std::string& table_name) const;
+
+  /**
+   *   @brief Run the query of one layer using a connection from the pool
+   *
+   *   Does not modify the index, so several layers can be queried concurrently.
+   */
+  pqxx::result execute_sql_request(const boost::posix_time::ptime& begin,
+                                   const boost::posix_time::ptime& end,
+                                   const std::string& layer,
+                                   const double* boundingBox,
+                                   int boundingBoxCRS,
+                                   int destCRS) const;
+
+  /**
+   *   @brief Select the granules of a layer from the in-memory mirror of its table
+   *
+   *   Returns false if the table is not mirrored or the mirror does not cover the
+   *   requested period.
+   */
+  bool select_from_mirror(const boost::posix_time::ptime& begin,
+                          const boost::posix_time::ptime& end,
+                          const std::string& layer,
+                          const double* boundingBox,
+                          int boundingBoxCRS,
+                          std::vector<GeoServerMosaicIndex::GranulePtr>& granules) const;
 
-  static std::string create_geometry_str(const double* boundingBox, int boundingBoxCRS);
+  void process_sql_result(pqxx::result& result, const std::string& layer, int destCRS);
 
-  void process_sql_result(pqxx::result& result, const std::string& layers);
+  void process_granules(const std::vector<GeoServerMosaicIndex::GranulePtr>& granules,
+                        const std::string& layer,
+                        int destCRS);
 
  private:
   GeoServerDB& db;
@@ -0,0 +1,273 @@
+#include "GeoServerMosaicIndex.h"
+#include "GeoServerDB.h"
+#include <boost/date_time/posix_time/posix_time.hpp>
+#include <macgyver/Exception.h>
+#include <macgyver/StringConversion.h>
+#include <algorithm>
+#include <sstream>
+
+namespace bw = SmartMet::Plugin::WFS;
+namespace pt = boost::posix_time;
+
+namespace
+{
+// Period of full reloads noticing removed and modified rows
+const pt::time_duration reload_interval = pt::hours(1);
+
+void append_coords(const OGRLineString& line, std::vector<double>& coords, int& dim)
+{
+  const int num_points = line.getNumPoints();
+  dim = line.getCoordinateDimension();
+  coords.reserve(num_points * dim);
+  for (int i = 0; i < num_points; i++)
+  {
+    coords.push_back(line.getX(i));
+    if (dim > 1)
+    {
+      coords.push_back(line.getY(i));
+      if (dim > 2)
+        coords.push_back(line.getZ(i));
+    }
+  }
+}
+
+const OGRPolygon* get_polygon(const OGRGeometry& geom)
+{
+  const auto* polygon = dynamic_cast<const OGRPolygon*>(&geom);
+  if (polygon == nullptr)
+  {
+    const auto* multi = dynamic_cast<const OGRMultiPolygon*>(&geom);
+    if (multi != nullptr and multi->getNumGeometries() == 1)
+      polygon = dynamic_cast<const OGRPolygon*>(multi->getGeometryRef(0));
+  }
+  return polygon;
+}
+}  // namespace
+
+bw::GeoServerMosaicIndex::GeoServerMosaicIndex(GeoServerDB& db,
+                                               const std::string& table_name,
+                                               int hours,
+                                               int update_interval)
+    : db(db), table_name(table_name), hours(hours), update_interval(update_interval)
+{
+}
+
+bw::GeoServerMosaicIndex::~GeoServerMosaicIndex() {}
+
+void bw::GeoServerMosaicIndex::update()
+{
+  try
+  {
+    std::unique_lock<std::mutex> lock(update_mutex, std::try_to_lock);
+    if (not lock.owns_lock())
+    {
+      if (get_snapshot())
+        return;
+      lock.lock();
+    }
+
+    const pt::ptime now = pt::second_clock::universal_time();
+    auto current = get_snapshot();
+    if (current and now < last_update + pt::seconds(update_interval))
+      return;
+
+    auto next = std::make_shared<Snapshot>();
+    next->start = now - pt::hours(hours);
+
+    try
+    {
+      if (not current or now >= last_reload + reload_interval)
+      {
+        next->granules = fetch(next->start);
+        last_reload = now;
+      }
+      else
+      {
+        // Rows of the latest time already seen are fetched again, as more of them may
+        // have been added after the previous update.
+        auto new_granules = fetch(current->last_time);
+        for (const auto& granule : current->granules)
+          if (granule->time >= next->start and granule->time < current->last_time)
+            next->granules.push_back(granule);
+        next->granules.insert(next->granules.end(), new_granules.begin(), new_granules.end());
+      }
+    }
+    catch (...)
+    {
+      if (not current)
+        throw;
+
+      // Keep using the old snapshot and try again after the update interval
+      Fmi::Exception exception(BCP, "Failed to update GeoServer mosaic index mirror", nullptr);
+      exception.addParameter("Table", table_name);
+      exception.printError();
+      last_update = now;
+      return;
+    }
+
+    next->last_time = next->start;
+    next->srid = current ? current->srid : -1;
+    for (const auto& granule : next->granules)
+    {
+      next->last_time = std::max(next->last_time, granule->time);
+      next->srid = granule->srid;
+    }
+
+    {
+      std::lock_guard<std::mutex> snapshot_lock(snapshot_mutex);
+      snapshot = next;
+    }
+    last_update = now;
+  }
+  catch (...)
+  {
+    Fmi::Exception exception(BCP, "Operation failed!");
+    exception.addParameter("Table", table_name);
+    throw exception;
+  }
+}
+
+bool bw::GeoServerMosaicIndex::covers(const pt::ptime& begin) const
+{
+  auto current = get_snapshot();
+  return current and begin >= current->start;
+}
+
+std::vector<bw::GeoServerMosaicIndex::GranulePtr> bw::GeoServerMosaicIndex::select(
+    const pt::ptime& begin, const pt::ptime& end, const OGRGeometry& area) const
+{
+  try
+  {
+    std::vector<GranulePtr> result;
+    auto current = get_snapshot();
+    if (not current)
+      return result;
+
+    OGREnvelope area_envelope;
+    area.getEnvelope(&area_envelope);
+
+    const auto& granules = current->granules;
+    auto it = std::lower_bound(granules.begin(),
+                               granules.end(),
+                               begin,
+                               [](const GranulePtr& granule, const pt::ptime& t)
+                               { return granule->time < t; });
+    for (; it != granules.end() and (*it)->time <= end; ++it)
+    {
+      const auto& granule = **it;
+      if (granule.envelope.Intersects(area_envelope) and granule.footprint->Intersects(&area))
+        result.push_back(*it);
+    }
+
+    // The same order as from the database (latest first)
+    std::reverse(result.begin(), result.end());
+    return result;
+  }
+  catch (...)
+  {
+    throw Fmi::Exception::Trace(BCP, "Operation failed!");
+  }
+}
+
+int bw::GeoServerMosaicIndex::get_srid() const
+{
+  auto current = get_snapshot();
+  return current ? current->srid : -1;
+}
+
+std::shared_ptr<const bw::GeoServerMosaicIndex::Snapshot> bw::GeoServerMosaicIndex::get_snapshot()
+    const
+{
+  std::lock_guard<std::mutex> lock(snapshot_mutex);
+  return snapshot;
+}
+
+std::vector<bw::GeoServerMosaicIndex::GranulePtr> bw::GeoServerMosaicIndex::fetch(
+    const pt::ptime& from) const
+{
+  try
+  {
+    std::ostringstream q_columns;
+    for (const auto& name : db.get_column_names(table_name))
+      if (name != "the_geom")
+        q_columns << "    ,t.\"" << name << "\"\n";
+
+    boost::shared_ptr<pqxx::connection> conn = db.get_conn();
+    pqxx::work work(*conn);
+
+    std::ostringstream sql;
+    sql << "SELECT\n"
+        << "    t.time\n"
+        << "    ,t.location\n"
+        << "    ,ST_AsBinary(t.the_geom)\n"
+        << "    ,ST_SRID(t.the_geom)\n"
+        << q_columns.str() << "FROM\n"
+        << "    " << table_name << " AS t\n"
+        << "WHERE\n"
+        << "    t.time >= " << work.quote(Fmi::to_iso_extended_string(from) + "Z") << "\n"
+        << "ORDER BY t.time ASC\n";
+
+    pqxx::result result = work.exec(sql.str());
+    work.commit();
+
+    const unsigned col_begin = 4;
+    std::map<unsigned, std::string> col_names;
+    for (unsigned i = col_begin; i < result.columns(); i++)
+      col_names[i] = result.column_name(i);
+
+    std::vector<GranulePtr> granules;
+    granules.reserve(result.size());
+    for (auto row = result.begin(); row != result.end(); ++row)
+      granules.push_back(create_granule(*row, col_names));
+    return granules;
+  }
+  catch (...)
+  {
+    throw Fmi::Exception::Trace(BCP, "Operation failed!");
+  }
+}
+
+bw::GeoServerMosaicIndex::GranulePtr bw::GeoServerMosaicIndex::create_granule(
+    const pqxx::row& row, const std::map<unsigned, std::string>& col_names)
+{
+  try
+  {
+    auto granule = std::make_shared<Granule>();
+    granule->time = pt::time_from_string(row[0].as<std::string>());
+    granule->location = row[1].as<std::string>();
+    granule->srid = row[3].is_null() ? -1 : row[3].as<int>();
+
+    const pqxx::binarystring wkb(row[2]);
+    OGRGeometry* geom = nullptr;
+    if (OGRGeometryFactory::createFromWkb(wkb.data(), nullptr, &geom, wkb.size()) !=
+            OGRERR_NONE or
+        geom == nullptr)
+    {
+      throw Fmi::Exception(BCP, "Failed to parse WKB geometry");
+    }
+    granule->footprint.reset(geom, &OGRGeometryFactory::destroyGeometry);
+    geom->getEnvelope(&granule->envelope);
+
+    const OGRPolygon* polygon = get_polygon(*geom);
+    if (polygon == nullptr or polygon->getExteriorRing() == nullptr)
+    {
+      Fmi::Exception exception(BCP, "Unexpected footprint geometry type");
+      exception.addParameter("Type", geom->getGeometryName());
+      throw exception;
+    }
+    append_coords(*polygon->getExteriorRing(), granule->boundary, granule->dim);
+
+    for (const auto& item : col_names)
+    {
+      const auto& value = row[item.first];
+      if (not value.is_null())
+        granule->attributes[item.second] = SmartMet::Spine::Value(value.as<std::string>());
+    }
+
+    return granule;
+  }
+  catch (...)
+  {
+    throw Fmi::Exception::Trace(BCP, "Operation failed!");
+  }
+}
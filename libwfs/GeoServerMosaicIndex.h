@@ -0,0 +1,128 @@
+#pragma once
+
+#include <pqxx/pqxx>
+#include <boost/date_time/posix_time/ptime.hpp>
+#include <boost/noncopyable.hpp>
+#include <spine/Value.h>
+#include <ogr_geometry.h>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+namespace SmartMet
+{
+namespace Plugin
+{
+namespace WFS
+{
+class GeoServerDB;
+
+/**
+ *   @brief In-memory mirror of the recent part of a GeoServer mosaic index table
+ *
+ *   Keeps the granules (time, location, footprint and the other columns) of the
+ *   last @b hours hours ordered by time. The table is loaded on first use. Later
+ *   calls of update() fetch only the rows which are not older than the latest one
+ *   already seen, and reload the whole period once an hour to notice removed rows.
+ *
+ *   Requests select granules from an immutable snapshot, so they do not need to
+ *   access the database once the mirror has been loaded.
+ */
+class GeoServerMosaicIndex : private boost::noncopyable
+{
+ public:
+  struct Granule
+  {
+    boost::posix_time::ptime time;
+    std::string location;
+    int srid;
+
+    /**
+     *   @brief Footprint of the granule in the SRID of the table
+     */
+    std::shared_ptr<OGRGeometry> footprint;
+    OGREnvelope envelope;
+
+    /**
+     *   @brief Exterior boundary of the footprint as interleaved coordinates
+     */
+    std::vector<double> boundary;
+    int dim;
+
+    /**
+     *   @brief The other non-null columns of the table (including time and location)
+     */
+    std::map<std::string, SmartMet::Spine::Value> attributes;
+  };
+
+  typedef std::shared_ptr<const Granule> GranulePtr;
+
+  GeoServerMosaicIndex(GeoServerDB& db,
+                       const std::string& table_name,
+                       int hours,
+                       int update_interval);
+
+  virtual ~GeoServerMosaicIndex();
+
+  /**
+   *   @brief Fetch new rows from the database if the update interval has passed
+   *
+   *   Only the first call waits for another thread already doing an update.
+   *   Later calls use the current snapshot instead.
+   */
+  void update();
+
+  /**
+   *   @brief Check whether the mirrored period contains the time range starting at begin
+   */
+  bool covers(const boost::posix_time::ptime& begin) const;
+
+  /**
+   *   @brief Select granules of the time range intersecting the area
+   *
+   *   The area must be given in the SRID of the table (see get_srid()).
+   */
+  std::vector<GranulePtr> select(const boost::posix_time::ptime& begin,
+                                 const boost::posix_time::ptime& end,
+                                 const OGRGeometry& area) const;
+
+  /**
+   *   @brief Get the SRID of the table (-1 if the mirror is empty)
+   */
+  int get_srid() const;
+
+ private:
+  struct Snapshot
+  {
+    boost::posix_time::ptime start;
+    boost::posix_time::ptime last_time;
+    int srid;
+    std::vector<GranulePtr> granules;
+  };
+
+  std::shared_ptr<const Snapshot> get_snapshot() const;
+
+  std::vector<GranulePtr> fetch(const boost::posix_time::ptime& from) const;
+
+  static GranulePtr create_granule(const pqxx::row& row,
+                                   const std::map<unsigned, std::string>& col_names);
+
+ private:
+  GeoServerDB& db;
+  const std::string table_name;
+  const int hours;
+  const int update_interval;
+
+  mutable std::mutex snapshot_mutex;
+  std::shared_ptr<const Snapshot> snapshot;
+  boost::posix_time::ptime last_update;
+  boost::posix_time::ptime last_reload;
+
+  std::mutex update_mutex;
+};
+
+}  // namespace WFS
+}  // namespace Plugin
+}  // namespace SmartMet
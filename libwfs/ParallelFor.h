@@ -0,0 +1,65 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <exception>
+#include <future>
+#include <vector>
+
+namespace SmartMet
+{
+namespace Plugin
+{
+namespace WFS
+{
+/**
+ *   @brief Call task(i) for i = 0 ... num_tasks - 1 using at most max_threads threads
+ *
+ *   The calling thread is one of the workers, so max_threads = 1 runs the tasks
+ *   sequentially in the calling thread. Tasks must write their results into
+ *   separate locations (for example into their own element of a pre-sized vector).
+ *
+ *   All tasks are run even if some of them fail. The exception of the failed task
+ *   with the smallest index is rethrown afterwards, so that the outcome does not
+ *   depend on thread scheduling.
+ */
+template <typename Task>
+void parallel_for(std::size_t num_tasks, std::size_t max_threads, Task task)
+{
+  std::vector<std::exception_ptr> errors(num_tasks);
+  std::atomic<std::size_t> next(0);
+
+  const auto worker = [&]() {
+    for (std::size_t i = next++; i < num_tasks; i = next++)
+    {
+      try
+      {
+        task(i);
+      }
+      catch (...)
+      {
+        errors[i] = std::current_exception();
+      }
+    }
+  };
+
+  const std::size_t num_threads = std::min(std::max<std::size_t>(max_threads, 1), num_tasks);
+  {
+    // Futures returned by std::async block in destructor until the worker is done
+    std::vector<std::future<void> > workers;
+    for (std::size_t i = 1; i < num_threads; i++)
+      workers.emplace_back(std::async(std::launch::async, worker));
+    worker();
+    for (auto& item : workers)
+      item.get();
+  }
+
+  for (const auto& error : errors)
+    if (error)
+      std::rethrow_exception(error);
+}
+
+}  // namespace WFS
+}  // namespace Plugin
+}  // namespace SmartMet
@@ -21,6 +21,7 @@
 #include <spine/CRSRegistry.h>
 #include <macgyver/Exception.h>
 #include <spine/FmiApiKey.h>
+#include <algorithm>
 
 using namespace SmartMet::Plugin::WFS;
 namespace ba = boost::algorithm;
@@ -31,6 +32,7 @@ struct PluginImpl::RequestResult
 {
   SmartMet::Spine::HTTP::Status status;
   bool may_validate_xml;
+  boost::optional<std::string> content_type;
   std::ostringstream output;
   boost::optional<int> expires_seconds;
 
@@ -59,6 +61,9 @@ PluginImpl::PluginImpl(
     query_cache.reset(new QueryResponseCache(
         itsConfig.getCacheSize(), std::chrono::seconds(itsConfig.getCacheTimeConstant())));
 
+    contour_cache.reset(
+        new ContourCache(std::max(itsConfig.getContourCacheSize(), 0) * std::size_t(1024 * 1024)));
+
     request_factory.reset(new RequestFactory(*this));
 
     request_factory
@@ -292,7 +297,10 @@ void PluginImpl::init_geo_server_access()
       const std::string geoserver_conn_str = itsConfig.get_geoserver_conn_string();
       if (geoserver_conn_str != "")
       {
-        geo_server_db.reset(new GeoServerDB(itsConfig.get_geoserver_conn_string(), 5));
+        geo_server_db.reset(new GeoServerDB(itsConfig.get_geoserver_conn_string(),
+                                            5,
+                                            itsConfig.getGeoserverMirrorHours(),
+                                            itsConfig.getGeoserverMirrorUpdateInterval()));
       }
     }
     catch (...)
@@ -562,6 +570,7 @@ void PluginImpl::query(const std::string& req_language,
         request->set_fmi_apikey(*fmi_apikey);
       }
       result.may_validate_xml = request->may_validate_xml();
+      result.content_type = request->get_content_type();
       request->execute(result.output);
       result.expires_seconds = request->get_response_expires_seconds();
       if (request->get_http_status())
@@ -585,6 +594,7 @@ void PluginImpl::query(const std::string& req_language,
           request->set_fmi_apikey(*fmi_apikey);
         }
         result.may_validate_xml = request->may_validate_xml();
+        result.content_type = request->get_content_type();
         request->execute(result.output);
         result.expires_seconds = request->get_response_expires_seconds();
         if (request->get_http_status())
@@ -684,6 +694,7 @@ void PluginImpl::query(const std::string& req_language,
           request->set_fmi_apikey(*fmi_apikey);
         }
         result.may_validate_xml = request->may_validate_xml();
+        result.content_type = request->get_content_type();
         request->execute(result.output);
         result.expires_seconds = request->get_response_expires_seconds();
         if (request->get_http_status())
@@ -764,7 +775,10 @@ void PluginImpl::realRequestHandler(SmartMet::Spine::Reactor& /* theReactor */,
 
       // std::string mime = "text/xml; charset=UTF-8";
       const std::string mime =
-          content.substr(0, 6) == "<html>" ? "text/html; charset=UTF-8" : "text/xml; charset=UTF-8";
+          result.content_type
+              ? *result.content_type
+              : (content.substr(0, 6) == "<html>" ? "text/html; charset=UTF-8"
+                                                  : "text/xml; charset=UTF-8");
       theResponse.setHeader("Content-Type", mime.c_str());
 
       if (theResponse.getContentLength() == 0)
@@ -2,6 +2,7 @@
 #pragma once
 
 #include "Config.h"
+#include "ContourCache.h"
 #include "GeoServerDB.h"
 #include "RequestBase.h"
 #include "RequestFactory.h"
@@ -91,6 +92,8 @@ class PluginImpl : public boost::noncopyable
 
   inline QueryResponseCache& get_query_cache() { return *query_cache; }
 
+  inline ContourCache& get_contour_cache() const { return *contour_cache; }
+
   inline boost::shared_ptr<Fmi::TemplateFormatter> get_get_capabilities_formater() const
   {
     return itsTemplateFactory.get(getCapabilitiesFormatterPath);
@@ -200,6 +203,8 @@ class PluginImpl : public boost::noncopyable
 
   std::unique_ptr<QueryResponseCache> query_cache;
 
+  std::unique_ptr<ContourCache> contour_cache;
+
   /**
    *   @brief An object that reads actual requests and creates request objects
    */
@@ -128,6 +128,11 @@ bool bw::RequestBase::may_validate_xml() const
   return true;
 }
 
+boost::optional<std::string> bw::RequestBase::get_content_type() const
+{
+  return boost::optional<std::string>();
+}
+
 void bw::RequestBase::set_fmi_apikey(const std::string& fmi_apikey)
 {
   this->fmi_apikey = fmi_apikey;
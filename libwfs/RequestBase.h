@@ -103,6 +103,14 @@ class RequestBase
    */
   virtual bool may_validate_xml() const;
 
+  /**
+   *   @brief Returns MIME type of the response when it is not XML
+   *
+   *   The default value (not set) means that the response type is detected
+   *   from the response content (XML or HTML).
+   */
+  virtual boost::optional<std::string> get_content_type() const;
+
   virtual void set_fmi_apikey(const std::string& fmi_apikey);
 
   virtual void set_fmi_apikey_prefix(const std::string& fmi_apikey_prefix);
@@ -19,11 +19,21 @@ const char* bw::StandardPresentationParameters::DEFAULT_OUTPUT_FORMAT =
 
 const char* bw::StandardPresentationParameters::DEBUG_OUTPUT_FORMAT = "debug";
 
+const char* bw::StandardPresentationParameters::GEOJSON_OUTPUT_FORMAT = "application/geo+json";
+
+const char* bw::StandardPresentationParameters::ARROW_OUTPUT_FORMAT =
+    "application/vnd.apache.arrow.stream";
+
+const char* bw::StandardPresentationParameters::CSV_OUTPUT_FORMAT = "text/csv";
+
 std::vector<std::string> SUPPORTED_FORMATS = {
     "text/xml; subtype=gml/3.2",
     "text/xml; version=3.2",
     "application/gml+xml; subtype=gml/3.2",
-    bw::StandardPresentationParameters::DEFAULT_OUTPUT_FORMAT};
+    bw::StandardPresentationParameters::DEFAULT_OUTPUT_FORMAT,
+    bw::StandardPresentationParameters::GEOJSON_OUTPUT_FORMAT,
+    bw::StandardPresentationParameters::ARROW_OUTPUT_FORMAT,
+    bw::StandardPresentationParameters::CSV_OUTPUT_FORMAT};
 
 bw::StandardPresentationParameters::StandardPresentationParameters()
     : have_counts(false),
@@ -36,6 +46,15 @@ bw::StandardPresentationParameters::StandardPresentationParameters()
 
 bw::StandardPresentationParameters::~StandardPresentationParameters() {}
 
+bool bw::StandardPresentationParameters::is_xml_format(const std::string& format)
+{
+  return (format == DEBUG_OUTPUT_FORMAT) or
+         ((format != GEOJSON_OUTPUT_FORMAT) and (format != ARROW_OUTPUT_FORMAT) and
+          (format != CSV_OUTPUT_FORMAT) and
+          (std::find(SUPPORTED_FORMATS.cbegin(), SUPPORTED_FORMATS.cend(), format) !=
+           SUPPORTED_FORMATS.cend()));
+}
+
 void bw::StandardPresentationParameters::read_from_kvp(
     const SmartMet::Spine::HTTP::Request& request)
 {
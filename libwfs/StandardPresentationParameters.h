@@ -26,11 +26,19 @@ class StandardPresentationParameters
 
   static const char* DEFAULT_OUTPUT_FORMAT;
   static const char* DEBUG_OUTPUT_FORMAT;
+  static const char* GEOJSON_OUTPUT_FORMAT;
+  static const char* ARROW_OUTPUT_FORMAT;
+  static const char* CSV_OUTPUT_FORMAT;
 
  public:
   StandardPresentationParameters();
   virtual ~StandardPresentationParameters();
 
+  /**
+   *   @brief Check whether the output format is one of GML formats (including debug format)
+   */
+  static bool is_xml_format(const std::string& format);
+
   void read_from_kvp(const SmartMet::Spine::HTTP::Request& http_request);
   void read_from_xml(const xercesc::DOMElement& element);
 
@@ -40,6 +48,9 @@ class StandardPresentationParameters
   inline std::string get_output_format() const { return output_format; }
   inline SPPResultType get_result_type() const { return result_type; }
   inline bool is_hits_only_request() const { return result_type == SPP_HITS; }
+  inline bool is_geojson_format() const { return output_format == GEOJSON_OUTPUT_FORMAT; }
+  inline bool is_arrow_format() const { return output_format == ARROW_OUTPUT_FORMAT; }
+  inline bool is_csv_format() const { return output_format == CSV_OUTPUT_FORMAT; }
 
  private:
   void set_output_format(const std::string& str);
@@ -24,9 +24,18 @@ static void check_param_min_occurs(int actual_count,
                                    const std::string& location,
                                    const std::string& param_name);
 
+static void check_output_format(const bw::StoredQueryHandlerBase& handler,
+                                const std::string& query_id,
+                                const std::string& output_format);
+
 bwx::ParameterExtractor bw::StoredQuery::param_extractor;
 
-bw::StoredQuery::StoredQuery() : handler(), debug_format(false) {}
+bw::StoredQuery::StoredQuery()
+    : handler(),
+      debug_format(false),
+      output_format(StandardPresentationParameters::DEFAULT_OUTPUT_FORMAT)
+{
+}
 
 bw::StoredQuery::~StoredQuery() {}
 
@@ -96,6 +105,8 @@ boost::shared_ptr<bw::StoredQuery> bw::StoredQuery::create_from_kvp(
 
     query->id = query_id;
     query->debug_format = spp.get_output_format() == "debug";
+    query->output_format = spp.get_output_format();
+    check_output_format(*query->handler, query_id, query->output_format);
     // We do not need query sequence number here
 
     bw::FeatureID feature_id(query_id, query->params->get_map(), 0);
@@ -103,6 +114,8 @@ boost::shared_ptr<bw::StoredQuery> bw::StoredQuery::create_from_kvp(
     feature_id.add_param("language", language);
     if (query->debug_format)
       feature_id.add_param("debugFormat", 1);
+    if (not StandardPresentationParameters::is_xml_format(query->output_format))
+      feature_id.add_param("outputFormat", query->output_format);
     query->cache_key = feature_id.get_id();
     query->set_stale_seconds(query->handler->get_config()->get_expires_seconds());
 
@@ -170,12 +183,16 @@ boost::shared_ptr<bw::StoredQuery> bw::StoredQuery::create_from_xml(
 
     query->id = query_id;
     query->debug_format = spp.get_output_format() == "debug";
+    query->output_format = spp.get_output_format();
+    check_output_format(*query->handler, query_id, query->output_format);
 
     bw::FeatureID feature_id(query_id, query->params->get_map(), 0);
     feature_id.add_param("source", query->handler->get_data_source());
     feature_id.add_param("language", language);
     if (query->debug_format)
       feature_id.add_param("debugFormat", 1);
+    if (not StandardPresentationParameters::is_xml_format(query->output_format))
+      feature_id.add_param("outputFormat", query->output_format);
     query->cache_key = feature_id.get_id();
     query->set_stale_seconds(query->handler->get_config()->get_expires_seconds());
 
@@ -207,12 +224,15 @@ boost::shared_ptr<bw::StoredQuery> bw::StoredQuery::create_from_feature_id(
 
     query->language = orig_query.language;
     query->debug_format = orig_query.debug_format;
+    query->output_format = orig_query.output_format;
 
     bw::FeatureID cache_feature_id(query_id, query->params->get_map(), 0);
     cache_feature_id.add_param("source", query->handler->get_data_source());
     cache_feature_id.add_param("language", query->language);
     if (query->debug_format)
       cache_feature_id.add_param("debugFormat", 1);
+    if (not StandardPresentationParameters::is_xml_format(query->output_format))
+      cache_feature_id.add_param("outputFormat", query->output_format);
     query->cache_key = cache_feature_id.get_id();
     query->set_stale_seconds(query->handler->get_config()->get_expires_seconds());
 
@@ -681,3 +701,17 @@ std::ostream& bw::operator<<(
     throw Fmi::Exception::Trace(BCP, "Operation failed!");
   }
 }
+
+void check_output_format(const bw::StoredQueryHandlerBase& handler,
+                         const std::string& query_id,
+                         const std::string& output_format)
+{
+  if (not handler.supports_output_format(output_format))
+  {
+    Fmi::Exception exception(BCP,
+                             "Output format '" + output_format +
+                                 "' is not supported by the stored query '" + query_id + "'!");
+    exception.addParameter(WFS_EXCEPTION_CODE, WFS_OPERATION_PARSING_FAILED);
+    throw exception.disableStackTrace();
+  }
+}
@@ -78,6 +78,19 @@ class StoredQuery : public QueryBase
   virtual std::string get_cache_key() const;
 
   bool get_use_debug_format() const { return debug_format; }
+  const std::string& get_output_format() const { return output_format; }
+  bool get_use_geojson_format() const
+  {
+    return output_format == StandardPresentationParameters::GEOJSON_OUTPUT_FORMAT;
+  }
+  bool get_use_arrow_format() const
+  {
+    return output_format == StandardPresentationParameters::ARROW_OUTPUT_FORMAT;
+  }
+  bool get_use_csv_format() const
+  {
+    return output_format == StandardPresentationParameters::CSV_OUTPUT_FORMAT;
+  }
   virtual void execute(std::ostream& output, const std::string& language, const boost::optional<std::string>& hostname) const;
 
   const SmartMet::Spine::Value& get_param(const std::string& name) const;
@@ -153,6 +166,7 @@ class StoredQuery : public QueryBase
   std::vector<std::string> skipped_params;
   boost::shared_ptr<const SmartMet::Plugin::WFS::StoredQueryHandlerBase> handler;
   bool debug_format;
+  std::string output_format;
 
   static SmartMet::Plugin::WFS::Xml::ParameterExtractor param_extractor;
 };
@@ -1,8 +1,8 @@
 #include "StoredQueryHandlerBase.h"
+#include "CoordinateTransformationCache.h"
 #include "WfsException.h"
 #include <boost/algorithm/string.hpp>
 #include <boost/foreach.hpp>
-#include <fmt/format.h>
 #include <macgyver/TypeName.h>
 #include <newbase/NFmiPoint.h>
 #include <spine/Convenience.h>
@@ -147,6 +147,11 @@ bool StoredQueryHandlerBase::redirect(const StoredQuery& query,
   }
 }
 
+bool StoredQueryHandlerBase::supports_output_format(const std::string& format) const
+{
+  return StandardPresentationParameters::is_xml_format(format);
+}
+
 const StoredQueryMap& StoredQueryHandlerBase::get_stored_query_map() const
 {
   try
@@ -218,11 +223,7 @@ std::pair<std::string, std::string> StoredQueryHandlerBase::get_2D_coord(
   {
     NFmiPoint p1(X, Y);
     NFmiPoint p2 = transformation->transform(p1);
-    double w1 = std::max(std::fabs(p2.X()), std::fabs(p2.Y()));
-    int prec = w1 < 1000 ? 5 : std::max(0, 7 - static_cast<int>(std::floor(log10(w1))));
-    auto str_x = fmt::format("{:.{}f}", p2.X(), prec);
-    auto str_y = fmt::format("{:.{}f}", p2.Y(), prec);
-    return {str_x, str_y};
+    return CoordinateTransformationCache::format_2D_coord(p2);
   }
   catch (...)
   {
@@ -264,6 +265,23 @@ void StoredQueryHandlerBase::set_2D_coord(
   }
 }
 
+void StoredQueryHandlerBase::set_2D_coord(CoordinateTransformationCache& transformation,
+                                          double sx,
+                                          double sy,
+                                          CTPP::CDT& hash)
+{
+  try
+  {
+    const auto& xy = transformation.get_2D_coord(sx, sy);
+    hash["x"] = xy.first;
+    hash["y"] = xy.second;
+  }
+  catch (...)
+  {
+    throw Fmi::Exception::Trace(BCP, "Operation failed!");
+  }
+}
+
 const std::string& StoredQueryHandlerBase::get_data_source() const
 {
   return get_plugin_impl().get_data_source();
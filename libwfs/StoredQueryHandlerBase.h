@@ -1,5 +1,6 @@
 #pragma once
 
+#include "CoordinateTransformationCache.h"
 #include "PluginImpl.h"
 #include "StandardPresentationParameters.h"
 #include "StoredQuery.h"
@@ -92,6 +93,13 @@ class StoredQueryHandlerBase : virtual protected SupportsExtraHandlerParams,
    */
   virtual bool redirect(const StoredQuery& query, std::string& new_stored_query_id) const;
 
+  /**
+   *   @brief Check whether the handler is able to generate the response in the requested format
+   *
+   *   The base class only supports GML (and debug) output formats.
+   */
+  virtual bool supports_output_format(const std::string& format) const;
+
   inline boost::shared_ptr<const StoredQueryConfig> get_config() const { return config; }
   const StoredQueryMap& get_stored_query_map() const;
 
@@ -129,6 +137,14 @@ class StoredQueryHandlerBase : virtual protected SupportsExtraHandlerParams,
       const std::string& X,
       const std::string& Y,
       CTPP::CDT& hash);
+
+  /**
+   *   @brief Set transformed coordinates using per request transformation cache
+   */
+  static void set_2D_coord(CoordinateTransformationCache& transformation,
+                           double X,
+                           double Y,
+                           CTPP::CDT& hash);
 };
 
 }  // namespace WFS
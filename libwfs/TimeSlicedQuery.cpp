@@ -0,0 +1,117 @@
+#include "TimeSlicedQuery.h"
+#include "ParallelFor.h"
+#include <macgyver/Exception.h>
+#include <algorithm>
+
+namespace bw = SmartMet::Plugin::WFS;
+namespace pt = boost::posix_time;
+namespace ts = SmartMet::Spine::TimeSeries;
+
+std::vector<bw::TimeSlice> bw::make_time_slices(const pt::ptime& begin,
+                                                const pt::ptime& end,
+                                                const pt::time_duration& slice_length)
+{
+  try
+  {
+    std::vector<TimeSlice> slices;
+    if (slice_length <= pt::time_duration(0, 0, 0) or end <= begin + slice_length)
+    {
+      slices.push_back(TimeSlice{begin, end});
+      return slices;
+    }
+
+    for (pt::ptime t = begin; t < end; t += slice_length)
+      slices.push_back(TimeSlice{t, std::min(t + slice_length, end)});
+    return slices;
+  }
+  catch (...)
+  {
+    throw Fmi::Exception::Trace(BCP, "Operation failed!");
+  }
+}
+
+ts::TimeSeriesVectorPtr bw::merge_time_slices(const std::vector<TimeSlice>& slices,
+                                              const std::vector<ts::TimeSeriesVectorPtr>& results)
+{
+  try
+  {
+    if (slices.size() != results.size())
+      throw Fmi::Exception(BCP, "The number of time slices and query results do not match");
+
+    ts::TimeSeriesVectorPtr merged;
+    for (std::size_t i = 0; i < results.size(); i++)
+    {
+      const auto& result = results[i];
+      if (not result or result->empty())
+        continue;
+
+      if (not merged)
+      {
+        merged.reset(new ts::TimeSeriesVector(result->size()));
+      }
+      else if (merged->size() != result->size())
+      {
+        Fmi::Exception exception(BCP, "Time slice query results have different columns");
+        exception.addParameter("Expected", std::to_string(merged->size()));
+        exception.addParameter("Actual", std::to_string(result->size()));
+        throw exception;
+      }
+
+      // Rows at the end of the slice are taken from the next slice instead
+      const bool last = (i + 1 == results.size());
+      const auto& times = result->front();
+      std::vector<std::size_t> rows;
+      rows.reserve(times.size());
+      for (std::size_t row = 0; row < times.size(); row++)
+        if (last or times[row].time.utc_time() < slices[i].end)
+          rows.push_back(row);
+
+      for (std::size_t k = 0; k < result->size(); k++)
+      {
+        const auto& src = result->at(k);
+        if (src.size() != times.size())
+          throw Fmi::Exception(BCP, "Time slice query result columns have different lengths");
+
+        auto& dest = merged->at(k);
+        dest.reserve(dest.size() + rows.size());
+        for (std::size_t row : rows)
+          dest.push_back(src[row]);
+      }
+    }
+
+    if (not merged)
+      merged.reset(new ts::TimeSeriesVector);
+    return merged;
+  }
+  catch (...)
+  {
+    throw Fmi::Exception::Trace(BCP, "Operation failed!");
+  }
+}
+
+ts::TimeSeriesVectorPtr bw::time_sliced_query(
+    const pt::ptime& begin,
+    const pt::ptime& end,
+    const pt::time_duration& slice_length,
+    std::size_t max_threads,
+    const std::function<ts::TimeSeriesVectorPtr(const pt::ptime& begin, const pt::ptime& end)>&
+        fetch)
+{
+  try
+  {
+    const auto slices = make_time_slices(begin, end, slice_length);
+    if (slices.size() == 1)
+      return fetch(begin, end);
+
+    std::vector<ts::TimeSeriesVectorPtr> results(slices.size());
+    parallel_for(slices.size(),
+                 max_threads,
+                 [&](std::size_t i) { results[i] = fetch(slices[i].begin, slices[i].end); });
+
+    return merge_time_slices(slices, results);
+  }
+  catch (...)
+  {
+    throw Fmi::Exception::Trace(BCP, "Operation failed!");
+  }
+}
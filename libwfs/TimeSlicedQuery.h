@@ -0,0 +1,63 @@
+#pragma once
+
+#include <boost/date_time/posix_time/posix_time_types.hpp>
+#include <spine/TimeSeries.h>
+#include <cstddef>
+#include <functional>
+#include <vector>
+
+namespace SmartMet
+{
+namespace Plugin
+{
+namespace WFS
+{
+struct TimeSlice
+{
+  boost::posix_time::ptime begin;
+  boost::posix_time::ptime end;
+};
+
+/**
+ *   @brief Split the time interval [begin, end] into slices of at most slice_length
+ *
+ *   Slice boundaries are at begin + N * slice_length. Consecutive slices share their
+ *   boundary time (the end of a slice is the begin of the next one), so that no data
+ *   between the whole seconds is lost. A single slice is returned if slice_length is
+ *   not positive or the interval is not longer than it.
+ */
+std::vector<TimeSlice> make_time_slices(const boost::posix_time::ptime& begin,
+                                        const boost::posix_time::ptime& end,
+                                        const boost::posix_time::time_duration& slice_length);
+
+/**
+ *   @brief Merge results of queries of the time slices into a single result
+ *
+ *   Columns are concatenated in slice order. Rows of all but the last slice are dropped
+ *   if their time is not before the end of the slice, as they are included in the
+ *   result of the next slice too. Empty results (without columns) are skipped.
+ */
+SmartMet::Spine::TimeSeries::TimeSeriesVectorPtr merge_time_slices(
+    const std::vector<TimeSlice>& slices,
+    const std::vector<SmartMet::Spine::TimeSeries::TimeSeriesVectorPtr>& results);
+
+/**
+ *   @brief Query the time interval [begin, end] slice by slice using at most max_threads threads
+ *
+ *   The fetch callback is called for each slice (see make_time_slices()) and must be
+ *   thread safe. The merged result contains the same rows as a single query of the whole
+ *   interval, provided that the rows of one query are ordered by time within each
+ *   station (or other entity) and that the caller does not depend on the order of rows
+ *   of different stations.
+ */
+SmartMet::Spine::TimeSeries::TimeSeriesVectorPtr time_sliced_query(
+    const boost::posix_time::ptime& begin,
+    const boost::posix_time::ptime& end,
+    const boost::posix_time::time_duration& slice_length,
+    std::size_t max_threads,
+    const std::function<SmartMet::Spine::TimeSeries::TimeSeriesVectorPtr(
+        const boost::posix_time::ptime& begin, const boost::posix_time::ptime& end)>& fetch);
+
+}  // namespace WFS
+}  // namespace Plugin
+}  // namespace SmartMet
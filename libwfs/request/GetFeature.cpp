@@ -1,6 +1,7 @@
 #include "request/GetFeature.h"
 #include "AdHocQuery.h"
 #include "ErrorResponseGenerator.h"
+#include "GeoJsonUtils.h"
 #include "StoredQuery.h"
 #include "StoredQueryMap.h"
 #include "TypeNameStoredQueryMap.h"
@@ -46,6 +47,18 @@ void bw::Request::GetFeature::execute(std::ostream& output) const
 {
   try
   {
+    if (spp.is_geojson_format())
+    {
+      execute_geojson_queries(output);
+      return;
+    }
+
+    if (spp.is_arrow_format() or spp.is_csv_format())
+    {
+      execute_tabular_query(output);
+      return;
+    }
+
     switch (queries.size())
     {
       case 0:
@@ -119,6 +132,107 @@ int bw::Request::GetFeature::get_response_expires_seconds() const
   }
 }
 
+bool bw::Request::GetFeature::may_validate_xml() const
+{
+  return StandardPresentationParameters::is_xml_format(spp.get_output_format());
+}
+
+boost::optional<std::string> bw::Request::GetFeature::get_content_type() const
+{
+  if (spp.is_geojson_format())
+    return std::string("application/geo+json; charset=UTF-8");
+  if (spp.is_arrow_format())
+    return std::string(StandardPresentationParameters::ARROW_OUTPUT_FORMAT);
+  if (spp.is_csv_format())
+    return std::string("text/csv; charset=UTF-8; header=present");
+  return boost::optional<std::string>();
+}
+
+void bw::Request::GetFeature::execute_geojson_queries(std::ostream& ost) const
+{
+  try
+  {
+    std::vector<std::string> query_responses;
+    collect_query_responses(query_responses, false);
+
+    Json::Value result = bw::GeoJson::create_feature_collection(plugin_impl.get_time_stamp());
+    for (const auto& response : query_responses)
+      bw::GeoJson::merge(result, bw::GeoJson::parse(response));
+
+    if (spp.is_hits_only_request())
+      bw::GeoJson::select_members(result, 0, 0);
+    else if (spp.get_have_counts())
+      bw::GeoJson::select_members(result, spp.get_start_index(), spp.get_count());
+
+    bw::GeoJson::write(result, ost);
+  }
+  catch (...)
+  {
+    throw Fmi::Exception::Trace(BCP, "Operation failed!");
+  }
+}
+
+void bw::Request::GetFeature::execute_tabular_query(std::ostream& ost) const
+{
+  try
+  {
+    // Tabular response: placeholder substitution of XML responses is not applicable
+    const auto& query = queries.at(0);
+    boost::optional<std::string> cached_response = query->get_cached_response();
+    if (cached_response)
+    {
+      ost << *cached_response;
+    }
+    else
+    {
+      std::ostringstream result_stream;
+      query->execute(result_stream, get_language(), get_hostname());
+      query_cache.insert(query->get_cache_key(), result_stream.str());
+      ost << result_stream.str();
+    }
+  }
+  catch (...)
+  {
+    throw Fmi::Exception::Trace(BCP, "Operation failed!");
+  }
+}
+
+void bw::Request::GetFeature::check_non_xml_queries() const
+{
+  try
+  {
+    if (StandardPresentationParameters::is_xml_format(spp.get_output_format()))
+      return;
+
+    if ((spp.is_arrow_format() or spp.is_csv_format()) and
+        (queries.size() != 1 or spp.get_have_counts() or spp.is_hits_only_request()))
+    {
+      Fmi::Exception exception(BCP,
+                               "The output format '" + spp.get_output_format() +
+                                   "' supports only a single stored query without paging and"
+                                   " resultType=hits!");
+      exception.addParameter(WFS_EXCEPTION_CODE, WFS_OPERATION_PARSING_FAILED);
+      throw exception;
+    }
+
+    for (const auto& query : queries)
+    {
+      if (query->get_type() != QueryBase::STORED_QUERY)
+      {
+        Fmi::Exception exception(BCP,
+                                 "The output format '" + spp.get_output_format() +
+                                     "' is supported only for stored queries!");
+        exception.addParameter(WFS_EXCEPTION_CODE, WFS_OPERATION_PARSING_FAILED);
+        throw exception;
+      }
+    }
+  }
+  catch (...)
+  {
+    throw Fmi::Exception::Trace(BCP, "Operation failed!");
+  }
+}
+
 void bw::Request::GetFeature::execute_single_query(std::ostream& ost) const
 {
   try
@@ -610,6 +724,7 @@ boost::shared_ptr<bw::Request::GetFeature> bw::Request::GetFeature::create_from_
                                       typename_stored_query_map,
                                       result->queries);
     }
+    result->check_non_xml_queries();
     result->fast = result->get_cached_responses();
     return result;
   }
@@ -673,6 +788,7 @@ boost::shared_ptr<bw::Request::GetFeature> bw::Request::GetFeature::create_from_
       }
     }
 
+    result->check_non_xml_queries();
     result->fast = result->get_cached_responses();
     return result;
   }
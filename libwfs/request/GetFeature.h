@@ -32,6 +32,10 @@ class GetFeature : public RequestBase
 
   virtual int get_response_expires_seconds() const;
 
+  virtual bool may_validate_xml() const;
+
+  virtual boost::optional<std::string> get_content_type() const;
+
   static boost::shared_ptr<GetFeature> create_from_kvp(
       const std::string& language,
       const SmartMet::Spine::HTTP::Request& http_request,
@@ -48,6 +52,26 @@ class GetFeature : public RequestBase
 
   void execute_multiple_queries(std::ostream& ost) const;
 
+  /**
+   *   @brief Merges and pages GeoJSON responses of the queries
+   *
+   *   XPath based selection of members is not available for GeoJSON, so
+   *   the features arrays are handled directly instead.
+   */
+  void execute_geojson_queries(std::ostream& ost) const;
+
+  /**
+   *   @brief Writes the response of a single query as such (Arrow IPC stream and CSV)
+   */
+  void execute_tabular_query(std::ostream& ost) const;
+
+  /**
+   *   @brief Verifies that non-XML output formats are only requested for stored queries
+   *
+   *   Arrow IPC and CSV output are further restricted to a single stored query without paging.
+   */
+  void check_non_xml_queries() const;
+
   boost::shared_ptr<xercesc::DOMDocument> create_hits_only_response(const std::string& src) const;
 
   /**
@@ -62,6 +62,16 @@ void GetPropertyValue::execute(std::ostream& output) const
       throw exception;
     }
 
+    if (not StandardPresentationParameters::is_xml_format(spp.get_output_format()))
+    {
+      Fmi::Exception exception(
+          BCP,
+          "The '" + spp.get_output_format() +
+              "' output format is not supported for the 'GetPropertyValue' request!");
+      exception.addParameter(WFS_EXCEPTION_CODE, WFS_OPERATION_PROCESSING_FAILED);
+      throw exception;
+    }
+
     boost::shared_ptr<xercesc::DOMDocument> result =
         bwx::create_dom_document(WFS_NAMESPACE_URI, "wfs:ValueCollection");
 
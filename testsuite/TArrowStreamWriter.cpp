@@ -0,0 +1,323 @@
+#define BOOST_TEST_MODULE TArrowStreamWriter
+#define BOOST_TEST_DYN_LINK 1
+#include <iostream>
+#include <cmath>
+#include <cstring>
+#include <sstream>
+#include <vector>
+#include <boost/test/unit_test.hpp>
+#include "ArrowStreamWriter.h"
+
+using namespace boost::unit_test;
+
+test_suite* init_unit_test_suite(int argc, char* argv[])
+{
+  const char* name = "ArrowStreamWriter tester";
+  unit_test_log.set_threshold_level(log_messages);
+  framework::master_test_suite().p_name.value = name;
+  BOOST_TEST_MESSAGE("");
+  BOOST_TEST_MESSAGE(name);
+  BOOST_TEST_MESSAGE(std::string(std::strlen(name), '='));
+  return NULL;
+}
+
+using namespace SmartMet::Plugin::WFS;
+namespace ts = SmartMet::Spine::TimeSeries;
+
+namespace
+{
+std::uint32_t read_uint32(const std::string& src, std::size_t pos)
+{
+  std::uint32_t result;
+  std::memcpy(&result, src.data() + pos, sizeof(result));
+  return result;
+}
+
+template <typename T>
+T read(const std::string& src, std::size_t pos)
+{
+  BOOST_REQUIRE(pos + sizeof(T) <= src.size());
+  T result;
+  std::memcpy(&result, src.data() + pos, sizeof(T));
+  return result;
+}
+
+/*
+ *  Flatbuffer table reader following the flatbuffers specification, independent of
+ *  the encoder used by ArrowStreamWriter
+ */
+struct Table
+{
+  const std::string* buf;
+  std::size_t pos;
+
+  // Position of the field or 0 if it is not present
+  std::size_t field(unsigned slot) const
+  {
+    const std::size_t vtable = pos - read<std::int32_t>(*buf, pos);
+    const std::uint16_t vtable_size = read<std::uint16_t>(*buf, vtable);
+    if (4 + 2 * slot >= vtable_size)
+      return 0;
+    const std::uint16_t offset = read<std::uint16_t>(*buf, vtable + 4 + 2 * slot);
+    return offset ? pos + offset : 0;
+  }
+
+  template <typename T>
+  T scalar(unsigned slot, T default_value = 0) const
+  {
+    const std::size_t p = field(slot);
+    return p ? read<T>(*buf, p) : default_value;
+  }
+
+  std::size_t indirect(unsigned slot) const
+  {
+    const std::size_t p = field(slot);
+    BOOST_REQUIRE(p != 0);
+    return p + read<std::uint32_t>(*buf, p);
+  }
+
+  Table table(unsigned slot) const { return Table{buf, indirect(slot)}; }
+
+  std::string string(unsigned slot) const
+  {
+    const std::size_t p = indirect(slot);
+    return buf->substr(p + 4, read<std::uint32_t>(*buf, p));
+  }
+
+  std::vector<Table> tables(unsigned slot) const
+  {
+    const std::size_t p = indirect(slot);
+    std::vector<Table> result;
+    for (std::uint32_t i = 0; i < read<std::uint32_t>(*buf, p); i++)
+    {
+      const std::size_t item = p + 4 + 4 * i;
+      result.push_back(Table{buf, item + read<std::uint32_t>(*buf, item)});
+    }
+    return result;
+  }
+
+  // Vector of structs of two 64 bit integers (FieldNode and Buffer)
+  std::vector<std::pair<std::int64_t, std::int64_t> > pairs(unsigned slot) const
+  {
+    const std::size_t p = indirect(slot);
+    BOOST_CHECK_EQUAL(0U, (p + 4) % 8);
+    std::vector<std::pair<std::int64_t, std::int64_t> > result;
+    for (std::uint32_t i = 0; i < read<std::uint32_t>(*buf, p); i++)
+      result.emplace_back(read<std::int64_t>(*buf, p + 4 + 16 * i),
+                          read<std::int64_t>(*buf, p + 12 + 16 * i));
+    return result;
+  }
+};
+
+struct Message
+{
+  std::string metadata;
+  std::string body;
+
+  Table root() const { return Table{&metadata, read<std::uint32_t>(metadata, 0)}; }
+};
+
+std::vector<Message> read_messages(const std::string& stream)
+{
+  std::vector<Message> result;
+  std::size_t pos = 0;
+  while (true)
+  {
+    BOOST_REQUIRE_EQUAL(0xFFFFFFFFU, read_uint32(stream, pos));
+    const std::uint32_t size = read_uint32(stream, pos + 4);
+    if (size == 0)
+      break;
+    Message message;
+    message.metadata = stream.substr(pos + 8, size);
+    const auto length = message.root().scalar<std::int64_t>(3);
+    message.body = stream.substr(pos + 8 + size, length);
+    result.push_back(message);
+    pos += 8 + size + length;
+  }
+  return result;
+}
+
+struct Column
+{
+  std::int64_t length;
+  std::int64_t null_count;
+  std::string validity;
+  std::string offsets;
+  std::string data;
+
+  bool valid(std::size_t i) const
+  {
+    return validity.empty() or (static_cast<unsigned char>(validity[i / 8]) >> (i % 8)) & 1;
+  }
+
+  template <typename T>
+  T value(std::size_t i) const
+  {
+    return read<T>(data, i * sizeof(T));
+  }
+
+  std::string string(std::size_t i) const
+  {
+    const auto begin = read<std::int32_t>(offsets, 4 * i);
+    const auto end = read<std::int32_t>(offsets, 4 * i + 4);
+    return data.substr(begin, end - begin);
+  }
+};
+}  // namespace
+
+BOOST_AUTO_TEST_CASE(test_stream_structure)
+{
+  BOOST_TEST_MESSAGE("+ [Arrow IPC stream message framing]");
+
+  ArrowStreamWriter writer;
+  const std::size_t name = writer.add_column("name", ArrowStreamWriter::STRING);
+  const std::size_t value = writer.add_column("value", ArrowStreamWriter::DOUBLE);
+  writer.append(name, std::string("foo"));
+  writer.append(value, ts::Value(1.5));
+  writer.append_null(name);
+  writer.append(value, std::nan(""));
+  BOOST_CHECK_EQUAL(2U, writer.num_rows());
+
+  std::ostringstream output;
+  writer.write(output);
+  const std::string result = output.str();
+
+  // Schema message, record batch message and end-of-stream marker
+  std::size_t pos = 0;
+  BOOST_REQUIRE_EQUAL(0xFFFFFFFFU, read_uint32(result, pos));
+  const std::uint32_t schema_size = read_uint32(result, pos + 4);
+  BOOST_CHECK_EQUAL(0U, schema_size % 8);
+  pos += 8 + schema_size;
+  BOOST_REQUIRE(pos < result.size());
+  BOOST_REQUIRE_EQUAL(0xFFFFFFFFU, read_uint32(result, pos));
+  BOOST_CHECK_EQUAL(0U, result.size() % 8);
+  BOOST_CHECK_EQUAL(0xFFFFFFFFU, read_uint32(result, result.size() - 8));
+  BOOST_CHECK_EQUAL(0U, read_uint32(result, result.size() - 4));
+}
+
+BOOST_AUTO_TEST_CASE(test_invalid_usage)
+{
+  BOOST_TEST_MESSAGE("+ [Arrow writer error handling]");
+
+  ArrowStreamWriter writer;
+  const std::size_t value = writer.add_column("value", ArrowStreamWriter::DOUBLE);
+  const std::size_t time = writer.add_column("time", ArrowStreamWriter::TIMESTAMP);
+  BOOST_CHECK_THROW(writer.append(value, std::string("foo")), std::exception);
+
+  writer.append(value, 1.0);
+  BOOST_CHECK_THROW(writer.num_rows(), std::exception);
+  BOOST_CHECK_THROW(writer.add_column("other", ArrowStreamWriter::INT64), std::exception);
+
+  // Unsuitable time series values are stored as nulls
+  writer.append(time, ts::Value(std::string("foo")));
+  BOOST_CHECK_EQUAL(1U, writer.num_rows());
+}
+
+BOOST_AUTO_TEST_CASE(test_decode_round_trip)
+{
+  BOOST_TEST_MESSAGE("+ [Decoding written Arrow stream]");
+
+  namespace pt = boost::posix_time;
+
+  ArrowStreamWriter writer;
+  writer.add_column("fmisid", ArrowStreamWriter::INT64);
+  writer.add_column("name", ArrowStreamWriter::STRING);
+  writer.add_column("value", ArrowStreamWriter::DOUBLE);
+  writer.add_column("time", ArrowStreamWriter::TIMESTAMP);
+
+  writer.append(0, std::int64_t(100971));
+  writer.append(1, std::string("Helsinki"));
+  writer.append(2, 1.5);
+  writer.append(3, pt::time_from_string("2020-01-01 00:00:00"));
+
+  writer.append_null(0);
+  writer.append(1, std::string());
+  writer.append(2, std::nan(""));
+  writer.append(3, pt::ptime(pt::not_a_date_time));
+
+  writer.append(0, ts::Value(101004));
+  writer.append_null(1);
+  writer.append(2, ts::Value(3));
+  writer.append(3, pt::time_from_string("1970-01-01 00:00:10"));
+
+  std::ostringstream output;
+  writer.write(output);
+  const auto messages = read_messages(output.str());
+  BOOST_REQUIRE_EQUAL(2U, messages.size());
+
+  // Schema
+  const Table schema_message = messages[0].root();
+  BOOST_CHECK_EQUAL(1, schema_message.scalar<std::uint8_t>(1));
+  const auto fields = schema_message.table(2).tables(1);
+  BOOST_REQUIRE_EQUAL(4U, fields.size());
+  const char* names[] = {"fmisid", "name", "value", "time"};
+  const int types[] = {2, 5, 3, 10};  // Int, Utf8, FloatingPoint, Timestamp
+  for (std::size_t i = 0; i < fields.size(); i++)
+  {
+    BOOST_CHECK_EQUAL(names[i], fields[i].string(0));
+    BOOST_CHECK_EQUAL(1, fields[i].scalar<std::uint8_t>(1));
+    BOOST_CHECK_EQUAL(types[i], fields[i].scalar<std::uint8_t>(2));
+  }
+  BOOST_CHECK_EQUAL(64, fields[0].table(3).scalar<std::int32_t>(0));
+  BOOST_CHECK_EQUAL(1, fields[0].table(3).scalar<std::uint8_t>(1));
+  BOOST_CHECK_EQUAL(2, fields[2].table(3).scalar<std::int16_t>(0));  // DOUBLE
+  BOOST_CHECK_EQUAL(0, fields[3].table(3).scalar<std::int16_t>(0));  // SECOND
+  BOOST_CHECK_EQUAL("UTC", fields[3].table(3).string(1));
+
+  // Record batch
+  const Table batch_message = messages[1].root();
+  BOOST_CHECK_EQUAL(3, batch_message.scalar<std::uint8_t>(1));
+  const Table batch = batch_message.table(2);
+  BOOST_CHECK_EQUAL(3, batch.scalar<std::int64_t>(0));
+  const auto nodes = batch.pairs(1);
+  const auto buffers = batch.pairs(2);
+  BOOST_REQUIRE_EQUAL(4U, nodes.size());
+  BOOST_REQUIRE_EQUAL(9U, buffers.size());
+
+  const std::string& body = messages[1].body;
+  const auto buffer = [&](std::size_t i) {
+    BOOST_CHECK_EQUAL(0, buffers[i].first % 8);
+    BOOST_REQUIRE(buffers[i].first + buffers[i].second <= static_cast<std::int64_t>(body.size()));
+    return body.substr(buffers[i].first, buffers[i].second);
+  };
+
+  std::vector<Column> columns;
+  std::size_t b = 0;
+  for (std::size_t i = 0; i < nodes.size(); i++)
+  {
+    Column column;
+    column.length = nodes[i].first;
+    column.null_count = nodes[i].second;
+    column.validity = buffer(b++);
+    if (i == 1)
+      column.offsets = buffer(b++);
+    column.data = buffer(b++);
+    BOOST_CHECK_EQUAL(3, column.length);
+    columns.push_back(column);
+  }
+
+  BOOST_CHECK_EQUAL(1, columns[0].null_count);
+  BOOST_CHECK(columns[0].valid(0));
+  BOOST_CHECK(not columns[0].valid(1));
+  BOOST_CHECK(columns[0].valid(2));
+  BOOST_CHECK_EQUAL(100971, columns[0].value<std::int64_t>(0));
+  BOOST_CHECK_EQUAL(101004, columns[0].value<std::int64_t>(2));
+
+  BOOST_CHECK_EQUAL(1, columns[1].null_count);
+  BOOST_CHECK(columns[1].valid(0));
+  BOOST_CHECK(columns[1].valid(1));
+  BOOST_CHECK(not columns[1].valid(2));
+  BOOST_CHECK_EQUAL("Helsinki", columns[1].string(0));
+  BOOST_CHECK_EQUAL("", columns[1].string(1));
+  BOOST_CHECK_EQUAL("", columns[1].string(2));
+
+  BOOST_CHECK_EQUAL(1, columns[2].null_count);
+  BOOST_CHECK(not columns[2].valid(1));
+  BOOST_CHECK_EQUAL(1.5, columns[2].value<double>(0));
+  BOOST_CHECK_EQUAL(3.0, columns[2].value<double>(2));
+
+  BOOST_CHECK_EQUAL(1, columns[3].null_count);
+  BOOST_CHECK(not columns[3].valid(1));
+  BOOST_CHECK_EQUAL(1577836800, columns[3].value<std::int64_t>(0));
+  BOOST_CHECK_EQUAL(10, columns[3].value<std::int64_t>(2));
+}
@@ -0,0 +1,110 @@
+#define BOOST_TEST_MODULE TContourCache
+#define BOOST_TEST_DYN_LINK 1
+#include <iostream>
+#include <cstring>
+#include <boost/test/unit_test.hpp>
+#include "ContourCache.h"
+
+using namespace boost::unit_test;
+
+test_suite* init_unit_test_suite(int argc, char* argv[])
+{
+  const char* name = "ContourCache tester";
+  unit_test_log.set_threshold_level(log_messages);
+  framework::master_test_suite().p_name.value = name;
+  BOOST_TEST_MESSAGE("");
+  BOOST_TEST_MESSAGE(name);
+  BOOST_TEST_MESSAGE(std::string(std::strlen(name), '='));
+  return NULL;
+}
+
+using SmartMet::Plugin::WFS::ContourCache;
+
+namespace
+{
+ContourCache::GeometriesPtr create_geometries(std::size_t num_points)
+{
+  std::shared_ptr<ContourCache::Geometries> result(new ContourCache::Geometries);
+  std::shared_ptr<OGRLineString> line(new OGRLineString);
+  for (std::size_t i = 0; i < num_points; i++)
+    line->addPoint(double(i), double(i));
+  result->emplace_back(new SmartMet::Plugin::WFS::ContourGeometryIndex(line));
+  return result;
+}
+
+// Keys which differ only at the end, like cache keys of consecutive timesteps
+std::string key(int i)
+{
+  return "querydata=1234;param=Temperature;crs=EPSG:4326;time=2020010100" + std::to_string(i);
+}
+}  // namespace
+
+BOOST_AUTO_TEST_CASE(test_find_and_insert)
+{
+  BOOST_TEST_MESSAGE("+ [Finding inserted geometries]");
+
+  ContourCache cache(1024 * 1024);
+  BOOST_CHECK(not cache.find(key(1)));
+
+  auto geoms = create_geometries(10);
+  cache.insert(key(1), geoms);
+  BOOST_CHECK(cache.find(key(1)) == geoms);
+  BOOST_CHECK(not cache.find(key(2)));
+  BOOST_CHECK_EQUAL(cache.num_entries(), 1U);
+  BOOST_CHECK_EQUAL(cache.size(), ContourCache::estimate_size(*geoms) + 2 * key(1).size());
+
+  // Replacing an entry does not change the number of entries
+  auto geoms2 = create_geometries(20);
+  cache.insert(key(1), geoms2);
+  BOOST_CHECK(cache.find(key(1)) == geoms2);
+  BOOST_CHECK_EQUAL(cache.num_entries(), 1U);
+  BOOST_CHECK_EQUAL(cache.size(), ContourCache::estimate_size(*geoms2) + 2 * key(1).size());
+}
+
+BOOST_AUTO_TEST_CASE(test_size_limit)
+{
+  BOOST_TEST_MESSAGE("+ [Least recently used entries are dropped]");
+
+  auto geoms1 = create_geometries(100);
+  auto geoms2 = create_geometries(100);
+  auto geoms3 = create_geometries(100);
+  const std::size_t size = ContourCache::estimate_size(*geoms1);
+
+  ContourCache cache(2 * size + size / 2);
+  cache.insert(key(1), geoms1);
+  cache.insert(key(2), geoms2);
+  BOOST_CHECK(cache.find(key(1)));  // makes entry 2 the least recently used one
+  cache.insert(key(3), geoms3);
+
+  BOOST_CHECK(cache.find(key(1)) == geoms1);
+  BOOST_CHECK(not cache.find(key(2)));
+  BOOST_CHECK(cache.find(key(3)) == geoms3);
+  BOOST_CHECK(cache.size() <= cache.get_max_size());
+
+  // Too large entries are not cached at all
+  ContourCache small_cache(size / 2);
+  small_cache.insert(key(1), geoms1);
+  BOOST_CHECK(not small_cache.find(key(1)));
+
+  // Zero size disables the cache
+  ContourCache disabled(0);
+  disabled.insert(key(1), geoms1);
+  BOOST_CHECK_EQUAL(disabled.num_entries(), 0U);
+}
+
+BOOST_AUTO_TEST_CASE(test_full_key_comparison)
+{
+  BOOST_TEST_MESSAGE("+ [Entries are found only with the full key]");
+
+  ContourCache cache(1024 * 1024);
+  auto geoms1 = create_geometries(10);
+  auto geoms2 = create_geometries(10);
+  cache.insert(key(1), geoms1);
+  cache.insert(key(1) + " ", geoms2);
+
+  BOOST_CHECK(cache.find(key(1)) == geoms1);
+  BOOST_CHECK(cache.find(key(1) + " ") == geoms2);
+  BOOST_CHECK(not cache.find(key(1).substr(0, key(1).size() - 1)));
+  BOOST_CHECK(not cache.find(""));
+  BOOST_CHECK_EQUAL(cache.num_entries(), 2U);
+}
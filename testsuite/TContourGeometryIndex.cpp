@@ -0,0 +1,108 @@
+#define BOOST_TEST_MODULE TContourGeometryIndex
+#define BOOST_TEST_DYN_LINK 1
+#include <iostream>
+#include <cstring>
+#include <boost/test/unit_test.hpp>
+#include "ContourGeometryIndex.h"
+
+using namespace boost::unit_test;
+
+test_suite* init_unit_test_suite(int argc, char* argv[])
+{
+  const char* name = "ContourGeometryIndex tester";
+  unit_test_log.set_threshold_level(log_messages);
+  framework::master_test_suite().p_name.value = name;
+  BOOST_TEST_MESSAGE("");
+  BOOST_TEST_MESSAGE(name);
+  BOOST_TEST_MESSAGE(std::string(std::strlen(name), '='));
+  return NULL;
+}
+
+using SmartMet::Plugin::WFS::ContourGeometryIndex;
+
+namespace
+{
+// Unit squares with lower left corners at (2*i, 2*j) for i, j = 0 ... n-1
+ContourGeometryIndex::GeometryPtr create_squares(int n)
+{
+  std::shared_ptr<OGRMultiPolygon> result(new OGRMultiPolygon);
+  for (int j = 0; j < n; j++)
+    for (int i = 0; i < n; i++)
+    {
+      OGRLinearRing ring;
+      ring.addPoint(2 * i, 2 * j);
+      ring.addPoint(2 * i + 1, 2 * j);
+      ring.addPoint(2 * i + 1, 2 * j + 1);
+      ring.addPoint(2 * i, 2 * j + 1);
+      ring.closeRings();
+      OGRPolygon polygon;
+      polygon.addRing(&ring);
+      result->addGeometry(&polygon);
+    }
+  return result;
+}
+
+OGREnvelope envelope(double x1, double y1, double x2, double y2)
+{
+  OGREnvelope result;
+  result.MinX = x1;
+  result.MinY = y1;
+  result.MaxX = x2;
+  result.MaxY = y2;
+  return result;
+}
+
+int num_geometries(const ContourGeometryIndex::GeometryPtr& geom)
+{
+  return static_cast<const OGRGeometryCollection*>(geom.get())->getNumGeometries();
+}
+}  // namespace
+
+BOOST_AUTO_TEST_CASE(test_selecting_parts)
+{
+  BOOST_TEST_MESSAGE("+ [Selecting parts of a multipolygon]");
+
+  auto squares = create_squares(10);
+  ContourGeometryIndex index(squares);
+  BOOST_CHECK_EQUAL(index.num_parts(), 100U);
+
+  bool within = false;
+
+  // Whole extent: original geometry is returned
+  auto result = index.select(envelope(-1, -1, 100, 100), within);
+  BOOST_CHECK(result == squares);
+  BOOST_CHECK(within);
+
+  // Two squares completely inside
+  result = index.select(envelope(1.5, 1.5, 5.5, 3.5), within);
+  BOOST_CHECK_EQUAL(num_geometries(result), 2);
+  BOOST_CHECK(within);
+
+  // Partially covered squares need clipping
+  result = index.select(envelope(0.5, 0.5, 2.5, 0.7), within);
+  BOOST_CHECK_EQUAL(num_geometries(result), 2);
+  BOOST_CHECK(not within);
+
+  // Between the squares or outside the extent
+  result = index.select(envelope(1.2, 1.2, 1.8, 1.8), within);
+  BOOST_CHECK(result);
+  BOOST_CHECK(result->IsEmpty());
+  result = index.select(envelope(50, 50, 60, 60), within);
+  BOOST_CHECK(result->IsEmpty());
+}
+
+BOOST_AUTO_TEST_CASE(test_single_geometry)
+{
+  BOOST_TEST_MESSAGE("+ [Indexing a single line]");
+
+  std::shared_ptr<OGRLineString> line(new OGRLineString);
+  line->addPoint(0, 0);
+  line->addPoint(10, 10);
+  ContourGeometryIndex index(line);
+  BOOST_CHECK_EQUAL(index.num_parts(), 1U);
+
+  bool within = true;
+  BOOST_CHECK(index.select(envelope(2, 2, 3, 3), within) == line);
+  BOOST_CHECK(not within);
+  BOOST_CHECK(index.select(envelope(20, 20, 30, 30), within)->IsEmpty());
+}
@@ -0,0 +1,130 @@
+#define BOOST_TEST_MODULE TContourSimplification
+#define BOOST_TEST_DYN_LINK 1
+#include <iostream>
+#include <cmath>
+#include <cstring>
+#include <utility>
+#include <vector>
+#include <boost/test/unit_test.hpp>
+#include "ContourSimplification.h"
+
+using namespace boost::unit_test;
+
+test_suite* init_unit_test_suite(int argc, char* argv[])
+{
+  const char* name = "ContourSimplification tester";
+  unit_test_log.set_threshold_level(log_messages);
+  framework::master_test_suite().p_name.value = name;
+  BOOST_TEST_MESSAGE("");
+  BOOST_TEST_MESSAGE(name);
+  BOOST_TEST_MESSAGE(std::string(std::strlen(name), '='));
+  return NULL;
+}
+
+using SmartMet::Plugin::WFS::simplify_contour;
+
+namespace
+{
+// Dense wiggly boundary from (5, 0) to (5, 10)
+std::vector<std::pair<double, double> > shared_boundary()
+{
+  std::vector<std::pair<double, double> > points;
+  for (int i = 0; i <= 100; i++)
+    points.emplace_back(5.0 + 0.8 * std::sin(0.37 * i), 0.1 * i);
+  return points;
+}
+
+// Adjacent bands covering [0, 10] x [0, 10] with the shared boundary between them
+std::shared_ptr<OGRPolygon> create_band(bool left)
+{
+  const auto boundary = shared_boundary();
+  OGRLinearRing ring;
+  if (left)
+  {
+    ring.addPoint(0, 0);
+    for (const auto& p : boundary)
+      ring.addPoint(p.first, p.second);
+    ring.addPoint(0, 10);
+  }
+  else
+  {
+    ring.addPoint(10, 0);
+    ring.addPoint(10, 10);
+    for (auto it = boundary.rbegin(); it != boundary.rend(); ++it)
+      ring.addPoint(it->first, it->second);
+  }
+  ring.closeRings();
+
+  std::shared_ptr<OGRPolygon> polygon(new OGRPolygon);
+  polygon->addRing(&ring);
+  return polygon;
+}
+
+int num_points(const OGRGeometry& geometry)
+{
+  return static_cast<const OGRPolygon&>(geometry).getExteriorRing()->getNumPoints();
+}
+}  // namespace
+
+BOOST_AUTO_TEST_CASE(test_adjacent_bands_stay_adjacent)
+{
+  BOOST_TEST_MESSAGE("+ [Simplified adjacent bands have neither gaps nor overlaps]");
+
+  const auto left = create_band(true);
+  const auto right = create_band(false);
+  BOOST_REQUIRE_CLOSE(100.0, left->get_Area() + right->get_Area(), 1e-9);
+
+  const auto simple_left = simplify_contour(*left, 0.5);
+  const auto simple_right = simplify_contour(*right, 0.5);
+  BOOST_REQUIRE_EQUAL(wkbPolygon, wkbFlatten(simple_left->getGeometryType()));
+  BOOST_REQUIRE_EQUAL(wkbPolygon, wkbFlatten(simple_right->getGeometryType()));
+  BOOST_CHECK_LT(num_points(*simple_left), num_points(*left));
+  BOOST_CHECK_LT(num_points(*simple_right), num_points(*right));
+
+  // The outer boundary is on the grid, so the bands still cover exactly the same area
+  const double left_area = static_cast<const OGRPolygon&>(*simple_left).get_Area();
+  const double right_area = static_cast<const OGRPolygon&>(*simple_right).get_Area();
+  BOOST_CHECK_CLOSE(100.0, left_area + right_area, 1e-9);
+  BOOST_CHECK_GT(left_area, 0.0);
+  BOOST_CHECK_GT(right_area, 0.0);
+}
+
+BOOST_AUTO_TEST_CASE(test_collapsed_parts_are_removed)
+{
+  BOOST_TEST_MESSAGE("+ [Parts smaller than the tolerance are removed]");
+
+  OGRMultiPolygon multi;
+  multi.addGeometry(create_band(true).get());
+  OGRLinearRing ring;
+  ring.addPoint(20.0, 20.0);
+  ring.addPoint(20.1, 20.0);
+  ring.addPoint(20.1, 20.1);
+  ring.closeRings();
+  OGRPolygon tiny;
+  tiny.addRing(&ring);
+  multi.addGeometry(&tiny);
+
+  const auto result = simplify_contour(multi, 0.5);
+  BOOST_REQUIRE_EQUAL(wkbMultiPolygon, wkbFlatten(result->getGeometryType()));
+  BOOST_CHECK_EQUAL(1, static_cast<const OGRMultiPolygon&>(*result).getNumGeometries());
+
+  const auto empty = simplify_contour(tiny, 0.5);
+  BOOST_REQUIRE(empty);
+  BOOST_CHECK(empty->IsEmpty());
+
+  OGRLineString line;
+  line.addPoint(0.0, 0.0);
+  line.addPoint(0.1, 0.1);
+  BOOST_CHECK(simplify_contour(line, 0.5)->IsEmpty());
+}
+
+BOOST_AUTO_TEST_CASE(test_no_simplification)
+{
+  BOOST_TEST_MESSAGE("+ [Zero tolerance returns a copy]");
+
+  const auto band = create_band(true);
+  const auto result = simplify_contour(*band, 0.0);
+  BOOST_REQUIRE(result);
+  BOOST_CHECK(result.get() != band.get());
+  BOOST_CHECK(result->Equals(band.get()));
+}
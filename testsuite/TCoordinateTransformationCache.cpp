@@ -0,0 +1,205 @@
+#define BOOST_TEST_MODULE TCoordinateTransformationCache
+#define BOOST_TEST_DYN_LINK 1
+#include <iostream>
+#include <atomic>
+#include <cstring>
+#include <string>
+#include <thread>
+#include <vector>
+#include <boost/array.hpp>
+#include <boost/test/unit_test.hpp>
+#include <ogr_geometry.h>
+#include "CoordinateTransformationCache.h"
+
+using namespace boost::unit_test;
+
+test_suite* init_unit_test_suite(int argc, char* argv[])
+{
+  const char* name = "CoordinateTransformationCache tester";
+  unit_test_log.set_threshold_level(log_messages);
+  framework::master_test_suite().p_name.value = name;
+  BOOST_TEST_MESSAGE("");
+  BOOST_TEST_MESSAGE(name);
+  BOOST_TEST_MESSAGE(std::string(std::strlen(name), '='));
+  return NULL;
+}
+
+using SmartMet::Plugin::WFS::CoordinateTransformationCache;
+
+namespace
+{
+/**
+ *   Fake transformation (x, y) -> (scale * x + offset, scale * y - offset) which
+ *   counts the calls of the underlying transformation
+ */
+class FakeTransformation : public SmartMet::Spine::CRSRegistry::Transformation
+{
+ public:
+  FakeTransformation(const std::string& src, const std::string& dest, double scale, double offset)
+      : src(src), dest(dest), scale(scale), offset(offset), num_points(0), num_geometries(0)
+  {
+  }
+
+  std::string get_src_name() const override { return src; }
+  std::string get_dest_name() const override { return dest; }
+
+  NFmiPoint transform(const NFmiPoint& p) override
+  {
+    num_points++;
+    return NFmiPoint(scale * p.X() + offset, scale * p.Y() - offset);
+  }
+
+  boost::array<double, 3> transform(const boost::array<double, 3>& p) override
+  {
+    num_points++;
+    return boost::array<double, 3>{{scale * p[0] + offset, scale * p[1] - offset, p[2]}};
+  }
+
+  void transform(OGRGeometry& geometry) override
+  {
+    num_geometries++;
+    auto& line = dynamic_cast<OGRLineString&>(geometry);
+    for (int i = 0; i < line.getNumPoints(); i++)
+      line.setPoint(i, scale * line.getX(i) + offset, scale * line.getY(i) - offset);
+  }
+
+  const std::string src;
+  const std::string dest;
+  const double scale;
+  const double offset;
+  std::atomic<int> num_points;
+  std::atomic<int> num_geometries;
+};
+
+std::vector<NFmiPoint> test_points()
+{
+  std::vector<NFmiPoint> points;
+  for (int i = 0; i < 20; i++)
+    points.push_back(NFmiPoint(20.0 + 0.25 * (i % 5), 60.0 + 0.5 * (i % 4)));
+  return points;
+}
+}  // namespace
+
+BOOST_AUTO_TEST_CASE(test_cache_hits)
+{
+  BOOST_TEST_MESSAGE("+ [Transformed points and formatted coordinates are cached]");
+
+  boost::shared_ptr<FakeTransformation> fake(
+      new FakeTransformation("EPSG::4326", "EPSG::3067", 1000.0, 500.0));
+  CoordinateTransformationCache cache(fake);
+
+  const NFmiPoint p1 = cache.transform(25.5, 60.25);
+  BOOST_CHECK_EQUAL(1, int(fake->num_points));
+  BOOST_CHECK_CLOSE(26000.0, p1.X(), 1e-9);
+  BOOST_CHECK_CLOSE(59750.0, p1.Y(), 1e-9);
+
+  const NFmiPoint p2 = cache.transform(25.5, 60.25);
+  BOOST_CHECK_EQUAL(1, int(fake->num_points));
+  BOOST_CHECK_EQUAL(p1.X(), p2.X());
+  BOOST_CHECK_EQUAL(p1.Y(), p2.Y());
+
+  // Formatting reuses the already transformed point
+  const auto& c1 = cache.get_2D_coord(25.5, 60.25);
+  const auto& c2 = cache.get_2D_coord(25.5, 60.25);
+  BOOST_CHECK_EQUAL(1, int(fake->num_points));
+  BOOST_CHECK_EQUAL(&c1, &c2);
+  BOOST_CHECK(c1 == CoordinateTransformationCache::format_2D_coord(p1));
+
+  // Only the points not yet in the cache are transformed in one batch
+  const auto points = test_points();
+  const auto coords = cache.get_2D_coords(points);
+  BOOST_CHECK_EQUAL(1, int(fake->num_points));
+  BOOST_CHECK_EQUAL(1, int(fake->num_geometries));
+  BOOST_REQUIRE_EQUAL(points.size(), coords.size());
+  for (std::size_t i = 0; i < points.size(); i++)
+    BOOST_CHECK(coords[i] ==
+                CoordinateTransformationCache::format_2D_coord(fake->transform(points[i])));
+
+  fake->num_points = 0;
+  cache.get_2D_coords(points);
+  cache.transform(points);
+  BOOST_CHECK_EQUAL(0, int(fake->num_points));
+  BOOST_CHECK_EQUAL(1, int(fake->num_geometries));
+}
+
+BOOST_AUTO_TEST_CASE(test_distinct_keys)
+{
+  BOOST_TEST_MESSAGE("+ [Cached values are kept separate by CRS pair and source point]");
+
+  boost::shared_ptr<FakeTransformation> fake1(
+      new FakeTransformation("EPSG::4326", "EPSG::3067", 1000.0, 500.0));
+  boost::shared_ptr<FakeTransformation> fake2(
+      new FakeTransformation("EPSG::4326", "EPSG::3035", 2000.0, 100.0));
+  boost::shared_ptr<FakeTransformation> fake3(
+      new FakeTransformation("EPSG::3067", "EPSG::3067", 1.0, 0.0));
+  CoordinateTransformationCache cache1(fake1);
+  CoordinateTransformationCache cache2(fake2);
+  CoordinateTransformationCache cache3(fake3);
+
+  // The same source point in caches of different CRS pairs
+  const NFmiPoint p1 = cache1.transform(25.0, 60.0);
+  const NFmiPoint p2 = cache2.transform(25.0, 60.0);
+  const NFmiPoint p3 = cache3.transform(25.0, 60.0);
+  BOOST_CHECK_CLOSE(25500.0, p1.X(), 1e-9);
+  BOOST_CHECK_CLOSE(50100.0, p2.X(), 1e-9);
+  BOOST_CHECK_CLOSE(25.0, p3.X(), 1e-9);
+  BOOST_CHECK(cache1.get_2D_coord(25.0, 60.0) != cache2.get_2D_coord(25.0, 60.0));
+  BOOST_CHECK_EQUAL(1, int(fake1->num_points));
+  BOOST_CHECK_EQUAL(1, int(fake2->num_points));
+  BOOST_CHECK_EQUAL(1, int(fake3->num_points));
+  BOOST_CHECK_EQUAL("EPSG::3035", cache2.get_transformation()->get_dest_name());
+
+  // Swapped and nearby source points are not mixed up
+  const NFmiPoint q1 = cache1.transform(60.0, 25.0);
+  const NFmiPoint q2 = cache1.transform(25.0, 60.000001);
+  BOOST_CHECK_EQUAL(3, int(fake1->num_points));
+  BOOST_CHECK_CLOSE(60500.0, q1.X(), 1e-9);
+  BOOST_CHECK_CLOSE(24500.0, q1.Y(), 1e-9);
+  BOOST_CHECK(q2.Y() != p1.Y());
+
+  const std::vector<NFmiPoint> src{NFmiPoint(25.0, 60.0), NFmiPoint(60.0, 25.0)};
+  const auto result = cache2.transform(src);
+  BOOST_REQUIRE_EQUAL(2, int(result.size()));
+  BOOST_CHECK_CLOSE(50100.0, result[0].X(), 1e-9);
+  BOOST_CHECK_CLOSE(120100.0, result[1].X(), 1e-9);
+  BOOST_CHECK_CLOSE(49900.0, result[1].Y(), 1e-9);
+}
+
+BOOST_AUTO_TEST_CASE(test_reuse_in_threads)
+{
+  BOOST_TEST_MESSAGE("+ [Caches of concurrent requests share the same transformation]");
+
+  boost::shared_ptr<FakeTransformation> fake(
+      new FakeTransformation("EPSG::4326", "EPSG::3067", 1000.0, 500.0));
+  const auto points = test_points();
+
+  CoordinateTransformationCache reference(fake);
+  const auto expected = reference.get_2D_coords(points);
+
+  // The cache is not thread safe: each request (thread) has its own cache
+  // but the underlying transformation object is shared
+  const int num_threads = 8;
+  std::vector<std::vector<CoordinateTransformationCache::Coord2D> > results(num_threads);
+  std::vector<std::thread> threads;
+  for (int k = 0; k < num_threads; k++)
+  {
+    threads.emplace_back([&fake, &points, &results, k]() {
+      CoordinateTransformationCache cache(fake);
+      for (int round = 0; round < 10; round++)
+      {
+        for (const auto& p : points)
+          cache.get_2D_coord(p.X(), p.Y());
+        results[k] = cache.get_2D_coords(points);
+      }
+    });
+  }
+
+  for (auto& thread : threads)
+    thread.join();
+
+  for (const auto& result : results)
+    BOOST_CHECK(result == expected);
+
+  // Each thread transforms every distinct point only once
+  BOOST_CHECK_EQUAL(num_threads * 20, int(fake->num_points));
+}
@@ -0,0 +1,69 @@
+#define BOOST_TEST_MODULE TCsvWriter
+#define BOOST_TEST_DYN_LINK 1
+#include <iostream>
+#include <cstring>
+#include <sstream>
+#include <boost/test/unit_test.hpp>
+#include "CsvWriter.h"
+#include "FormattedValueColumn.h"
+
+using namespace boost::unit_test;
+
+test_suite* init_unit_test_suite(int argc, char* argv[])
+{
+  const char* name = "CsvWriter tester";
+  unit_test_log.set_threshold_level(log_messages);
+  framework::master_test_suite().p_name.value = name;
+  BOOST_TEST_MESSAGE("");
+  BOOST_TEST_MESSAGE(name);
+  BOOST_TEST_MESSAGE(std::string(std::strlen(name), '='));
+  return NULL;
+}
+
+using namespace SmartMet::Plugin::WFS;
+namespace pt = boost::posix_time;
+namespace ts = SmartMet::Spine::TimeSeries;
+
+BOOST_AUTO_TEST_CASE(test_writing_rows)
+{
+  BOOST_TEST_MESSAGE("+ [Writing CSV rows]");
+
+  SmartMet::Spine::ValueFormatterParam vf_param;
+  vf_param.missingText = "NaN";
+  const SmartMet::Spine::ValueFormatter formatter(vf_param);
+  FormattedValueColumn column(formatter, 1);
+  column.append(ts::Value(1.5));
+  column.append(ts::Value(ts::None()));
+
+  std::ostringstream output;
+  CsvWriter csv(output);
+  csv.write_header({"name", "time", "value"});
+
+  csv.add_field(std::string("Helsinki, Kaisaniemi"));
+  csv.add_field(pt::ptime(boost::gregorian::date(2020, 1, 2), pt::hours(3)));
+  csv.add_field(column, 0);
+  csv.end_row();
+
+  csv.add_field(std::string("say \"hello\""));
+  csv.add_empty_field();
+  csv.add_field(column, 1);
+  csv.end_row();
+
+  BOOST_CHECK_EQUAL(2U, csv.num_rows());
+  BOOST_CHECK_EQUAL(std::string("name,time,value\r\n"
+                                "\"Helsinki, Kaisaniemi\",2020-01-02T03:00:00Z,1.5\r\n"
+                                "\"say \"\"hello\"\"\",,\r\n"),
+                    output.str());
+}
+
+BOOST_AUTO_TEST_CASE(test_field_count_check)
+{
+  BOOST_TEST_MESSAGE("+ [Checking the number of fields]");
+
+  std::ostringstream output;
+  CsvWriter csv(output);
+  csv.write_header({"a", "b"});
+  csv.add_field(std::string("1"));
+  BOOST_CHECK_THROW(csv.end_row(), std::exception);
+  BOOST_CHECK_THROW(csv.write_header({"c"}), std::exception);
+}
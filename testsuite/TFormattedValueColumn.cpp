@@ -0,0 +1,80 @@
+#define BOOST_TEST_MODULE TFormattedValueColumn
+#define BOOST_TEST_DYN_LINK 1
+#include <iostream>
+#include <cmath>
+#include <boost/test/unit_test.hpp>
+#include "FormattedValueColumn.h"
+
+using namespace boost::unit_test;
+
+test_suite* init_unit_test_suite(int argc, char* argv[])
+{
+  const char* name = "FormattedValueColumn tester";
+  unit_test_log.set_threshold_level(log_messages);
+  framework::master_test_suite().p_name.value = name;
+  BOOST_TEST_MESSAGE("");
+  BOOST_TEST_MESSAGE(name);
+  BOOST_TEST_MESSAGE(std::string(std::strlen(name), '='));
+  return NULL;
+}
+
+using namespace SmartMet::Plugin::WFS;
+namespace ts = SmartMet::Spine::TimeSeries;
+
+namespace
+{
+SmartMet::Spine::ValueFormatter create_formatter()
+{
+  SmartMet::Spine::ValueFormatterParam vf_param;
+  vf_param.missingText = "NaN";
+  return SmartMet::Spine::ValueFormatter(vf_param);
+}
+}  // namespace
+
+BOOST_AUTO_TEST_CASE(test_formatting_values)
+{
+  BOOST_TEST_MESSAGE("+ [Formatting values of different types]");
+
+  const auto formatter = create_formatter();
+  FormattedValueColumn column(formatter, 2);
+  column.append(ts::Value(1.0));
+  column.append(ts::Value(ts::None()));
+  column.append(ts::Value(std::nan("")));
+  column.append(ts::Value(std::string("foo")));
+  column.append(ts::Value(-12.345));
+
+  BOOST_REQUIRE_EQUAL(5, (int)column.size());
+  BOOST_CHECK_EQUAL(std::string("1.00"), column.get(0));
+  BOOST_CHECK(not column.is_missing(0));
+  BOOST_CHECK(column.is_missing(1));
+  BOOST_CHECK_EQUAL(std::string("NaN"), column.get(1));
+  BOOST_CHECK(column.is_missing(2));
+  BOOST_CHECK_EQUAL(std::string("foo"), column.get(3));
+  BOOST_CHECK_EQUAL(std::string("-12.35"), column.get(4));
+
+  std::string dest;
+  column.append_to(dest, 0);
+  dest += ' ';
+  column.append_to(dest, 1);
+  BOOST_CHECK_EQUAL(std::string("1.00 NaN"), dest);
+}
+
+BOOST_AUTO_TEST_CASE(test_formatting_selected_rows)
+{
+  BOOST_TEST_MESSAGE("+ [Formatting selected time series rows]");
+
+  const auto formatter = create_formatter();
+  boost::local_time::local_date_time t(boost::posix_time::time_from_string("2020-01-01 00:00:00"),
+                                       boost::local_time::time_zone_ptr());
+  ts::TimeSeries src;
+  for (int i = 0; i < 5; i++)
+    src.push_back(ts::TimedValue(t, ts::Value(double(i))));
+
+  FormattedValueColumn column(formatter, 0);
+  column.append(src, std::vector<std::size_t>{4, 0, 2});
+  BOOST_REQUIRE_EQUAL(3, (int)column.size());
+  BOOST_CHECK_EQUAL(std::string("4"), column.get(0));
+  BOOST_CHECK_EQUAL(std::string("0"), column.get(1));
+  BOOST_CHECK_EQUAL(std::string("2"), column.get(2));
+  BOOST_CHECK_THROW(column.get(3), std::exception);
+}
@@ -0,0 +1,79 @@
+#define BOOST_TEST_MODULE TGeoJsonUtils
+#define BOOST_TEST_DYN_LINK 1
+#include <iostream>
+#include <cmath>
+#include <sstream>
+#include <boost/test/unit_test.hpp>
+#include "GeoJsonUtils.h"
+
+using namespace boost::unit_test;
+
+test_suite* init_unit_test_suite(int argc, char* argv[])
+{
+  const char* name = "GeoJsonUtils tester";
+  unit_test_log.set_threshold_level(log_messages);
+  framework::master_test_suite().p_name.value = name;
+  BOOST_TEST_MESSAGE("");
+  BOOST_TEST_MESSAGE(name);
+  BOOST_TEST_MESSAGE(std::string(std::strlen(name), '='));
+  return NULL;
+}
+
+using namespace SmartMet::Plugin::WFS;
+namespace ts = SmartMet::Spine::TimeSeries;
+
+namespace
+{
+Json::Value create_collection(int num_features)
+{
+  Json::Value result = GeoJson::create_feature_collection(
+      boost::posix_time::time_from_string("2020-01-01 00:00:00"));
+  for (int i = 0; i < num_features; i++)
+  {
+    Json::Value& properties =
+        GeoJson::add_point_feature(result, "f." + std::to_string(i), 25.0, 60.0 + i);
+    properties["value"] = i;
+  }
+  GeoJson::update_counts(result);
+  return result;
+}
+}  // namespace
+
+BOOST_AUTO_TEST_CASE(test_value_conversion)
+{
+  BOOST_TEST_MESSAGE("+ [Converting values to JSON]");
+
+  BOOST_CHECK(GeoJson::to_json(ts::Value(ts::None())).isNull());
+  BOOST_CHECK(GeoJson::to_json(ts::Value(std::nan(""))).isNull());
+  BOOST_CHECK_EQUAL(1.5, GeoJson::to_json(ts::Value(1.5)).asDouble());
+  BOOST_CHECK_EQUAL(std::string("foo"), GeoJson::to_json(ts::Value(std::string("foo"))).asString());
+
+  BOOST_CHECK(GeoJson::to_json("NaN", "NaN").isNull());
+  BOOST_CHECK(GeoJson::to_json("", "NaN").isNull());
+  BOOST_CHECK_EQUAL(-2.25, GeoJson::to_json("-2.25", "NaN").asDouble());
+  BOOST_CHECK_EQUAL(std::string("2.5 m"), GeoJson::to_json("2.5 m", "NaN").asString());
+}
+
+BOOST_AUTO_TEST_CASE(test_merge_and_select)
+{
+  BOOST_TEST_MESSAGE("+ [Merging and paging feature collections]");
+
+  Json::Value collection = create_collection(3);
+  GeoJson::merge(collection, create_collection(2));
+  BOOST_CHECK_EQUAL(5U, collection["numberMatched"].asUInt());
+  BOOST_CHECK_EQUAL(5U, collection["features"].size());
+
+  GeoJson::select_members(collection, 2, 2);
+  BOOST_CHECK_EQUAL(5U, collection["numberMatched"].asUInt());
+  BOOST_CHECK_EQUAL(2U, collection["numberReturned"].asUInt());
+  BOOST_CHECK_EQUAL(std::string("f.2"), collection["features"][0]["id"].asString());
+  BOOST_CHECK_EQUAL(std::string("f.0"), collection["features"][1]["id"].asString());
+
+  std::ostringstream output;
+  GeoJson::write(collection, output);
+  const Json::Value parsed = GeoJson::parse(output.str());
+  BOOST_CHECK_EQUAL(std::string("FeatureCollection"), parsed["type"].asString());
+  BOOST_CHECK_EQUAL(60.0, parsed["features"][1]["geometry"]["coordinates"][1].asDouble());
+
+  BOOST_CHECK_THROW(GeoJson::parse("{ invalid"), std::exception);
+}
@@ -0,0 +1,62 @@
+#define BOOST_TEST_MODULE TParallelFor
+#define BOOST_TEST_DYN_LINK 1
+#include <iostream>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+#include <vector>
+#include <boost/test/unit_test.hpp>
+#include "ParallelFor.h"
+
+using namespace boost::unit_test;
+
+test_suite* init_unit_test_suite(int argc, char* argv[])
+{
+  const char* name = "ParallelFor tester";
+  unit_test_log.set_threshold_level(log_messages);
+  framework::master_test_suite().p_name.value = name;
+  BOOST_TEST_MESSAGE("");
+  BOOST_TEST_MESSAGE(name);
+  BOOST_TEST_MESSAGE(std::string(std::strlen(name), '='));
+  return NULL;
+}
+
+using SmartMet::Plugin::WFS::parallel_for;
+
+BOOST_AUTO_TEST_CASE(test_all_tasks_run)
+{
+  BOOST_TEST_MESSAGE("+ [All tasks are run exactly once]");
+
+  for (std::size_t max_threads : {0, 1, 3, 100})
+  {
+    std::vector<int> result(50, 0);
+    parallel_for(result.size(), max_threads, [&result](std::size_t i) { result[i] += i + 1; });
+    for (std::size_t i = 0; i < result.size(); i++)
+      BOOST_CHECK_EQUAL(result[i], int(i + 1));
+  }
+
+  BOOST_CHECK_NO_THROW(parallel_for(0, 4, [](std::size_t) { throw std::runtime_error("x"); }));
+}
+
+BOOST_AUTO_TEST_CASE(test_first_error_rethrown)
+{
+  BOOST_TEST_MESSAGE("+ [Exception of the first failed task is rethrown]");
+
+  std::vector<int> done(20, 0);
+  try
+  {
+    parallel_for(done.size(), 4, [&done](std::size_t i) {
+      done[i] = 1;
+      if (i == 7 or i == 13)
+        throw std::runtime_error(std::to_string(i));
+    });
+    BOOST_FAIL("Exception expected");
+  }
+  catch (const std::runtime_error& e)
+  {
+    BOOST_CHECK_EQUAL(std::string(e.what()), std::string("7"));
+  }
+
+  for (int item : done)
+    BOOST_CHECK_EQUAL(item, 1);
+}
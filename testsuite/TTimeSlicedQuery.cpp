@@ -0,0 +1,128 @@
+#define BOOST_TEST_MODULE TTimeSlicedQuery
+#define BOOST_TEST_DYN_LINK 1
+#include <iostream>
+#include <cstring>
+#include <map>
+#include <string>
+#include <vector>
+#include <boost/test/unit_test.hpp>
+#include "TimeSlicedQuery.h"
+
+using namespace boost::unit_test;
+
+test_suite* init_unit_test_suite(int argc, char* argv[])
+{
+  const char* name = "TimeSlicedQuery tester";
+  unit_test_log.set_threshold_level(log_messages);
+  framework::master_test_suite().p_name.value = name;
+  BOOST_TEST_MESSAGE("");
+  BOOST_TEST_MESSAGE(name);
+  BOOST_TEST_MESSAGE(std::string(std::strlen(name), '='));
+  return NULL;
+}
+
+using namespace SmartMet::Plugin::WFS;
+namespace pt = boost::posix_time;
+namespace ts = SmartMet::Spine::TimeSeries;
+
+namespace
+{
+/**
+ *   Fake observation query: two stations (columns station and value), an observation
+ *   every 20 minutes and 30 seconds, rows ordered by station and then by time
+ */
+ts::TimeSeriesVectorPtr fake_query(const pt::ptime& begin, const pt::ptime& end)
+{
+  const pt::ptime origin = pt::time_from_string("2020-01-01 00:00:00");
+  ts::TimeSeriesVectorPtr result(new ts::TimeSeriesVector(2));
+  for (int station = 1; station <= 2; station++)
+  {
+    for (pt::ptime t = origin; t <= end; t += pt::seconds(1230))
+    {
+      if (t < begin)
+        continue;
+      boost::local_time::local_date_time lt(t, boost::local_time::time_zone_ptr());
+      result->at(0).push_back(ts::TimedValue(lt, ts::Value(station)));
+      result->at(1).push_back(ts::TimedValue(lt, ts::Value(double((t - origin).total_seconds()))));
+    }
+  }
+  return result;
+}
+
+std::map<int, std::vector<std::pair<pt::ptime, double>>> by_station(
+    const ts::TimeSeriesVector& result)
+{
+  std::map<int, std::vector<std::pair<pt::ptime, double>>> rows;
+  for (std::size_t i = 0; i < result.at(0).size(); i++)
+    rows[boost::get<int>(result[0][i].value)].emplace_back(result[1][i].time.utc_time(),
+                                                           boost::get<double>(result[1][i].value));
+  return rows;
+}
+}  // namespace
+
+BOOST_AUTO_TEST_CASE(test_make_time_slices)
+{
+  BOOST_TEST_MESSAGE("+ [Splitting time interval into slices]");
+
+  const pt::ptime begin = pt::time_from_string("2020-01-01 00:00:00");
+  const pt::ptime end = pt::time_from_string("2020-01-01 10:00:00");
+
+  auto slices = make_time_slices(begin, end, pt::hours(4));
+  BOOST_REQUIRE_EQUAL(3, (int)slices.size());
+  BOOST_CHECK_EQUAL(begin, slices[0].begin);
+  BOOST_CHECK_EQUAL(begin + pt::hours(4), slices[0].end);
+  BOOST_CHECK_EQUAL(begin + pt::hours(4), slices[1].begin);
+  BOOST_CHECK_EQUAL(begin + pt::hours(8), slices[1].end);
+  BOOST_CHECK_EQUAL(begin + pt::hours(8), slices[2].begin);
+  BOOST_CHECK_EQUAL(end, slices[2].end);
+
+  BOOST_CHECK_EQUAL(1, (int)make_time_slices(begin, end, pt::hours(10)).size());
+  BOOST_CHECK_EQUAL(1, (int)make_time_slices(begin, end, pt::hours(0)).size());
+  BOOST_CHECK_EQUAL(1, (int)make_time_slices(begin, begin, pt::hours(1)).size());
+  BOOST_CHECK_EQUAL(2, (int)make_time_slices(begin, end, pt::hours(5)).size());
+}
+
+BOOST_AUTO_TEST_CASE(test_sliced_query_matches_single_query)
+{
+  BOOST_TEST_MESSAGE("+ [Sliced query returns the same rows as a single query]");
+
+  const pt::ptime begin = pt::time_from_string("2020-01-01 00:00:00");
+  const pt::ptime end = pt::time_from_string("2020-01-03 23:59:59");
+
+  const auto expected = by_station(*fake_query(begin, end));
+  BOOST_REQUIRE_EQUAL(2, (int)expected.size());
+
+  // 20.5 minutes divides 41 minutes, so that some observations are at slice boundaries
+  for (const pt::time_duration& slice_length :
+       {pt::time_duration(0, 41, 0), pt::time_duration(5, 0, 0), pt::time_duration(24, 0, 0)})
+  {
+    for (std::size_t max_threads : {1, 4})
+    {
+      const auto result = time_sliced_query(begin, end, slice_length, max_threads, &fake_query);
+      BOOST_REQUIRE_EQUAL(2, (int)result->size());
+      BOOST_CHECK(expected == by_station(*result));
+    }
+  }
+}
+
+BOOST_AUTO_TEST_CASE(test_merge_empty_slices)
+{
+  BOOST_TEST_MESSAGE("+ [Merging results with empty slices]");
+
+  const pt::ptime begin = pt::time_from_string("2020-01-01 00:00:00");
+  const pt::ptime end = pt::time_from_string("2020-01-01 02:03:00");
+  const auto slices = make_time_slices(begin, end, pt::minutes(41));
+  BOOST_REQUIRE_EQUAL(3, (int)slices.size());
+
+  std::vector<ts::TimeSeriesVectorPtr> results(slices.size());
+  BOOST_CHECK(merge_time_slices(slices, results)->empty());
+
+  results[1] = fake_query(slices[1].begin, slices[1].end);
+  const auto merged = merge_time_slices(slices, results);
+  BOOST_REQUIRE_EQUAL(2, (int)merged->size());
+  // The row at the end of the middle slice belongs to the last slice
+  BOOST_CHECK_EQUAL(results[1]->at(0).size() - 2, merged->at(0).size());
+
+  results.pop_back();
+  BOOST_CHECK_THROW(merge_time_slices(slices, results), std::exception);
+}
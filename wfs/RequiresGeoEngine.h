@@ -3,6 +3,9 @@
 #include "StoredQueryHandlerInitBase.h"
 #include <spine/Reactor.h>
 #include <engines/geonames/Engine.h>
+#include <macgyver/TimedCache.h>
+#include <chrono>
+#include <string>
 
 namespace SmartMet
 {
@@ -15,6 +18,7 @@ class RequiresGeoEngine : protected virtual StoredQueryHandlerInitBase
 {
 public:
   RequiresGeoEngine(SmartMet::Spine::Reactor* reactor)
+    : location_cache(10000, std::chrono::hours(1))
     {
         add_init_action(
             "Acquire Geoengine",
@@ -24,7 +28,29 @@ public:
     }
 
 protected:
+  /**
+   *   @brief Get station location by geoid using a cache of recent lookups
+   *
+   *   Station locations change very rarely, but the same stations are decorated
+   *   in almost every observation response. Unknown geoids are cached too (as
+   *   null pointers) so that they are not searched again on every request.
+   */
+  SmartMet::Spine::LocationPtr cached_id_search(long geoid, const std::string& language) const
+  {
+    const std::string key = std::to_string(geoid) + ':' + language;
+    auto cached = location_cache.find(key);
+    if (cached)
+      return *cached;
+
+    SmartMet::Spine::LocationPtr location = geo_engine->idSearch(geoid, language);
+    location_cache.insert(key, location);
+    return location;
+  }
+
   SmartMet::Engine::Geonames::Engine* geo_engine;
+
+private:
+  mutable Fmi::TimedCache::Cache<std::string, SmartMet::Spine::LocationPtr> location_cache;
 };
 
 }  // namespace WFS
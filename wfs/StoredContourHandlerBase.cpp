@@ -1,4 +1,8 @@
 #include "StoredContourHandlerBase.h"
+#include "ContourCache.h"
+#include "ContourSimplification.h"
+#include "GeoJsonUtils.h"
+#include "ParallelFor.h"
 #include <boost/algorithm/string/replace.hpp>
 #include <boost/format.hpp>
 #include <gis/Box.h>
@@ -10,7 +14,9 @@
 #include <macgyver/StringConversion.h>
 #include <macgyver/TimeParser.h>
 #include <newbase/NFmiEnumConverter.h>
+#include <cmath>
 #include <iomanip>
+#include <sstream>
 
 namespace bw = SmartMet::Plugin::WFS;
 
@@ -24,8 +30,79 @@ const char* P_CRS = "crs";
 const char* P_SMOOTHING = "smoothing";
 const char* P_SMOOTHING_DEGREE = "smoothing_degree";
 const char* P_SMOOTHING_SIZE = "smoothing_size";
+const char* P_SIMPLIFICATION = "simplification";
 const char* P_IMAGE_DIR = "imageDir";
 const char* P_IMAGE_FILE = "imageFile";
+
+/**
+ *   @brief Simplify contours so that boundaries shared by adjacent bands stay shared
+ *
+ *   See bw::simplify_contour() for details.
+ */
+bw::ContourCache::GeometriesPtr simplifyContours(const bw::ContourCache::Geometries& contours,
+                                                 double tolerance)
+{
+  try
+  {
+    std::shared_ptr<bw::ContourCache::Geometries> result(new bw::ContourCache::Geometries);
+    for (const auto& contour : contours)
+    {
+      OGRGeometryPtr geom = contour->get_geometry();
+      if (geom && !geom->IsEmpty())
+        geom = bw::simplify_contour(*geom, tolerance);
+      result->emplace_back(new bw::ContourGeometryIndex(geom));
+    }
+    return result;
+  }
+  catch (...)
+  {
+    throw Fmi::Exception::Trace(BCP, "Operation failed!");
+  }
+}
+
+/**
+ *   @brief Describe the contouring options for the contour cache key
+ *
+ *   All the options set by the handlers are written out in full, so that the key
+ *   of different options can never be the same.
+ */
+std::string contourCacheKey(const SmartMet::Engine::Contour::Options& options)
+{
+  try
+  {
+    std::ostringstream key;
+    key << std::setprecision(17) << ";param=" << options.parameter.name() << '/'
+        << options.parameter.number() << ";time=" << options.time;
+    if (options.level)
+      key << ";level=" << *options.level;
+    if (not options.isovalues.empty())
+    {
+      key << ";isovalues=";
+      for (double value : options.isovalues)
+        key << value << ',';
+    }
+    if (not options.limits.empty())
+    {
+      key << ";limits=";
+      for (const auto& range : options.limits)
+      {
+        if (range.lolimit)
+          key << *range.lolimit;
+        key << ':';
+        if (range.hilimit)
+          key << *range.hilimit;
+        key << ',';
+      }
+    }
+    // Covers options with engine defaults which the handlers do not set
+    key << ";options=" << options.hash_value();
+    return key.str();
+  }
+  catch (...)
+  {
+    throw Fmi::Exception::Trace(BCP, "Operation failed!");
+  }
+}
 }  // anonymous namespace
 
 bw::StoredContourQueryHandler::StoredContourQueryHandler(
@@ -64,6 +141,8 @@ bw::StoredContourQueryHandler::StoredContourQueryHandler(
       register_scalar_param<uint64_t>(P_SMOOTHING_DEGREE);
     if (config->find_setting(config->get_root(), "handler_params.smoothing_size", false))
       register_scalar_param<uint64_t>(P_SMOOTHING_SIZE);
+    if (config->find_setting(config->get_root(), "handler_params.simplification", false))
+      register_scalar_param<double>(P_SIMPLIFICATION);
 
     // read contour parameters from config and check validity
     name = config->get_mandatory_config_param<std::string>("contour_param.name");
@@ -79,6 +158,19 @@ bw::StoredContourQueryHandler::StoredContourQueryHandler(
       throw exception;
     }
     id = static_cast<FmiParameterName>(cpid);
+
+    // maximal number of timesteps contoured concurrently for one request
+    max_threads = config->get_optional_config_param<unsigned>("maxThreads", 4);
+
+    // target resolution (pixels across the bounding box) for automatic simplification
+    simplification_resolution =
+        config->get_optional_config_param<double>("simplificationResolution", 1000.0);
+    if (simplification_resolution <= 0.0)
+    {
+      Fmi::Exception exception(BCP, "Invalid simplificationResolution value!");
+      exception.addParameter(WFS_EXCEPTION_CODE, WFS_INVALID_PARAMETER_VALUE);
+      throw exception;
+    }
   }
   catch (...)
   {
@@ -88,6 +180,33 @@ bw::StoredContourQueryHandler::StoredContourQueryHandler(
 
 bw::StoredContourQueryHandler::~StoredContourQueryHandler() {}
 
+double bw::StoredContourQueryHandler::get_simplification_tolerance(
+    const RequestParameterMap& params, const SmartMet::Spine::BoundingBox& bbox) const
+{
+  try
+  {
+    // Automatic simplification unless a tolerance is given (0 disables simplification)
+    double tolerance = params.get_optional<double>(P_SIMPLIFICATION, -1.0);
+    if (tolerance < 0.0)
+    {
+      // Automatic: about one pixel when the bounding box is drawn at the target resolution
+      const double size = std::max(bbox.xMax - bbox.xMin, bbox.yMax - bbox.yMin);
+      tolerance = std::max(size, 0.0) / simplification_resolution;
+    }
+
+    if (tolerance <= 0.0)
+      return 0.0;
+
+    // Round down to a power of two so that simplified contours can be cached per
+    // tolerance level and shared by requests with slightly different bounding boxes
+    return std::pow(2.0, std::floor(std::log2(tolerance)));
+  }
+  catch (...)
+  {
+    throw Fmi::Exception::Trace(BCP, "Operation failed!");
+  }
+}
+
 bw::ContourQueryResultSet bw::StoredContourQueryHandler::getContours(
     const ContourQueryParameter& queryParameter) const
 {
@@ -117,13 +236,42 @@ bw::ContourQueryResultSet bw::StoredContourQueryHandler::getContours_qEngine(
 {
   try
   {
-    ContourQueryResultSet ret;
+    // Querydata access changes the state of the shared Q object (selected parameter,
+    // level and time), so the data is selected sequentially. Only contouring and
+    // clipping of the timesteps is done in parallel.
 
+    struct TimeStep
+    {
+      boost::posix_time::ptime utctime;
+      std::unique_ptr<SmartMet::Engine::Contour::Options> options;
+      std::string cache_key;
+      std::string simplified_key;
+      ValuesPtr matrix;
+      ContourCache::GeometriesPtr contours;
+      ContourCache::GeometriesPtr geoms;
+      ContourQueryResultPtr result;
+    };
+
+    // Unclipped contours are cached by everything else except the bounding box
+    ContourCache& contour_cache = plugin_impl.get_contour_cache();
+    const bool use_cache = contour_cache.get_max_size() > 0;
+
+    const auto qhash = queryParameter.q->hashValue();
+    std::ostringstream request_key;
+    request_key << "data=" << qhash << ";id=" << static_cast<int>(id)
+                << ";crs=" << Fmi::OGR::exportToWkt(queryParameter.sr);
+    CoordinatesPtr coords;
+
+    const double simplification = queryParameter.simplification;
+
+    std::vector<TimeStep> timesteps;
     for (auto& timestep : queryParameter.tlist)
     {
-      boost::posix_time::ptime utctime(timestep.utc_time());
-
-      SmartMet::Engine::Contour::Options options(getContourEngineOptions(utctime, queryParameter));
+      TimeStep item;
+      item.utctime = timestep.utc_time();
+      item.options.reset(new SmartMet::Engine::Contour::Options(
+          getContourEngineOptions(item.utctime, queryParameter)));
+      auto& options = *item.options;
 
       if (queryParameter.smoothing)
       {
@@ -131,11 +279,29 @@ bw::ContourQueryResultSet bw::StoredContourQueryHandler::getContours_qEngine(
         options.filter_size = queryParameter.smoothing_size;
       }
 
-      std::vector<OGRGeometryPtr> geoms;
+      item.cache_key = request_key.str() + contourCacheKey(options);
+      if (queryParameter.smoothing)
+        item.cache_key += ";smoothing=" + std::to_string(queryParameter.smoothing_degree) + '/' +
+                          std::to_string(queryParameter.smoothing_size);
+      std::ostringstream simplified_key;
+      simplified_key << item.cache_key << ";simplification=" << std::setprecision(17)
+                     << simplification;
+      item.simplified_key = simplified_key.str();
+      if (use_cache)
+      {
+        if (simplification > 0.0)
+          item.geoms = contour_cache.find(item.simplified_key);
+        if (!item.geoms)
+          item.contours = contour_cache.find(item.cache_key);
+        if (item.geoms || item.contours)
+        {
+          timesteps.push_back(std::move(item));
+          continue;
+        }
+      }
 
       try
       {
-        auto qhash = queryParameter.q->hashValue();
         auto valueshash = qhash;
         Fmi::hash_combine(valueshash, options.data_hash_value());
 
@@ -161,71 +327,107 @@ bw::ContourQueryResultSet bw::StoredContourQueryHandler::getContours_qEngine(
           }
         }
 
-        auto matrix = q_engine->getValues(queryParameter.q, valueshash, options.time);
-        CoordinatesPtr coords = q_engine->getWorldCoordinates(queryParameter.q, queryParameter.sr);
+        item.matrix = q_engine->getValues(queryParameter.q, valueshash, options.time);
 
-        geoms = contour_engine->contour(qhash,
-                                        queryParameter.q->SpatialReference(),
-                                        queryParameter.sr,
-                                        *matrix,
-                                        *coords,
-                                        options);
+        // Coordinates do not depend on time: fetch them only once
+        if (!coords)
+          coords = q_engine->getWorldCoordinates(queryParameter.q, queryParameter.sr);
       }
       catch (const std::exception& e)
       {
         continue;
       }
-#ifdef MYDEBUG
-      if (pGeom->getGeometryType() == wkbMultiPolygon)
-      {
-        std::cout << "MULTIPOLYGON" << std::endl;
-      }
-      else if (pGeom->getGeometryType() == wkbPolygon)
-      {
-        std::cout << "POLYGON" << std::endl;
-      }
-      else if (pGeom->getGeometryType() == wkbLinearRing)
-      {
-        std::cout << "LINEAR RING" << std::endl;
-      }
-      else if (pGeom->getGeometryType() == wkbLineString)
-      {
-        std::cout << "LINE STRING" << std::endl;
-      }
-      else if (pGeom->getGeometryType() == wkbMultiLineString)
-      {
-        std::cout << "MULTILINE STRING" << std::endl;
-      }
-      else if (pGeom->getGeometryType() == wkbGeometryCollection)
-      {
-        std::cout << "GEOMETRY COLLECTION" << std::endl;
-      }
-      else
-      {
-        std::cout << "Unknown geometry: " << pGeom->getGeometryType() << std::endl;
-      }
-#endif
 
-      // if no geometry just continue
-      if (geoms.empty())
-        continue;
+      timesteps.push_back(std::move(item));
+    }
 
-      // clip the geometry into bounding box
-      Fmi::Box bbox(queryParameter.bbox.xMin,
-                    queryParameter.bbox.yMin,
-                    queryParameter.bbox.xMax,
-                    queryParameter.bbox.yMax,
-                    0,
-                    0);
+    parallel_for(timesteps.size(),
+                 max_threads,
+                 [&](std::size_t i)
+                 {
+                   auto& item = timesteps[i];
+                   if (!item.geoms && !item.contours)
+                   {
+                     std::vector<OGRGeometryPtr> contours;
+                     try
+                     {
+                       contours = contour_engine->contour(qhash,
+                                                          queryParameter.q->SpatialReference(),
+                                                          queryParameter.sr,
+                                                          *item.matrix,
+                                                          *coords,
+                                                          *item.options);
+                     }
+                     catch (const std::exception& e)
+                     {
+                       return;
+                     }
+
+                     std::shared_ptr<ContourCache::Geometries> geoms(
+                         new ContourCache::Geometries);
+                     for (const auto& contour : contours)
+                       geoms->emplace_back(new ContourGeometryIndex(contour));
+
+                     item.contours = geoms;
+                     if (use_cache)
+                       contour_cache.insert(item.cache_key, item.contours);
+                   }
+
+                   if (!item.geoms)
+                   {
+                     if (simplification > 0.0)
+                     {
+                       item.geoms = simplifyContours(*item.contours, simplification);
+                       if (use_cache)
+                         contour_cache.insert(item.simplified_key, item.geoms);
+                     }
+                     else
+                     {
+                       item.geoms = item.contours;
+                     }
+                   }
+
+                   // if no geometry just continue
+                   if (item.geoms->empty())
+                     return;
+
+                   // clip the geometry into bounding box
+                   Fmi::Box bbox(queryParameter.bbox.xMin,
+                                 queryParameter.bbox.yMin,
+                                 queryParameter.bbox.xMax,
+                                 queryParameter.bbox.yMax,
+                                 0,
+                                 0);
+
+                   OGREnvelope envelope;
+                   envelope.MinX = queryParameter.bbox.xMin;
+                   envelope.MinY = queryParameter.bbox.yMin;
+                   envelope.MaxX = queryParameter.bbox.xMax;
+                   envelope.MaxY = queryParameter.bbox.yMax;
+
+                   // Only the parts of the contours near the bounding box are clipped.
+                   // The formatters assign a spatial reference to the geometries, so
+                   // a geometry still shared with the cache is copied before use.
+                   ContourQueryResultPtr cgr(new ContourQueryResult());
+                   for (const auto& index : *item.geoms)
+                   {
+                     bool within = false;
+                     OGRGeometryPtr geom = index->select(envelope, within);
+                     if (!within)
+                       clipGeometry(geom, bbox);
+                     if (geom == index->get_geometry())
+                       geom.reset(geom->clone());
+                     cgr->area_geoms.push_back(WeatherAreaGeometry(item.utctime, geom));
+                   }
+                   item.result = cgr;
+                 });
+
+    // Results are collected in time order
+    ContourQueryResultSet ret;
+    for (const auto& item : timesteps)
+      if (item.result)
+        ret.push_back(item.result);
 
-      ContourQueryResultPtr cgr(new ContourQueryResult());
-      for (auto geom : geoms)
-      {
-        clipGeometry(geom, bbox);
-        cgr->area_geoms.push_back(WeatherAreaGeometry(utctime, geom));
-      }
-      ret.push_back(cgr);
-    }
     return ret;
   }
   catch (...)
@@ -561,8 +763,17 @@ void bw::StoredContourQueryHandler::query_qEngine(const StoredQuery& stored_quer
     if (requestedCRS.compare(query_param->bbox.crs) != 0)
       query_param->bbox = transform_bounding_box(query_param->bbox, requestedCRS);
 
+    query_param->simplification = get_simplification_tolerance(sq_params, query_param->bbox);
+
     std::vector<ContourQueryResultPtr> query_results(processQuery(*query_param));
 
+    if (stored_query.get_use_geojson_format())
+    {
+      formatGeoJson(
+          query_results, requestedCRS, origintime, stored_query.get_query_id(), output);
+      return;
+    }
+
     SmartMet::Spine::CRSRegistry& crsRegistry = plugin_impl.get_crs_registry();
 
     parseQueryResults(query_results,
@@ -814,6 +1025,13 @@ void bw::StoredContourQueryHandler::query_gridEngine(const StoredQuery& stored_q
     if (modificationTimeStr > " ")
       modificationtime = boost::posix_time::ptime(Fmi::TimeParser::parse_iso(modificationTimeStr));
 
+    if (stored_query.get_use_geojson_format())
+    {
+      formatGeoJson(
+          query_results, requestedCRS, origintime, stored_query.get_query_id(), output);
+      return;
+    }
+
     parseQueryResults(query_results,
                       query_param->bbox,
                       language,
@@ -833,6 +1051,83 @@ void bw::StoredContourQueryHandler::query_gridEngine(const StoredQuery& stored_q
   }
 }
 
+bool bw::StoredContourQueryHandler::supports_output_format(const std::string& format) const
+{
+  return format == StandardPresentationParameters::GEOJSON_OUTPUT_FORMAT or
+         StoredQueryHandlerBase::supports_output_format(format);
+}
+
+void bw::StoredContourQueryHandler::setResultJsonValue(Json::Value& properties,
+                                                       const ContourQueryResult& resultItem) const
+{
+  properties["name"] = resultItem.name;
+  if (!resultItem.unit.empty())
+    properties["unit"] = resultItem.unit;
+}
+
+void bw::StoredContourQueryHandler::formatGeoJson(
+    const std::vector<ContourQueryResultPtr>& query_results,
+    const std::string& requestedCRS,
+    const boost::posix_time::ptime& origintime,
+    int sq_id,
+    std::ostream& output) const
+{
+  try
+  {
+    // Contours are calculated in the requested CRS, but GeoJSON coordinates are always WGS84.
+    // Importing the CRS resets the axis mapping strategy, so it is set afterwards.
+    OGRSpatialReference sourceSRS;
+    std::string sourceURN("urn:ogc:def:crs:" + requestedCRS);
+    if (sourceSRS.importFromURN(sourceURN.c_str()) != OGRERR_NONE)
+      throw Fmi::Exception(BCP, "Invalid crs '" + requestedCRS + "'!");
+    sourceSRS.SetAxisMappingStrategy(OAMS_TRADITIONAL_GIS_ORDER);
+
+    OGRSpatialReference targetSRS;
+    targetSRS.SetWellKnownGeogCS("WGS84");
+    targetSRS.SetAxisMappingStrategy(OAMS_TRADITIONAL_GIS_ORDER);
+
+    std::unique_ptr<OGRCoordinateTransformation> transformation;
+    if (not sourceSRS.IsSame(&targetSRS))
+    {
+      transformation.reset(OGRCreateCoordinateTransformation(&sourceSRS, &targetSRS));
+      if (not transformation)
+        throw Fmi::Exception(BCP, "Failed to create coordinate transformation to WGS84");
+    }
+
+    Json::Value collection = GeoJson::create_feature_collection(plugin_impl.get_time_stamp());
+    std::size_t feature_index = 0;
+    for (ContourQueryResultPtr result_item : query_results)
+    {
+      for (auto& area_geom : result_item->area_geoms)
+      {
+        OGRGeometryPtr geom = area_geom.geometry;
+        if (!geom || geom->IsEmpty())
+          continue;
+
+        std::unique_ptr<OGRGeometry> tmp(geom->clone());
+        if (transformation and tmp->transform(transformation.get()) != OGRERR_NONE)
+          throw Fmi::Exception(BCP, "Failed to transform contour geometry to WGS84");
+
+        // The query number keeps the ids unique when responses of several queries are merged
+        const std::string id =
+            "contour." + std::to_string(sq_id) + "." + std::to_string(++feature_index);
+        Json::Value& properties = GeoJson::add_feature(collection, id, *tmp);
+        properties["time"] = Fmi::to_iso_extended_string(area_geom.timestamp) + "Z";
+        if (not origintime.is_not_a_date_time())
+          properties["analysisTime"] = Fmi::to_iso_extended_string(origintime) + "Z";
+        setResultJsonValue(properties, *result_item);
+      }
+    }
+
+    GeoJson::update_counts(collection);
+    GeoJson::write(collection, output);
+  }
+  catch (...)
+  {
+    throw Fmi::Exception::Trace(BCP, "Operation failed!");
+  }
+}
+
 std::string bw::StoredContourQueryHandler::double2string(double d, unsigned int precision) const
 {
   switch (precision)
@@ -1151,3 +1446,88 @@ void bw::StoredContourQueryHandler::parseQueryResults(
     throw Fmi::Exception::Trace(BCP, "Operation failed!");
   }
 }
+
+/**
+
+@page WFS_SQ_CONTOUR_QUERY_HANDLER Stored Query handlers for querying contours
+
+@section WFS_SQ_CONTOUR_QUERY_HANDLER_INTRO Introduction
+
+These stored query handlers return isolines or isobands calculated from forecast data
+with the contour engine.
+
+<table border="1">
+  <tr>
+    <td>Implementation</td>
+    <td>SmartMet::Plugin::WFS::StoredIsolineQueryHandler,
+        SmartMet::Plugin::WFS::StoredCoverageQueryHandler,
+        SmartMet::Plugin::WFS::StoredWWCoverageQueryHandler</td>
+  </tr>
+  <tr>
+    <td>constructor name (for stored query configuration)</td>
+    <td>@b wfs_isoline_query_handler_factory, @b wfs_coverage_query_handler_factory,
+        @b wfs_winterweather_coverage_query_handler_factory</td>
+</table>
+
+@section WFS_SQ_CONTOUR_QUERY_HANDLER_PARAMS Query handler built-in parameters
+
+The following stored query handler parameter groups are being used by these stored query handlers:
+- @ref WFS_SQ_PARAM_BBOX
+- @ref WFS_SQ_TIME_PARAMS
+- @ref WFS_SQ_TIME_ZONE
+
+Additionally to parameters from these groups the following parameters are also in use
+
+<table border="1">
+
+<tr>
+<th>Entry name</th>
+<th>Type</th>
+<th>Data type</th>
+<th>Description</th>
+</tr>
+
+<tr>
+  <td>simplification</td>
+  <td>@ref WFS_CFG_SCALAR_PARAM_TMPL</td>
+  <td>double</td>
+  <td>Optional. Tolerance of contour simplification in units of the requested CRS.
+      0 disables simplification. A negative value or leaving the parameter out selects
+      the tolerance automatically (see @b simplificationResolution). The tolerance is
+      rounded down to a power of two. Vertices are snapped to a grid of the tolerance,
+      so that boundaries shared by adjacent isobands are simplified identically.</td>
+</tr>
+
+</table>
+
+The following handler configuration settings are also supported
+
+<table border="1">
+
+<tr>
+<th>Setting</th>
+<th>Data type</th>
+<th>Use</th>
+<th>Description</th>
+</tr>
+
+<tr>
+  <td>maxThreads</td>
+  <td>unsigned integer</td>
+  <td>optional (default 4)</td>
+  <td>Maximal number of threads used for contouring the timesteps of one request.
+      Value 1 disables parallel contouring.</td>
+</tr>
+
+<tr>
+  <td>simplificationResolution</td>
+  <td>double</td>
+  <td>optional (default 1000)</td>
+  <td>Target resolution (pixels across the larger side of the bounding box) of automatic
+      simplification. The automatic tolerance is the size of the bounding box divided
+      by this value.</td>
+</tr>
+
+</table>
+
+*/
@@ -15,6 +15,7 @@
 #include "RequiresGeoEngine.h"
 
 #include <gis/OGR.h>
+#include <json/json.h>
 
 namespace SmartMet
 {
@@ -45,6 +46,8 @@ class StoredContourQueryHandler : public StoredQueryHandlerBase,
 		     const boost::optional<std::string>& hostname,
                      std::ostream& output) const;
 
+  virtual bool supports_output_format(const std::string& format) const;
+
  protected:
 
   virtual void  query_qEngine(
@@ -69,14 +72,28 @@ class StoredContourQueryHandler : public StoredQueryHandlerBase,
   virtual void setResultHashValue(CTPP::CDT& resultHash,
                                   const ContourQueryResult& resultItem) const = 0;
 
+  /**
+   *   @brief Set result item specific GeoJSON feature properties (name and unit by default)
+   */
+  virtual void setResultJsonValue(Json::Value& properties,
+                                  const ContourQueryResult& resultItem) const;
+
   ContourQueryResultSet getContours(const ContourQueryParameter& queryParameter) const;
   ContourQueryResultSet getContours_qEngine(const ContourQueryParameter& queryParameter) const;
   ContourQueryResultSet getContours_gridEngine(const ContourQueryParameter& queryParameter) const;
 
   std::string name;
   FmiParameterName id;
+  std::size_t max_threads;
+  double simplification_resolution;
 
  private:
+  /**
+   *   @brief Get the contour simplification tolerance of the request (0 for none)
+   */
+  double get_simplification_tolerance(const RequestParameterMap& params,
+                                      const SmartMet::Spine::BoundingBox& bbox) const;
+
   std::string formatCoordinates(const OGRGeometry* geom,
                                 bool latLonOrder,
                                 unsigned int precision) const;
@@ -90,6 +107,11 @@ class StoredContourQueryHandler : public StoredQueryHandlerBase,
                          const boost::posix_time::ptime& modificationtime,
                          const std::string& tz_name,
                          CTPP::CDT& hash) const;
+  void formatGeoJson(const std::vector<ContourQueryResultPtr>& query_results,
+                     const std::string& requestedCRS,
+                     const boost::posix_time::ptime& origintime,
+                     int sq_id,
+                     std::ostream& output) const;
   void parsePolygon(OGRPolygon* polygon,
                     bool latLonOrder,
                     unsigned int precision,
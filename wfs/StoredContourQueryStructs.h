@@ -31,6 +31,7 @@ struct ContourQueryParameter
   bool smoothing;
   unsigned short smoothing_degree;
   unsigned short smoothing_size;
+  double simplification;  // tolerance in units of the output CRS, 0 means no simplification
   SmartMet::Spine::TimeSeriesGenerator::LocalTimeList tlist;
   mutable QueryServer::Query gridQuery;
 
@@ -44,7 +45,8 @@ struct ContourQueryParameter
         tz_name("UTC"),
         smoothing(false),
         smoothing_degree(2),
-        smoothing_size(2)
+        smoothing_size(2),
+        simplification(0.0)
   {
   }
   virtual ~ContourQueryParameter() {}
@@ -1,9 +1,11 @@
 #include "stored_queries/StoredGridForecastQueryHandler.h"
+#include "CsvWriter.h"
 #include "FeatureID.h"
 #include "StoredQueryHandlerFactoryDef.h"
 #include "WfsConvenience.h"
 #include <boost/algorithm/string.hpp>
 #include <boost/math/constants/constants.hpp>
+#include <boost/optional.hpp>
 #include <boost/format.hpp>
 #include <macgyver/StringConversion.h>
 #include <macgyver/TimeFormatter.h>
@@ -205,7 +207,8 @@ void StoredGridForecastQueryHandler::query(const StoredQuery& stored_query, cons
         parse_times(params, query);
 
         const std::string crs = params.get_single<std::string>(P_CRS);
-        auto transformation = plugin_impl.get_crs_registry().create_transformation("urn:ogc:def:crs:EPSG::4326", crs);
+        CoordinateTransformationCache transformation(
+            plugin_impl.get_crs_registry().create_transformation("urn:ogc:def:crs:EPSG::4326", crs));
         bool show_height = false;
         std::string proj_uri = "UNKNOWN";
         std::string proj_epoch_uri = "UNKNOWN";
@@ -214,6 +217,12 @@ void StoredGridForecastQueryHandler::query(const StoredQuery& stored_query, cons
         plugin_impl.get_crs_registry().get_attribute(crs, "projEpochUri", &proj_epoch_uri);
 
         query.result = extract_forecast(query);
+        if (stored_query.get_use_csv_format())
+        {
+          write_csv(query, output);
+          return;
+        }
+
         const std::size_t num_rows = query.result->rows().size();
 
         std::set<std::string> geo_id_set;
@@ -356,7 +365,10 @@ void StoredGridForecastQueryHandler::query(const StoredQuery& stored_query, cons
 
               CTPP::CDT& row_data = group["returnArray"][row_counter++];
 
-              set_2D_coord(transformation, query.result->get(ind_lat, i), query.result->get(ind_lon, i), row_data);
+              set_2D_coord(transformation,
+                           std::stod(query.result->get(ind_lat, i)),
+                           std::stod(query.result->get(ind_lon, i)),
+                           row_data);
 
               if (show_height)
               {
@@ -415,12 +427,140 @@ void StoredGridForecastQueryHandler::query(const StoredQuery& stored_query, cons
 
 
 
+bool StoredGridForecastQueryHandler::supports_output_format(const std::string& format) const
+{
+  return format == StandardPresentationParameters::CSV_OUTPUT_FORMAT or
+         StoredQueryHandlerBase::supports_output_format(format);
+}
+
+
+
+
+
+void StoredGridForecastQueryHandler::write_csv(const Query& query, std::ostream& output) const
+{
+  try
+  {
+    CsvWriter csv(output);
+    std::vector<std::string> header = {"geoid", "name", "latitude", "longitude", "time", "level"};
+    for (std::size_t k = query.first_data_ind; k <= query.last_data_ind; k++)
+      header.push_back(query.data_params.at(k).name());
+    csv.write_header(header);
+
+    const auto add_value = [&csv, &query](const std::string& value) {
+      if (value.empty() or value == query.missing_text)
+        csv.add_empty_field();
+      else
+        csv.add_field(remove_trailing_0(value));
+    };
+
+    // Rows of a site are consecutive in the result table
+    std::string tz_geoid;
+    lt::time_zone_ptr tzp;
+    const std::size_t num_rows = query.result->rows().size();
+    for (std::size_t i = 0; i < num_rows; i++)
+    {
+      const std::string geoid = query.result->get(ind_geoid, i);
+      const std::string latitude = query.result->get(ind_lat, i);
+      const std::string longitude = query.result->get(ind_lon, i);
+      if (i == 0 or geoid != tz_geoid)
+      {
+        tzp = get_tz_for_site(Fmi::stod(longitude), Fmi::stod(latitude), query.tz_name);
+        tz_geoid = geoid;
+      }
+
+      const pt::ptime epoch = Fmi::TimeParser::parse_iso(query.result->get(ind_epoch, i));
+      csv.add_field(geoid);
+      csv.add_field(query.result->get(ind_place, i));
+      csv.add_field(latitude);
+      csv.add_field(longitude);
+      csv.add_field(format_local_time(epoch, tzp));
+      add_value(query.result->get(ind_level, i));
+      for (std::size_t k = query.first_data_ind; k <= query.last_data_ind; k++)
+        add_value(query.result->get(k, i));
+      csv.end_row();
+    }
+  }
+  catch (...)
+  {
+    throw Fmi::Exception(BCP, "Operation failed!", NULL);
+  }
+}
+
+
+
+
+
+/**
+ * @brief Producer and generation information of the grid engine resolved once per request
+ *
+ * The same producer and generation ids are repeated in the values of every parameter,
+ * time step and location, and each lookup is a request to the content server.
+ * Failed lookups are remembered too.
+ */
+class StoredGridForecastQueryHandler::GridInfoLookup
+{
+  public:
+
+    GridInfoLookup(Engine::Grid::Engine& engine) : engine(engine) {}
+
+    const std::string* getProducerName(uint producerId)
+    {
+      auto it = producerNames.find(producerId);
+      if (it == producerNames.end())
+      {
+        boost::optional<std::string> name;
+        T::ProducerInfo info;
+        if (engine.getProducerInfoById(producerId, info))
+          name = info.mName;
+        it = producerNames.emplace(producerId, name).first;
+      }
+      return it->second ? it->second.get_ptr() : nullptr;
+    }
+
+    const std::string* getAnalysisTime(uint generationId)
+    {
+      auto it = analysisTimes.find(generationId);
+      if (it == analysisTimes.end())
+      {
+        boost::optional<std::string> analysisTime;
+        T::GenerationInfo info;
+        if (engine.getGenerationInfoById(generationId, info))
+          analysisTime = info.mAnalysisTime;
+        it = analysisTimes.emplace(generationId, analysisTime).first;
+      }
+      return it->second ? it->second.get_ptr() : nullptr;
+    }
+
+    const std::vector<std::string>& getProducerNameList(const std::string& producer)
+    {
+      auto it = producerNameLists.find(producer);
+      if (it == producerNameLists.end())
+      {
+        std::vector<std::string> nameList;
+        engine.getProducerNameList(producer, nameList);
+        it = producerNameLists.emplace(producer, nameList).first;
+      }
+      return it->second;
+    }
+
+  private:
+
+    Engine::Grid::Engine& engine;
+    std::map<uint, boost::optional<std::string>> producerNames;
+    std::map<uint, boost::optional<std::string>> analysisTimes;
+    std::map<std::string, std::vector<std::string>> producerNameLists;
+};
+
+
+
 uint StoredGridForecastQueryHandler::processGridQuery(
     Query& wfsQuery,
     const std::string& tag,
     const Spine::LocationPtr loc,
     std::string country,
     QueryServer::Query& gridQuery,
+    GridInfoLookup& gridInfo,
     Table_sptr output,
     uint rowCount) const
 {
@@ -619,10 +759,10 @@ uint StoredGridForecastQueryHandler::processGridQuery(
             {
               if (gridQuery.mQueryParameterList[idx].mValueList[t]->mProducerId > 0)
               {
-                T::ProducerInfo info;
-                if (grid_engine->getProducerInfoById(gridQuery.mQueryParameterList[idx].mValueList[t]->mProducerId,info))
+                const std::string* producerName = gridInfo.getProducerName(gridQuery.mQueryParameterList[idx].mValueList[t]->mProducerId);
+                if (producerName != nullptr)
                 {
-                  output->set(col, row, info.mName);
+                  output->set(col, row, *producerName);
                   idx = pLen + 10;
                 }
               }
@@ -634,8 +774,7 @@ uint StoredGridForecastQueryHandler::processGridQuery(
               std::string producer = "Unknown";
               if (gridQuery.mProducerNameList.size() == 1)
               {
-                std::vector<std::string> pnameList;
-                grid_engine->getProducerNameList(gridQuery.mProducerNameList[0], pnameList);
+                const std::vector<std::string>& pnameList = gridInfo.getProducerNameList(gridQuery.mProducerNameList[0]);
                 if (pnameList.size() > 0)
                   producer = pnameList[0];
               }
@@ -650,10 +789,10 @@ uint StoredGridForecastQueryHandler::processGridQuery(
             {
               if (gridQuery.mQueryParameterList[idx].mValueList[t]->mGenerationId > 0)
               {
-                T::GenerationInfo info;
-                if (grid_engine->getGenerationInfoById(gridQuery.mQueryParameterList[idx].mValueList[t]->mGenerationId,info))
+                const std::string* analysisTime = gridInfo.getAnalysisTime(gridQuery.mQueryParameterList[idx].mValueList[t]->mGenerationId);
+                if (analysisTime != nullptr)
                 {
-                  boost::local_time::local_date_time origTime(Fmi::TimeParser::parse_iso(info.mAnalysisTime), tz);
+                  boost::local_time::local_date_time origTime(Fmi::TimeParser::parse_iso(*analysisTime), tz);
                   output->set(col, row, wfsQuery.time_formatter->format(origTime));
                   idx = pLen + 10;
                 }
@@ -681,9 +820,9 @@ uint StoredGridForecastQueryHandler::processGridQuery(
               if (gridQuery.mQueryParameterList[p].mValueList[r]->mForecastTimeUTC == *ft)
               {
                 std::string producerName;
-                T::ProducerInfo producer;
-                if (grid_engine->getProducerInfoById(gridQuery.mQueryParameterList[p].mValueList[r]->mProducerId,producer))
-                  producerName = producer.mName;
+                const std::string* name = gridInfo.getProducerName(gridQuery.mQueryParameterList[p].mValueList[r]->mProducerId);
+                if (name != nullptr)
+                  producerName = *name;
 
                 sprintf(tmp, "%s:%d:%d:%d:%d:%s", gridQuery.mQueryParameterList[p].mValueList[r]->mParameterKey.c_str(),
                     (int) gridQuery.mQueryParameterList[p].mValueList[r]->mParameterLevelId, (int) gridQuery.mQueryParameterList[p].mValueList[r]->mParameterLevel,
@@ -716,11 +855,11 @@ uint StoredGridForecastQueryHandler::processGridQuery(
 
     if (generationId > 0)
     {
-      T::GenerationInfo info;
-      if (grid_engine->getGenerationInfoById(generationId,info))
+      const std::string* analysisTime = gridInfo.getAnalysisTime(generationId);
+      if (analysisTime != nullptr)
       {
         //boost::local_time::local_date_time origTime(boost::posix_time::from_iso_string(info->mAnalysisTime), tz);
-        wfsQuery.origin_time.reset(new pt::ptime(Fmi::TimeParser::parse_iso(info.mAnalysisTime)));
+        wfsQuery.origin_time.reset(new pt::ptime(Fmi::TimeParser::parse_iso(*analysisTime)));
       }
     }
 
@@ -768,6 +907,80 @@ Table_sptr StoredGridForecastQueryHandler::extract_forecast(Query& wfsQuery) con
     wfsQuery.have_model_area = false;
     Table_sptr output(new Spine::Table);
 
+    // The producer and parameter lists do not depend on the location, so the
+    // producer mappings and parameter details are resolved only once.
+
+    std::string producerAttribute;
+    uint sz = wfsQuery.models.size();
+    if (sz > 0)
+    {
+      char tmp[1000];
+      char *p = tmp;
+      *p = '\0';
+      for (auto prod = wfsQuery.models.begin(); prod != wfsQuery.models.end(); ++prod)
+      {
+        std::string mappingName = grid_engine->getProducerName(*prod);
+
+        std::vector<std::string> nameList;
+        grid_engine->getProducerNameList(mappingName,nameList);
+        for (auto n = nameList.begin(); n != nameList.end(); ++n)
+        {
+          if (p > tmp)
+            p += sprintf(p,",%s",n->c_str());
+          else
+            p += sprintf(p,"%s",n->c_str());
+        }
+      }
+      producerAttribute = tmp;
+    }
+
+    std::string paramAttribute;
+    {
+      char tmp[10000];
+      tmp[0] = '\0';
+      char *p = tmp;
+
+      for (auto param = wfsQuery.data_params.begin(); param != wfsQuery.data_params.end(); ++param)
+      {
+        if (param != wfsQuery.data_params.begin())
+          p += sprintf(p,",");
+
+        std::string paramName = param->name();
+        std::string interpolationMethod = "";
+        auto pos = paramName.find(".raw");
+        if (pos != std::string::npos)
+        {
+          interpolationMethod = std::to_string(T::AreaInterpolationMethod::Linear);
+          paramName.erase(pos,4);
+        }
+
+        std::string name = paramName;
+
+        for (auto it = wfsQuery.models.begin(); it != wfsQuery.models.end(); ++it)
+        {
+          std::string producerName = *it;
+          producerName = grid_engine->getProducerName(producerName);
+          Engine::Grid::ParameterDetails_vec parameters;
+
+          std::string key = producerName + ";" + paramName;
+
+
+          grid_engine->getParameterDetails(producerName,paramName,parameters);
+
+          size_t len = parameters.size();
+          if (len > 0  &&  strcasecmp(parameters[0].mProducerName.c_str(),key.c_str()) != 0)
+            name = paramName + ":" + parameters[0].mProducerName + ":" + parameters[0].mGeometryId + ":" + parameters[0].mLevelId + ":" + parameters[0].mLevel + ":" + parameters[0].mForecastType + ":" + parameters[0].mForecastNumber + "::" + interpolationMethod;
+          else
+            name = paramName;
+        }
+
+        p += sprintf(p,"%s",name.c_str());
+      }
+      paramAttribute = tmp;
+    }
+
+    GridInfoLookup gridInfo(*grid_engine);
+
     uint rowCount = 0;
     for (auto tloc = wfsQuery.locations.begin(); tloc != wfsQuery.locations.end(); ++tloc)
     {
@@ -795,28 +1008,8 @@ Table_sptr StoredGridForecastQueryHandler::extract_forecast(Query& wfsQuery) con
       if (!wfsQuery.language.empty())
         attributeList.addAttribute("language",wfsQuery.language);
 
-      uint sz = wfsQuery.models.size();
-      if (sz > 0)
-      {
-        char tmp[1000];
-        char *p = tmp;
-        *p = '\0';
-        for (auto prod = wfsQuery.models.begin(); prod != wfsQuery.models.end(); ++prod)
-        {
-          std::string mappingName = grid_engine->getProducerName(*prod);
-
-          std::vector<std::string> nameList;
-          grid_engine->getProducerNameList(mappingName,nameList);
-          for (auto n = nameList.begin(); n != nameList.end(); ++n)
-          {
-            if (p > tmp)
-              p += sprintf(p,",%s",n->c_str());
-            else
-              p += sprintf(p,"%s",n->c_str());
-          }
-        }
-        attributeList.addAttribute("producer",tmp);
-      }
+      if (!wfsQuery.models.empty())
+        attributeList.addAttribute("producer",producerAttribute);
 
       if (wfsQuery.levels.size() > 0)
       {
@@ -859,48 +1052,7 @@ Table_sptr StoredGridForecastQueryHandler::extract_forecast(Query& wfsQuery) con
       if (wfsQuery.toptions->timeStep)
         attributeList.addAttribute("timestep",std::to_string(*wfsQuery.toptions->timeStep));
 
-      char tmp[10000];
-      tmp[0] = '\0';
-      char *p = tmp;
-
-      for (auto param = wfsQuery.data_params.begin(); param != wfsQuery.data_params.end(); ++param)
-      {
-        if (param != wfsQuery.data_params.begin())
-          p += sprintf(p,",");
-
-        std::string paramName = param->name();
-        std::string interpolationMethod = "";
-        auto pos = paramName.find(".raw");
-        if (pos != std::string::npos)
-        {
-          interpolationMethod = std::to_string(T::AreaInterpolationMethod::Linear);
-          paramName.erase(pos,4);
-        }
-
-        std::string name = paramName;
-
-        for (auto it = wfsQuery.models.begin(); it != wfsQuery.models.end(); ++it)
-        {
-          std::string producerName = *it;
-          producerName = grid_engine->getProducerName(producerName);
-          Engine::Grid::ParameterDetails_vec parameters;
-
-          std::string key = producerName + ";" + paramName;
-
-
-          grid_engine->getParameterDetails(producerName,paramName,parameters);
-
-          size_t len = parameters.size();
-          if (len > 0  &&  strcasecmp(parameters[0].mProducerName.c_str(),key.c_str()) != 0)
-            name = paramName + ":" + parameters[0].mProducerName + ":" + parameters[0].mGeometryId + ":" + parameters[0].mLevelId + ":" + parameters[0].mLevel + ":" + parameters[0].mForecastType + ":" + parameters[0].mForecastNumber + "::" + interpolationMethod;
-          else
-            name = paramName;
-        }
-
-        p += sprintf(p,"%s",name.c_str());
-      }
-
-      attributeList.addAttribute("param",tmp);
+      attributeList.addAttribute("param",paramAttribute);
 
       QueryServer::Query query;
       //attributeList.print(std::cout,0,0);
@@ -908,7 +1060,7 @@ Table_sptr StoredGridForecastQueryHandler::extract_forecast(Query& wfsQuery) con
 
       //query.print(std::cout,0,0);
 
-      rowCount = processGridQuery(wfsQuery,tloc->first,loc,country,query,output,rowCount);
+      rowCount = processGridQuery(wfsQuery,tloc->first,loc,country,query,gridInfo,output,rowCount);
     }
 /*
 
@@ -4,6 +4,7 @@
 #include <macgyver/TimeZones.h>
 #include <spine/Convenience.h>
 #include <macgyver/Exception.h>
+#include <cmath>
 
 namespace bw = SmartMet::Plugin::WFS;
 
@@ -15,7 +16,11 @@ namespace dt = boost::date_time;
 namespace
 {
 const char* P_TZ = "timeZone";
-}
+
+// Coordinate rounding (1/degrees) and max. size of the cache of site time zones
+const double tz_cache_resolution = 10000.0;
+const std::size_t tz_cache_max_size = 100000;
+}  // namespace
 
 bw::SupportsTimeZone::SupportsTimeZone(SmartMet::Spine::Reactor* reactor, StoredQueryConfig::Ptr config)
     : bw::StoredQueryParamRegistry(config)
@@ -57,9 +62,22 @@ lt::time_zone_ptr bw::SupportsTimeZone::get_tz_for_site(double longitude,
   {
     if (ba::iequals(tz_name, "local"))
     {
-      return geo_engine
-          ->getTimeZones()
-          .time_zone_from_coordinate(longitude, latitude);
+      const auto key = std::make_pair(std::lround(longitude * tz_cache_resolution),
+                                      std::lround(latitude * tz_cache_resolution));
+      {
+        std::lock_guard<std::mutex> lock(tz_cache_mutex);
+        auto it = tz_cache.find(key);
+        if (it != tz_cache.end())
+          return it->second;
+      }
+
+      auto tz = geo_engine->getTimeZones().time_zone_from_coordinate(longitude, latitude);
+
+      std::lock_guard<std::mutex> lock(tz_cache_mutex);
+      if (tz_cache.size() >= tz_cache_max_size)
+        tz_cache.clear();
+      tz_cache.emplace(key, tz);
+      return tz;
     }
     else
     {
@@ -114,6 +132,23 @@ std::string bw::SupportsTimeZone::format_local_time(const pt::ptime& utc_time,
   }
 }
 
+const std::string& bw::SupportsTimeZone::LocalTimeFormatter::format(const pt::ptime& utc_time,
+                                                                   lt::time_zone_ptr tz)
+{
+  try
+  {
+    auto key = std::make_pair(utc_time, tz);
+    auto it = cache.find(key);
+    if (it == cache.end())
+      it = cache.emplace(std::move(key), format_local_time(utc_time, tz)).first;
+    return it->second;
+  }
+  catch (...)
+  {
+    throw Fmi::Exception::Trace(BCP, "Operation failed!");
+  }
+}
+
 /**
 
 @page WFS_SQ_TIME_ZONE Time zone parameter
@@ -5,6 +5,10 @@
 #include "StoredQueryParamRegistry.h"
 #include "SupportsExtraHandlerParams.h"
 #include <boost/date_time/local_time/local_time.hpp>
+#include <map>
+#include <mutex>
+#include <string>
+#include <utility>
 
 namespace SmartMet
 {
@@ -34,6 +38,33 @@ class SupportsTimeZone : protected virtual SupportsExtraHandlerParams,
 
   static std::string format_local_time(const boost::posix_time::ptime& utc_time,
                                        boost::local_time::time_zone_ptr tz);
+
+  /**
+   *  @brief Formats local times reusing earlier results
+   *
+   *  Stations of a response share the same time steps and usually also the time
+   *  zone, so the same local time string is needed many times. Not thread safe:
+   *  intended to be used for a single request only.
+   */
+  class LocalTimeFormatter
+  {
+   public:
+    const std::string& format(const boost::posix_time::ptime& utc_time,
+                              boost::local_time::time_zone_ptr tz);
+
+   private:
+    std::map<std::pair<boost::posix_time::ptime, boost::local_time::time_zone_ptr>, std::string>
+        cache;
+  };
+
+ private:
+  /**
+   *  @brief Time zones of the coordinates already resolved for tz_name "local"
+   *
+   *  Coordinates are rounded to 0.0001 degrees in the key.
+   */
+  mutable std::mutex tz_cache_mutex;
+  mutable std::map<std::pair<long, long>, boost::local_time::time_zone_ptr> tz_cache;
 };
 
 }  // namespace WFS
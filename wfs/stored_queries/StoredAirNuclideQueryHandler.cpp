@@ -8,6 +8,7 @@
 #include <engines/observation/MastQuery.h>
 #include <smartmet/macgyver/Exception.h>
 #include <spine/Convenience.h>
+#include <future>
 
 namespace bw = SmartMet::Plugin::WFS;
 
@@ -190,7 +191,7 @@ void bw::StoredAirNuclideQueryHandler::query(const StoredQuery& query,
         std::string fmisidStr = std::to_string((*it).fmisid);
         stations.emplace(fmisidStr, *it);
 
-        SmartMet::Spine::LocationPtr geoLoc = geo_engine->idSearch(it->geoid, langCode);
+        SmartMet::Spine::LocationPtr geoLoc = cached_id_search(it->geoid, langCode);
         if (geoLoc)
         {
           stations[fmisidStr].country = geoLoc->country;
@@ -315,26 +316,12 @@ void bw::StoredAirNuclideQueryHandler::query(const StoredQuery& query,
         radioNuclidesQueryParams.useDistinct();
 
         radioNuclidesQuery.setQueryParams(&radioNuclidesQueryParams);
-        obs_engine->makeQuery(&radioNuclidesQuery);
 
-        std::shared_ptr<bo::QueryResult> radioNuclidesContainer =
-            radioNuclidesQuery.getQueryResultContainer();
-
-        if (radioNuclidesContainer->size())
-        {
-          bo::QueryResult::ValueVectorType::const_iterator nCodeIt =
-              radioNuclidesContainer->begin("NUCLIDE_CODE");
-          bo::QueryResult::ValueVectorType::const_iterator nCodeItEnd =
-              radioNuclidesContainer->end("NUCLIDE_CODE");
-          bo::QueryResult::ValueVectorType::const_iterator nNameIt =
-              radioNuclidesContainer->begin("NUCLIDE_NAME");
-
-          for (; nCodeIt != nCodeItEnd; ++nCodeIt, ++nNameIt)
-          {
-            nuclideNameMap.emplace(bo::QueryResult::toString(nCodeIt),
-                                   bo::QueryResult::toString(nNameIt));
-          }
-        }
+        // Nuclide names do not depend on the data: fetch them while the data query is
+        // prepared and executed.
+        auto radioNuclidesSearch =
+            std::async(std::launch::async,
+                       [this, &radioNuclidesQuery]() { obs_engine->makeQuery(&radioNuclidesQuery); });
 
         typedef std::set<int> LatestSet;
         LatestSet latestSet;
@@ -391,6 +378,27 @@ void bw::StoredAirNuclideQueryHandler::query(const StoredQuery& query,
 
         if (queryInitializationOK)
           obs_engine->makeQuery(&dataQuery);
+
+        radioNuclidesSearch.get();
+
+        std::shared_ptr<bo::QueryResult> radioNuclidesContainer =
+            radioNuclidesQuery.getQueryResultContainer();
+
+        if (radioNuclidesContainer->size())
+        {
+          bo::QueryResult::ValueVectorType::const_iterator nCodeIt =
+              radioNuclidesContainer->begin("NUCLIDE_CODE");
+          bo::QueryResult::ValueVectorType::const_iterator nCodeItEnd =
+              radioNuclidesContainer->end("NUCLIDE_CODE");
+          bo::QueryResult::ValueVectorType::const_iterator nNameIt =
+              radioNuclidesContainer->begin("NUCLIDE_NAME");
+
+          for (; nCodeIt != nCodeItEnd; ++nCodeIt, ++nNameIt)
+          {
+            nuclideNameMap.emplace(bo::QueryResult::toString(nCodeIt),
+                                   bo::QueryResult::toString(nNameIt));
+          }
+        }
       }
 
       // Get the sequence number of query in the request
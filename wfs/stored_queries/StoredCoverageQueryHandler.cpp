@@ -174,6 +174,24 @@ void bw::StoredCoverageQueryHandler::setResultHashValue(CTPP::CDT& resultHash,
   }
 }
 
+void bw::StoredCoverageQueryHandler::setResultJsonValue(Json::Value& properties,
+                                                        const ContourQueryResult& resultItem) const
+{
+  try
+  {
+    const CoverageQueryResult& coverageResultItem =
+        reinterpret_cast<const CoverageQueryResult&>(resultItem);
+
+    StoredContourQueryHandler::setResultJsonValue(properties, resultItem);
+    properties["lovalue"] = coverageResultItem.lolimit;
+    properties["hivalue"] = coverageResultItem.hilimit;
+  }
+  catch (...)
+  {
+    throw Fmi::Exception::Trace(BCP, "Operation failed!");
+  }
+}
+
 namespace
 {
 using namespace SmartMet::Plugin::WFS;
@@ -29,6 +29,7 @@ class StoredCoverageQueryHandler : public StoredContourQueryHandler
       const SmartMet::Engine::Querydata::Q& q,
       OGRSpatialReference& sr) const;
   void setResultHashValue(CTPP::CDT& resultHash, const ContourQueryResult& resultItem) const;
+  void setResultJsonValue(Json::Value& properties, const ContourQueryResult& resultItem) const;
 
   std::vector<double> itsLimits;
 
@@ -9,9 +9,11 @@
 #include <smartmet/macgyver/Exception.h>
 
 #include <boost/icl/type_traits/to_string.hpp>
+#include <chrono>
 #include <functional>
 #include <future>
 #include <memory>
+#include <sstream>
 #include <unordered_map>
 
 namespace bw = SmartMet::Plugin::WFS;
@@ -67,6 +69,17 @@ bw::StoredEnvMonitoringFacilityQueryHandler::StoredEnvMonitoringFacilityQueryHan
     register_scalar_param<bool>(P_SHOW_OBSERVING_CAPABILITY, false);
     m_missingText = config->get_optional_config_param<std::string>(P_MISSING_TEXT, "NaN");
     m_debugLevel = config->get_debug_level();
+
+    // Station metadata is cached for metadataCacheTime seconds (0 disables caching)
+    const int cacheTime = config->get_optional_config_param<int>("metadataCacheTime", 300);
+    const int cacheSize = config->get_optional_config_param<int>("metadataCacheSize", 100);
+    m_metadataCacheTime = 0;
+    if (cacheTime > 0 and cacheSize > 0)
+    {
+      m_metadataCacheTime = cacheTime;
+      m_metadataCache.reset(
+          new StationMetadataCache(cacheSize, std::chrono::seconds(cacheTime)));
+    }
   }
   catch (...)
   {
@@ -113,46 +126,12 @@ void bw::StoredEnvMonitoringFacilityQueryHandler::query(const StoredQuery &query
     bool RADAR_active = true;
     bool IMAGE_active = false;
 
-    // Get valid stations
-    bo::MastQuery validStationsQuery;
-    StationDataMap validStations;
-    getValidStations(validStationsQuery, validStations, params);
-
-    // Get capability data from obsengine.
-    StationCapabilityMap stationCapabilityMap;
-    std::future<void> fObservingCapability;
-    bo::MastQuery scQuery;
-    if (showObservingCapability) {
-      fObservingCapability =
-	std::async(std::launch::async,
-		   [this, &scQuery, &stationCapabilityMap, &params, &validStations]() {
-		     getStationCapabilities(scQuery, stationCapabilityMap, params, validStations);
-		   });
-    }
-
-    // Get station group data from Observation
-    StationGroupMap stationGroupMap;
-    bo::MastQuery sgQuery;
-    std::future<void> fStationGroupData =
-      std::async(std::launch::async,
-		 [this, &sgQuery, &language, &stationGroupMap, &params, &validStations]() {
-		   getStationGroupData(language, sgQuery, stationGroupMap, params, validStations);
-		 });
-
-    // Get network membership data from Observation
-    NetworkMembershipMap networkMemberShipMap;
-    bo::MastQuery emfQuery;
-    std::future<void> fNetworkMembershipMap =
-      std::async(std::launch::async,
-		 [this, &emfQuery, &language, &networkMemberShipMap, &params, &validStations]() {
-		   getStationNetworkMembershipData(language, emfQuery, networkMemberShipMap, params, validStations);
-		 });
-
-    if (showObservingCapability) {
-      fObservingCapability.wait();
-    }
-    fStationGroupData.wait();
-    fNetworkMembershipMap.wait();
+    // Station metadata changes rarely, so it is shared by requests with the same parameters
+    const auto metadata = getStationMetadata(language, params, showObservingCapability);
+    const StationDataMap &validStations = metadata->validStations;
+    const StationCapabilityMap &stationCapabilityMap = metadata->stationCapabilityMap;
+    const StationGroupMap &stationGroupMap = metadata->stationGroupMap;
+    const NetworkMembershipMap &networkMemberShipMap = metadata->networkMemberShipMap;
 
     CTPP::CDT hash;
     params.dump_params(hash["query_parameters"]);
@@ -196,7 +175,7 @@ void bw::StoredEnvMonitoringFacilityQueryHandler::query(const StoredQuery &query
       opts.SetFeatures("SYNOP,STUK");
       opts.SetResultLimit(1);
 
-      for (bw::StoredEnvMonitoringFacilityQueryHandler::StationDataMap::iterator vsIt =
+      for (bw::StoredEnvMonitoringFacilityQueryHandler::StationDataMap::const_iterator vsIt =
                validStations.begin();
            vsIt != validStations.end();
            ++vsIt)
@@ -384,6 +363,123 @@ void bw::StoredEnvMonitoringFacilityQueryHandler::query(const StoredQuery &query
   }
 }
 
+std::string bw::StoredEnvMonitoringFacilityQueryHandler::roundedTime(const pt::ptime &time) const
+{
+  try
+  {
+    if (time.is_special() or m_metadataCacheTime <= 0)
+      return pt::to_iso_string(time);
+
+    const pt::ptime epoch(boost::gregorian::date(1970, 1, 1));
+    const long step = m_metadataCacheTime;
+    const long seconds = (time - epoch).total_seconds();
+    const long rounded = seconds - ((seconds % step) + step) % step;
+    return pt::to_iso_string(epoch + pt::seconds(rounded));
+  }
+  catch (...)
+  {
+    throw Fmi::Exception::Trace(BCP, "Operation failed!");
+  }
+}
+
+std::shared_ptr<const bw::StoredEnvMonitoringFacilityQueryHandler::StationMetadata>
+bw::StoredEnvMonitoringFacilityQueryHandler::getStationMetadata(
+    const std::string &language,
+    const RequestParameterMap &params,
+    bool showObservingCapability) const
+{
+  try
+  {
+    // Only the parameters used for selecting the metadata belong to the key
+    std::ostringstream key;
+    const char *keyParams[] = {P_CLASS_ID,
+                               P_GROUP_ID,
+                               P_STATION_ID,
+                               P_STATION_NAME,
+                               P_BASE_PHENOMENON,
+                               P_AGGREGATE_FUNCTION,
+                               P_AGGREGATE_PERIOD,
+                               P_MEASURAND_CODE,
+                               P_STORAGE_ID};
+    for (unsigned i = 0; i < sizeof(keyParams) / sizeof(*keyParams); i++)
+    {
+      key << '(' << keyParams[i];
+      for (const auto &value : params.get_values(keyParams[i]))
+        key << ' ' << value;
+      key << ')';
+    }
+
+    // Default time intervals are relative to the current time, so the times would
+    // change the key every minute. The key therefore contains the times rounded to the
+    // cache lifetime. The queries use the requested times, so a cached entry may be
+    // based on an interval differing from the requested one by less than the lifetime.
+    key << "(period " << roundedTime(params.get_single<pt::ptime>(P_BEGIN_TIME)) << ' '
+        << roundedTime(params.get_single<pt::ptime>(P_END_TIME)) << ')';
+    key << "(capability " << showObservingCapability << ')';
+
+    if (m_metadataCache)
+    {
+      auto cached = m_metadataCache->find(key.str());
+      if (cached)
+        return *cached;
+    }
+
+    auto metadata = std::make_shared<StationMetadata>();
+    getValidStations(metadata->validStationsQuery, metadata->validStations, params);
+
+    const StationDataMap &validStations = metadata->validStations;
+
+    // Get capability data from obsengine.
+    std::future<void> fObservingCapability;
+    if (showObservingCapability)
+    {
+      fObservingCapability = std::async(std::launch::async,
+                                        [this, &metadata, &params, &validStations]() {
+                                          getStationCapabilities(metadata->scQuery,
+                                                                 metadata->stationCapabilityMap,
+                                                                 params,
+                                                                 validStations);
+                                        });
+    }
+
+    // Get station group data from Observation
+    std::future<void> fStationGroupData =
+        std::async(std::launch::async,
+                   [this, &metadata, &language, &params, &validStations]() {
+                     getStationGroupData(language,
+                                         metadata->sgQuery,
+                                         metadata->stationGroupMap,
+                                         params,
+                                         validStations);
+                   });
+
+    // Get network membership data from Observation
+    std::future<void> fNetworkMembershipMap =
+        std::async(std::launch::async,
+                   [this, &metadata, &language, &params, &validStations]() {
+                     getStationNetworkMembershipData(language,
+                                                     metadata->emfQuery,
+                                                     metadata->networkMemberShipMap,
+                                                     params,
+                                                     validStations);
+                   });
+
+    if (showObservingCapability)
+      fObservingCapability.get();
+    fStationGroupData.get();
+    fNetworkMembershipMap.get();
+
+    if (m_metadataCache)
+      m_metadataCache->insert(key.str(), metadata);
+
+    return metadata;
+  }
+  catch (...)
+  {
+    throw Fmi::Exception::Trace(BCP, "Operation failed!");
+  }
+}
+
 const std::shared_ptr<SmartMet::Engine::Observation::DBRegistryConfig>
 bw::StoredEnvMonitoringFacilityQueryHandler::dbRegistryConfig(const std::string &configName) const
 {
@@ -1055,6 +1151,20 @@ specific measurand code.</td>
   <td>Enable or disable observing capabilities to be shown in XML response.</td>
 </tr>
 
+<tr>
+  <td>metadataCacheTime</td>
+  <td>@ref WFS_CFG_SCALAR_PARAM_TMPL</td>
+  <td>int</td>
+  <td>Optional (default 300). Cache lifetime in seconds. Station metadata is cached by the query parameters, with the requested time interval rounded to this time. 0 disables caching.</td>
+</tr>
+
+<tr>
+  <td>metadataCacheSize</td>
+  <td>@ref WFS_CFG_SCALAR_PARAM_TMPL</td>
+  <td>int</td>
+  <td>Optional (default 100). Largest number of cached metadata query results.</td>
+</tr>
+
 
 </table>
 
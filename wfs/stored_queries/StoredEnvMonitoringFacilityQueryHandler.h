@@ -9,6 +9,9 @@
 #include <engines/geonames/Engine.h>
 #include <engines/observation/Engine.h>
 #include <engines/observation/MastQuery.h>
+#include <macgyver/TimedCache.h>
+#include <boost/date_time/posix_time/ptime.hpp>
+#include <memory>
 #include <unordered_map>
 
 namespace SmartMet
@@ -84,6 +87,35 @@ class StoredEnvMonitoringFacilityQueryHandler : public StoredQueryHandlerBase,
   typedef std::vector<NetworkMembership> NetworkMembershipVector;
   typedef std::map<std::string, NetworkMembershipVector> NetworkMembershipMap;
 
+  /**
+   *   @brief Station metadata selected by the request parameters
+   *
+   *   The queries own the result containers the iterators in the maps point to,
+   *   so a snapshot stays valid for as long as it is referenced.
+   */
+  struct StationMetadata
+  {
+    SmartMet::Engine::Observation::MastQuery validStationsQuery;
+    SmartMet::Engine::Observation::MastQuery scQuery;
+    SmartMet::Engine::Observation::MastQuery sgQuery;
+    SmartMet::Engine::Observation::MastQuery emfQuery;
+    StationDataMap validStations;
+    StationCapabilityMap stationCapabilityMap;
+    StationGroupMap stationGroupMap;
+    NetworkMembershipMap networkMemberShipMap;
+  };
+  typedef Fmi::TimedCache::Cache<std::string, std::shared_ptr<const StationMetadata> >
+      StationMetadataCache;
+
+  /**
+   *  @brief Format time rounded down to a multiple of the metadata cache lifetime
+   */
+  std::string roundedTime(const boost::posix_time::ptime& time) const;
+
+  std::shared_ptr<const StationMetadata> getStationMetadata(const std::string& language,
+                                                            const RequestParameterMap& params,
+                                                            bool showObservingCapability) const;
+
   void getValidStations(SmartMet::Engine::Observation::MastQuery& stationQuery,
                         StationDataMap& validStations,
                         const RequestParameterMap& params) const;
@@ -105,6 +137,8 @@ class StoredEnvMonitoringFacilityQueryHandler : public StoredQueryHandlerBase,
 
   std::string m_missingText;
   int m_debugLevel;
+  int m_metadataCacheTime;
+  std::unique_ptr<StationMetadataCache> m_metadataCache;
 };
 
 }  // namespace WFS
@@ -7,10 +7,14 @@
 #include <boost/icl/type_traits/to_string.hpp>
 #include <smartmet/engines/observation/DBRegistry.h>
 #include <smartmet/macgyver/Exception.h>
+#include <algorithm>
+#include <chrono>
 #include <memory>
+#include <sstream>
 
 namespace bw = SmartMet::Plugin::WFS;
 namespace bo = SmartMet::Engine::Observation;
+namespace pt = boost::posix_time;
 
 namespace
 {
@@ -49,6 +53,13 @@ bw::StoredEnvMonitoringNetworkQueryHandler::StoredEnvMonitoringNetworkQueryHandl
     register_scalar_param<std::string>(P_AUTHORITY_DOMAIN);
     m_missingText = config->get_optional_config_param<std::string>(P_MISSING_TEXT, "NaN");
     m_debugLevel = config->get_debug_level();
+
+    // Network metadata is cached for metadataCacheTime seconds (0 disables caching)
+    const int cacheTime = config->get_optional_config_param<int>("metadataCacheTime", 300);
+    const int cacheSize = config->get_optional_config_param<int>("metadataCacheSize", 100);
+    m_snapshotTime = std::max(cacheTime, 0);
+    if (cacheTime > 0 and cacheSize > 0)
+      m_networkCache.reset(new NetworkCache(cacheSize, std::chrono::seconds(cacheTime)));
   }
   catch (...)
   {
@@ -106,65 +117,102 @@ void bw::StoredEnvMonitoringNetworkQueryHandler::query(const StoredQuery& query,
     std::vector<std::string> stationNameVector;
     params.get<std::string>(P_STATION_NAME, std::back_inserter(stationNameVector));
 
-    // Using GROUP_MEMBERS_V1 as a base configuration
-    bo::MastQueryParams emnQueryParams(dbRegistryConfig("GROUP_MEMBERS_V1"));
-    emnQueryParams.addField("GROUP_ID");
-
-    emnQueryParams.addJoinOnConfig(dbRegistryConfig("NETWORK_MEMBERS_V1"), "STATION_ID");
-
-    // Join on NETWORKS_V1 view
-    emnQueryParams.addJoinOnConfig(dbRegistryConfig("STATION_GROUPS_V2"), "GROUP_ID");
-    emnQueryParams.addField("GROUP_CODE");
-    emnQueryParams.addField("GROUP_NAME");
-    emnQueryParams.addField("GROUP_DESC");
+    // Networks matching the request in GROUP_ID order. Identifier filters are applied to
+    // a shared snapshot of all memberships. Name filters are SQL patterns, so such
+    // requests are sent to the database and the results are cached by the parameters.
+    std::ostringstream key;
+    for (unsigned i = 0; i < sizeof(removeParams) / sizeof(*removeParams); i++)
+    {
+      key << '(' << removeParams[i];
+      for (const auto& value : params.get_values(removeParams[i]))
+        key << ' ' << value;
+      key << ')';
+    }
 
-    if (not stationNameVector.empty())
+    std::shared_ptr<const NetworkList> networks;
+    if (m_snapshotTime > 0 and classNameVector.empty() and stationNameVector.empty())
     {
-      // Join on STATION_NAMES_V1 view. Needed for search of netwprk by STATION_NAME
-      emnQueryParams.addJoinOnConfig(dbRegistryConfig("STATION_NAMES_V1"), "STATION_ID");
+      networks = std::make_shared<NetworkList>(selectNetworks(
+          *getNetworkSnapshot(), networkIdVector, classIdVector, groupIdVector, stationIdVector));
     }
+    else if (m_networkCache)
+    {
+      auto cached = m_networkCache->find(key.str());
+      if (cached)
+        networks = *cached;
+    }
+
+    if (not networks)
+    {
+      // Using GROUP_MEMBERS_V1 as a base configuration
+      bo::MastQueryParams emnQueryParams(dbRegistryConfig("GROUP_MEMBERS_V1"));
+      emnQueryParams.addField("GROUP_ID");
+
+      emnQueryParams.addJoinOnConfig(dbRegistryConfig("NETWORK_MEMBERS_V1"), "STATION_ID");
+
+      // Join on NETWORKS_V1 view
+      emnQueryParams.addJoinOnConfig(dbRegistryConfig("STATION_GROUPS_V2"), "GROUP_ID");
+      emnQueryParams.addField("GROUP_CODE");
+      emnQueryParams.addField("GROUP_NAME");
+      emnQueryParams.addField("GROUP_DESC");
 
-    emnQueryParams.addOrderBy("GROUP_ID", "ASC");
-    emnQueryParams.useDistinct();
+      if (not stationNameVector.empty())
+      {
+        // Join on STATION_NAMES_V1 view. Needed for search of netwprk by STATION_NAME
+        emnQueryParams.addJoinOnConfig(dbRegistryConfig("STATION_NAMES_V1"), "STATION_ID");
+      }
 
-    for (std::vector<int64_t>::const_iterator it = networkIdVector.begin();
-         it != networkIdVector.end();
-         ++it)
-      emnQueryParams.addOperation("OR_GROUP_network_id", "NETWORK_ID", "PropertyIsEqualTo", *it);
+      emnQueryParams.addOrderBy("GROUP_ID", "ASC");
+      emnQueryParams.useDistinct();
 
-    for (auto& classId : classIdVector)
-      emnQueryParams.addOperation("OR_GROUP_class_id", "CLASS_ID", "PropertyIsEqualTo", classId);
+      for (std::vector<int64_t>::const_iterator it = networkIdVector.begin();
+           it != networkIdVector.end();
+           ++it)
+        emnQueryParams.addOperation("OR_GROUP_network_id", "NETWORK_ID", "PropertyIsEqualTo", *it);
 
-    for (std::vector<std::string>::const_iterator it = classNameVector.begin();
-         it != classNameVector.end();
-         ++it)
-      emnQueryParams.addOperation("OR_GROUP_class_name", "CLASS_NAME", "PropertyIsLike", *it);
+      for (auto& classId : classIdVector)
+        emnQueryParams.addOperation("OR_GROUP_class_id", "CLASS_ID", "PropertyIsEqualTo", classId);
 
-    for (auto& groupId : groupIdVector)
-      emnQueryParams.addOperation("OR_GROUP_group_id", "GROUP_ID", "PropertyIsEqualTo", groupId);
+      for (std::vector<std::string>::const_iterator it = classNameVector.begin();
+           it != classNameVector.end();
+           ++it)
+        emnQueryParams.addOperation("OR_GROUP_class_name", "CLASS_NAME", "PropertyIsLike", *it);
 
-    for (std::vector<int64_t>::const_iterator it = stationIdVector.begin();
-         it != stationIdVector.end();
-         ++it)
-      emnQueryParams.addOperation("OR_GROUP_station_id", "STATION_ID", "PropertyIsEqualTo", *it);
+      for (auto& groupId : groupIdVector)
+        emnQueryParams.addOperation("OR_GROUP_group_id", "GROUP_ID", "PropertyIsEqualTo", groupId);
 
-    if (not stationNameVector.empty())
-    {
-      for (std::vector<std::string>::const_iterator it = stationNameVector.begin();
-           it != stationNameVector.end();
+      for (std::vector<int64_t>::const_iterator it = stationIdVector.begin();
+           it != stationIdVector.end();
            ++it)
-        emnQueryParams.addOperation("OR_GROUP_station_name", "STATION_NAME", "PropertyIsLike", *it);
-    }
+        emnQueryParams.addOperation("OR_GROUP_station_id", "STATION_ID", "PropertyIsEqualTo", *it);
 
-    /*
-    emnQueryParams.addOperation(
-        "OR_GROUP_language_code", "LANGUAGE_CODE", "PropertyIsEqualTo", lang);
-    */
+      if (not stationNameVector.empty())
+      {
+        for (std::vector<std::string>::const_iterator it = stationNameVector.begin();
+             it != stationNameVector.end();
+             ++it)
+          emnQueryParams.addOperation(
+              "OR_GROUP_station_name", "STATION_NAME", "PropertyIsLike", *it);
+      }
 
-    // bo::EnvironmentalMonitoringFacilityQuery emnQuery;
-    bo::MastQuery emnQuery;
-    emnQuery.setQueryParams(&emnQueryParams);
-    obs_engine->makeQuery(&emnQuery);
+      /*
+      emnQueryParams.addOperation(
+          "OR_GROUP_language_code", "LANGUAGE_CODE", "PropertyIsEqualTo", lang);
+      */
+
+      // bo::EnvironmentalMonitoringFacilityQuery emnQuery;
+      bo::MastQuery emnQuery;
+      emnQuery.setQueryParams(&emnQueryParams);
+      obs_engine->makeQuery(&emnQuery);
+      auto result = std::make_shared<NetworkList>();
+      std::shared_ptr<bo::QueryResult> resultContainer = emnQuery.getQueryResultContainer();
+      if (resultContainer)
+        readNetworks(*resultContainer, *result, nullptr);
+      networks = result;
+
+      if (m_networkCache)
+        m_networkCache->insert(key.str(), networks);
+    }
 
     CTPP::CDT hash;
     params.dump_params(hash["query_parameters"]);
@@ -174,62 +222,21 @@ void bw::StoredEnvMonitoringNetworkQueryHandler::query(const StoredQuery& query,
         boost::posix_time::to_iso_extended_string(get_plugin_impl().get_time_stamp()) + "Z";
     hash["queryId"] = query.get_query_id();
 
-    // Container with the data fetched from obsengine.
-    std::shared_ptr<bo::QueryResult> resultContainer = emnQuery.getQueryResultContainer();
-
+    // Filling the group and station data
     int groupCount = 0;
-
-    if (resultContainer)
+    for (const auto& network : *networks)
     {
-      bo::QueryResult::ValueVectorType::const_iterator groupIdIt =
-          resultContainer->begin("GROUP_ID");
-      bo::QueryResult::ValueVectorType::const_iterator groupIdItEnd =
-          resultContainer->end("GROUP_ID");
-      bo::QueryResult::ValueVectorType::const_iterator groupCodeIt =
-          resultContainer->begin("GROUP_CODE");
-      bo::QueryResult::ValueVectorType::const_iterator groupNameIt =
-          resultContainer->begin("GROUP_NAME");
-      bo::QueryResult::ValueVectorType::const_iterator groupDescIt =
-          resultContainer->begin("GROUP_DESC");
-
-      size_t groupNameVectorSize = resultContainer->size("GROUP_NAME");
-      size_t groupIdVectorSize = groupIdItEnd - groupIdIt;
-      std::string groupIdOld;
-
-      if (groupIdVectorSize == groupNameVectorSize)
-      {
-        // Filling the group and station data
-        int groupCounter = 0;
-        for (; groupIdIt != groupIdItEnd; ++groupIdIt, ++groupCodeIt, ++groupNameIt, ++groupDescIt)
-        {
-          const std::string groupId = bo::QueryResult::toString(groupIdIt);
-          if (groupIdOld != groupId)
-          {
-            groupCount++;
-            groupCounter++;
-            hash["networks"][groupCounter - 1]["id"] = groupId;
-            const std::string groupCode = bo::QueryResult::toString(groupCodeIt);
-            if (not groupCode.empty())
-              hash["networks"][groupCounter - 1]["code"] = groupCode;
-            hash["networks"][groupCounter - 1]["name"] = bo::QueryResult::toString(groupNameIt);
-            hash["networks"][groupCounter - 1]["description"] =
-                bo::QueryResult::toString(groupDescIt);
-            hash["networks"][groupCounter - 1]["inspireNamespace"] = inspireNamespace;
-
-            featureId.add_param(P_GROUP_ID, groupId);
-            hash["networks"][groupCounter - 1]["featureId"] = featureId.get_id();
-            featureId.erase_param(P_GROUP_ID);
-          }
-          groupIdOld = groupId;
-        }
-      }
-      else
-      {
-        std::ostringstream msg;
-        msg << "warning: bw::StoredEnvMonitoringNetworkQueryHandler::query - varying size data "
-               "vectors!\n";
-        std::cerr << msg.str();
-      }
+      auto& item = hash["networks"][groupCount++];
+      item["id"] = network.id;
+      if (not network.code.empty())
+        item["code"] = network.code;
+      item["name"] = network.name;
+      item["description"] = network.description;
+      item["inspireNamespace"] = inspireNamespace;
+
+      featureId.add_param(P_GROUP_ID, network.id);
+      item["featureId"] = featureId.get_id();
+      featureId.erase_param(P_GROUP_ID);
     }
 
     const std::string networksMatched = boost::to_string(groupCount);
@@ -256,6 +263,193 @@ void bw::StoredEnvMonitoringNetworkQueryHandler::query(const StoredQuery& query,
   }
 }
 
+std::shared_ptr<const bw::StoredEnvMonitoringNetworkQueryHandler::NetworkSnapshot>
+bw::StoredEnvMonitoringNetworkQueryHandler::getNetworkSnapshot() const
+{
+  try
+  {
+    // Requests use the current snapshot while another thread reloads it. Only the
+    // first load is waited for.
+    std::unique_lock<std::mutex> updateLock(m_updateMutex, std::try_to_lock);
+    if (not updateLock.owns_lock())
+    {
+      std::shared_ptr<const NetworkSnapshot> current;
+      {
+        std::lock_guard<std::mutex> lock(m_snapshotMutex);
+        current = m_snapshot;
+      }
+      if (current)
+        return current;
+      updateLock.lock();
+    }
+
+    const pt::ptime now = pt::second_clock::universal_time();
+    std::shared_ptr<const NetworkSnapshot> current;
+    {
+      std::lock_guard<std::mutex> lock(m_snapshotMutex);
+      current = m_snapshot;
+      if (current and now < m_snapshotUpdated + pt::seconds(m_snapshotTime))
+        return current;
+    }
+
+    auto snapshot = std::make_shared<NetworkSnapshot>();
+    try
+    {
+      bo::MastQueryParams emnQueryParams(dbRegistryConfig("GROUP_MEMBERS_V1"));
+      emnQueryParams.addJoinOnConfig(dbRegistryConfig("NETWORK_MEMBERS_V1"), "STATION_ID");
+      emnQueryParams.addJoinOnConfig(dbRegistryConfig("STATION_GROUPS_V2"), "GROUP_ID");
+      emnQueryParams.addField("GROUP_ID");
+      emnQueryParams.addField("GROUP_CODE");
+      emnQueryParams.addField("GROUP_NAME");
+      emnQueryParams.addField("GROUP_DESC");
+      emnQueryParams.addField("NETWORK_ID");
+      emnQueryParams.addField("CLASS_ID");
+      emnQueryParams.addField("STATION_ID");
+      emnQueryParams.addOrderBy("GROUP_ID", "ASC");
+      emnQueryParams.useDistinct();
+
+      bo::MastQuery emnQuery;
+      emnQuery.setQueryParams(&emnQueryParams);
+      obs_engine->makeQuery(&emnQuery);
+
+      std::shared_ptr<bo::QueryResult> resultContainer = emnQuery.getQueryResultContainer();
+      if (resultContainer)
+        readNetworks(*resultContainer, snapshot->networks, &snapshot->members);
+    }
+    catch (...)
+    {
+      if (not current)
+        throw;
+
+      // Keep using the old snapshot and try again after the cache time
+      Fmi::Exception exception(BCP, "Failed to update network metadata snapshot", nullptr);
+      exception.printError();
+      std::lock_guard<std::mutex> lock(m_snapshotMutex);
+      m_snapshotUpdated = now;
+      return current;
+    }
+
+    std::lock_guard<std::mutex> lock(m_snapshotMutex);
+    m_snapshot = snapshot;
+    m_snapshotUpdated = now;
+    return snapshot;
+  }
+  catch (...)
+  {
+    throw Fmi::Exception::Trace(BCP, "Operation failed!");
+  }
+}
+
+bw::StoredEnvMonitoringNetworkQueryHandler::NetworkList
+bw::StoredEnvMonitoringNetworkQueryHandler::selectNetworks(const NetworkSnapshot& snapshot,
+                                                           const std::vector<int64_t>& networkIds,
+                                                           const std::vector<int64_t>& classIds,
+                                                           const std::vector<int64_t>& groupIds,
+                                                           const std::vector<int64_t>& stationIds)
+{
+  try
+  {
+    // Values of the same parameter are alternatives, different parameters must all match
+    const auto matches = [](const std::vector<int64_t>& ids, const std::string& value) {
+      if (ids.empty())
+        return true;
+      for (const auto id : ids)
+        if (std::to_string(id) == value)
+          return true;
+      return false;
+    };
+
+    std::vector<bool> selected(snapshot.networks.size(), false);
+    for (const auto& member : snapshot.members)
+    {
+      if (not selected[member.network] and matches(networkIds, member.networkId) and
+          matches(classIds, member.classId) and matches(groupIds, member.groupId) and
+          matches(stationIds, member.stationId))
+        selected[member.network] = true;
+    }
+
+    NetworkList networks;
+    for (std::size_t i = 0; i < snapshot.networks.size(); i++)
+      if (selected[i])
+        networks.push_back(snapshot.networks[i]);
+    return networks;
+  }
+  catch (...)
+  {
+    throw Fmi::Exception::Trace(BCP, "Operation failed!");
+  }
+}
+
+void bw::StoredEnvMonitoringNetworkQueryHandler::readNetworks(bo::QueryResult& result,
+                                                              NetworkList& networks,
+                                                              std::vector<NetworkMember>* members)
+{
+  try
+  {
+    bo::QueryResult::ValueVectorType::const_iterator groupIdIt = result.begin("GROUP_ID");
+    bo::QueryResult::ValueVectorType::const_iterator groupIdItEnd = result.end("GROUP_ID");
+    bo::QueryResult::ValueVectorType::const_iterator groupCodeIt = result.begin("GROUP_CODE");
+    bo::QueryResult::ValueVectorType::const_iterator groupNameIt = result.begin("GROUP_NAME");
+    bo::QueryResult::ValueVectorType::const_iterator groupDescIt = result.begin("GROUP_DESC");
+
+    const std::size_t size = groupIdItEnd - groupIdIt;
+    bool validSizes = (result.size("GROUP_NAME") == size);
+    if (members)
+      validSizes = validSizes and result.size("NETWORK_ID") == size and
+                   result.size("CLASS_ID") == size and result.size("STATION_ID") == size;
+    if (not validSizes)
+    {
+      std::ostringstream msg;
+      msg << "warning: bw::StoredEnvMonitoringNetworkQueryHandler::query - varying size data "
+             "vectors!\n";
+      std::cerr << msg.str();
+      return;
+    }
+
+    bo::QueryResult::ValueVectorType::const_iterator networkIdIt;
+    bo::QueryResult::ValueVectorType::const_iterator classIdIt;
+    bo::QueryResult::ValueVectorType::const_iterator stationIdIt;
+    if (members)
+    {
+      networkIdIt = result.begin("NETWORK_ID");
+      classIdIt = result.begin("CLASS_ID");
+      stationIdIt = result.begin("STATION_ID");
+    }
+
+    // Rows are ordered by GROUP_ID, so the rows of a network are consecutive
+    std::string groupIdOld;
+    for (; groupIdIt != groupIdItEnd; ++groupIdIt, ++groupCodeIt, ++groupNameIt, ++groupDescIt)
+    {
+      const std::string groupId = bo::QueryResult::toString(groupIdIt);
+      if (networks.empty() or groupIdOld != groupId)
+      {
+        NetworkInfo network;
+        network.id = groupId;
+        network.code = bo::QueryResult::toString(groupCodeIt);
+        network.name = bo::QueryResult::toString(groupNameIt);
+        network.description = bo::QueryResult::toString(groupDescIt);
+        networks.push_back(network);
+      }
+      groupIdOld = groupId;
+
+      if (members)
+      {
+        NetworkMember member;
+        member.network = networks.size() - 1;
+        member.groupId = bo::QueryResult::toString(groupIdIt, 0);
+        member.networkId = bo::QueryResult::toString(networkIdIt++, 0);
+        member.classId = bo::QueryResult::toString(classIdIt++, 0);
+        member.stationId = bo::QueryResult::toString(stationIdIt++, 0);
+        members->push_back(member);
+      }
+    }
+  }
+  catch (...)
+  {
+    throw Fmi::Exception::Trace(BCP, "Operation failed!");
+  }
+}
+
 const std::shared_ptr<SmartMet::Engine::Observation::DBRegistryConfig>
 bw::StoredEnvMonitoringNetworkQueryHandler::dbRegistryConfig(const std::string& configName) const
 {
@@ -410,6 +604,20 @@ unique identity for a group.</td>
   <td>Authority domain used for example in codeSpace names of XML response.</td>
 </tr>
 
+<tr>
+  <td>metadataCacheTime</td>
+  <td>@ref WFS_CFG_SCALAR_PARAM_TMPL</td>
+  <td>int</td>
+  <td>Optional (default 300). Cache lifetime in seconds. All networks are kept in a snapshot reloaded after this time, and queries with className or stationName are cached by their parameters. 0 disables both.</td>
+</tr>
+
+<tr>
+  <td>metadataCacheSize</td>
+  <td>@ref WFS_CFG_SCALAR_PARAM_TMPL</td>
+  <td>int</td>
+  <td>Optional (default 100). Largest number of cached metadata query results.</td>
+</tr>
+
 </table>
 
 */
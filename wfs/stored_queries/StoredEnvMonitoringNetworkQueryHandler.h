@@ -9,6 +9,12 @@
 #include <engines/geonames/Engine.h>
 #include <engines/observation/Engine.h>
 #include <engines/observation/MastQuery.h>
+#include <macgyver/TimedCache.h>
+#include <boost/date_time/posix_time/ptime.hpp>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
 
 namespace SmartMet
 {
@@ -37,8 +43,65 @@ class StoredEnvMonitoringNetworkQueryHandler : protected virtual RequiresGeoEngi
   const std::shared_ptr<SmartMet::Engine::Observation::DBRegistryConfig> dbRegistryConfig(
       const std::string& configName) const;
 
+  struct NetworkInfo
+  {
+    std::string id;
+    std::string code;
+    std::string name;
+    std::string description;
+  };
+
+  /**
+   *   @brief Station membership of a network with the identifiers used for filtering
+   */
+  struct NetworkMember
+  {
+    std::size_t network;  // Index of the network in NetworkSnapshot::networks
+    std::string groupId;
+    std::string networkId;
+    std::string classId;
+    std::string stationId;
+  };
+
+  /**
+   *   @brief All networks and their station memberships (in GROUP_ID order)
+   */
+  struct NetworkSnapshot
+  {
+    std::vector<NetworkInfo> networks;
+    std::vector<NetworkMember> members;
+  };
+
+  typedef std::vector<NetworkInfo> NetworkList;
+  typedef Fmi::TimedCache::Cache<std::string, std::shared_ptr<const NetworkList> > NetworkCache;
+
+  /**
+   *   @brief Get the snapshot of all networks, reloading it if older than m_snapshotTime
+   *
+   *   The snapshot is reloaded outside of the snapshot lock and swapped in afterwards,
+   *   so other requests keep using the previous snapshot during the reload.
+   */
+  std::shared_ptr<const NetworkSnapshot> getNetworkSnapshot() const;
+
+  static NetworkList selectNetworks(const NetworkSnapshot& snapshot,
+                                    const std::vector<int64_t>& networkIds,
+                                    const std::vector<int64_t>& classIds,
+                                    const std::vector<int64_t>& groupIds,
+                                    const std::vector<int64_t>& stationIds);
+
+  static void readNetworks(SmartMet::Engine::Observation::QueryResult& result,
+                           NetworkList& networks,
+                           std::vector<NetworkMember>* members);
+
   std::string m_missingText;
   int m_debugLevel;
+  int m_snapshotTime;
+  std::unique_ptr<NetworkCache> m_networkCache;
+
+  mutable std::mutex m_updateMutex;
+  mutable std::mutex m_snapshotMutex;
+  mutable std::shared_ptr<const NetworkSnapshot> m_snapshot;
+  mutable boost::posix_time::ptime m_snapshotUpdated;
 };
 
 }  // namespace WFS
@@ -1,6 +1,9 @@
 #include "stored_queries/StoredFlashQueryHandler.h"
+#include "CsvWriter.h"
 #include "FeatureID.h"
+#include "GeoJsonUtils.h"
 #include "StoredQueryHandlerFactoryDef.h"
+#include "TimeSlicedQuery.h"
 #include "WfsConst.h"
 #include <fmt/format.h>
 #include <macgyver/StringConversion.h>
@@ -8,6 +11,7 @@
 #include <smartmet/macgyver/Exception.h>
 #include <smartmet/spine/ParameterTools.h>
 #include <smartmet/spine/Value.h>
+#include <cmath>
 
 namespace bw = SmartMet::Plugin::WFS;
 namespace pt = boost::posix_time;
@@ -57,6 +61,8 @@ bw::StoredFlashQueryHandler::StoredFlashQueryHandler(
     station_type = config->get_optional_config_param<std::string>("stationType", "flash");
     max_hours = config->get_optional_config_param<double>("maxHours", 7.0 * 24.0);
     missing_text = config->get_optional_config_param<std::string>("missingText", "NaN");
+    time_slice_hours = config->get_optional_config_param<double>("timeSliceHours", 0.0);
+    max_threads = config->get_optional_config_param<unsigned>("maxThreads", 4);
 
     sq_restrictions = plugin_data.get_config().getSQRestrictions();
     time_block_size = 1;
@@ -263,10 +269,40 @@ void bw::StoredFlashQueryHandler::query(const StoredQuery& query,
 
       // Fetch the values
 
-      const auto result_ptr = obs_engine->values(query_params);
+      // Long intervals are optionally queried in parallel slices. Slices are whole
+      // multiples of the time block size, so that they match the blocks of the query.
+      const long slice_seconds =
+          std::lround(time_slice_hours * 3600.0 / time_block_size) * time_block_size;
+      const auto result_ptr = time_sliced_query(
+          query_params.starttime,
+          query_params.endtime,
+          pt::seconds(slice_seconds),
+          max_threads,
+          [this, &query_params](const pt::ptime& slice_begin, const pt::ptime& slice_end)
+          {
+            auto slice_params = query_params;
+            slice_params.starttime = slice_begin;
+            slice_params.endtime = slice_end;
+            return obs_engine->values(slice_params);
+          });
 
       CTPP::CDT hash;
 
+      const bool geojson = query.get_use_geojson_format();
+      Json::Value feature_collection;
+      if (geojson)
+        feature_collection = GeoJson::create_feature_collection(get_plugin_impl().get_time_stamp());
+
+      // CSV output: rows are written directly to the output without CTPP hash
+      std::unique_ptr<CsvWriter> csv;
+      if (query.get_use_csv_format())
+      {
+        std::vector<std::string> header = {"time", "longitude", "latitude"};
+        header.insert(header.end(), param_names.begin(), param_names.end());
+        csv.reset(new CsvWriter(output));
+        csv->write_header(header);
+      }
+
       // Get the sequence number of query in the request
       int sq_id = query.get_query_id();
 
@@ -274,68 +310,73 @@ void bw::StoredFlashQueryHandler::query(const StoredQuery& query,
 
       bw::FeatureID feature_id(get_config()->get_query_id(), params.get_map(), sq_id);
 
-      hash["language"] = language;
-
-      hash["responseTimestamp"] =
-          Fmi::to_iso_extended_string(get_plugin_impl().get_time_stamp()) + "Z";
-      hash["queryNum"] = query.get_query_id();
-
-      hash["featureId"] = feature_id.get_id();
-      // FIXME: Do we need separate feature ID for each parameter?
-
-      hash["fmi_apikey"] = bw::QueryBase::FMI_APIKEY_SUBST;
-      hash["fmi_apikey_prefix"] = bw::QueryBase::FMI_APIKEY_PREFIX_SUBST;
-      hash["hostname"] = QueryBase::HOSTNAME_SUBST;
-      hash["protocol"] = QueryBase::PROTOCOL_SUBST;
-      hash["srsName"] = proj_uri;
-      hash["projSrsDim"] = projSrsDim;
-      hash["srsEpochName"] = proj_epoch_uri;
-      hash["projEpochSrsDim"] = (show_height ? 4 : 3);
-
-      hash["memberId"] = "enn-m-1";
-      hash["resultTimeId"] = "time-1";
-      hash["samplingFeatureId"] = "flash-s-1";
-      hash["sampledFeatureTargetId"] = "area-1";
-      hash["sampledFeatureTargetPolygonId"] = "polygon-1";
-      hash["resultCoverageId"] = "mpcv-1";
-      hash["resultCoverageMultiPointId"] = "mp-1";
-
-      for (int k = first_param; k <= last_param; k++)
+      // The GML hash is needed neither for GeoJSON nor for CSV output
+      const bool gml = not geojson and not csv;
+      if (gml)
       {
-        const int k0 = k - first_param;
-        const std::string& name = param_names.at(k0);
-        feature_id.erase_param(P_PARAM);
-        feature_id.add_param(P_PARAM, name);
-        hash["paramList"][k0]["name"] = param_names.at(k0);
-        hash["paramList"][k0]["featureID"] = feature_id.get_id();
-      }
+        hash["language"] = language;
+
+        hash["responseTimestamp"] =
+            Fmi::to_iso_extended_string(get_plugin_impl().get_time_stamp()) + "Z";
+        hash["queryNum"] = query.get_query_id();
+
+        hash["featureId"] = feature_id.get_id();
+        // FIXME: Do we need separate feature ID for each parameter?
+
+        hash["fmi_apikey"] = bw::QueryBase::FMI_APIKEY_SUBST;
+        hash["fmi_apikey_prefix"] = bw::QueryBase::FMI_APIKEY_PREFIX_SUBST;
+        hash["hostname"] = QueryBase::HOSTNAME_SUBST;
+        hash["protocol"] = QueryBase::PROTOCOL_SUBST;
+        hash["srsName"] = proj_uri;
+        hash["projSrsDim"] = projSrsDim;
+        hash["srsEpochName"] = proj_epoch_uri;
+        hash["projEpochSrsDim"] = (show_height ? 4 : 3);
+
+        hash["memberId"] = "enn-m-1";
+        hash["resultTimeId"] = "time-1";
+        hash["samplingFeatureId"] = "flash-s-1";
+        hash["sampledFeatureTargetId"] = "area-1";
+        hash["sampledFeatureTargetPolygonId"] = "polygon-1";
+        hash["resultCoverageId"] = "mpcv-1";
+        hash["resultCoverageMultiPointId"] = "mp-1";
+
+        for (int k = first_param; k <= last_param; k++)
+        {
+          const int k0 = k - first_param;
+          const std::string& name = param_names.at(k0);
+          feature_id.erase_param(P_PARAM);
+          feature_id.add_param(P_PARAM, name);
+          hash["paramList"][k0]["name"] = param_names.at(k0);
+          hash["paramList"][k0]["featureID"] = feature_id.get_id();
+        }
 
-      if (have_bbox)
-      {
-        // FIXME: missä projektion pitäisi käyttää täälä. Todennäköisesti alkuperainen
-        //        bbox projektio olisi parempi
-        CTPP::CDT p_bb;
-        double x_ll = bb_swap_coord ? requested_bbox.yMin : requested_bbox.xMin;
-        double y_ll = bb_swap_coord ? requested_bbox.xMin : requested_bbox.yMin;
-        double x_ur = bb_swap_coord ? requested_bbox.yMax : requested_bbox.xMax;
-        double y_ur = bb_swap_coord ? requested_bbox.xMax : requested_bbox.yMax;
+        if (have_bbox)
+        {
+          // FIXME: missä projektion pitäisi käyttää täälä. Todennäköisesti alkuperainen
+          //        bbox projektio olisi parempi
+          CTPP::CDT p_bb;
+          double x_ll = bb_swap_coord ? requested_bbox.yMin : requested_bbox.xMin;
+          double y_ll = bb_swap_coord ? requested_bbox.xMin : requested_bbox.yMin;
+          double x_ur = bb_swap_coord ? requested_bbox.yMax : requested_bbox.xMax;
+          double y_ur = bb_swap_coord ? requested_bbox.xMax : requested_bbox.yMax;
 
-        p_bb["lowerLeft"]["x"] = x_ll;
-        p_bb["lowerLeft"]["y"] = y_ll;
+          p_bb["lowerLeft"]["x"] = x_ll;
+          p_bb["lowerLeft"]["y"] = y_ll;
 
-        p_bb["lowerRight"]["x"] = x_ur;
-        p_bb["lowerRight"]["y"] = y_ll;
+          p_bb["lowerRight"]["x"] = x_ur;
+          p_bb["lowerRight"]["y"] = y_ll;
 
-        p_bb["upperLeft"]["x"] = x_ll;
-        p_bb["upperLeft"]["y"] = y_ur;
+          p_bb["upperLeft"]["x"] = x_ll;
+          p_bb["upperLeft"]["y"] = y_ur;
 
-        p_bb["upperRight"]["x"] = x_ur;
-        p_bb["upperRight"]["y"] = y_ur;
+          p_bb["upperRight"]["x"] = x_ur;
+          p_bb["upperRight"]["y"] = y_ur;
 
-        p_bb["projUri"] = bb_proj_uri;
-        p_bb["srsDim"] = 2;
+          p_bb["projUri"] = bb_proj_uri;
+          p_bb["srsDim"] = 2;
 
-        hash["metadata"]["boundingBox"] = p_bb;
+          hash["metadata"]["boundingBox"] = p_bb;
+        }
       }
 
       std::size_t used_rows = 0;
@@ -356,13 +397,25 @@ void bw::StoredFlashQueryHandler::query(const StoredQuery& query,
         const auto& result = *result_ptr;
         num_rows = result[1].size();
 
+        // Transform all stroke locations using a single coordinate transformation call
+        std::vector<NFmiPoint> points;
+        points.reserve(num_rows);
         for (std::size_t i = 0; i < num_rows; i++)
         {
           // I have no clue why the ordering is this, this changed code
           // does the same as the original (sx = lat, sy = lon) - Mika
+          points.emplace_back(boost::get<double>(result[lat_ind][i].value),
+                              boost::get<double>(result[lon_ind][i].value));
+        }
+
+        std::vector<CoordinateTransformationCache::Coord2D> coords;
+        if (gml)
+          coords = CoordinateTransformationCache(transformation).get_2D_coords(points);
 
-          double lon = boost::get<double>(result[lat_ind][i].value);
-          double lat = boost::get<double>(result[lon_ind][i].value);
+        for (std::size_t i = 0; i < num_rows; i++)
+        {
+          double lon = points[i].X();
+          double lat = points[i].Y();
 
           if (to_bbox_transform)
           {
@@ -396,18 +449,30 @@ void bw::StoredFlashQueryHandler::query(const StoredQuery& query,
             }
           }
 
-          auto str_xy = get_2D_coord(transformation, lon, lat);
-
           const pt::ptime epoch = result[lon_ind][i].time.utc_time();
           long long jd = epoch.date().julian_day();
           long seconds = epoch.time_of_day().total_seconds();
           INT_64 s_epoch = 86400LL * (jd - ref_jd) + seconds;
-          auto stroke_time_str = format_local_time(epoch, tzp);
+          const std::string stroke_time_str = geojson ? "" : format_local_time(epoch, tzp);
 
           ++used_rows;
 
-          if (!is_simple_query)
+          Json::Value* properties = nullptr;
+          if (csv)
           {
+            csv->add_field(stroke_time_str);
+            csv->add_field(value_formatter->format(lon, 5));
+            csv->add_field(value_formatter->format(lat, 5));
+          }
+          else if (geojson)
+          {
+            properties = &GeoJson::add_point_feature(
+                feature_collection, fmt::format("{}.{}", sq_id, used_rows), lon, lat);
+            (*properties)["time"] = Fmi::to_iso_extended_string(epoch) + "Z";
+          }
+          else if (!is_simple_query)
+          {
+            const auto& str_xy = coords[i];
             multipoint_position_rows +=
                 str_xy.first + ' ' + str_xy.second + ' ' + Fmi::to_string(s_epoch) + '\n';
           }
@@ -428,7 +493,19 @@ void bw::StoredFlashQueryHandler::query(const StoredQuery& query,
             else
               value = query_params.missingtext;
 
-            if (!is_simple_query)
+            if (csv)
+            {
+              if (value == query_params.missingtext)
+                csv->add_empty_field();
+              else
+                csv->add_field(remove_trailing_0(value));
+            }
+            else if (properties)
+            {
+              (*properties)[param_names.at(k - first_param)] =
+                  GeoJson::to_json(value, query_params.missingtext);
+            }
+            else if (!is_simple_query)
             {
               multipoint_data_rows += remove_trailing_0(value);
               multipoint_data_rows += (k < last_param ? ' ' : '\n');
@@ -453,13 +530,16 @@ void bw::StoredFlashQueryHandler::query(const StoredQuery& query,
                                          k - first_param + 1,
                                          projSrsDim,
                                          proj_uri,
-                                         str_xy.first,
-                                         str_xy.second,
+                                         coords[i].first,
+                                         coords[i].second,
                                          stroke_time_str,
                                          param_names.at(k - first_param),
                                          value);
             }
           }
+
+          if (csv)
+            csv->end_row();
         }
       }
 
@@ -471,28 +551,39 @@ void bw::StoredFlashQueryHandler::query(const StoredQuery& query,
         std::cout << msg.str() << std::flush;
       }
 
-      if (is_simple_query)
-        hash["dataRows"] = simple_rows;
-      else
+      if (gml)
       {
-        if (!multipoint_data_rows.empty())
-          hash["dataRows"] = multipoint_data_rows;  // the template behaves differently when not set
-        hash["positionRows"] = multipoint_position_rows;
-      }
+        if (is_simple_query)
+          hash["dataRows"] = simple_rows;
+        else
+        {
+          if (!multipoint_data_rows.empty())
+            hash["dataRows"] = multipoint_data_rows;  // the template behaves differently when not set
+          hash["positionRows"] = multipoint_position_rows;
+        }
 
-      hash["numMatched"] = used_rows == 0 ? 0 : 1;
-      hash["numReturned"] = used_rows == 0 ? 0 : 1;
+        hash["numMatched"] = used_rows == 0 ? 0 : 1;
+        hash["numReturned"] = used_rows == 0 ? 0 : 1;
 
-      hash["numberMatched"] = used_rows * (last_param - first_param + 1);
-      hash["numberReturned"] = used_rows * (last_param - first_param + 1);
+        hash["numberMatched"] = used_rows * (last_param - first_param + 1);
+        hash["numberReturned"] = used_rows * (last_param - first_param + 1);
 
-      hash["phenomenonTimeId"] = "time-interval-1";
-      hash["phenomenonStartTime"] = Fmi::to_iso_extended_string(query_params.starttime) + "Z";
-      hash["phenomenonEndTime"] = Fmi::to_iso_extended_string(query_params.endtime) + "Z";
+        hash["phenomenonTimeId"] = "time-interval-1";
+        hash["phenomenonStartTime"] = Fmi::to_iso_extended_string(query_params.starttime) + "Z";
+        hash["phenomenonEndTime"] = Fmi::to_iso_extended_string(query_params.endtime) + "Z";
+      }
 
       // std::cout << "Hash = \n" << hash.RecursiveDump() << std::endl;
 
-      format_output(hash, output, query.get_use_debug_format());
+      if (geojson)
+      {
+        GeoJson::update_counts(feature_collection);
+        GeoJson::write(feature_collection, output);
+      }
+      else if (not csv)
+      {
+        format_output(hash, output, query.get_use_debug_format());
+      }
     }
     catch (...)
     {
@@ -508,6 +599,13 @@ void bw::StoredFlashQueryHandler::query(const StoredQuery& query,
   }
 }
 
+bool bw::StoredFlashQueryHandler::supports_output_format(const std::string& format) const
+{
+  return format == StandardPresentationParameters::GEOJSON_OUTPUT_FORMAT or
+         format == StandardPresentationParameters::CSV_OUTPUT_FORMAT or
+         StoredQueryHandlerBase::supports_output_format(format);
+}
+
 namespace
 {
 using namespace SmartMet::Plugin::WFS;
@@ -654,6 +752,25 @@ services
       parameter is set to false in WFS Plugin configurations.</td>
 </tr>
 
+<tr>
+  <td>timeSliceHours</td>
+  <td>double</td>
+  <td>optional (default 0)</td>
+  <td>Length of time slices in hours. Time intervals longer than this are queried
+      from the observation engine in slices of this length in parallel and the
+      results are merged in time order. The response is the same as without
+      slicing. The value is rounded to whole time blocks. The default value 0
+      disables slicing.</td>
+</tr>
+
+<tr>
+  <td>maxThreads</td>
+  <td>unsigned integer</td>
+  <td>optional (default 4)</td>
+  <td>Maximal number of time slices of one request queried in parallel.
+      Value 1 queries the slices sequentially.</td>
+</tr>
+
 </table>
 
 
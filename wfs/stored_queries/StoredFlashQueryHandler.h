@@ -38,6 +38,8 @@ class StoredFlashQueryHandler : public StoredQueryHandlerBase,
 		     const boost::optional<std::string> &hostname,
                      std::ostream &output) const;
 
+  virtual bool supports_output_format(const std::string &format) const;
+
  private:
   std::vector<SmartMet::Spine::Parameter> bs_param;
   int stroke_time_ind;
@@ -49,6 +51,8 @@ class StoredFlashQueryHandler : public StoredQueryHandlerBase,
   std::string missing_text;
   bool sq_restrictions;
   int time_block_size;
+  double time_slice_hours;
+  std::size_t max_threads;
 };
 
 }  // namespace WFS
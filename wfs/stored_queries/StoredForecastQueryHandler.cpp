@@ -1,5 +1,10 @@
 #include "stored_queries/StoredForecastQueryHandler.h"
+#include "ArrowStreamWriter.h"
+#include "CsvWriter.h"
 #include "FeatureID.h"
+#include "FormattedValueColumn.h"
+#include "GeoJsonUtils.h"
+#include "ParallelFor.h"
 #include "StoredQueryHandlerFactoryDef.h"
 #include "WfsConvenience.h"
 #include <boost/algorithm/string.hpp>
@@ -18,6 +23,8 @@
 #include <smartmet/spine/TimeSeriesGenerator.h>
 #include <smartmet/spine/TimeSeriesOutput.h>
 #include <smartmet/spine/Value.h>
+#include <cmath>
+#include <iterator>
 #include <limits>
 #include <locale>
 #include <map>
@@ -88,6 +95,7 @@ bw::StoredForecastQueryHandler::StoredForecastQueryHandler(
 
     max_np_distance = config->get_optional_config_param<double>("maxNpDistance", -1.0);
     separate_groups = config->get_optional_config_param<bool>("separateGroups", false);
+    max_threads = config->get_optional_config_param<unsigned>("maxThreads", 4);
   }
   catch (...)
   {
@@ -146,8 +154,8 @@ void bw::StoredForecastQueryHandler::query(const StoredQuery& stored_query,
         parse_times(params, query);
 
         const std::string crs = params.get_single<std::string>(P_CRS);
-        auto transformation =
-            plugin_impl.get_crs_registry().create_transformation("urn:ogc:def:crs:EPSG::4326", crs);
+        CoordinateTransformationCache transformation(
+            plugin_impl.get_crs_registry().create_transformation("urn:ogc:def:crs:EPSG::4326", crs));
         bool show_height = false;
         std::string proj_uri = "UNKNOWN";
         std::string proj_epoch_uri = "UNKNOWN";
@@ -155,7 +163,20 @@ void bw::StoredForecastQueryHandler::query(const StoredQuery& stored_query,
         plugin_impl.get_crs_registry().get_attribute(crs, "projUri", &proj_uri);
         plugin_impl.get_crs_registry().get_attribute(crs, "projEpochUri", &proj_epoch_uri);
 
+        query.keep_raw_data = stored_query.get_use_arrow_format();
         query.result = extract_forecast(query);
+        if (query.keep_raw_data)
+        {
+          write_arrow(query, output);
+          return;
+        }
+
+        if (stored_query.get_use_csv_format())
+        {
+          write_csv(query, output);
+          return;
+        }
+
         const std::size_t num_rows = query.result->rows().size();
 
         std::set<std::string> geo_id_set;
@@ -181,6 +202,12 @@ void bw::StoredForecastQueryHandler::query(const StoredQuery& stored_query,
 
         CTPP::CDT hash;
 
+        const bool geojson = stored_query.get_use_geojson_format();
+        Json::Value feature_collection;
+        if (geojson)
+          feature_collection =
+              GeoJson::create_feature_collection(get_plugin_impl().get_time_stamp());
+
         hash["language"] = language;
 
         hash["responseTimestamp"] =
@@ -273,7 +300,8 @@ void bw::StoredForecastQueryHandler::query(const StoredQuery& stored_query,
             for (auto row_iter = row_range.first; row_iter != row_range.second; ++row_iter)
             {
               std::size_t i = row_iter->second;
-              if (row_iter == row_range.first)
+              // The GML hash is not needed for GeoJSON output
+              if (row_iter == row_range.first and not geojson)
               {
                 const std::string name = query.result->get(ind_place, i);
                 const std::string country_code = query.result->get(ind_country_iso, i);
@@ -304,29 +332,54 @@ void bw::StoredForecastQueryHandler::query(const StoredQuery& stored_query,
                 station_ind++;
               }
 
-              CTPP::CDT& row_data = group["returnArray"][row_counter++];
-
-              set_2D_coord(transformation,
-                           query.result->get(ind_lat, i),
-                           query.result->get(ind_lon, i),
-                           row_data);
-
-              if (show_height)
-              {
-                row_data["elev"] = query.result->get(ind_level, i);
-              }
-
               pt::ptime epoch = Fmi::TimeParser::parse_iso(query.result->get(ind_epoch, i));
               long long jd = epoch.date().julian_day();
               long seconds = epoch.time_of_day().total_seconds();
               INT_64 s_epoch = 86400LL * (jd - ref_jd) + seconds;
-              row_data["epochTime"] = s_epoch;
-              row_data["epochTimeStr"] = format_local_time(epoch, tzp);
 
-              for (std::size_t k = query.first_data_ind; k <= query.last_data_ind; k++)
+              if (not geojson)
               {
-                row_data["data"][k - query.first_data_ind] =
-                    remove_trailing_0(query.result->get(k, i));
+                CTPP::CDT& row_data = group["returnArray"][row_counter++];
+
+                set_2D_coord(transformation,
+                             std::stod(query.result->get(ind_lat, i)),
+                             std::stod(query.result->get(ind_lon, i)),
+                             row_data);
+
+                if (show_height)
+                {
+                  row_data["elev"] = query.result->get(ind_level, i);
+                }
+
+                row_data["epochTime"] = s_epoch;
+                row_data["epochTimeStr"] = format_local_time(epoch, tzp);
+
+                for (std::size_t k = query.first_data_ind; k <= query.last_data_ind; k++)
+                {
+                  row_data["data"][k - query.first_data_ind] =
+                      remove_trailing_0(query.result->get(k, i));
+                }
+              }
+              else
+              {
+                const std::string id =
+                    str(format("%1%-%2%.%3%.%4%") % sq_id % (group_id + 1) % geo_id % s_epoch);
+                Json::Value& properties =
+                    GeoJson::add_point_feature(feature_collection,
+                                               id,
+                                               std::stod(query.result->get(ind_lon, i)),
+                                               std::stod(query.result->get(ind_lat, i)));
+                properties["geoid"] = geo_id;
+                properties["name"] = query.result->get(ind_place, i);
+                properties["time"] = Fmi::to_iso_extended_string(epoch) + "Z";
+                if (show_height)
+                  properties["level"] =
+                      GeoJson::to_json(query.result->get(ind_level, i), query.missing_text);
+                for (std::size_t k = query.first_data_ind; k <= query.last_data_ind; k++)
+                {
+                  properties[query.data_params.at(k).name()] =
+                      GeoJson::to_json(query.result->get(k, i), query.missing_text);
+                }
               }
 
               interval_begin = i == 0 ? epoch : std::min(interval_begin, epoch);
@@ -338,7 +391,15 @@ void bw::StoredForecastQueryHandler::query(const StoredQuery& stored_query,
           group["phenomenonEndTime"] = Fmi::to_iso_extended_string(interval_end) + "Z";
         }
 
-        format_output(hash, output, stored_query.get_use_debug_format());
+        if (geojson)
+        {
+          GeoJson::update_counts(feature_collection);
+          GeoJson::write(feature_collection, output);
+        }
+        else
+        {
+          format_output(hash, output, stored_query.get_use_debug_format());
+        }
       }
       catch (...)
       {
@@ -361,6 +422,14 @@ void bw::StoredForecastQueryHandler::query(const StoredQuery& stored_query,
   }
 }
 
+bool bw::StoredForecastQueryHandler::supports_output_format(const std::string& format) const
+{
+  return format == StandardPresentationParameters::GEOJSON_OUTPUT_FORMAT or
+         format == StandardPresentationParameters::ARROW_OUTPUT_FORMAT or
+         format == StandardPresentationParameters::CSV_OUTPUT_FORMAT or
+         StoredQueryHandlerBase::supports_output_format(format);
+}
+
 namespace
 {
 struct StationRec
@@ -373,6 +442,21 @@ struct StationRec
 };
 }  // namespace
 
+/**
+ *   @brief Extracted data of one location
+ *
+ *   Values of all levels are collected to the same columns in the order
+ *   in which the rows are stored to the result table.
+ */
+struct bw::StoredForecastQueryHandler::LocationBlock
+{
+  SmartMet::Engine::Querydata::Producer producer;
+  SmartMet::Engine::Querydata::Q q;
+  std::size_t num_rows = 0;
+  std::vector<std::unique_ptr<FormattedValueColumn> > columns;
+  std::vector<std::vector<SmartMet::Spine::TimeSeries::Value> > raw_data;
+};
+
 boost::shared_ptr<SmartMet::Spine::Table> bw::StoredForecastQueryHandler::extract_forecast(
     Query& query) const
 {
@@ -380,52 +464,59 @@ boost::shared_ptr<SmartMet::Spine::Table> bw::StoredForecastQueryHandler::extrac
   {
     using namespace SmartMet;
 
-    int debug_level = get_config()->get_debug_level();
-
     boost::shared_ptr<SmartMet::Spine::Table> ennusteet(new SmartMet::Spine::Table);
 
 #ifdef ENABLE_MODEL_PATH
     boost::optional<std::string> model_path;
 #endif
 
-    std::string language = Fmi::ascii_tolower_copy(query.language);
-    SupportsLocationParameters::engOrFinToEnOrFi(language);
-
     decltype(query.origin_time) origin_time;
     if (query.origin_time)
     {
       origin_time.reset(new pt::ptime(*query.origin_time));
     }
 
-    int row = 0;
-    BOOST_FOREACH (const auto& tloc, query.locations)
+    query.raw_data.clear();
+    if (query.keep_raw_data)
+      query.raw_data.resize(query.data_params.size());
+
+    const std::vector<std::pair<std::string, SmartMet::Spine::LocationPtr> > locations(
+        query.locations.begin(), query.locations.end());
+    std::vector<LocationBlock> blocks(locations.size());
+
+    // Without a given origin time the first location selects the model run to use for
+    // the other locations too. It must therefore be extracted before the others.
+    std::size_t first_parallel = 0;
+    if (not query.origin_time and not locations.empty())
     {
-      SmartMet::Spine::LocationPtr loc = tloc.second;
-      const std::string place = tloc.second->name;
-      const std::string country = geo_engine->countryName(loc->iso2, language);
-      if (debug_level > 0)
-      {
-        std::cout << "Location: " << loc->name << " in " << country << std::endl;
-      }
+      extract_location(query, locations[0].second, origin_time, blocks[0]);
+      const auto& q = blocks[0].q;
 
-      SmartMet::Engine::Querydata::Producer producer = select_producer(*loc, query);
+      // With multifile data q_engine->get() origintime must not be set/locked
 
-      if (debug_level > 0)
-      {
-        std::cout << "Selected producer: " << producer << std::endl;
-      }
+      query.origin_time.reset(new pt::ptime(q->originTime()));
 
-      if (producer.empty())
+      if (not q_engine->getProducerConfig(blocks[0].producer).ismultifile)
       {
-        if (query.keyword.empty())
-        {
-          Fmi::Exception exception(BCP, "No data available for '" + loc->name + "'!");
-          exception.addParameter(WFS_EXCEPTION_CODE, WFS_OPERATION_PROCESSING_FAILED);
-          throw exception.disableStackTrace();
-        }
+        origin_time.reset(new pt::ptime(*query.origin_time));
       }
+      first_parallel = 1;
+    }
+
+    // Each location is extracted into its own block. The blocks are stored into the result
+    // table in location order afterwards, so the result does not depend on thread scheduling.
+    parallel_for(locations.size() - first_parallel,
+                 max_threads,
+                 [&](std::size_t i)
+                 {
+                   const std::size_t ind = first_parallel + i;
+                   extract_location(query, locations[ind].second, origin_time, blocks[ind]);
+                 });
 
-      auto q = (origin_time ? q_engine->get(producer, *origin_time) : q_engine->get(producer));
+    int row = 0;
+    for (auto& block : blocks)
+    {
+      const auto& q = block.q;
       query.modification_time = q->modificationTime();
 
 // FIXME: try to use the same model instead of searching model again
@@ -441,18 +532,6 @@ boost::shared_ptr<SmartMet::Spine::Table> bw::StoredForecastQueryHandler::extrac
       model_path = q->path().string();
 #endif
 
-      if (not query.origin_time)
-      {
-        // With multifile data q_engine->get() origintime must not be set/locked
-
-        query.origin_time.reset(new pt::ptime(q->originTime()));
-
-        if (not q_engine->getProducerConfig(producer).ismultifile)
-        {
-          origin_time.reset(new pt::ptime(*query.origin_time));
-        }
-      }
-
       query.have_model_area = false;
 
       if (q->isArea())
@@ -465,202 +544,385 @@ boost::shared_ptr<SmartMet::Spine::Table> bw::StoredForecastQueryHandler::extrac
         query.bottom_right = area.BottomRightLatLon();
       }
 
-      if (debug_level > 0 and not query.have_model_area)
-      {
-        std::ostringstream msg;
-        msg << METHOD_NAME << ": WARNING: model area not available";
+      query.producer_name = block.producer;
 #ifdef ENABLE_MODEL_PATH
-        if (model_path)
-          msg << " for " << *model_path;
+      query.model_path = q->path().string();
 #endif
-        msg << std::endl;
-        std::cout << msg.str() << std::flush;
-      }
+      query.toptions->setDataTimes(q->validTimes(), q->isClimatology());
 
-      // If we accept nearest valid points, find it now for this location
-      // This is fast if the nearest point is already valid
+      // The result table stores each cell as a separate string. Values are read directly from
+      // the column buffers through one reused string, so only the copy made by the table
+      // is allocated for each cell.
+      std::string value;
+      for (std::size_t column = 0; column < block.columns.size(); column++)
+      {
+        const auto& src = *block.columns[column];
+        for (std::size_t i = 0; i < src.size(); i++)
+        {
+          value.clear();
+          src.append_to(value, i);
+          ennusteet->set(column, row + i, value);
+        }
+      }
 
-      NFmiPoint nearestpoint(kFloatMissing, kFloatMissing);
-      if (query.find_nearest_valid_point)
+      if (query.keep_raw_data)
       {
-        NFmiPoint latlon(loc->longitude, loc->latitude);
-        // Querydata is using kilometers and WFS meters for a distance.
-        nearestpoint = q->validPoint(latlon, query.max_np_distance / 1000.0);
+        for (std::size_t column = query.first_data_ind; column <= query.last_data_ind; column++)
+        {
+          auto& src = block.raw_data.at(column);
+          query.raw_data[column].insert(query.raw_data[column].end(),
+                                        std::make_move_iterator(src.begin()),
+                                        std::make_move_iterator(src.end()));
+        }
       }
 
-      if (debug_level > 0)
+      row += block.num_rows;
+      block = LocationBlock();
+    }
+
+    return ennusteet;
+  }
+  catch (...)
+  {
+    throw Fmi::Exception::Trace(BCP, "Operation failed!");
+  }
+}
+
+void bw::StoredForecastQueryHandler::extract_location(
+    const Query& query,
+    const SmartMet::Spine::LocationPtr& loc,
+    const std::unique_ptr<pt::ptime>& origin_time,
+    LocationBlock& block) const
+{
+  try
+  {
+    using namespace SmartMet;
+
+    int debug_level = get_config()->get_debug_level();
+
+    std::string language = Fmi::ascii_tolower_copy(query.language);
+    SupportsLocationParameters::engOrFinToEnOrFi(language);
+
+    const std::string place = loc->name;
+    const std::string country = geo_engine->countryName(loc->iso2, language);
+    if (debug_level > 0)
+    {
+      std::ostringstream msg;
+      msg << "Location: " << loc->name << " in " << country << std::endl;
+      std::cout << msg.str() << std::flush;
+    }
+
+    SmartMet::Engine::Querydata::Producer producer = select_producer(*loc, query);
+
+    if (debug_level > 0)
+    {
+      std::ostringstream msg;
+      msg << "Selected producer: " << producer << std::endl;
+      std::cout << msg.str() << std::flush;
+    }
+
+    if (producer.empty())
+    {
+      if (query.keyword.empty())
       {
-        std::cout << "Producer : " << producer << std::endl;
+        Fmi::Exception exception(BCP, "No data available for '" + loc->name + "'!");
+        exception.addParameter(WFS_EXCEPTION_CODE, WFS_OPERATION_PROCESSING_FAILED);
+        throw exception.disableStackTrace();
+      }
+    }
+
+    auto q = (origin_time ? q_engine->get(producer, *origin_time) : q_engine->get(producer));
+    block.producer = producer;
+    block.q = q;
+
+    if (debug_level > 0 and not q->isArea())
+    {
+      std::ostringstream msg;
+      msg << METHOD_NAME << ": WARNING: model area not available";
 #ifdef ENABLE_MODEL_PATH
-        std::cout << "Selected model: " << q->path() << std::endl;
+      msg << " for " << q->path().string();
 #endif
-      }
+      msg << std::endl;
+      std::cout << msg.str() << std::flush;
+    }
+
+    // If we accept nearest valid points, find it now for this location
+    // This is fast if the nearest point is already valid
+
+    NFmiPoint nearestpoint(kFloatMissing, kFloatMissing);
+    if (query.find_nearest_valid_point)
+    {
+      NFmiPoint latlon(loc->longitude, loc->latitude);
+      // Querydata is using kilometers and WFS meters for a distance.
+      nearestpoint = q->validPoint(latlon, query.max_np_distance / 1000.0);
+    }
+
+    // Last point is updated by Querydata engine: use own copy for each location
+    NFmiPoint lastpoint = query.lastpoint;
 
-      query.producer_name = producer;
+    if (debug_level > 0)
+    {
+      std::ostringstream msg;
+      msg << "Producer : " << producer << std::endl;
 #ifdef ENABLE_MODEL_PATH
-      query.model_path = q->path().string();
+      msg << "Selected model: " << q->path() << std::endl;
 #endif
+      std::cout << msg.str() << std::flush;
+    }
 
-      const std::string zone = "UTC";
+    const std::string zone = "UTC";
 
-      query.toptions->setDataTimes(q->validTimes(), q->isClimatology());
-      if (debug_level > 2)
-      {
-        std::cout << *query.toptions << "\n";
-      }
+    SmartMet::Spine::TimeSeriesGeneratorOptions toptions(*query.toptions);
+    toptions.setDataTimes(q->validTimes(), q->isClimatology());
+    if (debug_level > 2)
+    {
+      std::ostringstream msg;
+      msg << toptions << "\n";
+      std::cout << msg.str() << std::flush;
+    }
 
-      auto tz = geo_engine->getTimeZones().time_zone_from_string(zone);
-      auto tlist = SmartMet::Spine::TimeSeriesGenerator::generate(*query.toptions, tz);
+    auto tz = geo_engine->getTimeZones().time_zone_from_string(zone);
+    auto tlist = SmartMet::Spine::TimeSeriesGenerator::generate(toptions, tz);
 
-      if (debug_level > 2)
+    if (debug_level > 2)
+    {
+      std::ostringstream msg;
+      msg << __FILE__ << "#" << __LINE__ << ": generated times:";
+      BOOST_FOREACH (const auto& t, tlist)
       {
-        std::cout << __FILE__ << "#" << __LINE__ << ": generated times:";
-        BOOST_FOREACH (const auto& t, tlist)
-        {
-          std::cout << " '" << t << "'";
-        }
-        std::cout << std::endl;
+        msg << " '" << t << "'";
       }
+      msg << std::endl;
+      std::cout << msg.str() << std::flush;
+    }
 
-      const int default_prec = 6;
-      const auto param_map = get_model_parameters(producer, q->originTime());
-      std::map<std::string, int> param_precision_map;
-      BOOST_FOREACH (const Parameter& param, query.data_params)
+    const int default_prec = 6;
+    const auto param_map = get_model_parameters(producer, q->originTime());
+    std::map<std::string, int> param_precision_map;
+    BOOST_FOREACH (const Parameter& param, query.data_params)
+    {
+      const std::string& name = param.name();
+      auto pos = param_map.find(Fmi::ascii_tolower_copy(name));
+      if (pos == param_map.end())
       {
-        const std::string& name = param.name();
-        auto pos = param_map.find(Fmi::ascii_tolower_copy(name));
-        if (pos == param_map.end())
-        {
-          param_precision_map[name] = default_prec;
-        }
-        else
-        {
-          param_precision_map[name] = pos->second.precision;
-        }
-
-        if (have_meteo_param_options(name))
-        {
-          param_precision_map[name] = get_meteo_parameter_options(name)->precision;
-        }
+        param_precision_map[name] = default_prec;
       }
-
-      if (not query.level_heights.empty() and q->levelType() != FmiLevelType::kFmiHybridLevel)
+      else
       {
-        Fmi::Exception exception(
-            BCP, "Only hybrid data supports data fetching from an arbitrary height.");
-        exception.addParameter(WFS_EXCEPTION_CODE, WFS_OPERATION_PROCESSING_FAILED);
-        throw exception.disableStackTrace();
+        param_precision_map[name] = pos->second.precision;
       }
 
-      if (not query.levels.empty() and not query.level_heights.empty())
+      if (have_meteo_param_options(name))
       {
-        Fmi::Exception exception(BCP,
-                                 "Fetching data from a level and an arbitrary height is not "
-                                 "supported in a same request.");
-        exception.addParameter(WFS_EXCEPTION_CODE, WFS_OPERATION_PROCESSING_FAILED);
-        throw exception.disableStackTrace();
+        param_precision_map[name] = get_meteo_parameter_options(name)->precision;
       }
+    }
+
+    if (not query.level_heights.empty() and q->levelType() != FmiLevelType::kFmiHybridLevel)
+    {
+      Fmi::Exception exception(
+          BCP, "Only hybrid data supports data fetching from an arbitrary height.");
+      exception.addParameter(WFS_EXCEPTION_CODE, WFS_OPERATION_PROCESSING_FAILED);
+      throw exception.disableStackTrace();
+    }
+
+    if (not query.levels.empty() and not query.level_heights.empty())
+    {
+      Fmi::Exception exception(BCP,
+                               "Fetching data from a level and an arbitrary height is not "
+                               "supported in a same request.");
+      exception.addParameter(WFS_EXCEPTION_CODE, WFS_OPERATION_PROCESSING_FAILED);
+      throw exception.disableStackTrace();
+    }
+
+    /*
+    if (query.levels.empty() and query.level_heights.empty())
+    {
+      Fmi::Exception exception(BCP, "No level selected.");
+      exception.addParameter(WFS_EXCEPTION_CODE, WFS_OPERATION_PROCESSING_FAILED);
+      throw exception;
+    }
+    */
+
+    // Values are collected and formatted column by column. Precision is looked up only once
+    // per parameter.
+    auto& columns = block.columns;
+    for (const Parameter& param : query.data_params)
+    {
+      columns.emplace_back(
+          new FormattedValueColumn(*query.value_formatter, param_precision_map.at(param.name())));
+      columns.back()->reserve(tlist.size());
+    }
+
+    if (query.keep_raw_data)
+      block.raw_data.resize(query.data_params.size());
 
-      /*
-      if (query.levels.empty() and query.level_heights.empty())
+    // Raw values are stored in the same order as the rows of the result table
+    const auto append_values = [&block, &query](std::size_t column,
+                                                const SmartMet::Spine::TimeSeries::TimeSeries& ts) {
+      if (query.keep_raw_data and column >= query.first_data_ind and
+          column <= query.last_data_ind)
       {
-        Fmi::Exception exception(BCP, "No level selected.");
-        exception.addParameter(WFS_EXCEPTION_CODE, WFS_OPERATION_PROCESSING_FAILED);
-        throw exception;
+        auto& dest = block.raw_data[column];
+        for (const auto& item : ts)
+          dest.push_back(item.value);
       }
-      */
-
-      // Fetch data from an arbitrary height.
-      for (const auto& level_height : query.level_heights)
+      else
       {
-        for (const lt::local_date_time& dt : tlist)
-        {
-          using SmartMet::Spine::Parameter;
+        block.columns[column]->append(ts);
+      }
+    };
+
+    // Whole time series of one parameter is fetched at once so that the location is
+    // looked up and the interpolation weights are computed only once per parameter
+    // instead of once per time step.
+    const std::string timestring = "";
+    const auto param_options = [&](const SmartMet::Spine::Parameter& param) {
+      return SmartMet::Engine::Querydata::ParameterOptions(param,
+                                                           producer,
+                                                           *loc,
+                                                           country,
+                                                           place,
+                                                           *query.time_formatter,
+                                                           timestring,
+                                                           query.language,
+                                                           *query.output_locale,
+                                                           zone,
+                                                           query.find_nearest_valid_point,
+                                                           nearestpoint,
+                                                           lastpoint);
+    };
+
+    // Fetch data from an arbitrary height.
+    for (const auto& level_height : query.level_heights)
+    {
+      std::size_t column = 0;
+      for (const Parameter& param : query.data_params)
+      {
+        const auto qengine_param = param_options(param);
+        const auto ts = q->valuesAtHeight(qengine_param, tlist, level_height);
+        append_values(column, *ts);
+        ++column;
+      }
 
-          int column = 0;
-          for (const Parameter& param : query.data_params)
-          {
-            int prec = param_precision_map.at(param.name());
-
-            const std::string timestring = "";
-
-            SmartMet::Engine::Querydata::ParameterOptions qengine_param(
-                param,
-                producer,
-                *loc,
-                country,
-                place,
-                *query.time_formatter,
-                timestring,
-                query.language,
-                *query.output_locale,
-                zone,
-                query.find_nearest_valid_point,
-                nearestpoint,
-                query.lastpoint);
-            SmartMet::Spine::TimeSeries::Value val =
-                q->valueAtHeight(qengine_param, dt, level_height);
-
-            std::stringstream ss;
-            SmartMet::Spine::TimeSeries::OStreamVisitor osv(ss, *query.value_formatter, prec);
-            boost::apply_visitor(osv, val);
-
-            ennusteet->set(column, row, ss.str());
-
-            ++column;
-          }
+      block.num_rows += tlist.size();
+    }
 
-          ++row;
+    for (q->resetLevel(); q->nextLevel() and query.level_heights.empty();)
+    {
+      if (query.levels.empty() || query.levels.count(static_cast<int>(q->levelValue())) > 0)
+      {
+        std::size_t column = 0;
+        for (const Parameter& param : query.data_params)
+        {
+          const auto qengine_param = param_options(param);
+          const auto ts = q->values(qengine_param, tlist);
+          append_values(column, *ts);
+          ++column;
         }
+
+        block.num_rows += tlist.size();
       }
+    }
+  }
+  catch (...)
+  {
+    throw Fmi::Exception::Trace(BCP, "Operation failed!");
+  }
+}
 
-      for (q->resetLevel(); q->nextLevel() and query.level_heights.empty();)
-      {
-        if (query.levels.empty() || query.levels.count(static_cast<int>(q->levelValue())) > 0)
-        {
-          BOOST_FOREACH (const lt::local_date_time& d, tlist)
-          {
-            using SmartMet::Spine::Parameter;
+void bw::StoredForecastQueryHandler::write_arrow(const Query& query, std::ostream& output) const
+{
+  try
+  {
+    // Station metadata comes from the formatted result table, data values as such
+    const auto to_double = [&query](const std::string& value) {
+      char* end = nullptr;
+      const double result = std::strtod(value.c_str(), &end);
+      return (value.empty() or value == query.missing_text or *end != 0)
+                 ? std::numeric_limits<double>::quiet_NaN()
+                 : result;
+    };
+
+    ArrowStreamWriter arrow;
+    const std::size_t col_geoid = arrow.add_column("geoid", ArrowStreamWriter::INT64);
+    const std::size_t col_name = arrow.add_column("name", ArrowStreamWriter::STRING);
+    const std::size_t col_lat = arrow.add_column("latitude", ArrowStreamWriter::DOUBLE);
+    const std::size_t col_lon = arrow.add_column("longitude", ArrowStreamWriter::DOUBLE);
+    const std::size_t col_time = arrow.add_column("time", ArrowStreamWriter::TIMESTAMP);
+    const std::size_t col_level = arrow.add_column("level", ArrowStreamWriter::DOUBLE);
+    std::vector<std::size_t> data_cols;
+    for (std::size_t k = query.first_data_ind; k <= query.last_data_ind; k++)
+      data_cols.push_back(arrow.add_column(query.data_params.at(k).name(), ArrowStreamWriter::DOUBLE));
+
+    const std::size_t num_rows = query.result->rows().size();
+    for (std::size_t i = 0; i < num_rows; i++)
+    {
+      const double geoid = to_double(query.result->get(ind_geoid, i));
+      if (std::isnan(geoid))
+        arrow.append_null(col_geoid);
+      else
+        arrow.append(col_geoid, static_cast<std::int64_t>(geoid));
+      arrow.append(col_name, query.result->get(ind_place, i));
+      arrow.append(col_lat, to_double(query.result->get(ind_lat, i)));
+      arrow.append(col_lon, to_double(query.result->get(ind_lon, i)));
+      arrow.append(col_time, Fmi::TimeParser::parse_iso(query.result->get(ind_epoch, i)));
+      arrow.append(col_level, to_double(query.result->get(ind_level, i)));
+      for (std::size_t k = query.first_data_ind; k <= query.last_data_ind; k++)
+        arrow.append(data_cols[k - query.first_data_ind], query.raw_data.at(k).at(i));
+    }
 
-            int column = 0;
-            BOOST_FOREACH (const Parameter& param, query.data_params)
-            {
-              int prec = param_precision_map.at(param.name());
-
-              const std::string timestring = "";
-
-              SmartMet::Engine::Querydata::ParameterOptions qengine_param(
-                  param,
-                  producer,
-                  *loc,
-                  country,
-                  place,
-                  *query.time_formatter,
-                  timestring,
-                  query.language,
-                  *query.output_locale,
-                  zone,
-                  query.find_nearest_valid_point,
-                  nearestpoint,
-                  query.lastpoint);
-              SmartMet::Spine::TimeSeries::Value val = q->value(qengine_param, d);
-
-              std::stringstream ss;
-              SmartMet::Spine::TimeSeries::OStreamVisitor osv(ss, *query.value_formatter, prec);
-              boost::apply_visitor(osv, val);
-
-              ennusteet->set(column, row, ss.str());
-
-              ++column;
-            }
+    arrow.write(output);
+  }
+  catch (...)
+  {
+    throw Fmi::Exception::Trace(BCP, "Operation failed!");
+  }
+}
 
-            ++row;
-          }
-        }
+void bw::StoredForecastQueryHandler::write_csv(const Query& query, std::ostream& output) const
+{
+  try
+  {
+    CsvWriter csv(output);
+    std::vector<std::string> header = {"geoid", "name", "latitude", "longitude", "time", "level"};
+    for (std::size_t k = query.first_data_ind; k <= query.last_data_ind; k++)
+      header.push_back(query.data_params.at(k).name());
+    csv.write_header(header);
+
+    const auto add_value = [&csv, &query](const std::string& value) {
+      if (value.empty() or value == query.missing_text)
+        csv.add_empty_field();
+      else
+        csv.add_field(remove_trailing_0(value));
+    };
+
+    // Rows of a site are consecutive in the result table
+    std::string tz_geoid;
+    lt::time_zone_ptr tzp;
+    const std::size_t num_rows = query.result->rows().size();
+    for (std::size_t i = 0; i < num_rows; i++)
+    {
+      const std::string geoid = query.result->get(ind_geoid, i);
+      const std::string latitude = query.result->get(ind_lat, i);
+      const std::string longitude = query.result->get(ind_lon, i);
+      if (i == 0 or geoid != tz_geoid)
+      {
+        tzp = get_tz_for_site(Fmi::stod(longitude), Fmi::stod(latitude), query.tz_name);
+        tz_geoid = geoid;
       }
-    }
 
-    return ennusteet;
+      const pt::ptime epoch = Fmi::TimeParser::parse_iso(query.result->get(ind_epoch, i));
+      csv.add_field(geoid);
+      csv.add_field(query.result->get(ind_place, i));
+      csv.add_field(latitude);
+      csv.add_field(longitude);
+      csv.add_field(format_local_time(epoch, tzp));
+      add_value(query.result->get(ind_level, i));
+      for (std::size_t k = query.first_data_ind; k <= query.last_data_ind; k++)
+        add_value(query.result->get(k, i));
+      csv.end_row();
+    }
   }
   catch (...)
   {
@@ -1066,6 +1328,14 @@ and must be specified on top level of stored query configuration file when prese
   <td>Specifying @b true causes separate response group to be generated for each site/td>
 </tr>
 
+<tr>
+  <td>maxThreads</td>
+  <td>unsigned integer</td>
+  <td>optional (default 4)</td>
+  <td>Maximal number of threads used for extracting data of different locations of
+      one request. Value 1 disables parallel extraction.</td>
+</tr>
+
 </table>
 
 
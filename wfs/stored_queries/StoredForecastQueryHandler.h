@@ -75,6 +75,13 @@ class StoredForecastQueryHandler : public StoredQueryHandlerBase,
     std::size_t first_data_ind;
     std::size_t last_data_ind;
 
+    /**
+     *  Unformatted values of data parameters (columns first_data_ind...last_data_ind)
+     *  are stored in raw_data instead of the result table when set.
+     */
+    bool keep_raw_data = false;
+    std::vector<std::vector<SmartMet::Spine::TimeSeries::Value> > raw_data;
+
    public:
     Query();
     Query(boost::shared_ptr<const StoredQueryConfig> config);
@@ -96,9 +103,28 @@ class StoredForecastQueryHandler : public StoredQueryHandlerBase,
 		     const boost::optional<std::string> &hostname,
                      std::ostream& output) const;
 
+  virtual bool supports_output_format(const std::string& format) const;
+
  private:
+  struct LocationBlock;
+
   boost::shared_ptr<SmartMet::Spine::Table> extract_forecast(Query& query) const;
 
+  /**
+   *   @brief Extract data of one location
+   *
+   *   Does not modify the query so that several locations can be extracted
+   *   concurrently.
+   */
+  void extract_location(const Query& query,
+                        const SmartMet::Spine::LocationPtr& loc,
+                        const std::unique_ptr<boost::posix_time::ptime>& origin_time,
+                        LocationBlock& block) const;
+
+  void write_arrow(const Query& query, std::ostream& output) const;
+
+  void write_csv(const Query& query, std::ostream& output) const;
+
   SmartMet::Engine::Querydata::Producer select_producer(const SmartMet::Spine::Location& loc,
                                                         const Query& query) const;
 
@@ -115,6 +141,7 @@ class StoredForecastQueryHandler : public StoredQueryHandlerBase,
   std::vector<SmartMet::Spine::Parameter> common_params;
   double max_np_distance;
   bool separate_groups;
+  std::size_t max_threads;
 
   std::size_t ind_geoid;
   std::size_t ind_epoch;
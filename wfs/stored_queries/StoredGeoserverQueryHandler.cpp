@@ -286,15 +286,13 @@ void bw::StoredGeoserverQueryHandler::update_parameters(
           BOOST_FOREACH (const std::string& label, dest_axisLabels_vect)
             pm1->add("destSrsAxisLabels", label);
 
-          const auto orig_coords = it2->get_orig_coords();
+          const auto& orig_coords = it2->get_orig_coords();
           BOOST_FOREACH (double value, orig_coords)
           {
             pm1->add("origBoundary", value);
           }
 
-          OGREnvelope envelope;
-
-          it2->orig_geom->getEnvelope(&envelope);
+          const OGREnvelope envelope = it2->get_orig_envelope();
           double c_env[4] = {envelope.MinX, envelope.MinY, envelope.MaxX, envelope.MaxY};
           pm1->add("origEnvelope", c_env, c_env + 4);
 
@@ -320,7 +318,7 @@ void bw::StoredGeoserverQueryHandler::update_parameters(
           if (layerParamNameIt != layer_param_name_map.end())
             pm1->add("layerParam", layerParamNameIt->second);
 
-          const auto dest_coords = it2->get_dest_coords();
+          const auto& dest_coords = it2->get_dest_coords();
           BOOST_FOREACH (double value, dest_coords)
           {
             char tmp[80];
@@ -328,8 +326,8 @@ void bw::StoredGeoserverQueryHandler::update_parameters(
             pm1->add("destBoundary", tmp);
           }
 
-          pm1->add("origSrsDim", it2->orig_geom->getCoordinateDimension());
-          pm1->add("destSrsDim", it2->dest_geom->getCoordinateDimension());
+          pm1->add("origSrsDim", it2->orig_dim);
+          pm1->add("destSrsDim", it2->dest_dim);
 
           BOOST_FOREACH (const auto& map_item, it2->data_map)
           {
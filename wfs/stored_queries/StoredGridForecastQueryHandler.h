@@ -43,6 +43,7 @@ class StoredGridForecastQueryHandler: public StoredQueryHandlerBase,
 
     void        init_handler();
     void        query(const StoredQuery& query, const std::string& language, const boost::optional<std::string>& hostname, std::ostream& output) const;
+    bool        supports_output_format(const std::string& format) const;
 
   protected:
 
@@ -55,12 +56,17 @@ class StoredGridForecastQueryHandler: public StoredQueryHandlerBase,
 
     Table_sptr  extract_forecast(Query& query) const;
 
+    void        write_csv(const Query& query, std::ostream& output) const;
+
+    class       GridInfoLookup;
+
     uint        processGridQuery(
                     Query& wfsQuery,
                     const std::string& tag,
                     const Spine::LocationPtr loc,
                     std::string country,
                     QueryServer::Query& gridQuery,
+                    GridInfoLookup& gridInfo,
                     Table_sptr output,
                     uint rowCount) const;
 
@@ -1,6 +1,8 @@
 #include <algorithm>
 #include <iomanip>
+#include <limits>
 #include <list>
+#include <map>
 #include <string>
 
 #include <boost/algorithm/string.hpp>
@@ -20,6 +22,7 @@
 #include <newbase/NFmiSvgTools.h>
 
 #include <macgyver/Exception.h>
+#include <macgyver/Hash.h>
 #include <macgyver/StringConversion.h>
 #include <macgyver/TypeName.h>
 
@@ -30,6 +33,7 @@
 #include <smartmet/spine/TimeSeriesOutput.h>
 
 #include "AreaUtils.h"
+#include "ArrowStreamWriter.h"
 #include "FeatureID.h"
 #include "StoredQueryHandlerFactoryDef.h"
 #include "WfsConvenience.h"
@@ -129,21 +133,6 @@ StoredGridQueryHandler::Query::~Query() {}
 
 namespace
 {
-double comparisonDistance(const NFmiPoint& first, const NFmiPoint& second)
-{
-  try
-  {
-    double result = ((first.X() - second.X()) * (first.X() - second.X())) +
-                    ((first.Y() - second.Y()) * (first.Y() - second.Y()));
-
-    return result;
-  }
-  catch (...)
-  {
-    throw Fmi::Exception::Trace(BCP, "Operation failed!");
-  }
-}
-
 std::string formatToScaledInteger(double input, unsigned long digits, unsigned long precision)
 {
   try
@@ -160,30 +149,60 @@ std::string formatToScaledInteger(double input, unsigned long digits, unsigned l
   }
 }
 
-ts::TimeSeriesGroupPtr makeSparseGrid(const ts::TimeSeriesGroupPtr& inputGrid,
-                                      unsigned long step,
-                                      const std::pair<unsigned, unsigned>& extents)
+/**
+ *   @brief Sub-rectangle of the data grid covered by the bounding box mask
+ *
+ *   Only every step:th column and row are included. Output rows are ordered
+ *   from north to south (the first output row is the northernmost one).
+ */
+struct GridSlab
+{
+  std::size_t i0;      // The first data grid column
+  std::size_t j0;      // The first (southernmost) data grid row
+  std::size_t step;    // Data step in grid cells
+  std::size_t width;   // Number of output columns
+  std::size_t height;  // Number of output rows
+
+  inline std::size_t size() const { return width * height; }
+  inline std::size_t column(std::size_t x) const { return i0 + x * step; }
+  inline std::size_t row(std::size_t y) const { return j0 + (height - 1 - y) * step; }
+};
+
+GridSlab make_grid_slab(const NFmiIndexMask& mask,
+                        std::size_t nx,
+                        std::size_t step,
+                        const std::string& producer)
 {
   try
   {
-    ts::TimeSeriesGroupPtr result(new ts::TimeSeriesGroup);
-
-    unsigned long index = 0;
-    unsigned long xindex;
-    unsigned long yindex;
-    for (auto locationIt = inputGrid->begin(); locationIt != inputGrid->end();
-         ++locationIt, ++index)
+    if (mask.empty() or nx == 0)
     {
-      xindex = index / extents.first;
-      yindex = index % extents.first;
+      Fmi::Exception exception(BCP, " No data available for producer '" + producer + "'");
+      exception.addParameter(WFS_EXCEPTION_CODE, WFS_OPERATION_PROCESSING_FAILED);
+      throw exception;
+    }
 
-      if (xindex % step == 0 && yindex % step == 0)
-      {
-        result->push_back(ts::LonLatTimeSeries(locationIt->lonlat, locationIt->timeseries));
-      }
+    std::size_t i0 = std::numeric_limits<std::size_t>::max();
+    std::size_t j0 = std::numeric_limits<std::size_t>::max();
+    std::size_t i1 = 0;
+    std::size_t j1 = 0;
+    for (const auto index : mask)
+    {
+      const std::size_t i = index % nx;
+      const std::size_t j = index / nx;
+      i0 = std::min(i0, i);
+      i1 = std::max(i1, i);
+      j0 = std::min(j0, j);
+      j1 = std::max(j1, j);
     }
 
-    return result;
+    GridSlab slab;
+    slab.i0 = i0;
+    slab.j0 = j0;
+    slab.step = step;
+    slab.width = (i1 - i0) / step + 1;
+    slab.height = (j1 - j0) / step + 1;
+    return slab;
   }
   catch (...)
   {
@@ -191,49 +210,77 @@ ts::TimeSeriesGroupPtr makeSparseGrid(const ts::TimeSeriesGroupPtr& inputGrid,
   }
 }
 
-#ifdef OLD_IMPL
-boost::any makeSparseGrid(const boost::any& inputGrid,
-                          unsigned long step,
-                          const std::pair<unsigned, unsigned>& extents)
+// Calculate values of a parameter not stored in the data for the cells of the slab
+std::vector<std::vector<float> > engine_values(
+    const qe::Q& model,
+    const SmartMet::Spine::Parameter& param,
+    const qe::Producer& producer,
+    const SmartMet::Spine::Location& loc,
+    const std::string& country,
+    const StoredGridQueryHandler::Query& query,
+    const GridSlab& slab,
+    const SmartMet::Spine::TimeSeriesGenerator::LocalTimeList& tlist)
 {
-  typedef std::vector<boost::any> AnyVector;
-
-  AnyVector result;
-
-  auto valVector = boost::any_cast<AnyVector>(inputGrid);
-
-  for (auto timeIt = valVector.begin(); timeIt != valVector.end(); ++timeIt)
+  try
   {
-    AnyVector area;
-    AnyVector dataVec;
+    // Output positions of the cells in the ascending grid index order of the mask
+    const std::size_t nx = model->grid().XNumber();
+    std::map<unsigned long, std::size_t> positions;
+    for (std::size_t y = 0; y < slab.height; y++)
+      for (std::size_t x = 0; x < slab.width; x++)
+        positions[slab.row(y) * nx + slab.column(x)] = y * slab.width + x;
 
-    auto placeVec = boost::any_cast<std::vector<boost::any> >(*timeIt);
+    NFmiIndexMask slab_mask;
+    for (const auto& item : positions)
+      slab_mask.insert(item.first);
 
-    auto locationVec = boost::any_cast<std::vector<boost::any> >(
-        *(placeVec.begin()));  // Only one area, this is sufficient
-
-    unsigned long index = 0;
-    unsigned long xindex;
-    unsigned long yindex;
-    for (auto innerIt = locationVec.begin(); innerIt != locationVec.end(); ++innerIt, ++index)
+    NFmiPoint nearestpoint(kFloatMissing, kFloatMissing);
+    qe::ParameterOptions qengine_param(param,
+                                       producer,
+                                       loc,
+                                       country,
+                                       loc.name,
+                                       *query.time_formatter,
+                                       "",
+                                       query.language,
+                                       *query.output_locale,
+                                       loc.timezone,
+                                       query.find_nearest_valid_point,
+                                       nearestpoint,
+                                       query.lastpoint);
+
+    auto values = model->values(qengine_param, slab_mask, tlist);
+
+    std::vector<std::vector<float> > result(tlist.size(),
+                                            std::vector<float>(slab.size(), kFloatMissing));
+    if (values->size() != positions.size())
     {
-      xindex = index / extents.first;
-      yindex = index % extents.first;
+      Fmi::Exception exception(BCP, "Unexpected number of grid points in parameter values");
+      exception.addParameter("Parameter", param.name());
+      exception.addParameter("Expected", std::to_string(positions.size()));
+      exception.addParameter("Actual", std::to_string(values->size()));
+      throw exception;
+    }
 
-      if (xindex % step == 0 && yindex % step == 0)
+    // Non-numeric values are not supported in the grid and are handled as missing
+    auto pos = positions.begin();
+    for (const auto& item : *values)
+    {
+      const std::size_t ind = (pos++)->second;
+      for (std::size_t t = 0; t < item.timeseries.size() and t < result.size(); t++)
       {
-        dataVec.push_back(*innerIt);
+        const double* value = boost::get<double>(&item.timeseries[t].value);
+        if (value)
+          result[t][ind] = static_cast<float>(*value);
       }
     }
-
-    area.push_back(dataVec);
-
-    result.push_back(area);
+    return result;
+  }
+  catch (...)
+  {
+    throw Fmi::Exception::Trace(BCP, "Operation failed!");
   }
-
-  return result;
 }
-#endif
 
 // make rectangle nfmisvgpath
 void make_rectangle_path(NFmiSvgPath& thePath,
@@ -393,92 +440,63 @@ void dump_meta_query_options(const qe::MetaQueryOptions& opt)
 
 }  // namespace
 
-std::pair<unsigned int, unsigned int> StoredGridQueryHandler::getDataIndexExtents(
-    const SmartMet::Spine::TimeSeries::TimeSeriesGroupPtr& longitudes,
-    const SmartMet::Spine::TimeSeries::TimeSeriesGroupPtr& latitudes,
-    const Query& query,
-    const std::string& dataCrs) const
+void StoredGridQueryHandler::write_arrow(const Query& query, std::ostream& output) const
 {
   try
   {
-    std::pair<unsigned int, unsigned int> result;
-
-    if (longitudes->empty())
-    {
-      std::ostringstream msg;
-      msg << " No data available for producer '" << query.producer_name << "'";
-      Fmi::Exception exception(BCP, msg.str());
-      exception.addParameter(WFS_EXCEPTION_CODE, WFS_OPERATION_PROCESSING_FAILED);
-      throw exception;
-    }
-
-    if (latitudes->empty())
-    {
-      std::ostringstream msg;
-      msg << " No data available for producer '" << query.producer_name << "'";
-      Fmi::Exception exception(BCP, msg.str());
-      exception.addParameter(WFS_EXCEPTION_CODE, WFS_OPERATION_PROCESSING_FAILED);
-      throw exception;
-    }
-
-    std::vector<double> locationVecLon;
-    std::vector<double> locationVecLat;
-
-    BOOST_FOREACH (const auto& item, *longitudes)
-      locationVecLon.push_back(item.lonlat.lon);
-    BOOST_FOREACH (const auto& item, *latitudes)
-      locationVecLat.push_back(item.lonlat.lat);
-
-    double firstLon = locationVecLon[0];
-    auto lonIter = locationVecLon.begin();
-    lonIter++;
-
-    auto firstLat = locationVecLat[0];
-    auto latIter = locationVecLat.begin();
-    latIter++;
-
-    if (lonIter == locationVecLon.end() || latIter == locationVecLat.end())
-    {
-      std::ostringstream msg;
-      msg << " Empty result grid, check data extents";
-      Fmi::Exception exception(BCP, msg.str());
-      exception.addParameter(WFS_EXCEPTION_CODE, WFS_OPERATION_PROCESSING_FAILED);
-      throw exception;
-    }
-
-    NFmiPoint firstPoint(firstLon, firstLat);
-    NFmiPoint secondPoint(*lonIter, *latIter);
-
-    double compDistance = ::comparisonDistance(firstPoint, secondPoint) *
-                          1.1;  // A little bit of slack, just to be safe
-
-    ++lonIter;
-    ++latIter;
-
-    auto previousPoint = secondPoint;
-
-    while (lonIter != locationVecLon.end() && latIter != locationVecLat.end())
+    // One row per grid cell, time step and level. Parameters are columns. Rows are
+    // in the same order as in GML output (the first row of the grid is the northernmost one)
+    // and values are not scaled.
+    const Result& result = query.result;
+
+    ArrowStreamWriter arrow;
+    const std::size_t col_level = arrow.add_column("level", ArrowStreamWriter::DOUBLE);
+    const std::size_t col_time = arrow.add_column("time", ArrowStreamWriter::TIMESTAMP);
+    const std::size_t col_x = arrow.add_column("x", ArrowStreamWriter::INT64);
+    const std::size_t col_y = arrow.add_column("y", ArrowStreamWriter::INT64);
+    const std::size_t col_lon = arrow.add_column("longitude", ArrowStreamWriter::DOUBLE);
+    const std::size_t col_lat = arrow.add_column("latitude", ArrowStreamWriter::DOUBLE);
+    std::vector<std::size_t> param_cols;
+    for (const auto& info : result.paramInfos)
+      param_cols.push_back(arrow.add_column(info.first, ArrowStreamWriter::DOUBLE));
+
+    const std::size_t width = result.xdim;
+    const std::size_t height = result.ydim;
+    const std::size_t grid_size = width * height;
+    if (result.longitudes.size() != grid_size or result.latitudes.size() != grid_size)
+      throw Fmi::Exception(BCP, "Grid coordinate count does not match grid dimensions");
+
+    std::size_t level_index = 0;
+    for (const auto& level_data : result.dataLevels)
     {
-      NFmiPoint thisPoint(*lonIter, *latIter);
-
-      double dist = ::comparisonDistance(previousPoint, thisPoint);
-
-      if (dist > compDistance)  // We have jumped to the next row in data
-      {
-        break;
-      }
-      else
+      const double level = result.levelValues.at(level_index++);
+      for (std::size_t t = 0; t < result.timesteps.size(); t++)
       {
-        lonIter++;
-        latIter++;
-        previousPoint = thisPoint;
+        for (std::size_t y = 0; y < height; y++)
+        {
+          for (std::size_t x = 0; x < width; x++)
+          {
+            const std::size_t ind = y * width + x;
+            arrow.append(col_level, level);
+            arrow.append(col_time, result.timesteps[t]);
+            arrow.append(col_x, static_cast<std::int64_t>(x));
+            arrow.append(col_y, static_cast<std::int64_t>(y));
+            arrow.append(col_lon, result.longitudes[ind]);
+            arrow.append(col_lat, result.latitudes[ind]);
+            for (std::size_t k = 0; k < param_cols.size(); k++)
+            {
+              const auto& grid = level_data.at(k).at(t);
+              if (grid.size() == grid_size and grid[ind] != kFloatMissing)
+                arrow.append(param_cols[k], static_cast<double>(grid[ind]));
+              else
+                arrow.append_null(param_cols[k]);
+            }
+          }
+        }
       }
     }
 
-    result.first = lonIter - locationVecLon.begin();
-    result.second = locationVecLon.size() / result.first;
-
-    return result;
+    arrow.write(output);
   }
   catch (...)
   {
@@ -486,145 +504,10 @@ std::pair<unsigned int, unsigned int> StoredGridQueryHandler::getDataIndexExtent
   }
 }
 
-#ifdef OLD_IMPL
-std::pair<unsigned int, unsigned int> StoredGridQueryHandler::getDataIndexExtents(
-    const boost::any& longitudes,
-    const boost::any& latitudes,
-    const Query& query,
-    const std::string& dataCrs) const
-{
-  std::pair<unsigned int, unsigned int> result;
-
-  auto valVectorLon = boost::any_cast<std::vector<boost::any> >(longitudes);
-
-  if (valVectorLon.empty())
-  {
-    std::ostringstream msg;
-    msg << " No data available for producer '" << query.producer_name << "'";
-    Fmi::Exception exception(BCP, msg.str());
-    exception.addParameter(WFS_EXCEPTION_CODE, WFS_OPERATION_PROCESSING_FAILED);
-    throw exception;
-  }
-
-  auto valVectorLat = boost::any_cast<std::vector<boost::any> >(latitudes);
-
-  if (valVectorLat.empty())
-  {
-    std::ostringstream msg;
-    msg << " No data available for producer '" << query.producer_name << "'";
-    Fmi::Exception exception(BCP, msg.str());
-    exception.addParameter(WFS_EXCEPTION_CODE, WFS_OPERATION_PROCESSING_FAILED);
-    throw exception;
-  }
-
-  auto timeItLon = valVectorLon.begin();
-  auto placeVecLon = boost::any_cast<std::vector<boost::any> >(*timeItLon);
-  auto locationVecLon = boost::any_cast<std::vector<boost::any> >(
-      *(placeVecLon.begin()));  // Only one area, this is sufficient
-  auto firstLon = boost::any_cast<double>(*(locationVecLon.begin()));
-  auto lonIter = locationVecLon.begin();
-  lonIter++;
-
-  auto timeItLat = valVectorLat.begin();
-  auto placeVecLat = boost::any_cast<std::vector<boost::any> >(*timeItLat);
-  auto locationVecLat = boost::any_cast<std::vector<boost::any> >(
-      *(placeVecLat.begin()));  // Only one area, this is sufficient
-  auto firstLat = boost::any_cast<double>(*(locationVecLat.begin()));
-  auto latIter = locationVecLat.begin();
-  latIter++;
-
-  if (lonIter == locationVecLon.end() || latIter == locationVecLat.end())
-  {
-    std::ostringstream msg;
-    msg << " Empty result grid, check data extents";
-    Fmi::Exception exception(BCP, msg.str());
-    exception.addParameter(WFS_EXCEPTION_CODE, WFS_OPERATION_PROCESSING_FAILED);
-    throw exception;
-  }
-
-  NFmiPoint firstPoint(firstLon, firstLat);
-  NFmiPoint secondPoint(boost::any_cast<double>(*lonIter), boost::any_cast<double>(*latIter));
-
-  double compDistance = ::comparisonDistance(firstPoint, secondPoint) *
-                        1.1;  // A little bit of slack, just to be safe
-
-  ++lonIter;
-  ++latIter;
-
-  auto previousPoint = secondPoint;
-
-  while (lonIter != locationVecLon.end() && latIter != locationVecLat.end())
-  {
-    NFmiPoint thisPoint(boost::any_cast<double>(*lonIter), boost::any_cast<double>(*latIter));
-
-    double dist = ::comparisonDistance(previousPoint, thisPoint);
-
-    if (dist > compDistance)  // We have jumped to the next row in data
-    {
-      break;
-    }
-    else
-    {
-      lonIter++;
-      latIter++;
-      previousPoint = thisPoint;
-    }
-  }
-
-  result.first = lonIter - locationVecLon.begin();
-  result.second = locationVecLon.size() / result.first;
-
-  return result;
-}
-#endif
-
-StoredGridQueryHandler::Result::Grid StoredGridQueryHandler::rearrangeGrid(
-    const Result::Grid& inputGrid, int arrayWidth) const
+bool StoredGridQueryHandler::supports_output_format(const std::string& format) const
 {
-  try
-  {
-    // In-place rearrange would be nicer
-
-    Result::Grid orderedGrid(inputGrid.size());
-
-    auto outputIt = orderedGrid.end();
-
-    std::advance(outputIt, -arrayWidth);
-
-    unsigned stepsSoFar = 0;
-
-    if (inputGrid.size() % arrayWidth != 0)
-    {
-      std::ostringstream os;
-      os << "Array width '" << arrayWidth
-         << "' is not multiple of data size, data rearrange is impossible";
-      throw Fmi::Exception(BCP, os.str());
-    }
-
-    while (true)
-    {
-      // If array dimensions change (i.e. queried bbox is in different projection than data, the
-      // following segfaults
-
-      outputIt = std::copy(inputGrid.begin() + arrayWidth * stepsSoFar,
-                           inputGrid.begin() + arrayWidth * (stepsSoFar + 1),
-                           outputIt);
-
-      if (outputIt == orderedGrid.begin() + arrayWidth)
-      {
-        break;
-      }
-
-      std::advance(outputIt, -2 * arrayWidth);
-      stepsSoFar++;
-    }
-
-    return orderedGrid;
-  }
-  catch (...)
-  {
-    throw Fmi::Exception::Trace(BCP, "Operation failed!");
-  }
+  return format == StandardPresentationParameters::ARROW_OUTPUT_FORMAT or
+         StoredQueryHandlerBase::supports_output_format(format);
 }
 
 std::map<std::string, SmartMet::Engine::Querydata::ModelParameter>
@@ -747,7 +630,6 @@ StoredGridQueryHandler::Result StoredGridQueryHandler::extract_forecast(
 
     SmartMet::Spine::LocationPtr loc = geo_engine->lonlatSearch(lon1, lat1, query.language);
 
-    const std::string place = loc->name;
     const std::string country = geo_engine->countryName(loc->iso2, query.language);
     if (debug_level > 0)
     {
@@ -784,8 +666,6 @@ StoredGridQueryHandler::Result StoredGridQueryHandler::extract_forecast(
       throw exception;
     }
 
-    NFmiPoint nearestpoint(kFloatMissing, kFloatMissing);
-
     if (debug_level > 0)
     {
       std::cout << "Producer : " << producer << std::endl;
@@ -839,7 +719,8 @@ StoredGridQueryHandler::Result StoredGridQueryHandler::extract_forecast(
     NFmiPoint secondPoint(query.requested_bbox.xMax, query.requested_bbox.yMax);
 
     make_rectangle_path(bbox_path, firstPoint, secondPoint);
-    mask = NFmiIndexMaskTools::MaskExpand(model->grid(), bbox_path, loc->radius);
+    const auto& grid = model->grid();
+    mask = NFmiIndexMaskTools::MaskExpand(grid, bbox_path, loc->radius);
 
     // Result is set here
     Result theResult;
@@ -865,80 +746,33 @@ StoredGridQueryHandler::Result StoredGridQueryHandler::extract_forecast(
 
     // Get result array dimensions, CURRENTLY ONLY WORK ON LATLON DATA
 
-    auto secondIt = tlist.begin();
-    std::advance(secondIt, 1);
-
-    TimeSeriesGenerator::LocalTimeList oneTimeStep(tlist.begin(), secondIt);
+    const GridSlab slab = make_grid_slab(mask, grid.XNumber(), data_step, query.producer_name);
 
-    auto lon = ParameterFactory::instance().parse("longitude");
-
-    auto lat = ParameterFactory::instance().parse("latitude");
+    theResult.xdim = slab.width;
+    theResult.ydim = slab.height;
 
-    // Add these so they will be returned to caller
-    if (query.includeDebugData)
+    // Coordinates of the output cells in output order
+    const std::size_t slab_size = slab.size();
+    theResult.longitudes.reserve(slab_size);
+    theResult.latitudes.reserve(slab_size);
+    for (std::size_t y = 0; y < slab.height; y++)
     {
-      query.data_params.push_back(lon);
-      query.data_params.push_back(lat);
+      for (std::size_t x = 0; x < slab.width; x++)
+      {
+        const NFmiPoint latlon = grid.GridToLatLon(slab.column(x), slab.row(y));
+        theResult.longitudes.push_back(latlon.X());
+        theResult.latitudes.push_back(latlon.Y());
+      }
     }
 
-    SmartMet::Engine::Querydata::ParameterOptions qengine_lonparam(lon,
-                                                                   producer,
-                                                                   *loc,
-                                                                   country,
-                                                                   place,
-                                                                   *query.time_formatter,
-                                                                   "",
-                                                                   query.language,
-                                                                   *query.output_locale,
-                                                                   loc->timezone,
-                                                                   query.find_nearest_valid_point,
-                                                                   nearestpoint,
-                                                                   query.lastpoint);
-
-    auto longitudeData = model->values(qengine_lonparam, mask, oneTimeStep);
-
-    SmartMet::Engine::Querydata::ParameterOptions qengine_latparam(lat,
-                                                                   producer,
-                                                                   *loc,
-                                                                   country,
-                                                                   place,
-                                                                   *query.time_formatter,
-                                                                   "",
-                                                                   query.language,
-                                                                   *query.output_locale,
-                                                                   loc->timezone,
-                                                                   query.find_nearest_valid_point,
-                                                                   nearestpoint,
-                                                                   query.lastpoint);
-
-    auto latitudeData = model->values(qengine_latparam, mask, oneTimeStep);
-
-    auto extents = getDataIndexExtents(longitudeData, latitudeData, query, dataCrs);
-
-    longitudeData = makeSparseGrid(longitudeData, data_step, extents);
-    latitudeData = makeSparseGrid(latitudeData, data_step, extents);
-
-    // MakeSparseGrid may have modified the extents, check them here again
-    auto resulting_extents = getDataIndexExtents(longitudeData, latitudeData, query, dataCrs);
-
-    theResult.xdim = resulting_extents.first;
-    theResult.ydim = resulting_extents.second;
-
-    std::vector<double> locationVecLon;
-    std::vector<double> locationVecLat;
-    BOOST_FOREACH (const auto& item, *longitudeData)
-      locationVecLon.push_back(item.lonlat.lon);
-    BOOST_FOREACH (const auto& item, *latitudeData)
-      locationVecLat.push_back(item.lonlat.lat);
-
-    // Set the corresponding geographical coordinates
-    if (locationVecLon.size() > 1 && locationVecLat.size() > 1)
+    // Set the corresponding geographical coordinates (the last output row is the southernmost one)
+    if (slab_size > 1)
     {
-      theResult.ll_lon = locationVecLon[0];
-      theResult.ur_lon = locationVecLon[locationVecLon.size() - 1];
+      theResult.ll_lon = theResult.longitudes[slab_size - slab.width];
+      theResult.ur_lon = theResult.longitudes[slab.width - 1];
 
-      theResult.ll_lat = locationVecLat[0];
-      theResult.ur_lat = locationVecLat[locationVecLat.size() - 1];
+      theResult.ll_lat = theResult.latitudes[slab_size - slab.width];
+      theResult.ur_lat = theResult.latitudes[slab.width - 1];
     }
     else
     {
@@ -949,11 +783,23 @@ StoredGridQueryHandler::Result StoredGridQueryHandler::extract_forecast(
       throw exception;
     }
 
+    auto lon = ParameterFactory::instance().parse("longitude");
+
+    auto lat = ParameterFactory::instance().parse("latitude");
+
+    // Add these so they will be returned to caller
+    if (query.includeDebugData)
+    {
+      query.data_params.push_back(lon);
+      query.data_params.push_back(lat);
+    }
+
     for (model->resetLevel(); model->nextLevel();)
     {
       if (query.levels.empty() ||
           query.levels.count(static_cast<int>(model->level().LevelValue())) > 0)
       {
+        theResult.levelValues.push_back(model->level().LevelValue());
         theResult.dataLevels.push_back(Result::LevelData());
         auto& thisLevel = theResult.dataLevels.back();
 
@@ -967,64 +813,46 @@ StoredGridQueryHandler::Result StoredGridQueryHandler::extract_forecast(
             theResult.paramInfos.push_back(paramInfo);
           }
 
-          using SmartMet::Spine::Parameter;
-
-          // Build index mask for the bbox area
-
-          SmartMet::Engine::Querydata::ParameterOptions qengine_param(
-              param,
-              producer,
-              *loc,
-              country,
-              place,
-              *query.time_formatter,
-              "",
-              query.language,
-              *query.output_locale,
-              loc->timezone,
-              query.find_nearest_valid_point,
-              nearestpoint,
-              query.lastpoint);
-
-          auto val = model->values(qengine_param, mask, tlist);
-
-          val = makeSparseGrid(val, data_step, extents);
-
           Result::ParamTimeSeries result;
+          result.reserve(tlist.size());
 
-          unsigned int timesteps(val->size() == 0 ? 0 : val->begin()->timeseries.size());
-
-          for (unsigned int i = 0; i < timesteps; i++)
+          if (param.number() == kFmiLongitude or param.number() == kFmiLatitude)
           {
-            Result::Grid thisXYGrid;
-            thisXYGrid.reserve(val->size());
-
-            for (auto locationIt = val->begin(); locationIt != val->end(); ++locationIt)
+            const auto& coords =
+                (param.number() == kFmiLongitude ? theResult.longitudes : theResult.latitudes);
+            for (std::size_t i = 0; i < tlist.size(); i++)
+              result.emplace_back(coords.begin(), coords.end());
+          }
+          else if (not model->param(param.number()))
+          {
+            // Derived and meta parameters are not stored in the data and must be
+            // calculated by the engine for the cells of the slab
+            result = engine_values(model, param, producer, *loc, country, query, slab, tlist);
+          }
+          else
+          {
+            // Read the sub-rectangle of each time step directly from the grid values
+            for (const auto& time : tlist)
             {
-              auto tsValue = locationIt->timeseries[i].value;
-
-              if (boost::get<SmartMet::Spine::TimeSeries::None>(&(tsValue)))
+              const pt::ptime utctime = time.utc_time();
+              auto valueshash = model->hashValue();
+              Fmi::hash_combine(valueshash, Fmi::hash_value(param.number()));
+              Fmi::hash_combine(valueshash, Fmi::hash_value(model->level().LevelValue()));
+              Fmi::hash_combine(valueshash, Fmi::hash_value(utctime));
+              const auto matrix = q_engine->getValues(model, valueshash, utctime);
+
+              Result::Grid thisXYGrid;
+              thisXYGrid.reserve(slab_size);
+              for (std::size_t y = 0; y < slab.height; y++)
               {
-                thisXYGrid.emplace_back(query.missing_text);
-              }
-              else if (!(boost::get<double>(&(tsValue))))
-              {
-                std::stringstream ss;
-                ss << tsValue;
-                thisXYGrid.emplace_back(ss.str());
-              }
-              else
-              {
-                double result = boost::get<double>(tsValue);
-
-                thisXYGrid.emplace_back(
-                    formatToScaledInteger(result, query.scaleFactor, query.precision));
+                const std::size_t j = slab.row(y);
+                for (std::size_t x = 0; x < slab.width; x++)
+                  thisXYGrid.push_back((*matrix)[slab.column(x)][j]);
               }
+              result.emplace_back(std::move(thisXYGrid));
             }
-
-            auto rearranged = rearrangeGrid(thisXYGrid, resulting_extents.first);
-            result.emplace_back(rearranged);
           }
+
           thisLevel.push_back(std::move(result));
         }
       }
@@ -1164,6 +992,12 @@ void StoredGridQueryHandler::query(const StoredQuery& stored_query,
         throw exception;
       }
 
+      if (stored_query.get_use_arrow_format())
+      {
+        write_arrow(query, output);
+        return;
+      }
+
       CTPP::CDT hash;
 
       hash["language"] = language;
@@ -1227,7 +1061,11 @@ void StoredGridQueryHandler::query(const StoredQuery& stored_query,
 
             for (std::size_t ind = 0; ind < timestep.size(); ++ind)
             {
-              thisTime["data"][ind] = timestep[ind];
+              const float value = timestep[ind];
+              thisTime["data"][ind] =
+                  (value == kFloatMissing
+                       ? query.missing_text
+                       : formatToScaledInteger(value, query.scaleFactor, query.precision));
             }
 
             ++timeindex;
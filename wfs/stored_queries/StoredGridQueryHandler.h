@@ -44,11 +44,19 @@ class StoredGridQueryHandler : public StoredQueryHandlerBase,
 {
   struct Result
   {
-    typedef std::vector<std::string> Grid;
+    // Values of the output grid cells in output order (the first row is the northernmost one).
+    // Missing values are kFloatMissing.
+    typedef std::vector<float> Grid;
     typedef std::vector<Grid> ParamTimeSeries;
     typedef std::vector<ParamTimeSeries> LevelData;
     std::list<LevelData> dataLevels;  // The order is data[level][parameter][time][grid]
 
+    // Coordinates of the output grid cells in the same order as the values
+    std::vector<double> longitudes;
+    std::vector<double> latitudes;
+
+    std::vector<double> levelValues;
+
     std::vector<boost::posix_time::ptime> timesteps;
 
     std::vector<std::pair<std::string, FmiParameterName> > paramInfos;
@@ -126,6 +134,8 @@ class StoredGridQueryHandler : public StoredQueryHandlerBase,
 		     const boost::optional<std::string>& hostname,
                      std::ostream& output) const;
 
+  virtual bool supports_output_format(const std::string& format) const;
+
  private:
   void parse_times(const RequestParameterMap& param, Query& dest) const;
 
@@ -145,13 +155,7 @@ class StoredGridQueryHandler : public StoredQueryHandlerBase,
                           Query& query,
                           const std::string& dataCrs) const;
 
-  Result::Grid rearrangeGrid(const Result::Grid& inputGrid, int arrayWidth) const;
-
-  std::pair<unsigned int, unsigned int> getDataIndexExtents(
-      const SmartMet::Spine::TimeSeries::TimeSeriesGroupPtr& longitudes,
-      const SmartMet::Spine::TimeSeries::TimeSeriesGroupPtr& latitudes,
-      const Query& query,
-      const std::string& dataCrs) const;
+  void write_arrow(const Query& query, std::ostream& output) const;
 
  private:
   const int debug_level;
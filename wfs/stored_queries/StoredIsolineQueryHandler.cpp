@@ -140,6 +140,23 @@ void bw::StoredIsolineQueryHandler::setResultHashValue(CTPP::CDT& resultHash,
   }
 }
 
+void bw::StoredIsolineQueryHandler::setResultJsonValue(Json::Value& properties,
+                                                       const ContourQueryResult& resultItem) const
+{
+  try
+  {
+    const IsolineQueryResult& isolineResultItem =
+        reinterpret_cast<const IsolineQueryResult&>(resultItem);
+
+    StoredContourQueryHandler::setResultJsonValue(properties, resultItem);
+    properties["isovalue"] = isolineResultItem.isovalue;
+  }
+  catch (...)
+  {
+    throw Fmi::Exception::Trace(BCP, "Operation failed!");
+  }
+}
+
 namespace
 {
 using namespace SmartMet::Plugin::WFS;
@@ -29,6 +29,7 @@ class StoredIsolineQueryHandler : public StoredContourQueryHandler
       const SmartMet::Engine::Querydata::Q& q,
       OGRSpatialReference& sr) const;
   void setResultHashValue(CTPP::CDT& resultHash, const ContourQueryResult& resultItem) const;
+  void setResultJsonValue(Json::Value& properties, const ContourQueryResult& resultItem) const;
 
  private:
   std::string itsName;
@@ -8,6 +8,7 @@
 #include <smartmet/engines/observation/MastQuery.h>
 #include <smartmet/spine/Convenience.h>
 #include <smartmet/macgyver/Exception.h>
+#include <future>
 #include <tuple>
 
 namespace bw = SmartMet::Plugin::WFS;
@@ -140,38 +141,43 @@ void bw::StoredMastQueryHandler::query(const StoredQuery& query,
         stationSettings.bounding_box_settings["maxy"] = query_bbox->yMax;
       }
 
-      stationSearchSettings.taggedFMISIDs =
-          obs_engine->translateToFMISID(stationSearchSettings.starttime,
-                                        stationSearchSettings.endtime,
-                                        stationSearchSettings.stationtype,
-                                        stationSettings);
-
-      // Search stations based on location settings.
-      // The result does not contain duplicates.
-      SmartMet::Spine::Stations stationCandidates;
-      obs_engine->getStations(stationCandidates, stationSearchSettings);
-
       std::string langCode = language;
       SupportsLocationParameters::engOrFinToEnOrFi(langCode);
 
-      // Get information from GeoEngien. Elevation is required.
-      SmartMet::Spine::Stations stations;
-      for (SmartMet::Spine::Stations::const_iterator it = stationCandidates.begin();
-           it != stationCandidates.end();
-           ++it)
-      {
-        stations.push_back(*it);
-
-        SmartMet::Spine::LocationPtr geoLoc = geo_engine->idSearch(it->geoid, langCode);
-        if (geoLoc)
-        {
-          stations.back().country = geoLoc->country;
-          stations.back().station_elevation = geoLoc->elevation;
-        }
-      }
+      // Station search does not depend on the parameters: search the stations in the
+      // background while the parameters are being validated.
+      auto stationSearch = std::async(
+          std::launch::async,
+          [this, &stationSearchSettings, &stationSettings, &langCode]()
+          {
+            stationSearchSettings.taggedFMISIDs =
+                obs_engine->translateToFMISID(stationSearchSettings.starttime,
+                                              stationSearchSettings.endtime,
+                                              stationSearchSettings.stationtype,
+                                              stationSettings);
+
+            // Search stations based on location settings.
+            // The result does not contain duplicates.
+            SmartMet::Spine::Stations stationCandidates;
+            obs_engine->getStations(stationCandidates, stationSearchSettings);
+
+            // Get information from GeoEngien. Elevation is required.
+            SmartMet::Spine::Stations result;
+            for (SmartMet::Spine::Stations::const_iterator it = stationCandidates.begin();
+                 it != stationCandidates.end();
+                 ++it)
+            {
+              result.push_back(*it);
 
-      if (stations.empty())
-        queryInitializationOK = false;
+              SmartMet::Spine::LocationPtr geoLoc = cached_id_search(it->geoid, langCode);
+              if (geoLoc)
+              {
+                result.back().country = geoLoc->country;
+                result.back().station_elevation = geoLoc->elevation;
+              }
+            }
+            return result;
+          });
 
       // Producers
       std::vector<uint64_t> producerIdVector;
@@ -285,6 +291,10 @@ void bw::StoredMastQueryHandler::query(const StoredQuery& query,
         }
       }
 
+      const SmartMet::Spine::Stations stations = stationSearch.get();
+      if (stations.empty())
+        queryInitializationOK = false;
+
       // Time range restriction to get data.
       pt::ptime startTime = params.get_single<pt::ptime>(P_BEGIN_TIME);
       pt::ptime endTime = params.get_single<pt::ptime>(P_END_TIME);
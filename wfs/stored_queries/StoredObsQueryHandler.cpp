@@ -1,6 +1,11 @@
 #include "stored_queries/StoredObsQueryHandler.h"
+#include "ArrowStreamWriter.h"
+#include "CsvWriter.h"
 #include "FeatureID.h"
+#include "FormattedValueColumn.h"
+#include "GeoJsonUtils.h"
 #include "StoredQueryHandlerFactoryDef.h"
+#include "TimeSlicedQuery.h"
 #include "WfsConst.h"
 #include "WfsConvenience.h"
 #include <boost/algorithm/string.hpp>
@@ -14,6 +19,8 @@
 #include <smartmet/spine/TimeSeriesOutput.h>
 #include <smartmet/spine/Value.h>
 #include <algorithm>
+#include <cmath>
+#include <cstdlib>
 #include <functional>
 
 #define P_BEGIN_TIME "beginTime"
@@ -98,6 +105,8 @@ StoredObsQueryHandler::StoredObsQueryHandler(SmartMet::Spine::Reactor* reactor,
     separate_groups = config->get_optional_config_param<bool>("separateGroups", false);
     sq_restrictions = plugin_data.get_config().getSQRestrictions();
     m_support_qc_parameters = config->get_optional_config_param<bool>("supportQCParameters", false);
+    time_slice_hours = config->get_optional_config_param<double>("timeSliceHours", 0.0);
+    max_threads = config->get_optional_config_param<unsigned>("maxThreads", 4);
   }
   catch (...)
   {
@@ -200,7 +209,8 @@ void StoredObsQueryHandler::query(const StoredQuery& query,
       }
 
       const std::string crs = params.get_single<std::string>(P_CRS);
-      auto transformation = crs_registry.create_transformation(DATA_CRS_NAME, crs);
+      CoordinateTransformationCache transformation(
+          crs_registry.create_transformation(DATA_CRS_NAME, crs));
       bool show_height = false;
       std::string proj_uri = "UNKNOWN";
       std::string proj_epoch_uri = "UNKNOWN";
@@ -340,13 +350,74 @@ void StoredObsQueryHandler::query(const StoredQuery& query,
       query_params.taggedFMISIDs = obs_engine->translateToFMISID(
           query_params.starttime, query_params.endtime, query_params.stationtype, stationSettings);
 
-      SmartMet::Spine::TimeSeries::TimeSeriesVectorPtr obsengine_result(
-          obs_engine->values(query_params));
+      // Long intervals are optionally queried in parallel slices. Slices are whole
+      // multiples of the time step so that the generated time steps do not change.
+      // Queries of the latest observations are never sliced.
+      const long slice_minutes =
+          (query_params.latest ? 0 : std::lround(time_slice_hours * 60.0 / ts1) * ts1);
+      SmartMet::Spine::TimeSeries::TimeSeriesVectorPtr obsengine_result = time_sliced_query(
+          query_params.starttime,
+          query_params.endtime,
+          pt::minutes(slice_minutes),
+          max_threads,
+          [this, &query_params](const pt::ptime& slice_begin, const pt::ptime& slice_end)
+          {
+            auto slice_params = query_params;
+            slice_params.starttime = slice_begin;
+            slice_params.endtime = slice_end;
+            return obs_engine->values(slice_params);
+          });
 
       const bool emptyResult = (!obsengine_result || obsengine_result->size() == 0);
 
       CTPP::CDT hash;
 
+      const bool geojson = query.get_use_geojson_format();
+      Json::Value feature_collection;
+      if (geojson)
+        feature_collection = GeoJson::create_feature_collection(get_plugin_impl().get_time_stamp());
+
+      // Arrow IPC output: fixed station and time columns followed by parameter columns
+      std::unique_ptr<ArrowStreamWriter> arrow;
+      std::vector<std::size_t> arrow_columns(param_index.size());
+      std::vector<std::size_t> arrow_qc_columns(param_index.size());
+      if (query.get_use_arrow_format())
+      {
+        arrow.reset(new ArrowStreamWriter);
+        arrow->add_column("fmisid", ArrowStreamWriter::INT64);
+        arrow->add_column("name", ArrowStreamWriter::STRING);
+        arrow->add_column("latitude", ArrowStreamWriter::DOUBLE);
+        arrow->add_column("longitude", ArrowStreamWriter::DOUBLE);
+        arrow->add_column("time", ArrowStreamWriter::TIMESTAMP);
+        for (std::size_t k = 0; k < param_index.size(); k++)
+        {
+          const auto& entry = param_index[k];
+          const std::string& name = (entry.p.sensor_name ? *entry.p.sensor_name : entry.p.name);
+          arrow_columns[k] = arrow->add_column(
+              name, entry.p.ind >= 0 ? ArrowStreamWriter::DOUBLE : ArrowStreamWriter::STRING);
+          // QC values exist only for parameters from the observation engine (see rows below)
+          if (entry.qc and entry.p.ind >= 0)
+            arrow_qc_columns[k] = arrow->add_column("qc_" + name, ArrowStreamWriter::DOUBLE);
+        }
+      }
+
+      // CSV output: rows are written directly to the output without CTPP hash
+      std::unique_ptr<CsvWriter> csv;
+      if (query.get_use_csv_format())
+      {
+        std::vector<std::string> header = {"fmisid", "name", "latitude", "longitude", "time"};
+        for (const auto& entry : param_index)
+        {
+          const std::string& name = (entry.p.sensor_name ? *entry.p.sensor_name : entry.p.name);
+          header.push_back(name);
+          // QC values exist only for parameters from the observation engine (see rows below)
+          if (entry.qc and entry.p.ind >= 0)
+            header.push_back("qc_" + name);
+        }
+        csv.reset(new CsvWriter(output));
+        csv->write_header(header);
+      }
+
       // Create index of all result rows (by observation site)
       std::map<std::string, SiteRec> site_map;
       std::map<int, GroupRec> group_map;
@@ -460,6 +531,51 @@ void StoredObsQueryHandler::query(const StoredQuery& query,
 
         std::map<std::string, SmartMet::Spine::LocationPtr> sites;
 
+        // Value of a location or time parameter which is not provided by the observation
+        // engine. Empty if the location of the site is not known.
+        const auto get_special_value = [&](const std::string& name,
+                                           const lt::local_date_time& ldt,
+                                           const std::string& geoid)
+            -> boost::optional<std::string> {
+          auto geoLoc = sites.at(geoid);
+          if (not geoLoc)
+            return boost::none;
+
+          if (SmartMet::Spine::is_location_parameter(name))
+          {
+            return SmartMet::Spine::location_parameter(
+                geoLoc, name, fmt, tz_name, get_meteo_parameter_options(name)->precision);
+          }
+          else if (SmartMet::Spine::is_time_parameter(name))
+          {
+            const std::string timestring = "Not supported";
+            if (not curr_locale)
+            {
+              curr_locale.reset(new std::locale(query_params.localename.c_str()));
+            }
+            const auto val = SmartMet::Spine::time_parameter(name,
+                                                             ldt,
+                                                             now,
+                                                             *geoLoc,
+                                                             tz_name,
+                                                             geo_engine->getTimeZones(),
+                                                             *curr_locale,
+                                                             *tfmt,
+                                                             timestring);
+            std::ostringstream val_str;
+            val_str << val;
+            return val_str.str();
+          }
+          else
+          {
+            assert(0 /* Not supposed to be here */);
+            return boost::none;
+          }
+        };
+
+        std::string langCode = language;
+        SupportsLocationParameters::engOrFinToEnOrFi(langCode);
+
         BOOST_FOREACH (const auto& it1, site_map)
         {
           const std::string& fmisid = it1.first;
@@ -484,7 +600,8 @@ void StoredObsQueryHandler::query(const StoredQuery& query,
           const std::string wmo = boost::apply_visitor(sv, ts_wmo[row_1].value);
 
           if (not lat.empty() and not lon.empty())
-            set_2D_coord(transformation, lat, lon, group["obsStationList"][ind]);
+            set_2D_coord(
+                transformation, std::stod(lat), std::stod(lon), group["obsStationList"][ind]);
           else
             throw Fmi::Exception(BCP, "wfs: Internal LatLon query error.");
 
@@ -496,9 +613,7 @@ void StoredObsQueryHandler::query(const StoredQuery& query,
             try
             {
               const long geoid_long = Fmi::stol(geoid);
-              std::string langCode = language;
-              SupportsLocationParameters::engOrFinToEnOrFi(langCode);
-              geoLoc = geo_engine->idSearch(geoid_long, langCode);
+              geoLoc = cached_id_search(geoid_long, langCode);
               region = (geoLoc ? geoLoc->area : "");
             }
             catch (...)
@@ -530,6 +645,8 @@ void StoredObsQueryHandler::query(const StoredQuery& query,
               : group["obsStationList"][ind]["geoid"] = geoid;
         }
 
+        LocalTimeFormatter local_time_formatter;
+
         for (int group_id = 0; group_id < num_groups; group_id++)
         {
           int ind = 0;
@@ -577,35 +694,147 @@ void StoredObsQueryHandler::query(const StoredQuery& query,
 
             if (it1.second.group_id == group_id)
             {
-              bool first = true;
+              const std::vector<std::size_t>& site_rows = it1.second.row_index_vect;
               lt::time_zone_ptr tzp;
 
               const SmartMet::Spine::TimeSeries::TimeSeries& ts_epoch =
                   obsengine_result->at(initial_bs_param.size());
-              BOOST_FOREACH (int row_num, it1.second.row_index_vect)
+
+              // Use first row instead of row_num for static parameter values
+              // SHOULD FIX Delfoi instead!
+              sv.setPrecision(5);
+              const std::string latitude = boost::apply_visitor(sv, ts_lat[row_1].value);
+              const std::string longitude = boost::apply_visitor(sv, ts_lon[row_1].value);
+              const std::string geoid = boost::apply_visitor(sv, ts_geoid[row_1].value);
+
+              const double lat = std::stod(latitude);
+              const double lon = std::stod(longitude);
+
+              tzp = get_tz_for_site(lon, lat, tz_name);
+
+              // Station coordinates are the same on every row of the site
+              const CoordinateTransformationCache::Coord2D station_xy =
+                  transformation.get_2D_coord(lat, lon);
+
+              if (arrow)
               {
-                static const long ref_jd = boost::gregorian::date(1970, 1, 1).julian_day();
+                // Values are stored as such: no formatting to strings is needed
+                // The station id may be missing (for example "NaN"): it is written as null
+                boost::optional<std::int64_t> fmisid;
+                char* id_end = nullptr;
+                const long long id = std::strtoll(it1.first.c_str(), &id_end, 10);
+                if (id_end != it1.first.c_str() and *id_end == '\0')
+                  fmisid = id;
+                const std::string station_name = boost::apply_visitor(sv, ts_name[row_1].value);
+                for (const std::size_t row_num : site_rows)
+                {
+                  const auto ldt = ts_epoch.at(row_num).time;
+                  if (fmisid)
+                    arrow->append(0, *fmisid);
+                  else
+                    arrow->append_null(0);
+                  arrow->append(1, station_name);
+                  arrow->append(2, lat);
+                  arrow->append(3, lon);
+                  arrow->append(4, ldt.utc_time());
+                  for (std::size_t k = 0; k < param_index.size(); k++)
+                  {
+                    const auto& entry = param_index[k];
+                    if (entry.p.ind >= 0)
+                    {
+                      arrow->append(arrow_columns[k], obsengine_result->at(entry.p.ind)[row_num].value);
+                      if (entry.qc)
+                        arrow->append(arrow_qc_columns[k],
+                                      obsengine_result->at(entry.qc->ind)[row_num].value);
+                    }
+                    else
+                    {
+                      const auto value = get_special_value(entry.p.name, ldt, geoid);
+                      if (value)
+                        arrow->append(arrow_columns[k], *value);
+                      else
+                        arrow->append_null(arrow_columns[k]);
+                    }
+                  }
+                }
+                continue;
+              }
 
-                sv.setPrecision(5);
-                // Use first row instead of row_num for static parameter values
-                // SHOULD FIX Delfoi instead!
-                const std::string latitude = boost::apply_visitor(sv, ts_lat[row_1].value);
-                const std::string longitude = boost::apply_visitor(sv, ts_lon[row_1].value);
-                const std::string geoid = boost::apply_visitor(sv, ts_geoid[row_1].value);
+              // Format the data columns of the site at once (precision is looked up
+              // only once per parameter)
+              std::vector<std::unique_ptr<FormattedValueColumn> > data_columns(param_index.size());
+              std::vector<std::unique_ptr<FormattedValueColumn> > qc_columns(param_index.size());
+              for (std::size_t k = 0; k < param_index.size(); k++)
+              {
+                const auto& entry = param_index[k];
+                if (entry.p.ind >= 0)
+                {
+                  const uint precision = get_meteo_parameter_options(entry.p.name)->precision;
+                  data_columns[k].reset(new FormattedValueColumn(fmt, precision));
+                  data_columns[k]->append(obsengine_result->at(entry.p.ind), site_rows);
+                  if (entry.qc)
+                  {
+                    qc_columns[k].reset(new FormattedValueColumn(fmt, 0));
+                    qc_columns[k]->append(obsengine_result->at(entry.qc->ind), site_rows);
+                  }
+                }
+              }
+
+              std::unique_ptr<FormattedValueColumn> height_column;
+              if (show_height)
+              {
+                height_column.reset(new FormattedValueColumn(fmt, 1));
+                height_column->append(ts_height, site_rows);
+              }
 
-                if (first)
+              if (csv)
+              {
+                const std::string station_name = boost::apply_visitor(sv, ts_name[row_1].value);
+                for (std::size_t site_row = 0; site_row < site_rows.size(); site_row++)
                 {
-                  tzp = get_tz_for_site(std::stod(longitude), std::stod(latitude), tz_name);
+                  const std::size_t row_num = site_rows[site_row];
+                  const auto ldt = ts_epoch.at(row_num).time;
+                  csv->add_field(it1.first);
+                  csv->add_field(station_name);
+                  csv->add_field(latitude);
+                  csv->add_field(longitude);
+                  csv->add_field(local_time_formatter.format(ldt.utc_time(), tzp));
+                  for (std::size_t k = 0; k < param_index.size(); k++)
+                  {
+                    if (data_columns[k])
+                    {
+                      csv->add_field(*data_columns[k], site_row);
+                      if (qc_columns[k])
+                        csv->add_field(*qc_columns[k], site_row);
+                    }
+                    else
+                    {
+                      const auto value = get_special_value(param_index[k].p.name, ldt, geoid);
+                      if (value)
+                        csv->add_field(*value);
+                      else
+                        csv->add_empty_field();
+                    }
+                  }
+                  csv->end_row();
                 }
+                continue;
+              }
+
+              for (std::size_t site_row = 0; site_row < site_rows.size(); site_row++)
+              {
+                const std::size_t row_num = site_rows[site_row];
+                static const long ref_jd = boost::gregorian::date(1970, 1, 1).julian_day();
 
                 CTPP::CDT obs_rec;
-                set_2D_coord(transformation, latitude, longitude, obs_rec);
+                obs_rec["x"] = station_xy.first;
+                obs_rec["y"] = station_xy.second;
 
                 if (show_height)
                 {
-                  sv.setPrecision(1);
-                  const std::string height = boost::apply_visitor(sv, ts_height[row_num].value);
-                  obs_rec["height"] = (height.empty() ? query_params.missingtext : height);
+                  obs_rec["height"] = height_column->is_missing(site_row)
+                                          ? query_params.missingtext
+                                          : height_column->get(site_row);
                 }
 
                 const auto ldt = ts_epoch.at(row_num).time;
@@ -616,86 +845,79 @@ void StoredObsQueryHandler::query(const StoredQuery& query,
                 long seconds = epoch.time_of_day().total_seconds();
                 INT_64 s_epoch = 86400LL * (jd - ref_jd) + seconds;
                 obs_rec["epochTime"] = s_epoch;
-                obs_rec["epochTimeStr"] = format_local_time(epoch, tzp);
+                obs_rec["epochTimeStr"] = local_time_formatter.format(epoch, tzp);
+
+                Json::Value* properties = nullptr;
+                if (geojson)
+                {
+                  const std::string id = str(format("%1%.%2%.%3%") % group_id_str % it1.first % s_epoch);
+                  properties = &GeoJson::add_point_feature(
+                      feature_collection, id, lon, lat);
+                  (*properties)["fmisid"] = it1.first;
+                  (*properties)["name"] = boost::apply_visitor(sv, ts_name[row_1].value);
+                  (*properties)["time"] = Fmi::to_iso_extended_string(epoch) + "Z";
+                }
 
                 for (std::size_t k = 0; k < param_index.size(); k++)
                 {
                   const auto& entry = param_index[k];
                   const std::string& name = entry.p.name;
-                  const int ind = entry.p.ind;
-                  if (ind >= 0)
+                  if (data_columns[k])
                   {
-                    const SmartMet::Spine::TimeSeries::TimeSeries& ts_k = obsengine_result->at(ind);
-                    const uint precision = get_meteo_parameter_options(name)->precision;
-                    sv.setPrecision(precision);
-                    const std::string value = boost::apply_visitor(sv, ts_k[row_num].value);
-                    obs_rec["data"][k]["value"] = value;
-                    if (entry.qc)
+                    obs_rec["data"][k]["value"] = data_columns[k]->get(site_row);
+                    if (qc_columns[k])
+                      obs_rec["data"][k]["qcValue"] = qc_columns[k]->get(site_row);
+                    if (properties)
                     {
-                      const int qc_ind = entry.qc->ind;
-                      std::stringstream qc_value;
-                      const SmartMet::Spine::TimeSeries::TimeSeries& ts_qc_k =
-                          obsengine_result->at(qc_ind);
-                      sv.setPrecision(0);
-                      const std::string value_qc = boost::apply_visitor(sv, ts_qc_k[row_num].value);
-                      obs_rec["data"][k]["qcValue"] = value_qc;
+                      const std::string& key =
+                          (entry.p.sensor_name ? *entry.p.sensor_name : entry.p.name);
+                      (*properties)[key] =
+                          data_columns[k]->is_missing(site_row)
+                              ? Json::Value(Json::nullValue)
+                              : GeoJson::to_json(data_columns[k]->get(site_row),
+                                                 query_params.missingtext);
+                      if (qc_columns[k])
+                        (*properties)["qc_" + key] =
+                            GeoJson::to_json(qc_columns[k]->get(site_row), query_params.missingtext);
                     }
                   }
                   else
                   {
-                    auto geoLoc = sites.at(geoid);
-                    if (geoLoc)
+                    const auto value = get_special_value(name, ldt, geoid);
+                    obs_rec["data"][k]["value"] = value ? *value : query_params.missingtext;
+                    if (properties)
                     {
-                      if (SmartMet::Spine::is_location_parameter(name))
-                      {
-                        const std::string val = SmartMet::Spine::location_parameter(
-                            geoLoc,
-                            name,
-                            fmt,
-                            tz_name,
-                            get_meteo_parameter_options(name)->precision);
-                        obs_rec["data"][k]["value"] = val;
-                      }
-                      else if (SmartMet::Spine::is_time_parameter(name))
-                      {
-                        const std::string timestring = "Not supported";
-                        if (not curr_locale)
-                        {
-                          curr_locale.reset(new std::locale(query_params.localename.c_str()));
-                        }
-                        const auto val = SmartMet::Spine::time_parameter(name,
-                                                                         ldt,
-                                                                         now,
-                                                                         *geoLoc,
-                                                                         tz_name,
-                                                                         geo_engine->getTimeZones(),
-                                                                         *curr_locale,
-                                                                         *tfmt,
-                                                                         timestring);
-                        std::ostringstream val_str;
-                        val_str << val;
-                        obs_rec["data"][k]["value"] = val_str.str();
-                      }
-                      else
-                      {
-                        assert(0 /* Not supposed to be here */);
-                      }
-                    }
-                    else
-                    {
-                      obs_rec["data"][k]["value"] = query_params.missingtext;
+                      (*properties)[name] = value ? GeoJson::to_json(*value, query_params.missingtext)
+                                                  : Json::Value(Json::nullValue);
                     }
                   }
                 }
 
-                group["obsReturnArray"][ind++] = obs_rec;
+                if (not geojson)
+                  group["obsReturnArray"][ind++] = obs_rec;
               }
             }
           }
         }
       }
 
-      format_output(hash, output, query.get_use_debug_format());
+      if (geojson)
+      {
+        GeoJson::update_counts(feature_collection);
+        GeoJson::write(feature_collection, output);
+      }
+      else if (arrow)
+      {
+        arrow->write(output);
+      }
+      else if (csv)
+      {
+        // Rows have already been written
+      }
+      else
+      {
+        format_output(hash, output, query.get_use_debug_format());
+      }
     }
     catch (...)
     {
@@ -712,6 +934,14 @@ void StoredObsQueryHandler::query(const StoredQuery& query,
   }
 }
 
+bool StoredObsQueryHandler::supports_output_format(const std::string& format) const
+{
+  return format == StandardPresentationParameters::GEOJSON_OUTPUT_FORMAT or
+         format == StandardPresentationParameters::ARROW_OUTPUT_FORMAT or
+         format == StandardPresentationParameters::CSV_OUTPUT_FORMAT or
+         StoredQueryHandlerBase::supports_output_format(format);
+}
+
 void StoredObsQueryHandler::check_parameter_names(const RequestParameterMap& params,
                                                   const std::vector<std::string>& param_names) const
 {
@@ -1130,6 +1360,24 @@ one.
    query.</td>
    </tr>
 
+   <tr>
+   <td>timeSliceHours</td>
+   <td>double</td>
+   <td>optional (default 0)</td>
+   <td>Length of time slices in hours. Time intervals longer than this are queried from
+   the observation engine in slices of this length in parallel and the results are merged.
+   The response is the same as without slicing. The value is rounded to whole time steps.
+   Queries of the latest observations are not sliced. The default value 0 disables slicing.</td>
+   </tr>
+
+   <tr>
+   <td>maxThreads</td>
+   <td>unsigned integer</td>
+   <td>optional (default 4)</td>
+   <td>Maximal number of time slices of one request queried in parallel.
+   Value 1 queries the slices sequentially.</td>
+   </tr>
+
    </table>
 
 */
@@ -41,6 +41,8 @@ class StoredObsQueryHandler : public StoredQueryHandlerBase,
 		     const boost::optional<std::string> &hostname,
                      std::ostream& output) const;
 
+  virtual bool supports_output_format(const std::string& format) const;
+
  private:
 
   struct ParamIndexEntry
@@ -93,7 +95,7 @@ class StoredObsQueryHandler : public StoredQueryHandlerBase,
   {
     int group_id;
     int ind_in_group;
-    std::vector<int> row_index_vect;
+    std::vector<std::size_t> row_index_vect;
   };
 
  private:
@@ -137,6 +139,13 @@ class StoredObsQueryHandler : public StoredQueryHandlerBase,
    * @brief Support parameters with "qc_" prefix
    */
   bool m_support_qc_parameters;
+
+  /**
+   * @brief Length of time slices queried in parallel (0 = no slicing)
+   */
+  double time_slice_hours;
+
+  std::size_t max_threads;
 };
 
 }  // namespace WFS
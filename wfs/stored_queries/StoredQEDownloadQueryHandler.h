@@ -7,6 +7,11 @@
 #include <boost/geometry/geometry.hpp>
 #include <boost/shared_ptr.hpp>
 #include <ogr_geometry.h>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+class NFmiArea;
 
 namespace SmartMet
 {
@@ -54,28 +59,63 @@ class StoredQEDownloadQueryHandler : public StoredAtomQueryHandlerBase,
       std::vector<boost::shared_ptr<RequestParameterMap> >& result) const;
 
  private:
-  boost::shared_ptr<OGRPolygon> get_model_boundary(
-      const SmartMet::Engine::Querydata::MetaData& meta_info,
-      const std::string& crs_name,
-      int num_side_points = 10) const;
+  /**
+   *   @brief Precomputed information about one model run
+   */
+  struct ModelRecord
+  {
+    SmartMet::Engine::Querydata::MetaData meta;
+
+    /**
+     *   @brief Copy of the area of the querydata (null if the data is not gridded)
+     */
+    std::shared_ptr<const NFmiArea> area;
+
+    /**
+     *   @brief Model boundary in EPSG:4326
+     */
+    boost::shared_ptr<const OGRPolygon> boundary;
+  };
+
+  typedef std::shared_ptr<const ModelRecord> ModelRecordPtr;
+
+  /**
+   *   @brief Model runs of the supported producers in the order returned by the engine
+   */
+  struct MetadataSnapshot
+  {
+    boost::posix_time::ptime update_time;
+    std::vector<ModelRecordPtr> records;
+  };
 
-  boost::shared_ptr<OGRGeometry> bbox_intersection(
-      const SmartMet::Spine::BoundingBox& bbox,
-      const SmartMet::Engine::Querydata::MetaData& meta_info) const;
+  std::shared_ptr<const MetadataSnapshot> get_metadata_snapshot() const;
+
+  ModelRecordPtr create_model_record(const SmartMet::Engine::Querydata::MetaData& meta_info) const;
+
+  boost::shared_ptr<OGRPolygon> get_model_boundary(const NFmiArea& area,
+                                                   const std::string& crs_name,
+                                                   int num_side_points = 10) const;
+
+  boost::shared_ptr<OGRGeometry> bbox_intersection(const SmartMet::Spine::BoundingBox& bbox,
+                                                   const NFmiArea& area) const;
 
   void add_bbox_info(RequestParameterMap* param_map,
                      const std::string& name,
-                     OGRGeometry& geom) const;
+                     const OGRGeometry& geom) const;
 
   void add_boundary(RequestParameterMap* param_map,
                     const std::string& name,
-                    OGRGeometry& polygon) const;
+                    const OGRGeometry& polygon) const;
 
  private:
   std::set<std::string> producers;
   std::set<std::string> formats;
   std::string default_format;
   const int debug_level;
+  int metadata_update_interval;
+
+  mutable std::mutex snapshot_mutex;
+  mutable std::shared_ptr<const MetadataSnapshot> metadata_snapshot;
 };
 
 }  // namespace WFS
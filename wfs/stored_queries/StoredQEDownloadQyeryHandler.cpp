@@ -5,12 +5,13 @@
 #include "stored_queries/StoredQEDownloadQueryHandler.h"
 #include <boost/algorithm/string.hpp>
 #include <boost/bind.hpp>
-#include <boost/date_time/posix_time/ptime.hpp>
+#include <boost/date_time/posix_time/posix_time.hpp>
 #include <boost/format.hpp>
 #include <boost/lambda/lambda.hpp>
 #include <boost/shared_array.hpp>
 #include <macgyver/StringConversion.h>
 #include <macgyver/TypeName.h>
+#include <newbase/NFmiArea.h>
 #include <newbase/NFmiQueryData.h>
 #include <smartmet/engines/geonames/Engine.h>
 #include <smartmet/engines/gis/GdalUtils.h>
@@ -21,6 +22,8 @@
 #include <algorithm>
 #include <cpl_error.h>
 #include <list>
+#include <map>
+#include <memory>
 #include <string>
 
 namespace bw = SmartMet::Plugin::WFS;
@@ -100,7 +103,8 @@ StoredQEDownloadQueryHandler::StoredQEDownloadQueryHandler(
       SupportsBoundingBox(config, plugin_data.get_crs_registry(), false),
       producers(),
       default_format("grib2"),
-      debug_level(get_config()->get_debug_level())
+      debug_level(get_config()->get_debug_level()),
+      metadata_update_interval(10)
 {
   try
   {
@@ -115,6 +119,9 @@ StoredQEDownloadQueryHandler::StoredQEDownloadQueryHandler(
     register_array_param<std::string>(P_FORMAT, 0, 1);
     register_array_param<std::string>(P_PROJECTION, 0, 1);
 
+    metadata_update_interval =
+        config->get_optional_config_param<int>("metadataUpdateInterval", 10);
+
     std::vector<std::string> tmp1;
     if (config->get_config_array<std::string>("producers", tmp1))
     {
@@ -353,22 +360,14 @@ void StoredQEDownloadQueryHandler::update_parameters(
 
     bw::FeatureID feature_id(get_config()->get_query_id(), params.get_map(), seq_id);
 
-    const auto md_list = q_engine->getEngineMetadata(opt);
-    for (auto md_iter = md_list.begin(); md_iter != md_list.end(); ++md_iter)
+    const auto snapshot = get_metadata_snapshot();
+    for (const auto& record : snapshot->records)
     {
-      const auto& meta_info = *md_iter;
+      const auto& meta_info = record->meta;
 
-      if (not producers.empty() and producers.count(meta_info.producer) == 0)
+      if ((opt.hasProducer() and meta_info.producer != opt.getProducer()) or
+          (opt.hasOriginTime() and meta_info.originTime != opt.getOriginTime()))
       {
-        if (debug_level > 1)
-        {
-          std::ostringstream msg;
-          msg << SmartMet::Spine::log_time_str() << ": [WFS] [DEBUG] ["
-              << get_config()->get_query_id() << "] Skipping producer '" << meta_info.producer
-              << '\n';
-          std::cout << msg.str() << std::flush;
-        }
-        // Producer set specified and found producer does not belong to it
         continue;
       }
 
@@ -435,7 +434,7 @@ void StoredQEDownloadQueryHandler::update_parameters(
         std::cout << msg.str() << std::flush;
       }
 
-      auto model_boundary = get_model_boundary(meta_info, DATA_CRS_NAME, 20);
+      const auto& model_boundary = record->boundary;
       if (model_boundary)
       {
         add_bbox_info(pm.get(), "modelBBox", *model_boundary);
@@ -443,7 +442,9 @@ void StoredQEDownloadQueryHandler::update_parameters(
 
       if (have_bbox)
       {
-        auto geom = bbox_intersection(requested_bbox, meta_info);
+        boost::shared_ptr<OGRGeometry> geom;
+        if (record->area)
+          geom = bbox_intersection(requested_bbox, *record->area);
         if (not geom)
         {
           if (debug_level > 1)
@@ -635,20 +636,106 @@ void StoredQEDownloadQueryHandler::update_parameters(
   }
 }
 
-boost::shared_ptr<OGRPolygon> StoredQEDownloadQueryHandler::get_model_boundary(
-    const SmartMet::Engine::Querydata::MetaData& meta_info,
-    const std::string& crs_name,
-    int num_side_points) const
+std::shared_ptr<const StoredQEDownloadQueryHandler::MetadataSnapshot>
+StoredQEDownloadQueryHandler::get_metadata_snapshot() const
 {
   try
   {
-    // TODO TODO: THIS PLACE HAD STRANGE CODE, SIMPLIFIED IT A LOT
+    const pt::ptime now = pt::microsec_clock::universal_time();
+
+    std::lock_guard<std::mutex> lock(snapshot_mutex);
+    if (metadata_snapshot and
+        now < metadata_snapshot->update_time + pt::seconds(metadata_update_interval))
+    {
+      return metadata_snapshot;
+    }
+
+    // Records of model runs whose metadata has not changed are reused, so that the
+    // querydata and model boundaries are accessed only for new or updated runs.
+    std::map<std::pair<std::string, pt::ptime>, ModelRecordPtr> old_records;
+    if (metadata_snapshot)
+    {
+      for (const auto& record : metadata_snapshot->records)
+        old_records[std::make_pair(record->meta.producer, record->meta.originTime)] = record;
+    }
+
+    auto snapshot = std::make_shared<MetadataSnapshot>();
+    snapshot->update_time = now;
+
+    qe::MetaQueryOptions opt;
+    const auto md_list = q_engine->getEngineMetadata(opt);
+    for (const auto& meta_info : md_list)
+    {
+      if (not producers.empty() and producers.count(meta_info.producer) == 0)
+      {
+        if (debug_level > 1)
+        {
+          std::ostringstream msg;
+          msg << SmartMet::Spine::log_time_str() << ": [WFS] [DEBUG] ["
+              << get_config()->get_query_id() << "] Skipping producer '" << meta_info.producer
+              << '\n';
+          std::cout << msg.str() << std::flush;
+        }
+        // Producer set specified and found producer does not belong to it
+        continue;
+      }
+
+      auto pos = old_records.find(std::make_pair(meta_info.producer, meta_info.originTime));
+      if (pos != old_records.end() and pos->second->meta.firstTime == meta_info.firstTime and
+          pos->second->meta.lastTime == meta_info.lastTime and
+          pos->second->meta.nTimeSteps == meta_info.nTimeSteps and
+          pos->second->meta.parameters.size() == meta_info.parameters.size() and
+          pos->second->meta.levels.size() == meta_info.levels.size() and
+          pos->second->meta.WKT == meta_info.WKT)
+      {
+        snapshot->records.push_back(pos->second);
+      }
+      else
+      {
+        snapshot->records.push_back(create_model_record(meta_info));
+      }
+    }
+
+    metadata_snapshot = snapshot;
+    return metadata_snapshot;
+  }
+  catch (...)
+  {
+    throw Fmi::Exception::Trace(BCP, "Operation failed!");
+  }
+}
+
+StoredQEDownloadQueryHandler::ModelRecordPtr StoredQEDownloadQueryHandler::create_model_record(
+    const SmartMet::Engine::Querydata::MetaData& meta_info) const
+{
+  try
+  {
+    auto record = std::make_shared<ModelRecord>();
+    record->meta = meta_info;
+
     auto q = q_engine->get(meta_info.producer, meta_info.originTime);
+    if (q->isArea())
+    {
+      record->area.reset(q->area().Clone());
+      record->boundary = get_model_boundary(*record->area, DATA_CRS_NAME, 20);
+    }
 
-    if (!q->isArea())
-      return boost::shared_ptr<OGRPolygon>();
+    return record;
+  }
+  catch (...)
+  {
+    Fmi::Exception exception(BCP, "Operation failed!");
+    exception.addParameter("Producer", meta_info.producer);
+    exception.addParameter("Origin time", pt::to_simple_string(meta_info.originTime));
+    throw exception;
+  }
+}
 
-    const NFmiArea& area = q->area();
+boost::shared_ptr<OGRPolygon> StoredQEDownloadQueryHandler::get_model_boundary(
+    const NFmiArea& area, const std::string& crs_name, int num_side_points) const
+{
+  try
+  {
     boost::shared_ptr<OGRPolygon> model_area(new OGRPolygon);
     SmartMet::Plugin::WFS::get_latlon_boundary(&area, model_area.get(), num_side_points);
 
@@ -664,22 +751,13 @@ boost::shared_ptr<OGRPolygon> StoredQEDownloadQueryHandler::get_model_boundary(
 }
 
 boost::shared_ptr<OGRGeometry> StoredQEDownloadQueryHandler::bbox_intersection(
-    const SmartMet::Spine::BoundingBox& bbox,
-    const SmartMet::Engine::Querydata::MetaData& meta_info) const
+    const SmartMet::Spine::BoundingBox& bbox, const NFmiArea& area) const
 {
   try
   {
-    // TODO TODO: STRANGE CODE WAS HERE
     const int BBOX_NPOINTS = 10;
     boost::shared_ptr<OGRGeometry> result;
 
-    auto q = q_engine->get(meta_info.producer, meta_info.originTime);
-
-    if (!q->isArea())
-      return result;
-
-    const NFmiArea& area = q->area();
-
     OGRPolygon query_bbox;
     auto transform_to_epsg4326 = crs_registry.create_transformation(bbox.crs, DATA_CRS_NAME);
     bbox2polygon(bbox, &query_bbox, BBOX_NPOINTS);
@@ -690,8 +768,6 @@ boost::shared_ptr<OGRGeometry> StoredQEDownloadQueryHandler::bbox_intersection(
     auto model_area = SmartMet::Engine::Gis::bbox2polygon(rect);
 
 #if 0    
-    std::cout << METHOD_NAME << ": " << meta_info.producer << "["
-              << pt::to_simple_string(meta_info.originTime) << "]" << std::endl;
     std::cout << METHOD_NAME << ": model_area='" << Engine::Gis::WKT(*model_area) << "'"
               << std::endl;
 #endif
@@ -739,7 +815,7 @@ boost::shared_ptr<OGRGeometry> StoredQEDownloadQueryHandler::bbox_intersection(
 
 void StoredQEDownloadQueryHandler::add_bbox_info(RequestParameterMap* param_map,
                                                  const std::string& name,
-                                                 OGRGeometry& geom) const
+                                                 const OGRGeometry& geom) const
 {
   try
   {
@@ -759,15 +835,15 @@ void StoredQEDownloadQueryHandler::add_bbox_info(RequestParameterMap* param_map,
 
 void StoredQEDownloadQueryHandler::add_boundary(RequestParameterMap* param_map,
                                                 const std::string& name,
-                                                OGRGeometry& geom) const
+                                                const OGRGeometry& geom) const
 {
   try
   {
     const auto geom_type = geom.getGeometryType();
     if (geom_type == wkbPolygon)
     {
-      OGRPolygon& polygon = dynamic_cast<OGRPolygon&>(geom);
-      OGRLinearRing* exterior = polygon.getExteriorRing();
+      const OGRPolygon& polygon = dynamic_cast<const OGRPolygon&>(geom);
+      const OGRLinearRing* exterior = polygon.getExteriorRing();
       const int numPoints = exterior->getNumPoints();
       for (int i = 0; i < numPoints; i++)
       {
@@ -960,6 +1036,14 @@ and must be specified on top level of stored query configuration file when prese
 days)</td>
 </tr>
 
+<tr>
+  <td>metadataUpdateInterval</td>
+  <td>integer</td>
+  <td>optional (default 10)</td>
+  <td>Specifies in seconds how often Querydata engine metadata is checked for new or
+      changed model runs. Requests are served from the latest metadata snapshot.</td>
+</tr>
+
 <tr>
   <td>producers</td>
   <td>array of string</td>
@@ -11,6 +11,7 @@
 #include <spine/Convenience.h>
 #include <macgyver/Exception.h>
 
+#include <future>
 #include <tuple>
 
 namespace pt = boost::posix_time;
@@ -98,11 +99,16 @@ void StoredSoundingQueryHandler::query(const StoredQuery& query,
     SmartMet::Engine::Observation::Settings stationSearchSettings;
     getStationSearchSettings(stationSearchSettings, params, language);
 
+    // Station search does not depend on the parameters: search the stations in the
+    // background while the parameters are being validated.
     // The result does not contain duplicates.
-    SmartMet::Spine::Stations stations;
-    obs_engine->getStations(stations, stationSearchSettings);
-    if (stations.empty())
-      queryInitializationOK = false;
+    auto stationSearch = std::async(std::launch::async,
+                                    [this, &stationSearchSettings]()
+                                    {
+                                      SmartMet::Spine::Stations result;
+                                      obs_engine->getStations(result, stationSearchSettings);
+                                      return result;
+                                    });
 
     // Gluing requested parameter name and parameter identities together.
     // Parameter names are needed in the result document.
@@ -111,6 +117,10 @@ void StoredSoundingQueryHandler::query(const StoredQuery& query,
     std::string pressureParameterName = "";
     validateAndPopulateMeteoParametersToMap(params, meteoParameterMap, pressureParameterName);
 
+    const SmartMet::Spine::Stations stations = stationSearch.get();
+    if (stations.empty())
+      queryInitializationOK = false;
+
     // Time range restriction to get data.
     pt::ptime startTime = params.get_single<pt::ptime>(P_BEGIN_TIME);
     pt::ptime endTime = params.get_single<pt::ptime>(P_END_TIME);
@@ -130,6 +130,24 @@ void bw::StoredWWCoverageQueryHandler::setResultHashValue(
   }
 }
 
+void bw::StoredWWCoverageQueryHandler::setResultJsonValue(Json::Value& properties,
+                                                          const ContourQueryResult& resultItem) const
+{
+  try
+  {
+    const CoverageQueryResult& coverageResultItem =
+        reinterpret_cast<const CoverageQueryResult&>(resultItem);
+
+    properties["winter_weather_type"] = coverageResultItem.name;
+    properties["lovalue"] = coverageResultItem.lolimit;
+    properties["hivalue"] = coverageResultItem.hilimit;
+  }
+  catch (...)
+  {
+    throw Fmi::Exception::Trace(BCP, "Operation failed!");
+  }
+}
+
 namespace
 {
 using namespace SmartMet::Plugin::WFS;
@@ -22,6 +22,7 @@ class StoredWWCoverageQueryHandler : public StoredCoverageQueryHandler
  protected:
   std::vector<ContourQueryResultPtr> processQuery(ContourQueryParameter& queryParameter) const;
   void setResultHashValue(CTPP::CDT& resultHash, const ContourQueryResult& resultItem) const;
+  void setResultJsonValue(Json::Value& properties, const ContourQueryResult& resultItem) const;
 
  private:
   std::vector<std::string> itsLimitNames;
@@ -1,15 +1,18 @@
 #include "stored_queries/StoredWWProbabilityQueryHandler.h"
 #include <gis/Box.h>
 #include <gis/OGR.h>
+#include <macgyver/Hash.h>
 #include <macgyver/TimeFormatter.h>
 #include <newbase/NFmiEnumConverter.h>
 #include <smartmet/macgyver/Exception.h>
 
 #include <boost/algorithm/string/replace.hpp>
-#include <boost/range/adaptor/map.hpp>
-#include <boost/range/algorithm/copy.hpp>
+#include <algorithm>
 #include <iomanip>
 #include <locale>
+#include <map>
+#include <set>
+#include <vector>
 
 namespace
 {
@@ -82,73 +85,103 @@ FmiParameterName get_parameter(boost::shared_ptr<SmartMet::Plugin::WFS::StoredQu
   }
 }
 
-SmartMet::Engine::Querydata::ParameterOptions get_qengine_parameter(
-    const SmartMet::Plugin::WFS::ProbabilityQueryParam& queryParam,
-    const SmartMet::Spine::Parameter& smartmetParam)
+using SmartMet::Plugin::WFS::ProbabilityGridPoint;
+using SmartMet::Plugin::WFS::ProbabilityTimeWeight;
+
+// Position of a point in a grid of nx * ny cells for bilinear interpolation
+ProbabilityGridPoint make_grid_point(const NFmiPoint& xy, std::size_t nx, std::size_t ny)
 {
-  try
+  ProbabilityGridPoint point{0, 0, 0, 0, false};
+  const double x = xy.X();
+  const double y = xy.Y();
+  if (nx < 2 or ny < 2 or not(x >= 0 and y >= 0 and x <= nx - 1 and y <= ny - 1))
+    return point;
+
+  point.i = std::min(static_cast<std::size_t>(x), nx - 2);
+  point.j = std::min(static_cast<std::size_t>(y), ny - 2);
+  point.dx = static_cast<float>(x - point.i);
+  point.dy = static_cast<float>(y - point.j);
+  point.inside = true;
+  return point;
+}
+
+// Position of a time among the (sorted) data times for linear interpolation
+ProbabilityTimeWeight make_time_weight(const std::vector<boost::posix_time::ptime>& data_times,
+                                       const boost::posix_time::ptime& t)
+{
+  ProbabilityTimeWeight weight{0, 0, 0, false};
+  auto it = std::lower_bound(data_times.begin(), data_times.end(), t);
+  if (it == data_times.end())
+    return weight;
+
+  weight.i1 = it - data_times.begin();
+  if (*it == t)
   {
-    std::unique_ptr<Fmi::TimeFormatter> timeFormatter(Fmi::TimeFormatter::create("iso"));
-
-    NFmiPoint nearestpoint(kFloatMissing, kFloatMissing);
-    bool nearestFlag(false);
-    std::string emptystring("");
-
-    SmartMet::Engine::Querydata::ParameterOptions qengine_param(smartmetParam,
-                                                                queryParam.producer,
-                                                                *(queryParam.loc),
-                                                                queryParam.loc->country,
-                                                                queryParam.loc->name,
-                                                                *timeFormatter,
-                                                                emptystring,
-                                                                queryParam.language,
-                                                                queryParam.outputLocale,
-                                                                queryParam.tz_name,
-                                                                nearestFlag,
-                                                                nearestpoint,
-                                                                nearestpoint);
-
-    return qengine_param;
+    weight.i0 = weight.i1;
+    weight.inside = true;
   }
-  catch (...)
+  else if (it != data_times.begin())
   {
-    throw Fmi::Exception::Trace(BCP, "Operation failed!");
+    weight.i0 = weight.i1 - 1;
+    const double span = (data_times[weight.i1] - data_times[weight.i0]).total_seconds();
+    weight.w1 = static_cast<float>((t - data_times[weight.i0]).total_seconds() / span);
+    weight.inside = true;
   }
+  return weight;
 }
 
-void populate_result_vector(
-    SmartMet::Spine::TimeSeries::TimeSeriesPtr qengine_result_light,
-    SmartMet::Spine::TimeSeries::TimeSeriesPtr qengine_result_moderate,
-    SmartMet::Spine::TimeSeries::TimeSeriesPtr qengine_result_heavy,
-    SmartMet::Plugin::WFS::WinterWeatherIntensityProbabilities& result_vector)
+// Bilinear interpolation ignoring missing corner values
+template <typename Matrix>
+float interpolate(const Matrix& values, const ProbabilityGridPoint& point)
 {
-  try
+  const float corners[4] = {values[point.i][point.j],
+                            values[point.i + 1][point.j],
+                            values[point.i][point.j + 1],
+                            values[point.i + 1][point.j + 1]};
+  const float weights[4] = {(1 - point.dx) * (1 - point.dy),
+                            point.dx * (1 - point.dy),
+                            (1 - point.dx) * point.dy,
+                            point.dx * point.dy};
+  float sum = 0;
+  float wsum = 0;
+  for (int k = 0; k < 4; k++)
   {
-    unsigned int result_set_size(qengine_result_light->size());
-
-    for (unsigned int i = 0; i < result_set_size; i++)
-    {
-      const SmartMet::Spine::TimeSeries::TimedValue& tv_light = qengine_result_light->at(i);
-      const SmartMet::Spine::TimeSeries::TimedValue& tv_moderate = qengine_result_moderate->at(i);
-      const SmartMet::Spine::TimeSeries::TimedValue& tv_heavy = qengine_result_heavy->at(i);
-
-      if (!(boost::get<double>(&tv_light.value)))
-      {
-        // nan-value is string
-        break;
-      }
+    const float w = (corners[k] == kFloatMissing ? 0.0f : weights[k]);
+    sum += w * (corners[k] == kFloatMissing ? 0.0f : corners[k]);
+    wsum += w;
+  }
+  return (wsum > 0 ? sum / wsum : kFloatMissing);
+}
 
-      double light_prob = *(boost::get<double>(&tv_light.value));
-      double moderate_prob = *(boost::get<double>(&tv_moderate.value));
-      double heavy_prob = *(boost::get<double>(&tv_heavy.value));
-      result_vector.push_back(SmartMet::Plugin::WFS::WinterWeatherProbability(
-          tv_light.time.utc_time(), light_prob, moderate_prob, heavy_prob));
-    }
+// Linear interpolation in time, missing if either value is missing
+void interpolate_in_time(const std::vector<float>& v0,
+                         const std::vector<float>& v1,
+                         float w1,
+                         std::vector<float>& result)
+{
+  const std::size_t n = v0.size();
+  result.resize(n);
+  for (std::size_t k = 0; k < n; k++)
+  {
+    const bool missing = (v0[k] == kFloatMissing) | (v1[k] == kFloatMissing);
+    result[k] = missing ? kFloatMissing : v0[k] + w1 * (v1[k] - v0[k]);
   }
-  catch (...)
+}
+
+// Number of leading time steps with all intensities available
+std::size_t count_valid_timesteps(const float* light,
+                                  const float* moderate,
+                                  const float* heavy,
+                                  std::size_t n)
+{
+  std::size_t count = n;
+  for (std::size_t k = n; k-- > 0;)
   {
-    throw Fmi::Exception::Trace(BCP, "Operation failed!");
+    const bool missing =
+        (light[k] == kFloatMissing) | (moderate[k] == kFloatMissing) | (heavy[k] == kFloatMissing);
+    count = missing ? k : count;
   }
+  return count;
 }
 
 }  // anonymous namespace
@@ -281,61 +314,64 @@ void StoredWWProbabilityQueryHandler::parseQueryResults(
     hash["wfs_members"] = CTPP::CDT(CTPP::CDT::ARRAY_VAL);
 
     unsigned int wfs_member_index(0);
-    // iterate locations
 
+    const std::string analysis_time = format_local_time(origintime, tzp);
+    const std::string result_time = format_local_time(modificationtime, tzp);
+    auto transformation = crs_registry.create_transformation("EPSG::4326", requestedCRS);
+
+    // the same timestamps are repeated for every location and precipitation type
+    std::map<boost::posix_time::ptime, std::string> timestamps;
+
+    // iterate locations
     for (const AirportLocation& airp_loc : airp_llist)
     {
       SmartMet::Spine::LocationPtr loc = airp_loc.loc;
 
-      WinterWeatherTypeProbabilities ww_tprobs = query_results.at(loc);
+      const WinterWeatherTypeProbabilities& ww_tprobs = query_results.at(loc);
 
-      std::vector<std::string> wwtypes;
-      // Retrieve all wwtypes
-      boost::copy(ww_tprobs | boost::adaptors::map_keys, std::back_inserter(wwtypes));
+      NFmiPoint p1(loc->longitude, loc->latitude);
+      NFmiPoint p2 = transformation->transform(p1);
 
-      for (const std::string& wwtype : wwtypes)
+      const std::string longitude(double2string(p2.X(), precision));
+      const std::string latitude(double2string(p2.Y(), precision));
+      const std::string position =
+          (latLonOrder ? latitude + " " + longitude : longitude + " " + latitude);
+
+      for (const auto& ww_tprob : ww_tprobs)
       {
+        const std::string& wwtype = ww_tprob.first;
+
         // own wfs_member for each precipitation type
         CTPP::CDT& wfs_member = hash["wfs_members"][wfs_member_index];
         wfs_member_index++;
 
         wfs_member["precipitation_form_id"] = wwtype;
         wfs_member["phenomenon_time"] = runtime_timestamp;
-        wfs_member["analysis_time"] = format_local_time(origintime, tzp);
-        wfs_member["resultTime"] = format_local_time(modificationtime, tzp);
+        wfs_member["analysis_time"] = analysis_time;
+        wfs_member["resultTime"] = result_time;
         wfs_member["designator"] = loc->iso2;
         wfs_member["name"] = loc->name;
         wfs_member["location_indicator_icao"] = airp_loc.icao_code;
         wfs_member["field_elevation"] = double2string(loc->elevation, 1);
 
-        auto transformation = crs_registry.create_transformation("EPSG::4326", requestedCRS);
-
-        NFmiPoint p1(loc->longitude, loc->latitude);
-        NFmiPoint p2 = transformation->transform(p1);
-
-        double longitude(p2.X());
-        double latitude(p2.Y());
-
-        std::stringstream ss_pos;
-        if (latLonOrder)
-          ss_pos << double2string(latitude, precision) << " "
-                 << double2string(longitude, precision);
-        else
-          ss_pos << double2string(longitude, precision) << " "
-                 << double2string(latitude, precision);
-
-        wfs_member["position"] = ss_pos.str();
+        wfs_member["position"] = position;
 
         CTPP::CDT& result = wfs_member["result"];
         result["timesteps"] = CTPP::CDT(CTPP::CDT::ARRAY_VAL);
 
-        WinterWeatherIntensityProbabilities ww_iprobs = ww_tprobs[wwtype];
+        const WinterWeatherIntensityProbabilities& ww_iprobs = ww_tprob.second;
 
         unsigned int timestep_index_index(0);
 
-        for (const WinterWeatherProbability ww_iprob : ww_iprobs)
+        for (const WinterWeatherProbability& ww_iprob : ww_iprobs)
         {
-          std::string timestamp(format_local_time(ww_iprob.timestamp, tzp));
+          auto ts = timestamps.find(ww_iprob.timestamp);
+          if (ts == timestamps.end())
+            ts = timestamps
+                     .insert(std::make_pair(ww_iprob.timestamp,
+                                            format_local_time(ww_iprob.timestamp, tzp)))
+                     .first;
+          const std::string& timestamp = ts->second;
 
           CTPP::CDT& timestep_data = result["timesteps"][timestep_index_index];
           timestep_index_index++;
@@ -343,8 +379,8 @@ void StoredWWProbabilityQueryHandler::parseQueryResults(
           timestep_data["precipitation_form_id"] = wwtype;
           timestep_data["date_time"] = timestamp;
           timestep_data["icao_code"] = airp_loc.icao_code;
-          timestep_data["latitude"] = double2string(latitude, precision);
-          timestep_data["longitude"] = double2string(longitude, precision);
+          timestep_data["latitude"] = latitude;
+          timestep_data["longitude"] = longitude;
           timestep_data["type_light"] = itsProbabilityConfigParams.intensityLight;
           timestep_data["type_moderate"] = itsProbabilityConfigParams.intensityModerate;
           timestep_data["type_heavy"] = itsProbabilityConfigParams.intensityHeavy;
@@ -365,46 +401,67 @@ void StoredWWProbabilityQueryHandler::parseQueryResults(
   }
 }
 
-WinterWeatherIntensityProbabilities StoredWWProbabilityQueryHandler::getProbabilities(
-    const ProbabilityQueryParam& queryParam) const
+std::vector<float> StoredWWProbabilityQueryHandler::extractProbabilities(
+    SmartMet::Engine::Querydata::Q& q,
+    FmiParameterName param,
+    const std::vector<boost::posix_time::ptime>& dataTimes,
+    const std::vector<ProbabilityGridPoint>& points,
+    const std::vector<ProbabilityTimeWeight>& times) const
 {
   try
   {
-    WinterWeatherIntensityProbabilities ret;
-
-    SmartMet::Engine::Querydata::ParameterOptions qengine_param_light =
-        get_qengine_parameter(queryParam, queryParam.paramLight);
-    SmartMet::Engine::Querydata::ParameterOptions qengine_param_moderate =
-        get_qengine_parameter(queryParam, queryParam.paramModerate);
-    SmartMet::Engine::Querydata::ParameterOptions qengine_param_heavy =
-        get_qengine_parameter(queryParam, queryParam.paramHeavy);
-
-    SmartMet::Spine::TimeSeries::TimeSeriesPtr qengine_result_light =
-        queryParam.q->values(qengine_param_light, queryParam.tlist);
-    SmartMet::Spine::TimeSeries::TimeSeriesPtr qengine_result_moderate =
-        queryParam.q->values(qengine_param_moderate, queryParam.tlist);
-    SmartMet::Spine::TimeSeries::TimeSeriesPtr qengine_result_heavy =
-        queryParam.q->values(qengine_param_heavy, queryParam.tlist);
-
-    unsigned int result_set_size(qengine_result_light->size());
-    // all intensities should have same timesteps
-    if (qengine_result_moderate->size() != result_set_size ||
-        qengine_result_heavy->size() != result_set_size)
+    if (not q->param(param))
     {
-      std::ostringstream msg;
-      msg << "Inconsistent timesteps in LIGHT, MODERATE, HEAVY Winter Weather Condition "
-             "parameters: '"
-          << queryParam.paramLight.name() << "', '" << queryParam.paramModerate.name() << "', '"
-          << queryParam.paramHeavy.name() << "'";
-      Fmi::Exception exception(BCP, msg.str());
+      Fmi::Exception exception(BCP, "Winter Weather Condition parameter not found in the data!");
+      exception.addParameter("Parameter", std::to_string(static_cast<int>(param)));
       exception.addParameter(WFS_EXCEPTION_CODE, WFS_OPERATION_PROCESSING_FAILED);
       throw exception;
     }
+    q->firstLevel();
+
+    // Values of all points at one data time (each data time is read only once)
+    std::map<std::size_t, std::vector<float> > point_values;
+    const auto get_point_values = [&](std::size_t k) -> const std::vector<float>& {
+      auto pos = point_values.find(k);
+      if (pos == point_values.end())
+      {
+        auto valueshash = q->hashValue();
+        Fmi::hash_combine(valueshash, Fmi::hash_value(static_cast<int>(param)));
+        Fmi::hash_combine(valueshash, Fmi::hash_value(q->levelValue()));
+        Fmi::hash_combine(valueshash, Fmi::hash_value(dataTimes[k]));
+        const auto matrix = q_engine->getValues(q, valueshash, dataTimes[k]);
+
+        std::vector<float> values(points.size(), kFloatMissing);
+        for (std::size_t i = 0; i < points.size(); i++)
+          if (points[i].inside)
+            values[i] = interpolate(*matrix, points[i]);
+        pos = point_values.emplace(k, std::move(values)).first;
+      }
+      return pos->second;
+    };
+
+    // Result is ordered by point and then by time
+    const std::size_t num_times = times.size();
+    std::vector<float> result(points.size() * num_times, kFloatMissing);
+    std::vector<float> tmp;
+    for (std::size_t t = 0; t < num_times; t++)
+    {
+      const ProbabilityTimeWeight& weight = times[t];
+      if (not weight.inside)
+        continue;
+
+      const std::vector<float>* values = &get_point_values(weight.i0);
+      if (weight.i1 != weight.i0)
+      {
+        interpolate_in_time(*values, get_point_values(weight.i1), weight.w1, tmp);
+        values = &tmp;
+      }
 
-    populate_result_vector(
-        qengine_result_light, qengine_result_moderate, qengine_result_heavy, ret);
+      for (std::size_t i = 0; i < points.size(); i++)
+        result[i * num_times + t] = (*values)[i];
+    }
 
-    return ret;
+    return result;
   }
   catch (...)
   {
@@ -501,7 +558,6 @@ void StoredWWProbabilityQueryHandler::query(const StoredQuery& query,
     }
 
     SmartMet::Engine::Querydata::Producer producer = sq_params.get_single<std::string>(P_PRODUCER);
-    std::string missingText = sq_params.get_single<std::string>(P_MISSING_TEXT);
     boost::optional<boost::posix_time::ptime> requested_origintime =
         sq_params.get_optional<boost::posix_time::ptime>(P_ORIGIN_TIME);
 
@@ -522,39 +578,76 @@ void StoredWWProbabilityQueryHandler::query(const StoredQuery& query,
     SmartMet::Spine::TimeSeriesGenerator::LocalTimeList tlist =
         SmartMet::Spine::TimeSeriesGenerator::generate(*pTimeOptions, tz);
 
+    if (not q->isGrid())
+    {
+      Fmi::Exception exception(BCP, "Winter Weather Condition data must be gridded!");
+      exception.addParameter("Producer", producer);
+      exception.addParameter(WFS_EXCEPTION_CODE, WFS_OPERATION_PROCESSING_FAILED);
+      throw exception;
+    }
+
+    // Grid positions of the airports and the requested times relative to the data
+    // times are resolved once. The probabilities of each parameter are then
+    // extracted for all airports and times at once into contiguous arrays.
+    const auto& grid = q->grid();
+    std::vector<ProbabilityGridPoint> points;
+    points.reserve(airp_llist.size());
+    for (const AirportLocation& airp_loc : airp_llist)
+    {
+      const NFmiPoint xy =
+          grid.LatLonToGrid(NFmiPoint(airp_loc.loc->longitude, airp_loc.loc->latitude));
+      points.push_back(make_grid_point(xy, grid.XNumber(), grid.YNumber()));
+    }
+
+    const auto valid_times = q->validTimes();
+    const std::vector<boost::posix_time::ptime> data_times(valid_times->begin(),
+                                                           valid_times->end());
+    std::vector<ProbabilityTimeWeight> times;
+    times.reserve(tlist.size());
+    for (const auto& t : tlist)
+      times.push_back(make_time_weight(data_times, t.utc_time()));
+    const std::size_t num_times = times.size();
+
     ProbabilityQueryResultSet query_results;
-    // iterate locations
-    for (AirportLocation airp_loc : airp_llist)
+    for (const AirportLocation& airp_loc : airp_llist)
+      query_results[airp_loc.loc];
+
+    // iterate winter weather condition parameters
+    std::set<std::string> precipitationTypes;
+    for (const ProbabilityConfigParam& configParam : itsProbabilityConfigParams.params)
     {
-      WinterWeatherTypeProbabilities wwprobs;
+      // the first definition of a precipitation type is used
+      if (not precipitationTypes.insert(configParam.precipitationType).second)
+        continue;
 
-      // iterate winter weather condition parameters
-      for (const ProbabilityConfigParam& configParam : itsProbabilityConfigParams.params)
+      const std::vector<float> light =
+          extractProbabilities(q, configParam.idLight, data_times, points, times);
+      const std::vector<float> moderate =
+          extractProbabilities(q, configParam.idModerate, data_times, points, times);
+      const std::vector<float> heavy =
+          extractProbabilities(q, configParam.idHeavy, data_times, points, times);
+
+      std::size_t i = 0;
+      for (const AirportLocation& airp_loc : airp_llist)
       {
-        // parameter read from configuration file
-        SmartMet::Spine::Parameter paramLight(
-            "", SmartMet::Spine::Parameter::Type::Data, configParam.idLight);
-        SmartMet::Spine::Parameter paramModerate(
-            "", SmartMet::Spine::Parameter::Type::Data, configParam.idModerate);
-        SmartMet::Spine::Parameter paramHeavy(
-            "", SmartMet::Spine::Parameter::Type::Data, configParam.idHeavy);
-
-        ProbabilityQueryParam query_param(paramLight, paramModerate, paramHeavy, q, sr);
-        query_param.tlist = tlist;
-        query_param.loc = airp_loc.loc;  // item.second;
-        query_param.producer = producer;
-        query_param.bbox = bbox;
-        query_param.missingText = missingText;
-        query_param.language = language;
-        query_param.outputLocale = outputLocale;
-        query_param.tz_name = tz_name;
-        query_param.precipitationType = configParam.precipitationType;
-
-        // fetch probabilities for one precipitation type for all intensities
-        wwprobs.insert(make_pair(configParam.precipitationType, getProbabilities(query_param)));
+        const std::size_t offset = i++ * num_times;
+
+        // time series ends at the first missing value
+        const std::size_t n = count_valid_timesteps(
+            light.data() + offset, moderate.data() + offset, heavy.data() + offset, num_times);
+
+        WinterWeatherIntensityProbabilities& probs =
+            query_results[airp_loc.loc][configParam.precipitationType];
+        probs.reserve(n);
+        auto tit = tlist.begin();
+        for (std::size_t t = 0; t < n; t++, ++tit)
+        {
+          probs.push_back(WinterWeatherProbability(tit->utc_time(),
+                                                   light[offset + t],
+                                                   moderate[offset + t],
+                                                   heavy[offset + t]));
+        }
       }
-      // probabilities for one location for all precipitation types
-      query_results.insert(make_pair(airp_loc.loc, wwprobs));
     }
 
     SmartMet::Spine::CRSRegistry& crsRegistry = plugin_impl.get_crs_registry();
@@ -52,32 +52,23 @@ struct ProbabilityConfigParams
   ProbabilityConfigParamVector params;
 };
 
-struct ProbabilityQueryParam
+// grid position of a location prepared for bilinear interpolation
+struct ProbabilityGridPoint
 {
-  const SmartMet::Spine::Parameter& paramLight;
-  const SmartMet::Spine::Parameter& paramModerate;
-  const SmartMet::Spine::Parameter& paramHeavy;
-  SmartMet::Engine::Querydata::Q& q;
-  OGRSpatialReference& sr;
-  SmartMet::Spine::BoundingBox bbox;
-  std::locale outputLocale;
-  bool nearestValid;
-  std::string tz_name;
-  SmartMet::Spine::TimeSeriesGenerator::LocalTimeList tlist;
-  SmartMet::Spine::LocationPtr loc;
-  SmartMet::Engine::Querydata::Producer producer;
-  std::string missingText;
-  std::string language;
-  std::string precipitationType;
+  std::size_t i;
+  std::size_t j;
+  float dx;
+  float dy;
+  bool inside;
+};
 
-  ProbabilityQueryParam(const SmartMet::Spine::Parameter& lp,
-                        const SmartMet::Spine::Parameter& mp,
-                        const SmartMet::Spine::Parameter& hp,
-                        SmartMet::Engine::Querydata::Q& qe,
-                        OGRSpatialReference& spref)
-      : paramLight(lp), paramModerate(mp), paramHeavy(hp), q(qe), sr(spref), tz_name("UTC")
-  {
-  }
+// requested time relative to the data times for linear interpolation in time
+struct ProbabilityTimeWeight
+{
+  std::size_t i0;
+  std::size_t i1;
+  float w1;
+  bool inside;
 };
 
 // contains timestamp and probability for all intesities
@@ -143,8 +134,11 @@ class StoredWWProbabilityQueryHandler : public StoredQueryHandlerBase,
                          const std::string& tz_name,
                          CTPP::CDT& hash) const;
 
-  WinterWeatherIntensityProbabilities getProbabilities(
-      const ProbabilityQueryParam& queryParam) const;
+  std::vector<float> extractProbabilities(SmartMet::Engine::Querydata::Q& q,
+                                          FmiParameterName param,
+                                          const std::vector<boost::posix_time::ptime>& dataTimes,
+                                          const std::vector<ProbabilityGridPoint>& points,
+                                          const std::vector<ProbabilityTimeWeight>& times) const;
 
   ProbabilityConfigParams itsProbabilityConfigParams;
 };